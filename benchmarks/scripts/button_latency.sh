@@ -0,0 +1,59 @@
+#!/bin/sh
+# Button to motor latency through the virtual GPIO. car_controller presses
+# the right button for 150 ms and releases it for 300 ms, over and over;
+# car_motors shares the edge log and reports the latency distribution when
+# it exits. Fails if any edge did not change the motors. Both programs must
+# be built with VIRTUAL_GPIO.
+#
+# Usage: button_latency.sh <car_controller> <car_motors> [udp|shm] [seconds]
+
+CONTROLLER=$1
+MOTORS=$2
+TRANSPORT=${3:-udp}
+RUN_SECONDS=${4:-10}
+CONTROLLER_IP=127.0.0.1
+MOTORS_IP=127.0.0.2
+
+if [ ! -x "$CONTROLLER" ] || [ ! -x "$MOTORS" ] || { [ "$TRANSPORT" != udp ] && [ "$TRANSPORT" != shm ]; }; then
+    echo "Usage: $0 <car_controller> <car_motors> [udp|shm] [seconds]"
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+export VIRTUAL_GPIO_NAME="/car_latency_$$"
+trap 'kill -9 $CONTROLLER_PID $MOTORS_PID 2>/dev/null; rm -rf "$WORK"; rm -f "/dev/shm$VIRTUAL_GPIO_NAME" "/dev/shm/car_latency_ring_$$"' EXIT
+
+if [ "$TRANSPORT" = shm ]; then
+    motors_args="-m /car_latency_ring_$$"
+    controller_args="-m /car_latency_ring_$$"
+else
+    motors_args="-i $MOTORS_IP"
+    controller_args="-c $CONTROLLER_IP -o $MOTORS_IP"
+fi
+
+# shellcheck disable=SC2086
+stdbuf -oL "$MOTORS" $motors_args > "$WORK/motors.log" 2>&1 &
+MOTORS_PID=$!
+sleep 0.2
+
+# The controller's script clears the edge log, so it starts second.
+# shellcheck disable=SC2086
+VIRTUAL_GPIO_SCRIPT="1=0+150,1=1+300" stdbuf -oL "$CONTROLLER" $controller_args > "$WORK/controller.log" 2>&1 &
+CONTROLLER_PID=$!
+# Ends 200 ms into a release, so the last edge has been answered.
+sleep "$(awk -v s="$RUN_SECONDS" 'BEGIN { printf "%.2f", int(s / 0.45) * 0.45 + 0.35 }')"
+kill -INT $CONTROLLER_PID
+wait $CONTROLLER_PID
+kill -INT $MOTORS_PID
+wait $MOTORS_PID
+
+echo "$TRANSPORT, $RUN_SECONDS s:"
+if ! grep -A10 "^Button to motor" "$WORK/motors.log"; then
+    echo "car_motors reported no latency"
+    exit 1
+fi
+if ! grep -q "^Button to motor latency: [1-9][0-9]* input edges, 0 without" "$WORK/motors.log"; then
+    echo "Some button edges did not reach the motors"
+    exit 1
+fi
+exit 0
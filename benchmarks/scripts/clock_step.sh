@@ -0,0 +1,91 @@
+#!/bin/sh
+# Restarts with the wall clock stepped back, as on a Raspberry Pi booting
+# without an RTC. car_controller is restarted an hour behind while car_motors
+# runs on, then car_motors is restarted an hour behind while car_controller
+# runs on. Each time the restarted side gets an older session epoch, and the
+# other side must still follow it and drive the motors. Both phases run
+# without and then with a pre-shared key, whose MAC counters must not depend
+# on the clocks either. Both programs must be built with VIRTUAL_GPIO.
+#
+# Usage: clock_step.sh <car_controller> <car_motors> <clock_shift library>
+
+# $KEY is empty or an option and its operand, so it is left unquoted.
+# shellcheck disable=SC2086
+
+CONTROLLER=$1
+MOTORS=$2
+SHIFT=$3
+CONTROLLER_IP=127.0.0.1
+MOTORS_IP=127.0.0.2
+SCRIPT="1=0+300,1=1+300"
+KEY_TEXT="000102030405060708090a0b0c0d0e0f"
+
+if [ ! -x "$CONTROLLER" ] || [ ! -x "$MOTORS" ] || [ ! -f "$SHIFT" ]; then
+    echo "Usage: $0 <car_controller> <car_motors> <clock_shift library>"
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+export VIRTUAL_GPIO_NAME="/car_clock_step_$$"
+trap 'kill -9 $CONTROLLER_PID $MOTORS_PID 2>/dev/null; rm -rf "$WORK"; rm -f "/dev/shm$VIRTUAL_GPIO_NAME"' EXIT
+
+printf '%s\n' "$KEY_TEXT" > "$WORK/key"
+failed=0
+
+for keyed in no yes; do
+    KEY=""
+    if [ $keyed = yes ]; then
+        KEY="-k $WORK/key"
+    fi
+    echo "Keyed: $keyed"
+
+    # car_controller restarted behind car_motors.
+    stdbuf -oL "$MOTORS" -i $MOTORS_IP $KEY > "$WORK/motors.log" 2>&1 &
+    MOTORS_PID=$!
+    sleep 0.2
+    VIRTUAL_GPIO_SCRIPT=$SCRIPT stdbuf -oL "$CONTROLLER" -c $CONTROLLER_IP -o $MOTORS_IP $KEY > "$WORK/controller.log" 2>&1 &
+    CONTROLLER_PID=$!
+    sleep 1.3
+    kill -INT $CONTROLLER_PID
+    wait $CONTROLLER_PID
+    before=$(grep -c "^Turning Clockwise" "$WORK/motors.log")
+    CLOCK_SHIFT_S=3600 LD_PRELOAD=$SHIFT VIRTUAL_GPIO_SCRIPT=$SCRIPT \
+        stdbuf -oL "$CONTROLLER" -c $CONTROLLER_IP -o $MOTORS_IP $KEY > "$WORK/controller.log" 2>&1 &
+    CONTROLLER_PID=$!
+    sleep 1.3
+    kill -INT $CONTROLLER_PID
+    wait $CONTROLLER_PID
+    kill -INT $MOTORS_PID
+    wait $MOTORS_PID
+    after=$(grep -c "^Turning Clockwise" "$WORK/motors.log")
+    echo "car_controller an hour behind: $((after - before)) presses followed"
+    grep "^Joined\|^Dropped packet from" "$WORK/motors.log"
+    if [ "$after" -le "$before" ] || [ "$(grep -c "^Joined" "$WORK/motors.log")" -ne 2 ]; then
+        echo "car_motors did not follow the restarted car_controller"
+        failed=$((failed + 1))
+    fi
+
+    # car_motors restarted behind car_controller.
+    VIRTUAL_GPIO_SCRIPT=$SCRIPT stdbuf -oL "$CONTROLLER" -c $CONTROLLER_IP -o $MOTORS_IP $KEY > "$WORK/controller.log" 2>&1 &
+    CONTROLLER_PID=$!
+    stdbuf -oL "$MOTORS" -i $MOTORS_IP $KEY > "$WORK/motors.log" 2>&1 &
+    MOTORS_PID=$!
+    sleep 1.3
+    kill -9 $MOTORS_PID
+    wait $MOTORS_PID 2>/dev/null
+    CLOCK_SHIFT_S=3600 LD_PRELOAD=$SHIFT stdbuf -oL "$MOTORS" -i $MOTORS_IP $KEY > "$WORK/motors.log" 2>&1 &
+    MOTORS_PID=$!
+    sleep 1.3
+    kill -INT $CONTROLLER_PID
+    wait $CONTROLLER_PID
+    kill -INT $MOTORS_PID
+    wait $MOTORS_PID
+    echo "car_motors an hour behind: $(grep -c "^Turning Clockwise" "$WORK/motors.log") presses followed"
+    grep "^car_motors restarted" "$WORK/controller.log"
+    if ! grep -q "^car_motors restarted" "$WORK/controller.log" || ! grep -q "^Turning Clockwise" "$WORK/motors.log"; then
+        echo "car_controller did not follow the restarted car_motors"
+        failed=$((failed + 1))
+    fi
+done
+
+exit $failed
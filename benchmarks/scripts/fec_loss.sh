@@ -0,0 +1,79 @@
+#!/bin/sh
+# car_controller and car_motors talking through lossy_proxy, once with
+# retransmission alone and once with FEC (-f). A button is pressed and
+# released every 300 ms, and an ACK is waited for 250 ms (-a) before a
+# command is sent again, so a lost one is retransmitted within the press.
+# Each run prints the button to motor latency, retransmissions and commands
+# rebuilt by FEC. A lost command costs up to the retransmit timeout without
+# FEC, and up to the next 200 ms keepalive with it, which carries the command
+# in its history: the p90 latency lands near one or the other. Fails if the
+# car did not end stopped, if nothing was retransmitted without FEC, or if
+# FEC rebuilt nothing. Both programs must be built with VIRTUAL_GPIO.
+#
+# Usage: fec_loss.sh <car_controller> <car_motors> <lossy_proxy> [drop percent] [FEC depth] [seconds]
+
+CONTROLLER=$1
+MOTORS=$2
+PROXY=$3
+DROP_PERCENT=${4:-20}
+FEC_DEPTH=${5:-4}
+RUN_SECONDS=${6:-10}
+CONTROLLER_IP=127.0.0.1
+MOTORS_IP=127.0.0.2
+PROXY_IP=127.0.0.3
+SEED=39
+RETRANSMIT_MS=250
+
+if [ ! -x "$CONTROLLER" ] || [ ! -x "$MOTORS" ] || [ ! -x "$PROXY" ]; then
+    echo "Usage: $0 <car_controller> <car_motors> <lossy_proxy> [drop percent] [FEC depth] [seconds]"
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+export VIRTUAL_GPIO_NAME="/car_fec_$$"
+trap 'kill -9 $CONTROLLER_PID $MOTORS_PID $PROXY_PID 2>/dev/null; rm -rf "$WORK"; rm -f "/dev/shm$VIRTUAL_GPIO_NAME"' EXIT
+
+failed=0
+for depth in 0 "$FEC_DEPTH"; do
+    fec=""
+    if [ "$depth" -gt 0 ]; then
+        fec="-f $depth"
+    fi
+
+    "$PROXY" -l $PROXY_IP -t $MOTORS_IP -d "$DROP_PERCENT" -s $SEED > "$WORK/proxy.log" 2>&1 &
+    PROXY_PID=$!
+    stdbuf -oL "$MOTORS" -i $MOTORS_IP > "$WORK/motors.log" 2>&1 &
+    MOTORS_PID=$!
+    sleep 0.2
+
+    # shellcheck disable=SC2086
+    VIRTUAL_GPIO_SCRIPT="1=0+300,1=1+300" stdbuf -oL "$CONTROLLER" -c $CONTROLLER_IP -o $PROXY_IP -a $RETRANSMIT_MS $fec > "$WORK/controller.log" 2>&1 &
+    CONTROLLER_PID=$!
+    # Ends 200 ms into a release, so the car must be stopped by then.
+    sleep "$(awk -v s="$RUN_SECONDS" 'BEGIN { printf "%.1f", int(s / 0.6) * 0.6 + 0.5 }')"
+    kill -INT $CONTROLLER_PID
+    wait $CONTROLLER_PID
+    kill -INT $MOTORS_PID
+    wait $MOTORS_PID
+    kill -INT $PROXY_PID
+    wait $PROXY_PID
+
+    echo "FEC depth $depth, $DROP_PERCENT% dropped each way over $RUN_SECONDS s:"
+    grep -h "^To car_\|^Commands sent\|^Stops acknowledged\|^Commands recovered" "$WORK/proxy.log" "$WORK/controller.log" "$WORK/motors.log"
+    grep -A1 "^Button to motor" "$WORK/motors.log"
+
+    if [ "$(grep "^Turning" "$WORK/motors.log" | tail -n 1)" != "Turning Off" ]; then
+        echo "Car did not end stopped"
+        failed=$((failed + 1))
+    fi
+    if [ "$depth" -eq 0 ] && ! grep -q "^Commands sent: [0-9]*, retransmissions: [1-9]" "$WORK/controller.log"; then
+        echo "No command was retransmitted"
+        failed=$((failed + 1))
+    fi
+    if [ "$depth" -gt 0 ] && ! grep -q "^Commands recovered by FEC: [1-9]" "$WORK/motors.log"; then
+        echo "No command was rebuilt by FEC"
+        failed=$((failed + 1))
+    fi
+done
+
+exit $failed
@@ -0,0 +1,79 @@
+#!/bin/sh
+# One car_controller driving a fleet of car_motors through a multicast group,
+# every car on its own loopback address (127.0.0.2 upwards). A button is
+# pressed and released every 300 ms. Each car must follow the presses and end
+# stopped, and car_controller must have an ACK from each one. With an absent
+# car listed, only that car may be sent retransmissions. Both programs must be
+# built with VIRTUAL_GPIO.
+#
+# Usage: fleet_loopback.sh <car_controller> <car_motors> [cars] [absent cars]
+
+CONTROLLER=$1
+MOTORS=$2
+CARS=${3:-4}
+ABSENT=${4:-0}
+CONTROLLER_IP=127.0.0.1
+GROUP=239.0.0.39
+RUN_SECONDS=3
+WAIT_TICKS=50
+
+if [ ! -x "$CONTROLLER" ] || [ ! -x "$MOTORS" ] || [ $((CARS + ABSENT)) -gt 64 ]; then
+    echo "Usage: $0 <car_controller> <car_motors> [cars] [absent cars], at most 64 in all"
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+MOTORS_PIDS=""
+trap 'kill -9 $CONTROLLER_PID $MOTORS_PIDS 2>/dev/null; rm -rf "$WORK"; rm -f /dev/shm/car_fleet_$$_*' EXIT
+
+receivers=""
+for car in $(seq 2 $((CARS + 1))); do
+    VIRTUAL_GPIO_NAME="/car_fleet_$$_$car" stdbuf -oL "$MOTORS" -i 127.0.0.$car -g $GROUP > "$WORK/car$car.log" 2>&1 &
+    MOTORS_PIDS="$MOTORS_PIDS $!"
+    receivers="$receivers -o 127.0.0.$car"
+done
+# Listed, but nothing runs there.
+for car in $(seq $((CARS + 2)) $((CARS + ABSENT + 1))); do
+    receivers="$receivers -o 127.0.0.$car"
+done
+
+# Every car must have joined before the first command goes out.
+for car in $(seq 2 $((CARS + 1))); do
+    ticks=0
+    while ! grep -q "Session epoch" "$WORK/car$car.log" && [ $ticks -lt $WAIT_TICKS ]; do
+        sleep 0.1
+        ticks=$((ticks + 1))
+    done
+done
+
+# shellcheck disable=SC2086
+VIRTUAL_GPIO_NAME="/car_fleet_$$_1" VIRTUAL_GPIO_SCRIPT="1=0+300,1=1+300" \
+    stdbuf -oL "$CONTROLLER" -c $CONTROLLER_IP -g $GROUP $receivers > "$WORK/controller.log" 2>&1 &
+CONTROLLER_PID=$!
+sleep $RUN_SECONDS
+kill -INT $CONTROLLER_PID
+wait $CONTROLLER_PID
+
+failed=0
+grep "fan-out" "$WORK/controller.log"
+for car in $(seq 2 $((CARS + ABSENT + 1))); do
+    report=$(grep "^Car 127.0.0.$car:" "$WORK/controller.log")
+    echo "$report"
+    if [ $car -gt $((CARS + 1)) ]; then
+        if [ -z "$report" ] || echo "$report" | grep -q " 0 retransmissions"; then
+            echo "Absent car 127.0.0.$car was not retransmitted to"
+            failed=$((failed + 1))
+        fi
+        continue
+    fi
+    if ! echo "$report" | grep -q "ACK mean"; then
+        echo "Car 127.0.0.$car never ACKed"
+        failed=$((failed + 1))
+    fi
+    if ! grep -q "Turning Clockwise" "$WORK/car$car.log" || [ "$(grep "^Turning" "$WORK/car$car.log" | tail -n 1)" != "Turning Off" ]; then
+        echo "Car 127.0.0.$car did not follow the button"
+        failed=$((failed + 1))
+    fi
+done
+
+exit $failed
@@ -0,0 +1,87 @@
+#!/bin/sh
+# Time from a car_motors start to its first actuation, with car_controller
+# already running and a button held. car_motors is killed with SIGKILL and
+# started again, cold (no state file) and then warm (-r), as a crash and a
+# supervisor restart would. A cold car_motors waits for the next keepalive,
+# a warm one announces itself to the car_controller in its state file, so
+# fails unless warm restarts are faster than cold ones on average. Both
+# programs must be built with VIRTUAL_GPIO.
+#
+# Usage: restart_actuation.sh <car_controller> <car_motors> [restarts]
+
+CONTROLLER=$1
+MOTORS=$2
+RESTARTS=${3:-10}
+CONTROLLER_IP=127.0.0.1
+MOTORS_IP=127.0.0.2
+WAIT_TICKS=100
+
+if [ ! -x "$CONTROLLER" ] || [ ! -x "$MOTORS" ]; then
+    echo "Usage: $0 <car_controller> <car_motors> [restarts]"
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+export VIRTUAL_GPIO_NAME="/car_restart_$$"
+trap 'kill -9 $CONTROLLER_PID $MOTORS_PID 2>/dev/null; rm -rf "$WORK"; rm -f "/dev/shm$VIRTUAL_GPIO_NAME"' EXIT
+
+# Right button held down for as long as the run lasts.
+VIRTUAL_GPIO_SCRIPT="1=0+60000" stdbuf -oL "$CONTROLLER" -c $CONTROLLER_IP -o $MOTORS_IP > "$WORK/controller.log" 2>&1 &
+CONTROLLER_PID=$!
+
+# Runs the given car_motors until its first actuation, or WAIT_TICKS.
+start_motors() {
+    # Emptied here, not by the background redirection, so the last run's line is never seen.
+    : > "$WORK/motors.log"
+    # shellcheck disable=SC2086
+    stdbuf -oL "$MOTORS" -i $MOTORS_IP $1 >> "$WORK/motors.log" 2>&1 &
+    MOTORS_PID=$!
+
+    ticks=0
+    while ! grep -q "First actuation" "$WORK/motors.log" && [ $ticks -lt $WAIT_TICKS ]; do
+        sleep 0.1
+        ticks=$((ticks + 1))
+    done
+    kill -9 $MOTORS_PID 2>/dev/null
+    wait $MOTORS_PID 2>/dev/null
+}
+
+failed=0
+for mode in cold warm; do
+    state=""
+    if [ $mode = warm ]; then
+        state="-r $WORK/motors.state"
+        # The state file is created cold, so one start fills it before the timed ones.
+        start_motors "$state"
+    fi
+    : > "$WORK/$mode.us"
+
+    for run in $(seq 1 "$RESTARTS"); do
+        start_motors "$state"
+        us=$(sed -n 's/^First actuation \([0-9]*\) us after start$/\1/p' "$WORK/motors.log" | head -n 1)
+        if [ -z "$us" ]; then
+            echo "$mode restart $run: no actuation within $((WAIT_TICKS / 10)) s"
+            tail -n 5 "$WORK/motors.log"
+            failed=$((failed + 1))
+        else
+            echo "$us" >> "$WORK/$mode.us"
+        fi
+    done
+
+    sort -n "$WORK/$mode.us" | awk -v mode=$mode '
+        { v[NR] = $1; sum += $1 }
+        END {
+            if (NR == 0) { exit }
+            printf "%s restarts: %d, first actuation min %.1f ms, median %.1f ms, mean %.1f ms, max %.1f ms\n",
+                   mode, NR, v[1] / 1000, v[int((NR + 1) / 2)] / 1000, sum / NR / 1000, v[NR] / 1000
+        }'
+done
+
+cold=$(awk '{ sum += $1 } END { if (NR) printf "%d", sum / NR }' "$WORK/cold.us")
+warm=$(awk '{ sum += $1 } END { if (NR) printf "%d", sum / NR }' "$WORK/warm.us")
+if [ -z "$cold" ] || [ -z "$warm" ] || [ "$warm" -ge "$cold" ]; then
+    echo "Warm restarts are not faster than cold ones"
+    failed=$((failed + 1))
+fi
+
+exit $failed
@@ -0,0 +1,95 @@
+#!/bin/sh
+# Packets per second car_motors processes from a flood of replayed commands,
+# through the UDP socket and then over AF_XDP (-x). car_motors listens on one
+# end of a veth pair; the other end is in a network namespace, where one
+# command from car_controller is captured and replayed by udp_flood. Fails if
+# either path processed nothing. Needs root and iproute2 and is skipped
+# without them (exit 77); if AF_XDP cannot attach, the socket figure is still
+# printed and the test is skipped. Both programs must be built with
+# VIRTUAL_GPIO.
+#
+# Usage: xdp_pps.sh <car_controller> <car_motors> <udp_flood> [seconds]
+
+CONTROLLER=$1
+MOTORS=$2
+FLOOD=$3
+RUN_SECONDS=${4:-5}
+NAMESPACE=car_xdp_$$
+HOST_IF=cxh$$
+PEER_IF=cxn$$
+MOTORS_IP=10.77.0.2
+CONTROLLER_IP=10.77.0.1
+CAPTURE_IP=10.77.0.3
+SKIPPED=77
+
+if [ ! -x "$CONTROLLER" ] || [ ! -x "$MOTORS" ] || [ ! -x "$FLOOD" ]; then
+    echo "Usage: $0 <car_controller> <car_motors> <udp_flood> [seconds]"
+    exit 1
+fi
+if [ "$(id -u)" != 0 ] || ! command -v ip > /dev/null; then
+    echo "Needs root and iproute2 for a veth pair, skipped"
+    exit $SKIPPED
+fi
+
+WORK=$(mktemp -d)
+export VIRTUAL_GPIO_NAME="/car_xdp_$$"
+trap 'kill -9 $CONTROLLER_PID $MOTORS_PID 2>/dev/null; ip link del $HOST_IF 2>/dev/null; ip netns del $NAMESPACE 2>/dev/null; rm -rf "$WORK"; rm -f "/dev/shm$VIRTUAL_GPIO_NAME"' EXIT
+
+if ! ip netns add $NAMESPACE || ! ip link add $HOST_IF type veth peer name $PEER_IF ||
+   ! ip link set $PEER_IF netns $NAMESPACE; then
+    echo "Could not set up a veth pair into a network namespace, skipped"
+    exit $SKIPPED
+fi
+ip addr add $MOTORS_IP/24 dev $HOST_IF
+ip link set $HOST_IF up
+ip netns exec $NAMESPACE ip addr add $CONTROLLER_IP/24 dev $PEER_IF
+ip netns exec $NAMESPACE ip addr add $CAPTURE_IP/24 dev $PEER_IF
+ip netns exec $NAMESPACE ip link set $PEER_IF up
+ip netns exec $NAMESPACE ip link set lo up
+
+# One real command, pointed at the capture address instead of car_motors.
+ip netns exec $NAMESPACE "$FLOOD" -l $CAPTURE_IP -w "$WORK/command.bin" &
+CAPTURE_PID=$!
+sleep 0.2
+VIRTUAL_GPIO_SCRIPT="1=0+1000" ip netns exec $NAMESPACE "$CONTROLLER" -c $CONTROLLER_IP -o $CAPTURE_IP > "$WORK/controller.log" 2>&1 &
+CONTROLLER_PID=$!
+if ! wait $CAPTURE_PID; then
+    echo "No command captured from car_controller"
+    exit 1
+fi
+kill -INT $CONTROLLER_PID
+wait $CONTROLLER_PID
+
+failed=0
+for path in socket xdp; do
+    xdp=""
+    if [ $path = xdp ]; then
+        xdp="-x $HOST_IF"
+    fi
+
+    # shellcheck disable=SC2086
+    "$MOTORS" -i $MOTORS_IP $xdp > "$WORK/motors.log" 2>&1 &
+    MOTORS_PID=$!
+    sleep 0.5
+    ip netns exec $NAMESPACE "$FLOOD" -r "$WORK/command.bin" -t $MOTORS_IP -s "$RUN_SECONDS"
+    sleep 0.2
+    kill -INT $MOTORS_PID
+    wait $MOTORS_PID
+
+    # Its output is buffered, so whether AF_XDP attached is only known now.
+    if [ $path = xdp ] && ! grep -q "^AF_XDP on" "$WORK/motors.log"; then
+        grep "AF_XDP" "$WORK/motors.log"
+        echo "AF_XDP did not attach, skipped"
+        exit $SKIPPED
+    fi
+
+    processed=$(grep -c "^Processing packet" "$WORK/motors.log")
+    echo "$path: $processed packets processed, $(awk -v n="$processed" -v s="$RUN_SECONDS" 'BEGIN { printf "%.0f", n / s }') per second"
+    grep "^AF_XDP" "$WORK/motors.log"
+    if [ "$processed" -eq 0 ]; then
+        echo "car_motors processed nothing over $path"
+        failed=$((failed + 1))
+    fi
+done
+
+exit $failed
@@ -0,0 +1,255 @@
+#include "packet_auth.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000LL
+#define DEFAULT_PACKETS 1000000
+#define SMALL_PACKET 64
+#define LARGE_PACKET 1152
+#define KEY_TEXT "000102030405060708090a0b0c0d0e0f"
+// Epochs of the sender sessions in the checks, the value does not matter.
+#define FIRST_EPOCH 1
+#define SECOND_EPOCH 2
+
+// Prototypes of functions.
+static int load_test_key(struct packet_auth *auth);
+static uint64_t time_packets(struct packet_auth *sender, struct packet_auth *receiver, size_t size, unsigned long packets);
+static int check_replay(void);
+static int64_t now_ns(void);
+
+int main(int argc, char *argv[])
+{
+    static const size_t sizes[] = {SMALL_PACKET, LARGE_PACKET};
+    unsigned long packets = DEFAULT_PACKETS;
+    int errors = 0;
+    int c;
+
+    while((c = getopt(argc, argv, ":n:")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    {
+        switch(c)
+        {
+            case 'n':
+            {
+                packets = strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case ':':
+            {
+                printf("Option requires an operand\n");
+            }
+            // Fall through
+            case '?':
+            {
+                printf("Unknown Argument Passed: Please use from the following...\n"
+                       " '-n' for the number of packets sealed and opened\n");
+                exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+    if(packets == 0)
+    {
+        printf("Packets must be at least 1\n");
+        return EXIT_FAILURE;
+    }
+
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        struct packet_auth sender;
+        struct packet_auth receiver;
+
+        if(load_test_key(&sender) == -1 || load_test_key(&receiver) == -1)
+        {
+            return EXIT_FAILURE;
+        }
+        if(time_packets(&sender, &receiver, sizes[i], packets) != packets)
+        {
+            printf("In-order packets were rejected\n");
+            errors++;
+        }
+    }
+
+    errors += check_replay();
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Start auth state the way the binaries do, from a key file.
+ * @param auth Auth state to enable.
+ * @return 0 on success, -1 on failure.
+ */
+static int load_test_key(struct packet_auth *auth)
+{
+    char path[] = "/tmp/bench_packet_auth_XXXXXX";
+    int fd = mkstemp(path);
+    int result;
+
+    if(fd == -1)
+    {
+        perror("mkstemp");
+        return -1;
+    }
+    if(write(fd, KEY_TEXT, strlen(KEY_TEXT)) != (ssize_t)strlen(KEY_TEXT))
+    {
+        perror("write");
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    close(fd);
+    result = packet_auth_load_key(auth, path);
+    unlink(path);
+    return result;
+}
+
+/**
+ * Seal and open packets in order and print the cost of each side.
+ * @param sender Auth state packets are sealed with.
+ * @param receiver Auth state packets are opened with.
+ * @param size Packet size without the trailer.
+ * @param packets Number of packets.
+ * @return Packets accepted.
+ */
+static uint64_t time_packets(struct packet_auth *sender, struct packet_auth *receiver, size_t size, unsigned long packets)
+{
+    uint8_t bytes[LARGE_PACKET + PACKET_AUTH_TRAILER_SIZE];
+    uint64_t accepted = 0;
+    int64_t seal_ns = 0;
+    int64_t open_ns = 0;
+
+    memset(bytes, 0x5a, sizeof(bytes)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    for(unsigned long i = 0; i < packets; i++)
+    {
+        size_t sealed;
+        size_t payload_size;
+        int64_t start = now_ns();
+        int64_t middle;
+
+        bytes[0] = (uint8_t)i;
+        sealed = packet_auth_seal(sender, bytes, size);
+        middle = now_ns();
+        accepted += packet_auth_open(receiver, bytes, sealed, FIRST_EPOCH, 1, &payload_size) == 0 && payload_size == size;
+        open_ns += now_ns() - middle;
+        seal_ns += middle - start;
+    }
+    printf("%4zu byte packets: seal %6.1f ns, open %6.1f ns, %" PRIu64 " of %lu accepted\n",
+           size, (double)seal_ns / (double)packets, (double)open_ns / (double)packets, accepted, packets);
+    return accepted;
+}
+
+/**
+ * A packet must be accepted once only, also by a receiver started after it
+ * was sent. A new sender session counts from 1 again and is only accepted
+ * once bound to the receiver, however far its counters are behind.
+ * @return Number of checks failed.
+ */
+static int check_replay(void)
+{
+    struct packet_auth sender;
+    struct packet_auth receiver;
+    struct packet_auth restarted;
+    uint8_t packet[SMALL_PACKET + PACKET_AUTH_TRAILER_SIZE];
+    uint8_t later[SMALL_PACKET + PACKET_AUTH_TRAILER_SIZE];
+    size_t payload_size;
+    size_t size;
+    int errors = 0;
+
+    if(load_test_key(&sender) == -1 || load_test_key(&receiver) == -1 || load_test_key(&restarted) == -1)
+    {
+        return 1;
+    }
+    memset(packet, 1, sizeof(packet)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    memset(later, 2, sizeof(later)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+
+    // Many packets in, so the next sender session is far behind.
+    for(int i = 0; i < 1000; i++)   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    {
+        size = packet_auth_seal(&sender, packet, SMALL_PACKET);
+        if(packet_auth_open(&receiver, packet, size, FIRST_EPOCH, 1, &payload_size) != 0)
+        {
+            printf("Fresh packet rejected\n");
+            errors++;
+            break;
+        }
+    }
+    if(packet_auth_open(&receiver, packet, size, FIRST_EPOCH, 1, &payload_size) == 0)
+    {
+        printf("Packet accepted twice\n");
+        errors++;
+    }
+    packet[0] ^= 1U;
+    if(packet_auth_open(&receiver, packet, size, FIRST_EPOCH, 1, &payload_size) == 0)
+    {
+        printf("Tampered packet accepted\n");
+        errors++;
+    }
+    packet[0] ^= 1U;
+
+    // A receiver restarted without a state file has a new epoch no packet
+    // sealed before names, so none of them is bound to it.
+    if(packet_auth_open(&restarted, packet, size, FIRST_EPOCH, 0, &payload_size) != PACKET_AUTH_UNBOUND)
+    {
+        printf("Packet from before the restart accepted\n");
+        errors++;
+    }
+
+    // In a group packets cannot be bound, the window kept in the state file refuses them.
+    packet_auth_set_window(&restarted, receiver.rx_epoch, receiver.rx_counter);
+    if(packet_auth_open(&restarted, packet, size, FIRST_EPOCH, 1, &payload_size) == 0)
+    {
+        printf("Packet accepted before the restart accepted again\n");
+        errors++;
+    }
+    size = packet_auth_seal(&sender, later, SMALL_PACKET);
+    if(packet_auth_open(&restarted, later, size, FIRST_EPOCH, 1, &payload_size) != 0)
+    {
+        printf("Packet after the restart rejected\n");
+        errors++;
+    }
+
+    // A restarted sender counts from 1 again, whatever its wall clock says.
+    if(load_test_key(&sender) == -1)
+    {
+        return errors + 1;
+    }
+    size = packet_auth_seal(&sender, later, SMALL_PACKET);
+    if(packet_auth_open(&receiver, later, size, SECOND_EPOCH, 0, &payload_size) != PACKET_AUTH_UNBOUND)
+    {
+        printf("Packet of an unbound session accepted\n");
+        errors++;
+    }
+    if(packet_auth_open(&receiver, later, size, SECOND_EPOCH, 1, &payload_size) != 0)
+    {
+        printf("Packet of a restarted sender rejected\n");
+        errors++;
+    }
+    if(packet_auth_open(&receiver, later, size, SECOND_EPOCH, 1, &payload_size) == 0)
+    {
+        printf("Packet of a restarted sender accepted twice\n");
+        errors++;
+    }
+
+    printf("Replay checks: %d failed, %" PRIu64 " replays, %" PRIu64 " bad tags and %" PRIu64 " unbound rejected\n",
+           errors, receiver.rejected_replay + restarted.rejected_replay, receiver.rejected_tag,
+           receiver.rejected_unbound + restarted.rejected_unbound);
+    return errors;
+}
+
+/**
+ * Wall time of the benchmark itself.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
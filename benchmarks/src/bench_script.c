@@ -0,0 +1,276 @@
+#include "script.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NSEC_PER_USEC 1000LL
+#define NSEC_PER_MSEC 1000000LL
+#define NSEC_PER_SEC 1000000000LL
+#define DEFAULT_SCRIPTS 100000
+#define DEFAULT_WAKE_LATENCY_US 200
+#define MAX_STEP_MS 2000
+#define PREEMPT_PERCENT 10
+#define MAX_FIRED (SCRIPT_MAX_STEPS + 1)
+
+/**
+ * The executor driven from a simulated clock instead of its thread. Every
+ * wakeup lands up to wake_latency_ns after the deadline it asked for, as a
+ * timed wait does on a loaded host, and one script in PREEMPT_PERCENT is
+ * preempted part way by the next, as a live command does.
+ */
+struct sim_clock {
+    int64_t now_ns;
+    uint64_t random_state;
+    int64_t wake_latency_ns;
+    int64_t fired_ns[MAX_FIRED];
+    size_t fired;
+};
+
+// Prototypes of functions.
+static int64_t sim_clock_now(void *ctx);
+static void sim_clock_actuate(enum script_command command, void *ctx);
+static uint64_t next_random(struct sim_clock *clock);
+static int64_t random_range(struct sim_clock *clock, int64_t low, int64_t high);
+static void random_script(struct sim_clock *clock, struct script *script);
+static int check_script(const struct script *script, int64_t start_ns, const struct sim_clock *clock);
+static int check_parse(void);
+
+int main(int argc, char *argv[])
+{
+    struct sim_clock clock;
+    struct script_executor executor;
+    unsigned long scripts = DEFAULT_SCRIPTS;
+    uint64_t seed = 1;
+    uint64_t checked = 0;
+    uint64_t errors = 0;
+    int c;
+
+    memset(&clock, 0, sizeof(clock)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    clock.wake_latency_ns = DEFAULT_WAKE_LATENCY_US * NSEC_PER_USEC;
+
+    while((c = getopt(argc, argv, ":s:n:w:")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    {
+        switch(c)
+        {
+            case 's':
+            {
+                seed = strtoull(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'n':
+            {
+                scripts = strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'w':
+            {
+                clock.wake_latency_ns = strtoll(optarg, NULL, 10) * NSEC_PER_USEC; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case ':':
+            {
+                printf("Option requires an operand\n");
+            }
+            // Fall through
+            case '?':
+            {
+                printf("Unknown Argument Passed: Please use from the following...\n"
+                       " '-s' for the seed\n"
+                       " '-n' for the number of scripts\n"
+                       " '-w' for the most a wakeup lands late, in us\n");
+                exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+
+    clock.random_state = seed;
+    script_executor_init(&executor, sim_clock_now, sim_clock_actuate, &clock);
+
+    for(unsigned long i = 0; i < scripts; i++)
+    {
+        struct script script;
+        int64_t start_ns;
+        int64_t deadline;
+        int preempt = random_range(&clock, 0, 99) < PREEMPT_PERCENT; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+        random_script(&clock, &script);
+        clock.fired = 0;
+        start_ns = clock.now_ns;
+        script_executor_start(&executor, &script);
+
+        deadline = script_executor_step(&executor, clock.now_ns);
+        while(deadline != -1)
+        {
+            int64_t wake_ns = deadline + random_range(&clock, 0, clock.wake_latency_ns);
+
+            // The next script arrives before this one is due to fire again.
+            if(preempt && random_range(&clock, 0, 3) == 0)
+            {
+                clock.now_ns = clock.now_ns + random_range(&clock, 0, wake_ns - clock.now_ns);
+                break;
+            }
+            clock.now_ns = wake_ns;
+            deadline = script_executor_step(&executor, clock.now_ns);
+        }
+
+        if(deadline == -1)
+        {
+            checked++;
+            errors += (uint64_t)check_script(&script, start_ns, &clock);
+        }
+    }
+
+    printf("%lu scripts over %.1f simulated hours, wakeups up to %" PRId64 " us late\n",
+           scripts, (double)clock.now_ns / (double)(3600 * NSEC_PER_SEC), (int64_t)(clock.wake_latency_ns / NSEC_PER_USEC)); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    script_executor_report(&executor);
+    printf("Completed scripts checked step by step: %" PRIu64 ", steps off schedule: %" PRIu64 "\n", checked, errors);
+    script_executor_destroy(&executor);
+    errors += (uint64_t)check_parse();
+
+    if(errors > 0 || executor.stats.lateness_max_ns > clock.wake_latency_ns)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Executor clock.
+ * @param ctx Simulated clock.
+ * @return Simulated time in nanoseconds.
+ */
+static int64_t sim_clock_now(void *ctx)
+{
+    const struct sim_clock *clock = ctx;
+
+    return clock->now_ns;
+}
+
+/**
+ * Record when each step of the current script fired.
+ * @param command Motor command, unused.
+ * @param ctx Simulated clock.
+ */
+static void sim_clock_actuate(enum script_command command, void *ctx)
+{
+    struct sim_clock *clock = ctx;
+
+    (void)command;
+    if(clock->fired < MAX_FIRED)
+    {
+        clock->fired_ns[clock->fired++] = clock->now_ns;
+    }
+}
+
+/**
+ * Next number of the seeded generator, splitmix64.
+ * @param clock Holds the generator state.
+ * @return 64 random bits.
+ */
+static uint64_t next_random(struct sim_clock *clock)
+{
+    uint64_t z;
+
+    clock->random_state += 0x9E3779B97F4A7C15ULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    z = clock->random_state;
+    z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    return z ^ (z >> 31U);                          // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+/**
+ * Uniform number in a closed range.
+ * @param clock Holds the generator state.
+ * @param low Lowest value.
+ * @param high Highest value, at least low.
+ * @return The number.
+ */
+static int64_t random_range(struct sim_clock *clock, int64_t low, int64_t high)
+{
+    return low + (int64_t)(next_random(clock) % (uint64_t)(high - low + 1));
+}
+
+/**
+ * A script of random steps and holds. Zero holds are kept in, as several steps
+ * then fall due in one wakeup.
+ * @param clock Holds the generator state.
+ * @param script Script to fill.
+ */
+static void random_script(struct sim_clock *clock, struct script *script)
+{
+    memset(script, 0, sizeof(struct script)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    script->count = (size_t)random_range(clock, 1, SCRIPT_MAX_STEPS);
+    for(size_t i = 0; i < script->count; i++)
+    {
+        script->steps[i].command = (enum script_command)random_range(clock, SCRIPT_STOP, SCRIPT_COUNTER_CLOCKWISE);
+        script->steps[i].duration_ms = (long)random_range(clock, 0, MAX_STEP_MS);
+    }
+}
+
+/**
+ * Every step of a completed script, and the closing stop, must fire no earlier
+ * than its offset from the start and no later than one wakeup latency after
+ * it. Deadlines accumulate from the start, so a late step must not push the
+ * ones after it.
+ * @param script Script that ran.
+ * @param start_ns When it was started.
+ * @param clock Fire times of its steps.
+ * @return Number of steps off schedule.
+ */
+static int check_script(const struct script *script, int64_t start_ns, const struct sim_clock *clock)
+{
+    size_t expected = script->count + (script->steps[script->count - 1].command != SCRIPT_STOP);
+    int64_t due_ns = start_ns;
+    int errors = 0;
+
+    if(clock->fired != expected)
+    {
+        return 1;
+    }
+    for(size_t i = 0; i < clock->fired; i++)
+    {
+        int64_t lateness = clock->fired_ns[i] - due_ns;
+
+        if(lateness < 0 || lateness > clock->wake_latency_ns)
+        {
+            errors++;
+        }
+        if(i < script->count)
+        {
+            due_ns += script->steps[i].duration_ms * NSEC_PER_MSEC;
+        }
+    }
+    return errors;
+}
+
+/**
+ * Holds outside 0 to SCRIPT_MAX_STEP_MS must fail the whole script.
+ * @return Number of scripts parsed wrongly.
+ */
+static int check_parse(void)
+{
+    static const char *const rejected[] = {"C99999999999999", "C99999999999999999999999", "C3600001", "S,A-5", "C800,X"};
+    struct script script;
+    int errors = 0;
+
+    for(size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++)
+    {
+        if(script_parse(rejected[i], &script) != -1)
+        {
+            printf("Script \"%s\" was accepted\n", rejected[i]);
+            errors++;
+        }
+    }
+    if(script_parse("C3600000,A0,S", &script) != 0 || script.steps[0].duration_ms != SCRIPT_MAX_STEP_MS)
+    {
+        printf("Script of the longest hold was rejected\n");
+        errors++;
+    }
+    return errors;
+}
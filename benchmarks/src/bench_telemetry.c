@@ -0,0 +1,218 @@
+#include "telemetry.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000LL
+#define DEFAULT_REPORTS 10000000
+#define DEFAULT_BUDGET_NS 1000
+
+/**
+ * Cost of the report every ACK carries: car_motors encodes one per ACK,
+ * car_controller decodes it and adds it to the series. Every report is
+ * different, and each decoded one is compared with what was encoded, so
+ * neither side can be optimised away.
+ */
+struct bench {
+    unsigned long reports;
+    int64_t budget_ns;
+    uint64_t mismatched;
+};
+
+// Prototypes of functions.
+static void make_report(struct telemetry *telemetry, unsigned long i);
+static int same_report(const struct telemetry *a, const struct telemetry *b);
+static int check_series(void);
+static int64_t now_ns(void);
+static void report(const char *what, uint64_t operations, int64_t elapsed_ns);
+
+int main(int argc, char *argv[])
+{
+    static struct telemetry_series series;
+    struct bench bench;
+    struct telemetry sent;
+    struct telemetry received;
+    uint8_t bytes[TELEMETRY_SIZE];
+    int64_t encode_ns = 0;
+    int64_t decode_ns = 0;
+    int64_t start;
+    int errors = 0;
+    int c;
+
+    memset(&bench, 0, sizeof(bench)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    bench.reports = DEFAULT_REPORTS;
+    bench.budget_ns = DEFAULT_BUDGET_NS;
+
+    while((c = getopt(argc, argv, ":n:b:")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    {
+        switch(c)
+        {
+            case 'n':
+            {
+                bench.reports = strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'b':
+            {
+                bench.budget_ns = strtoll(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case ':':
+            {
+                printf("Option requires an operand\n");
+            }
+            // Fall through
+            case '?':
+            {
+                printf("Unknown Argument Passed: Please use from the following...\n"
+                       " '-n' for the number of reports encoded and decoded\n"
+                       " '-b' for the most an encode and decode may cost together, in ns\n");
+                exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+    if(bench.reports == 0)
+    {
+        printf("Reports must be at least 1\n");
+        return EXIT_FAILURE;
+    }
+
+    // Encode and decode are timed in separate passes over the same reports.
+    start = now_ns();
+    for(unsigned long i = 0; i < bench.reports; i++)
+    {
+        make_report(&sent, i);
+        telemetry_encode(&sent, bytes);
+        bench.mismatched += bytes[0] != sent.motor_state;
+    }
+    encode_ns = now_ns() - start;
+
+    start = now_ns();
+    for(unsigned long i = 0; i < bench.reports; i++)
+    {
+        make_report(&sent, i);
+        telemetry_encode(&sent, bytes);
+        if(telemetry_decode(bytes, sizeof(bytes), &received) == -1 || !same_report(&sent, &received))
+        {
+            bench.mismatched++;
+        }
+        telemetry_series_add(&series, (int64_t)i, (int64_t)i, &received);
+    }
+    decode_ns = now_ns() - start - encode_ns;
+
+    report("encode", bench.reports, encode_ns);
+    report("decode and store", bench.reports, decode_ns);
+
+    if(bench.mismatched)
+    {
+        printf("%" PRIu64 " reports came back changed\n", bench.mismatched);
+        errors++;
+    }
+    if((encode_ns + decode_ns) / (int64_t)bench.reports > bench.budget_ns)
+    {
+        printf("Over the budget of %" PRId64 " ns per ACK\n", bench.budget_ns);
+        errors++;
+    }
+    if(telemetry_decode(bytes, TELEMETRY_SIZE - 1, &received) == 0)
+    {
+        printf("Short report decoded\n");
+        errors++;
+    }
+    errors += check_series();
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * A report whose every field changes from one ACK to the next.
+ * @param telemetry Report to fill.
+ * @param i ACK number.
+ */
+static void make_report(struct telemetry *telemetry, unsigned long i)
+{
+    telemetry->motor_state = (uint8_t)(i % 3);   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    telemetry->flags = (uint8_t)(i & (TELEMETRY_SCRIPT_ACTIVE | TELEMETRY_PULSE_PENDING | TELEMETRY_COMMAND_EXPIRED));
+    telemetry->script_steps = (uint16_t)i;
+    telemetry->command_id = (uint32_t)i;
+    telemetry->actuated_ns = (int64_t)i * NSEC_PER_SEC;
+    telemetry->packets = (uint32_t)(i * 2);
+    telemetry->rx_queue_bytes = (uint32_t)(i * 3);   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    telemetry->loop_mean_us = (uint32_t)(i >> 1U);
+    telemetry->loop_max_us = (uint32_t)~i;
+}
+
+/**
+ * Field by field comparison, the struct has padding.
+ * @param a First report.
+ * @param b Second report.
+ * @return 1 if equal.
+ */
+static int same_report(const struct telemetry *a, const struct telemetry *b)
+{
+    return a->motor_state == b->motor_state && a->flags == b->flags && a->script_steps == b->script_steps &&
+           a->command_id == b->command_id && a->actuated_ns == b->actuated_ns && a->packets == b->packets &&
+           a->rx_queue_bytes == b->rx_queue_bytes && a->loop_mean_us == b->loop_mean_us &&
+           a->loop_max_us == b->loop_max_us;
+}
+
+/**
+ * The series keeps the last TELEMETRY_SERIES reports and the latest is the
+ * one added last.
+ * @return Number of checks failed.
+ */
+static int check_series(void)
+{
+    static struct telemetry_series series;
+    struct telemetry telemetry;
+    const struct telemetry_sample *latest;
+    int errors = 0;
+
+    if(telemetry_series_latest(&series) != NULL)
+    {
+        printf("Empty series has a latest report\n");
+        errors++;
+    }
+    for(unsigned long i = 0; i < TELEMETRY_SERIES + 10; i++)   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    {
+        make_report(&telemetry, i);
+        telemetry_series_add(&series, (int64_t)i, (int64_t)i, &telemetry);
+    }
+    latest = telemetry_series_latest(&series);
+    if(series.count != TELEMETRY_SERIES || series.total != TELEMETRY_SERIES + 10 || latest == NULL ||
+       !same_report(&latest->telemetry, &telemetry))
+    {
+        printf("Series did not keep the last %d reports\n", TELEMETRY_SERIES);
+        errors++;
+    }
+    return errors;
+}
+
+/**
+ * Wall time of the benchmark itself.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Print the cost of one kind of operation.
+ * @param what Operation.
+ * @param operations How many were timed.
+ * @param elapsed_ns How long they took.
+ */
+static void report(const char *what, uint64_t operations, int64_t elapsed_ns)
+{
+    printf("%-17s %10" PRIu64 " ops, %8.1f ns/op\n", what, operations,
+           operations ? (double)elapsed_ns / (double)operations : (double)0);
+}
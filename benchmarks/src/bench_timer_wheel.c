@@ -0,0 +1,248 @@
+#include "timer_wheel.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000LL
+#define DEFAULT_TIMERS 200000
+#define DEFAULT_HORIZON_MS 600000
+#define REARM_PERCENT 25
+#define CANCEL_PERCENT 10
+
+/**
+ * Timers spread up to a horizon away, so every level of the wheel is in use.
+ * Each fires exactly on the tick it was set for or counts as a miss. On
+ * expiry a quarter re-arm themselves, as keepalives and pulses do, and some
+ * cancel another pending timer, as an ACK cancels its retransmission.
+ */
+struct bench {
+    struct timer_wheel wheel;
+    struct timer_entry *timers;
+    size_t count;
+    uint64_t horizon_ms;
+    uint64_t random_state;
+    uint64_t fired;
+    uint64_t late;
+    uint64_t early;
+    uint64_t rearmed;
+    uint64_t cancelled;
+};
+
+// Prototypes of functions.
+static void expired(struct timer_entry *timer, void *arg);
+static uint64_t next_random(struct bench *bench);
+static uint64_t random_below(struct bench *bench, uint64_t bound);
+static int64_t now_ns(void);
+static void report(const char *what, uint64_t operations, int64_t elapsed_ns);
+
+int main(int argc, char *argv[])
+{
+    static struct bench bench;
+    uint64_t deadline;
+    uint64_t queries = 0;
+    uint64_t armed;
+    int64_t start;
+    int c;
+
+    bench.count = DEFAULT_TIMERS;
+    bench.horizon_ms = DEFAULT_HORIZON_MS;
+    bench.random_state = 1;
+
+    while((c = getopt(argc, argv, ":n:h:s:")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    {
+        switch(c)
+        {
+            case 'n':
+            {
+                bench.count = strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'h':
+            {
+                bench.horizon_ms = strtoull(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 's':
+            {
+                bench.random_state = strtoull(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case ':':
+            {
+                printf("Option requires an operand\n");
+            }
+            // Fall through
+            case '?':
+            {
+                printf("Unknown Argument Passed: Please use from the following...\n"
+                       " '-n' for the number of timers\n"
+                       " '-h' for the furthest a timer is set, in ms\n"
+                       " '-s' for the seed\n");
+                exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+    if(bench.count == 0 || bench.horizon_ms == 0)
+    {
+        printf("Timers and horizon must be at least 1\n");
+        return EXIT_FAILURE;
+    }
+
+    bench.timers = calloc(bench.count, sizeof(struct timer_entry));
+    if(bench.timers == NULL)
+    {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    timer_wheel_init(&bench.wheel, 0);
+    for(size_t i = 0; i < bench.count; i++)
+    {
+        timer_init(&bench.timers[i], expired, &bench);
+    }
+
+    start = now_ns();
+    for(size_t i = 0; i < bench.count; i++)
+    {
+        timer_wheel_add(&bench.wheel, &bench.timers[i], 1 + random_below(&bench, bench.horizon_ms));
+    }
+    report("insert", bench.count, now_ns() - start);
+    printf("%zu timers active over %" PRIu64 " ms\n", bench.wheel.count, bench.horizon_ms);
+
+    // Cancel and re-insert every timer, as a retransmission is re-armed on each send.
+    start = now_ns();
+    for(size_t i = 0; i < bench.count; i++)
+    {
+        timer_wheel_cancel(&bench.wheel, &bench.timers[i]);
+    }
+    report("cancel", bench.count, now_ns() - start);
+    for(size_t i = 0; i < bench.count; i++)
+    {
+        timer_wheel_add(&bench.wheel, &bench.timers[i], 1 + random_below(&bench, bench.horizon_ms));
+    }
+
+    start = now_ns();
+    for(size_t i = 0; i < bench.count; i++)
+    {
+        timer_wheel_next_deadline(&bench.wheel, &deadline);
+    }
+    report("next deadline", bench.count, now_ns() - start);
+
+    // Jump from deadline to deadline, the way the binaries' poll loops do.
+    armed = bench.count;
+    start = now_ns();
+    while(timer_wheel_next_deadline(&bench.wheel, &deadline))
+    {
+        timer_wheel_advance(&bench.wheel, deadline);
+        queries++;
+    }
+    armed += bench.rearmed;
+    report("advance and fire", bench.fired, now_ns() - start);
+
+    printf("%" PRIu64 " deadline jumps, %" PRIu64 " re-armed, %" PRIu64 " cancelled on expiry\n",
+           queries, bench.rearmed, bench.cancelled);
+    printf("Fired %" PRIu64 " of %" PRIu64 ": %" PRIu64 " early, %" PRIu64 " late\n",
+           bench.fired, armed - bench.cancelled, bench.early, bench.late);
+    free(bench.timers);
+
+    if(bench.early || bench.late || bench.fired != armed - bench.cancelled || bench.wheel.count != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Check the timer fired on its own tick, then maybe re-arm it or cancel
+ * another one.
+ * @param timer Expired timer.
+ * @param arg The bench.
+ */
+static void expired(struct timer_entry *timer, void *arg)
+{
+    struct bench *bench = arg;
+    uint64_t roll = random_below(bench, 100); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+    bench->fired++;
+    if(bench->wheel.now < timer->expires)
+    {
+        bench->early++;
+    }
+    if(bench->wheel.now > timer->expires)
+    {
+        bench->late++;
+    }
+
+    if(roll < REARM_PERCENT && bench->wheel.now < bench->horizon_ms)
+    {
+        bench->rearmed++;
+        timer_wheel_add(&bench->wheel, timer, bench->wheel.now + 1 + random_below(bench, bench->horizon_ms - bench->wheel.now));
+    }
+    else if(roll < REARM_PERCENT + CANCEL_PERCENT)
+    {
+        struct timer_entry *other = &bench->timers[random_below(bench, bench->count)];
+
+        if(other->pending)
+        {
+            bench->cancelled++;
+            timer_wheel_cancel(&bench->wheel, other);
+        }
+    }
+}
+
+/**
+ * Next number of the seeded generator, splitmix64.
+ * @param bench Holds the generator state.
+ * @return 64 random bits.
+ */
+static uint64_t next_random(struct bench *bench)
+{
+    uint64_t z;
+
+    bench->random_state += 0x9E3779B97F4A7C15ULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    z = bench->random_state;
+    z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    return z ^ (z >> 31U);                          // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+/**
+ * Uniform number below a bound.
+ * @param bench Holds the generator state.
+ * @param bound Upper bound, exclusive, at least 1.
+ * @return The number.
+ */
+static uint64_t random_below(struct bench *bench, uint64_t bound)
+{
+    return next_random(bench) % bound;
+}
+
+/**
+ * Wall time of the benchmark itself.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Print the cost of one kind of operation.
+ * @param what Operation.
+ * @param operations How many were timed.
+ * @param elapsed_ns How long they took.
+ */
+static void report(const char *what, uint64_t operations, int64_t elapsed_ns)
+{
+    printf("%-17s %10" PRIu64 " ops, %8.1f ns/op\n", what, operations,
+           operations ? (double)elapsed_ns / (double)operations : (double)0);
+}
@@ -0,0 +1,386 @@
+#include "shm_ring.h"
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000LL
+#define DEFAULT_ROUND_TRIPS 100000
+#define DEFAULT_PACKET_SIZE 64
+#define WARMUP_ROUND_TRIPS 1000
+#define NAME_SIZE 64
+#define PERCENT 100
+
+/**
+ * Ping-pong between this process and a forked echo process, first over the
+ * shared memory rings car_controller and car_motors use with -m, then over UDP
+ * on the loopback interface. Each round trip sends one packet and waits for
+ * the same bytes to come back; half of it is the one-way latency.
+ */
+struct bench {
+    size_t packet_size;
+    unsigned long round_trips;
+    int64_t *samples;
+    uint64_t mismatched;
+};
+
+// Prototypes of functions.
+static int run_shm(struct bench *bench);
+static void echo_shm(struct shm_transport *transport);
+static int run_udp(struct bench *bench);
+static void echo_udp(int fd);
+static void fill_packet(uint8_t *bytes, size_t size, unsigned long round);
+static int compare_samples(const void *a, const void *b);
+static void report(const char *what, struct bench *bench);
+static int64_t now_ns(void);
+
+int main(int argc, char *argv[])
+{
+    struct bench bench;
+    int c;
+
+    memset(&bench, 0, sizeof(bench)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    bench.packet_size = DEFAULT_PACKET_SIZE;
+    bench.round_trips = DEFAULT_ROUND_TRIPS;
+
+    while((c = getopt(argc, argv, ":n:b:")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    {
+        switch(c)
+        {
+            case 'n':
+            {
+                bench.round_trips = strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'b':
+            {
+                bench.packet_size = strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case ':':
+            {
+                printf("Option requires an operand\n");
+            }
+            // Fall through
+            case '?':
+            {
+                printf("Unknown Argument Passed: Please use from the following...\n"
+                       " '-n' for the number of round trips\n"
+                       " '-b' for the packet size in bytes\n");
+                exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+    if(bench.round_trips == 0 || bench.packet_size == 0 || bench.packet_size > SHM_RING_SLOT_SIZE)
+    {
+        printf("Round trips must be at least 1 and packets 1 to %d bytes\n", SHM_RING_SLOT_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    bench.samples = calloc(bench.round_trips, sizeof(int64_t));
+    if(bench.samples == NULL)
+    {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    printf("%lu round trips of %zu byte packets, one-way latency\n", bench.round_trips, bench.packet_size);
+
+    if(run_shm(&bench) == -1 || run_udp(&bench) == -1)
+    {
+        free(bench.samples);
+        return EXIT_FAILURE;
+    }
+    free(bench.samples);
+
+    if(bench.mismatched)
+    {
+        printf("%" PRIu64 " packets came back changed\n", bench.mismatched);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Time round trips over a shared memory channel, this process on the
+ * controller side.
+ * @param bench Settings and sample buffer.
+ * @return 0 on success, -1 on failure.
+ */
+static int run_shm(struct bench *bench)
+{
+    struct shm_transport transport;
+    struct shm_transport peer;
+    uint8_t expected[SHM_RING_SLOT_SIZE];
+    char name[NAME_SIZE];
+    pid_t child;
+
+    // Both sides are mapped before the fork, opening drops what is already queued.
+    snprintf(name, sizeof(name), "/car_bench_%d", (int)getpid());
+    if(shm_transport_open(&transport, name, 1) == -1)
+    {
+        return -1;
+    }
+    if(shm_transport_open(&peer, name, 0) == -1)
+    {
+        shm_transport_close(&transport);
+        shm_unlink(name);
+        return -1;
+    }
+
+    child = fork();
+    if(child == -1)
+    {
+        perror("fork");
+        shm_transport_close(&peer);
+        shm_transport_close(&transport);
+        shm_unlink(name);
+        return -1;
+    }
+    if(child == 0)
+    {
+        echo_shm(&peer);
+    }
+    shm_transport_close(&peer);
+
+    for(unsigned long i = 0; i < WARMUP_ROUND_TRIPS + bench->round_trips; i++)
+    {
+        uint8_t *slot;
+        uint8_t *reply;
+        size_t size = 0;
+        int64_t start;
+
+        while((slot = shm_ring_reserve(transport.tx)) == NULL)
+        {
+        }
+        fill_packet(slot, bench->packet_size, i);
+        start = now_ns();
+        shm_ring_commit(transport.tx, bench->packet_size);
+        while(shm_ring_wait(transport.rx, -1) == 0)
+        {
+        }
+        reply = shm_ring_peek(transport.rx, &size);
+        if(i >= WARMUP_ROUND_TRIPS)
+        {
+            bench->samples[i - WARMUP_ROUND_TRIPS] = (now_ns() - start) / 2;
+        }
+
+        fill_packet(expected, bench->packet_size, i);
+        if(reply == NULL || size != bench->packet_size || memcmp(reply, expected, size) != 0)
+        {
+            bench->mismatched++;
+        }
+        shm_ring_release(transport.rx);
+    }
+
+    // An empty packet tells the echo to stop.
+    while(shm_ring_reserve(transport.tx) == NULL)
+    {
+    }
+    shm_ring_commit(transport.tx, 0);
+    waitpid(child, NULL, 0);
+    shm_transport_close(&transport);
+    shm_unlink(name);
+
+    report("shm ring", bench);
+    return 0;
+}
+
+/**
+ * Child side of the shared memory ping-pong, copies each packet back.
+ * @param transport Motors side of the channel, mapped before the fork.
+ */
+static void echo_shm(struct shm_transport *transport)
+{
+    for(;;)
+    {
+        uint8_t *packet;
+        uint8_t *slot;
+        size_t size = 0;
+
+        while(shm_ring_wait(transport->rx, -1) == 0)
+        {
+        }
+        packet = shm_ring_peek(transport->rx, &size);
+        if(packet == NULL || size == 0)
+        {
+            break;
+        }
+        while((slot = shm_ring_reserve(transport->tx)) == NULL)
+        {
+        }
+        memcpy(slot, packet, size); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        shm_ring_release(transport->rx);
+        shm_ring_commit(transport->tx, size);
+    }
+    shm_transport_close(transport);
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * Time round trips over UDP on 127.0.0.1, with blocking sockets as the
+ * binaries use.
+ * @param bench Settings and sample buffer.
+ * @return 0 on success, -1 on failure.
+ */
+static int run_udp(struct bench *bench)
+{
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    uint8_t packet[SHM_RING_SLOT_SIZE];
+    uint8_t reply[SHM_RING_SLOT_SIZE];
+    int fds[2];
+    pid_t child;
+
+    // Two sockets bound to ephemeral ports and connected to each other.
+    for(int i = 0; i < 2; i++)
+    {
+        memset(&address, 0, sizeof(address)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        if(fds[i] == -1 || bind(fds[i], (struct sockaddr *)&address, sizeof(address)) == -1)
+        {
+            perror("socket");
+            return -1;
+        }
+    }
+    for(int i = 0; i < 2; i++)
+    {
+        if(getsockname(fds[1 - i], (struct sockaddr *)&address, &length) == -1 ||
+           connect(fds[i], (struct sockaddr *)&address, sizeof(address)) == -1)
+        {
+            perror("connect");
+            return -1;
+        }
+    }
+
+    child = fork();
+    if(child == -1)
+    {
+        perror("fork");
+        return -1;
+    }
+    if(child == 0)
+    {
+        close(fds[0]);
+        echo_udp(fds[1]);
+    }
+    close(fds[1]);
+
+    for(unsigned long i = 0; i < WARMUP_ROUND_TRIPS + bench->round_trips; i++)
+    {
+        ssize_t size;
+        int64_t start;
+
+        fill_packet(packet, bench->packet_size, i);
+        start = now_ns();
+        if(send(fds[0], packet, bench->packet_size, 0) == -1)
+        {
+            perror("send");
+            break;
+        }
+        size = recv(fds[0], reply, sizeof(reply), 0);
+        if(i >= WARMUP_ROUND_TRIPS)
+        {
+            bench->samples[i - WARMUP_ROUND_TRIPS] = (now_ns() - start) / 2;
+        }
+        if(size != (ssize_t)bench->packet_size || memcmp(reply, packet, bench->packet_size) != 0)
+        {
+            bench->mismatched++;
+        }
+    }
+
+    send(fds[0], packet, 0, 0);
+    waitpid(child, NULL, 0);
+    close(fds[0]);
+
+    report("udp loopback", bench);
+    return 0;
+}
+
+/**
+ * Child side of the UDP ping-pong.
+ * @param fd Socket connected to the parent.
+ */
+static void echo_udp(int fd)
+{
+    uint8_t packet[SHM_RING_SLOT_SIZE];
+    ssize_t size;
+
+    while((size = recv(fd, packet, sizeof(packet), 0)) > 0)
+    {
+        send(fd, packet, (size_t)size, 0);
+    }
+    close(fd);
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * Bytes that differ from one round trip to the next, so a stale slot is caught.
+ * @param bytes Packet to fill.
+ * @param size Packet size.
+ * @param round Round trip number.
+ */
+static void fill_packet(uint8_t *bytes, size_t size, unsigned long round)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        bytes[i] = (uint8_t)(round + i);
+    }
+}
+
+/**
+ * qsort order of latency samples.
+ * @param a First sample.
+ * @param b Second sample.
+ * @return Negative, zero or positive.
+ */
+static int compare_samples(const void *a, const void *b)
+{
+    int64_t left = *(const int64_t *)a;
+    int64_t right = *(const int64_t *)b;
+
+    return (left > right) - (left < right);
+}
+
+/**
+ * Print latency percentiles of the last run.
+ * @param what Transport.
+ * @param bench Samples to sort and report.
+ */
+static void report(const char *what, struct bench *bench)
+{
+    unsigned long n = bench->round_trips;
+
+    qsort(bench->samples, n, sizeof(int64_t), compare_samples);
+    printf("%-13s p50 %7" PRId64 " ns, p90 %7" PRId64 " ns, p99 %7" PRId64 " ns, p99.9 %7" PRId64 " ns, max %9" PRId64 " ns\n",
+           what,
+           bench->samples[n * 50 / PERCENT],    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+           bench->samples[n * 90 / PERCENT],    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+           bench->samples[n * 99 / PERCENT],    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+           bench->samples[n * 999 / (PERCENT * 10)], // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+           bench->samples[n - 1]);
+}
+
+/**
+ * Wall time of the benchmark itself.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
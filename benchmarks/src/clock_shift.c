@@ -0,0 +1,28 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Preloaded into car_controller or car_motors to set their wall clock back
+ * by CLOCK_SHIFT_S seconds, as on a Raspberry Pi that boots without an RTC
+ * and before NTP has stepped the clock. CLOCK_MONOTONIC is left alone.
+ */
+int clock_gettime(clockid_t clock_id, struct timespec *ts)
+{
+    static int (*real_clock_gettime)(clockid_t, struct timespec *);
+    const char *shift;
+    int result;
+
+    if(real_clock_gettime == NULL)
+    {
+        *(void **)&real_clock_gettime = dlsym(RTLD_NEXT, "clock_gettime");
+    }
+    result = real_clock_gettime(clock_id, ts);
+    shift = getenv("CLOCK_SHIFT_S");   // NOLINT(concurrency-mt-unsafe)
+    if(result == 0 && clock_id == CLOCK_REALTIME && shift != NULL)
+    {
+        ts->tv_sec -= strtol(shift, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    }
+    return result;
+}
@@ -0,0 +1,261 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define COMMAND_PORT 5020
+#define STOP_PORT 5021
+#define PORTS 2
+#define BUF_SIZE 4096
+#define PERCENT 100
+
+/**
+ * Stands between car_controller and car_motors on both of their ports and
+ * drops a seeded share of the datagrams each way, as a lossy Wi-Fi link
+ * would. car_controller sends to the proxy's address; the proxy forwards to
+ * car_motors from the same port, so the ACKs come back through it too.
+ */
+struct lane {
+    int fd;
+    struct sockaddr_in target;   // car_motors on this port.
+    struct sockaddr_in client;   // car_controller, learnt from its first packet.
+    int has_client;
+};
+
+struct proxy {
+    struct lane lanes[PORTS];
+    unsigned int drop_percent;
+    uint64_t random_state;
+    uint64_t forwarded[2];
+    uint64_t dropped[2];
+};
+
+static volatile sig_atomic_t running = 1;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+// Prototypes of functions.
+static int open_lane(struct lane *lane, const char *listen_ip, const char *target_ip, in_port_t port);
+static void relay(struct proxy *proxy, struct lane *lane);
+static uint64_t next_random(struct proxy *proxy);
+static void signal_handler(int signum);
+
+int main(int argc, char *argv[])
+{
+    static const in_port_t ports[PORTS] = {COMMAND_PORT, STOP_PORT};
+    struct proxy proxy;
+    struct pollfd pfd[PORTS];
+    struct sigaction sa;
+    const char *listen_ip = NULL;
+    const char *target_ip = NULL;
+    int c;
+
+    memset(&proxy, 0, sizeof(proxy)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    proxy.random_state = 1;
+
+    while((c = getopt(argc, argv, ":l:t:d:s:")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    {
+        switch(c)
+        {
+            case 'l':
+            {
+                listen_ip = optarg;
+                break;
+            }
+            case 't':
+            {
+                target_ip = optarg;
+                break;
+            }
+            case 'd':
+            {
+                proxy.drop_percent = (unsigned int)strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 's':
+            {
+                proxy.random_state = strtoull(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case ':':
+            {
+                printf("Option requires an operand\n");
+            }
+            // Fall through
+            case '?':
+            {
+                printf("Unknown Argument Passed: Please use from the following...\n"
+                       " '-l' for the IP car_controller sends to\n"
+                       " '-t' for the IP of car_motors\n"
+                       " '-d' for the percentage of datagrams dropped each way\n"
+                       " '-s' for the seed\n");
+                exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+    if(listen_ip == NULL || target_ip == NULL || proxy.drop_percent > PERCENT)
+    {
+        printf("Both IPs are required and drops must be 0 to 100 percent\n");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < PORTS; i++)
+    {
+        if(open_lane(&proxy.lanes[i], listen_ip, target_ip, ports[i]) == -1)
+        {
+            return EXIT_FAILURE;
+        }
+        pfd[i].fd = proxy.lanes[i].fd;
+        pfd[i].events = POLLIN;
+    }
+
+    memset(&sa, 0, sizeof(sa)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    sa.sa_handler = signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("Relaying %s to %s, dropping %u%% each way\n", listen_ip, target_ip, proxy.drop_percent);
+    while(running)
+    {
+        if(poll(pfd, PORTS, -1) == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            return EXIT_FAILURE;
+        }
+        for(int i = 0; i < PORTS; i++)
+        {
+            if(pfd[i].revents & POLLIN)
+            {
+                relay(&proxy, &proxy.lanes[i]);
+            }
+        }
+    }
+
+    printf("To car_motors: %" PRIu64 " forwarded, %" PRIu64 " dropped\n", proxy.forwarded[0], proxy.dropped[0]);
+    printf("To car_controller: %" PRIu64 " forwarded, %" PRIu64 " dropped\n", proxy.forwarded[1], proxy.dropped[1]);
+    for(int i = 0; i < PORTS; i++)
+    {
+        close(proxy.lanes[i].fd);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Bind one of the ports on the address car_controller sends to.
+ * @param lane Lane to open.
+ * @param listen_ip Address car_controller sends to.
+ * @param target_ip Address of car_motors.
+ * @param port Port of the lane on both sides.
+ * @return 0 on success, -1 on failure.
+ */
+static int open_lane(struct lane *lane, const char *listen_ip, const char *target_ip, in_port_t port)
+{
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(listen_ip);
+    lane->target = addr;
+    lane->target.sin_addr.s_addr = inet_addr(target_ip);
+    lane->has_client = 0;
+
+    if(addr.sin_addr.s_addr == (in_addr_t)-1 || lane->target.sin_addr.s_addr == (in_addr_t)-1)
+    {
+        printf("Invalid IP address\n");
+        return -1;
+    }
+    lane->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(lane->fd == -1 || bind(lane->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        perror("bind");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Pass one datagram on, or drop it. Anything not from car_motors is taken to
+ * come from car_controller.
+ * @param proxy Proxy state and counters.
+ * @param lane Lane the datagram arrived on.
+ */
+static void relay(struct proxy *proxy, struct lane *lane)
+{
+    uint8_t bytes[BUF_SIZE];
+    struct sockaddr_in from;
+    struct sockaddr_in *to;
+    socklen_t from_len = sizeof(from);
+    ssize_t size;
+    int direction;
+
+    size = recvfrom(lane->fd, bytes, sizeof(bytes), 0, (struct sockaddr *)&from, &from_len);
+    if(size == -1)
+    {
+        return;
+    }
+
+    if(from.sin_addr.s_addr == lane->target.sin_addr.s_addr && from.sin_port == lane->target.sin_port)
+    {
+        direction = 1;
+        to = &lane->client;
+        if(!lane->has_client)
+        {
+            return;
+        }
+    }
+    else
+    {
+        direction = 0;
+        to = &lane->target;
+        lane->client = from;
+        lane->has_client = 1;
+    }
+
+    if(next_random(proxy) % PERCENT < proxy->drop_percent)
+    {
+        proxy->dropped[direction]++;
+        return;
+    }
+    proxy->forwarded[direction]++;
+    sendto(lane->fd, bytes, (size_t)size, 0, (struct sockaddr *)to, sizeof(*to));
+}
+
+/**
+ * Next number of the seeded generator, splitmix64.
+ * @param proxy Holds the generator state.
+ * @return 64 random bits.
+ */
+static uint64_t next_random(struct proxy *proxy)
+{
+    uint64_t z;
+
+    proxy->random_state += 0x9E3779B97F4A7C15ULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    z = proxy->random_state;
+    z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    return z ^ (z >> 31U);                          // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+/**
+ * Stop relaying and print the counts.
+ * @param signum Signal number.
+ */
+static void signal_handler(int signum)
+{
+    (void)signum;
+    running = 0;
+}
@@ -0,0 +1,267 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define COMMAND_PORT 5020
+#define BUF_SIZE 4096
+#define NSEC_PER_SEC 1000000000LL
+#define CAPTURE_TIMEOUT_MS 5000
+#define BURST 256
+
+/**
+ * Captures one command as car_controller sent it, then replays it at
+ * car_motors' command port as fast as the socket takes it, to load the
+ * receive path. With -w it binds the command port on the given address,
+ * where car_controller has been pointed with -o, and saves the first
+ * datagram. With -r it sends the saved datagram over and over for the
+ * given time and prints how many went out.
+ */
+struct flood {
+    const char *listen_ip;
+    const char *target_ip;
+    const char *path;
+    int capture;
+    int64_t duration_ns;
+};
+
+// Prototypes of functions.
+static int capture(const struct flood *flood);
+static int replay(const struct flood *flood);
+static int open_socket(const char *ip, struct sockaddr_in *addr);
+static int64_t now_ns(void);
+
+int main(int argc, char *argv[])
+{
+    struct flood flood;
+    int c;
+
+    memset(&flood, 0, sizeof(flood)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    flood.duration_ns = 5 * NSEC_PER_SEC;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+    while((c = getopt(argc, argv, ":l:w:r:t:s:")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    {
+        switch(c)
+        {
+            case 'l':
+            {
+                flood.listen_ip = optarg;
+                break;
+            }
+            case 'w':
+            {
+                flood.path = optarg;
+                flood.capture = 1;
+                break;
+            }
+            case 'r':
+            {
+                flood.path = optarg;
+                flood.capture = 0;
+                break;
+            }
+            case 't':
+            {
+                flood.target_ip = optarg;
+                break;
+            }
+            case 's':
+            {
+                flood.duration_ns = (int64_t)(strtod(optarg, NULL) * (double)NSEC_PER_SEC);
+                break;
+            }
+            case ':':
+            {
+                printf("Option requires an operand\n");
+            }
+            // Fall through
+            case '?':
+            {
+                printf("Unknown Argument Passed: Please use from the following...\n"
+                       " '-l' for the IP car_controller sends to, to capture a command from\n"
+                       " '-w' for the file the captured command is written to\n"
+                       " '-r' for the file of the command to replay\n"
+                       " '-t' for the IP of car_motors to replay it to\n"
+                       " '-s' for how long to replay for, in seconds\n");
+                exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+    if(flood.path == NULL || (flood.capture && flood.listen_ip == NULL) ||
+       (!flood.capture && (flood.target_ip == NULL || flood.duration_ns <= 0)))
+    {
+        printf("Either -l and -w to capture, or -r, -t and a positive -s to replay\n");
+        return EXIT_FAILURE;
+    }
+
+    return (flood.capture ? capture(&flood) : replay(&flood)) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Save the first datagram sent to the command port.
+ * @param flood Options.
+ * @return 0 on success, -1 on failure.
+ */
+static int capture(const struct flood *flood)
+{
+    uint8_t bytes[BUF_SIZE];
+    struct sockaddr_in addr;
+    struct pollfd pfd;
+    ssize_t size;
+    FILE *file;
+    int fd;
+
+    fd = open_socket(flood->listen_ip, &addr);
+    if(fd == -1)
+    {
+        return -1;
+    }
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, CAPTURE_TIMEOUT_MS) != 1)
+    {
+        printf("No command within %d ms\n", CAPTURE_TIMEOUT_MS);
+        close(fd);
+        return -1;
+    }
+    size = recv(fd, bytes, sizeof(bytes), 0);
+    close(fd);
+    if(size <= 0)
+    {
+        perror("recv");
+        return -1;
+    }
+
+    file = fopen(flood->path, "wb");
+    if(file == NULL || fwrite(bytes, 1, (size_t)size, file) != (size_t)size)
+    {
+        perror(flood->path);
+        if(file != NULL)
+        {
+            fclose(file);
+        }
+        return -1;
+    }
+    fclose(file);
+    printf("Captured a command of %zd bytes\n", size);
+    return 0;
+}
+
+/**
+ * Send the saved datagram in bursts until the time is up. A full socket
+ * buffer is not an error, the burst carries on.
+ * @param flood Options.
+ * @return 0 on success, -1 on failure.
+ */
+static int replay(const struct flood *flood)
+{
+    uint8_t bytes[BUF_SIZE];
+    struct sockaddr_in addr;
+    uint64_t sent = 0;
+    int64_t start;
+    int64_t elapsed;
+    size_t size;
+    FILE *file;
+    int fd;
+
+    file = fopen(flood->path, "rb");
+    if(file == NULL)
+    {
+        perror(flood->path);
+        return -1;
+    }
+    size = fread(bytes, 1, sizeof(bytes), file);
+    fclose(file);
+    if(size == 0)
+    {
+        printf("%s is empty\n", flood->path);
+        return -1;
+    }
+
+    fd = open_socket(flood->target_ip, &addr);
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    start = now_ns();
+    do
+    {
+        for(int i = 0; i < BURST; i++)
+        {
+            if(sendto(fd, bytes, size, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)size)
+            {
+                sent++;
+            }
+            else if(errno != ENOBUFS && errno != EAGAIN && errno != ECONNREFUSED)
+            {
+                perror("sendto");
+                close(fd);
+                return -1;
+            }
+        }
+        elapsed = now_ns() - start;
+    } while(elapsed < flood->duration_ns);
+    close(fd);
+
+    printf("Sent %" PRIu64 " datagrams of %zu bytes in %.2f s, %.0f per second\n", sent, size,
+           (double)elapsed / (double)NSEC_PER_SEC, (double)sent * (double)NSEC_PER_SEC / (double)elapsed);
+    return 0;
+}
+
+/**
+ * UDP socket and the command port address on an IP.
+ * @param ip Dotted IPv4 address.
+ * @param addr Filled in with the address and port.
+ * @return Socket FD, -1 on failure.
+ */
+static int open_socket(const char *ip, struct sockaddr_in *addr)
+{
+    int fd;
+
+    memset(addr, 0, sizeof(*addr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(COMMAND_PORT);
+    addr->sin_addr.s_addr = inet_addr(ip);
+    if(addr->sin_addr.s_addr == (in_addr_t)-1)
+    {
+        printf("Invalid IP address\n");
+        return -1;
+    }
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd == -1)
+    {
+        perror("socket");
+    }
+    return fd;
+}
+
+/**
+ * Wall time of the replay.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
@@ -0,0 +1,59 @@
+#ifndef CAR_CONTROLLER_FLEET_H
+#define CAR_CONTROLLER_FLEET_H
+
+#include "clock_sync.h"
+#include "packet_auth.h"
+#include "session.h"
+#include "telemetry.h"
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLEET_MAX_CARS 64
+
+// Lanes a packet can be multicast on, each tracked separately.
+enum fleet_lane {
+    FLEET_COMMAND,
+    FLEET_STOP,
+    FLEET_LANES
+};
+
+// One car_motors of the group, known by its unicast address.
+struct fleet_car {
+    struct sockaddr_in addr[FLEET_LANES]; // unicast addresses, for selective retransmission.
+    int acked[FLEET_LANES];               // ACKed the packet in flight on the lane.
+    struct packet_auth auth[FLEET_LANES]; // replay counters of this car's ACKs.
+    struct session_peer peer;             // session epochs of this car.
+    struct clock_sync clock;              // this car's clock, each has its own offset.
+    struct latency_stat ack_latency;      // command sent to this car's ACK.
+    uint64_t retransmissions;
+    struct telemetry telemetry;           // latest report from this car.
+    int has_telemetry;
+};
+
+// Packet in flight on a lane and how long the whole group took to ACK.
+struct fleet_round {
+    size_t waiting;
+    int64_t sent_ns;
+    struct latency_stat fanout; // sent to last ACK.
+};
+
+/**
+ * The cars a group address reaches. Each packet goes out once to the group;
+ * the ACKs come back unicast, so every car is tracked on its own and only the
+ * cars that did not ACK are sent the packet again.
+ */
+struct fleet {
+    struct fleet_car cars[FLEET_MAX_CARS];
+    size_t count;
+    struct fleet_round rounds[FLEET_LANES];
+};
+
+int fleet_add(struct fleet *fleet, const char *ip, in_port_t port, in_port_t stop_port, const struct packet_auth *auth);
+struct fleet_car *fleet_find(struct fleet *fleet, const struct sockaddr_in *from);
+void fleet_arm(struct fleet *fleet, enum fleet_lane lane, int64_t now_ns);
+void fleet_ack(struct fleet *fleet, enum fleet_lane lane, struct fleet_car *car, int64_t now_ns);
+int fleet_complete(const struct fleet *fleet, enum fleet_lane lane);
+void fleet_report(const struct fleet *fleet);
+
+#endif //CAR_CONTROLLER_FLEET_H
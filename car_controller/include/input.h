@@ -0,0 +1,50 @@
+#ifndef CAR_CONTROLLER_INPUT_H
+#define CAR_CONTROLLER_INPUT_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define RightButtonPin 1
+#define LeftButtonPin 0
+#define INPUT_PERIOD_US 1000
+// A new button state is published once it held for this many samples.
+#define INPUT_DEBOUNCE_SAMPLES 5
+
+// Command currently requested by the buttons.
+enum button_command {
+    COMMAND_STOP,
+    COMMAND_CLOCKWISE,
+    COMMAND_COUNTER_CLOCKWISE
+};
+
+// Debounced button state as last published.
+struct input_snapshot {
+    enum button_command command;
+    uint64_t changes;   // published changes so far.
+    int64_t changed_ns; // CLOCK_MONOTONIC time the state was first sampled.
+};
+
+/**
+ * Samples the buttons on its own thread at a fixed rate, so button changes
+ * are seen while the network thread is blocked on an ACK. The debounced state
+ * is published through a seqlock: the sampler is the only writer and readers
+ * never block it, they retry if a write overlapped their copy. Each change
+ * is also signalled on an eventfd the network thread can poll.
+ */
+struct input_sampler {
+    uint32_t sequence; // seqlock, odd while the snapshot is being written.
+    struct input_snapshot snapshot;
+    int event_fd;
+    int cpu;           // core the sampler is pinned to, -1 for any.
+    int running;
+    pthread_t thread;
+};
+
+int input_sampler_start(struct input_sampler *sampler, int cpu);
+void input_sampler_stop(struct input_sampler *sampler);
+void input_sampler_read(const struct input_sampler *sampler, struct input_snapshot *snapshot);
+int input_sampler_drain(const struct input_sampler *sampler);
+int64_t input_now_ns(void);
+int input_pin_cpu(int cpu);
+
+#endif //CAR_CONTROLLER_INPUT_H
@@ -0,0 +1,146 @@
+#include "fleet.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NSEC_PER_USEC 1000
+
+/**
+ * Add a car by the address its car_motors listens on.
+ * @param fleet Fleet to add to.
+ * @param ip Car IP in dot notation.
+ * @param port Command port.
+ * @param stop_port Express lane port.
+ * @param auth Key the car's ACKs are checked with.
+ * @return 0 on success, -1 if the fleet is full or the address is invalid.
+ */
+int fleet_add(struct fleet *fleet, const char *ip, in_port_t port, in_port_t stop_port, const struct packet_auth *auth)
+{
+    struct fleet_car *car;
+    in_addr_t address = inet_addr(ip);
+
+    if(fleet->count == FLEET_MAX_CARS || address == (in_addr_t)-1)
+    {
+        return -1;
+    }
+
+    car = &fleet->cars[fleet->count];
+    memset(car, 0, sizeof(struct fleet_car)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    car->addr[FLEET_COMMAND].sin_family = AF_INET;
+    car->addr[FLEET_COMMAND].sin_port = htons(port);
+    car->addr[FLEET_COMMAND].sin_addr.s_addr = address;
+    car->addr[FLEET_STOP] = car->addr[FLEET_COMMAND];
+    car->addr[FLEET_STOP].sin_port = htons(stop_port);
+    // Nothing is in flight yet.
+    car->acked[FLEET_COMMAND] = 1;
+    car->acked[FLEET_STOP] = 1;
+    car->auth[FLEET_COMMAND] = *auth;
+    car->auth[FLEET_STOP] = *auth;
+    clock_sync_init(&car->clock);
+    fleet->count++;
+    return 0;
+}
+
+/**
+ * Find the car a packet came from. Cars are told apart by IP, the ACKs of
+ * both lanes come from the same one.
+ * @param fleet Fleet to search.
+ * @param from Source address of the packet.
+ * @return The car, or NULL if it is not part of the fleet.
+ */
+struct fleet_car *fleet_find(struct fleet *fleet, const struct sockaddr_in *from)
+{
+    for(size_t i = 0; i < fleet->count; i++)
+    {
+        if(fleet->cars[i].addr[FLEET_COMMAND].sin_addr.s_addr == from->sin_addr.s_addr)
+        {
+            return &fleet->cars[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * A new packet was sent to the group on a lane, every car owes an ACK again.
+ * @param fleet Fleet sent to.
+ * @param lane Lane the packet went out on.
+ * @param now_ns Time it was sent, CLOCK_MONOTONIC.
+ */
+void fleet_arm(struct fleet *fleet, enum fleet_lane lane, int64_t now_ns)
+{
+    for(size_t i = 0; i < fleet->count; i++)
+    {
+        fleet->cars[i].acked[lane] = 0;
+    }
+    fleet->rounds[lane].waiting = fleet->count;
+    fleet->rounds[lane].sent_ns = now_ns;
+}
+
+/**
+ * Record a car's ACK of the packet in flight. Repeated ACKs are ignored.
+ * @param fleet Fleet the car belongs to.
+ * @param lane Lane the ACK answers.
+ * @param car Car that ACKed.
+ * @param now_ns Time the ACK was received, CLOCK_MONOTONIC.
+ */
+void fleet_ack(struct fleet *fleet, enum fleet_lane lane, struct fleet_car *car, int64_t now_ns)
+{
+    struct fleet_round *round = &fleet->rounds[lane];
+
+    if(car->acked[lane])
+    {
+        return;
+    }
+    car->acked[lane] = 1;
+    if(lane == FLEET_COMMAND)
+    {
+        latency_stat_add(&car->ack_latency, now_ns - round->sent_ns);
+    }
+
+    round->waiting--;
+    if(round->waiting == 0)
+    {
+        latency_stat_add(&round->fanout, now_ns - round->sent_ns);
+    }
+}
+
+/**
+ * Check whether every car ACKed the packet in flight on a lane.
+ * @param fleet Fleet to check.
+ * @param lane Lane to check.
+ * @return 1 if nothing is outstanding.
+ */
+int fleet_complete(const struct fleet *fleet, enum fleet_lane lane)
+{
+    return fleet->rounds[lane].waiting == 0;
+}
+
+/**
+ * Print how long the group took to ACK and the state of every car.
+ * @param fleet Fleet to print.
+ */
+void fleet_report(const struct fleet *fleet)
+{
+    printf("Fleet of %zu cars\n", fleet->count);
+    latency_stat_report(&fleet->rounds[FLEET_COMMAND].fanout, "Command fan-out, sent to last ACK");
+    latency_stat_report(&fleet->rounds[FLEET_STOP].fanout, "Stop fan-out, sent to last ACK");
+
+    for(size_t i = 0; i < fleet->count; i++)
+    {
+        const struct fleet_car *car = &fleet->cars[i];
+        const struct latency_stat *stat = &car->ack_latency;
+
+        printf("Car %s: ", inet_ntoa(car->addr[FLEET_COMMAND].sin_addr));
+        if(stat->count > 0)
+        {
+            printf("ACK mean %lld us, max %lld us, ", (long long)(stat->total_ns / (int64_t)stat->count / NSEC_PER_USEC),
+                   (long long)(stat->max_ns / NSEC_PER_USEC));
+        }
+        printf("%llu retransmissions", (unsigned long long)car->retransmissions);
+        if(car->has_telemetry)
+        {
+            printf(", motor %u, command %u", car->telemetry.motor_state, car->telemetry.command_id);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,239 @@
+// pthread_setaffinity_np and CPU_SET are GNU extensions.
+#define _GNU_SOURCE // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+#include "input.h"
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <wiringPi.h>
+
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_USEC 1000L
+
+static void *input_sampler_run(void *vargp);
+static enum button_command sample_buttons(enum button_command current);
+static void publish(struct input_sampler *sampler, enum button_command command, int64_t changed_ns);
+
+/**
+ * Start the sampling thread. The published state starts as COMMAND_STOP,
+ * matching the motors, which start off.
+ * @param sampler Sampler to start.
+ * @param cpu Core to pin the sampling thread to, -1 for any.
+ * @return 0 on success, -1 on failure.
+ */
+int input_sampler_start(struct input_sampler *sampler, int cpu)
+{
+    memset(sampler, 0, sizeof(struct input_sampler)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    sampler->snapshot.command = COMMAND_STOP;
+    sampler->cpu = cpu;
+
+    sampler->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(sampler->event_fd == -1)
+    {
+        perror("eventfd");
+        return -1;
+    }
+
+    sampler->running = 1;
+    errno = pthread_create(&sampler->thread, NULL, input_sampler_run, sampler);
+    if(errno)
+    {
+        perror("pthread_create input");
+        sampler->running = 0;
+        close(sampler->event_fd);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Stop the sampling thread and wait for it, if it was started.
+ * @param sampler Sampler to stop.
+ */
+void input_sampler_stop(struct input_sampler *sampler)
+{
+    if(!__atomic_load_n(&sampler->running, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    __atomic_store_n(&sampler->running, 0, __ATOMIC_RELAXED);
+    pthread_join(sampler->thread, NULL);
+    close(sampler->event_fd);
+}
+
+/**
+ * Copy the latest published state. Never blocks the sampler, the copy is
+ * retried if the sampler published while it was being taken.
+ * @param sampler Sampler to read.
+ * @param snapshot Filled in with the state.
+ */
+void input_sampler_read(const struct input_sampler *sampler, struct input_snapshot *snapshot)
+{
+    uint32_t begin;
+
+    do
+    {
+        begin = __atomic_load_n(&sampler->sequence, __ATOMIC_ACQUIRE);
+        snapshot->command = __atomic_load_n(&sampler->snapshot.command, __ATOMIC_RELAXED);
+        snapshot->changes = __atomic_load_n(&sampler->snapshot.changes, __ATOMIC_RELAXED);
+        snapshot->changed_ns = __atomic_load_n(&sampler->snapshot.changed_ns, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while((begin & 1) || begin != __atomic_load_n(&sampler->sequence, __ATOMIC_RELAXED));
+}
+
+/**
+ * Clear the change notification once the eventfd polled readable.
+ * @param sampler Sampler signalling the change.
+ * @return 1 if a change was pending.
+ */
+int input_sampler_drain(const struct input_sampler *sampler)
+{
+    uint64_t count;
+
+    return read(sampler->event_fd, &count, sizeof(count)) == (ssize_t)sizeof(count);
+}
+
+/**
+ * Clock the input state is stamped with.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+int64_t input_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Pin the calling thread to one core.
+ * @param cpu Core number.
+ * @return 0 on success, -1 on failure.
+ */
+int input_pin_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    return errno ? -1 : 0;
+}
+
+/**
+ * Sampling thread: read the buttons every INPUT_PERIOD_US on absolute
+ * deadlines, so a late wakeup never shifts the next sample, and publish a
+ * state once it held for INPUT_DEBOUNCE_SAMPLES samples in a row. Samples
+ * missed while descheduled are skipped, not caught up on back to back, which
+ * would shorten the debounce.
+ * @param vargp The sampler.
+ * @return NULL.
+ */
+static void *input_sampler_run(void *vargp)
+{
+    struct input_sampler *sampler = vargp;
+    enum button_command candidate = COMMAND_STOP;
+    int64_t candidate_ns = 0;
+    int stable = INPUT_DEBOUNCE_SAMPLES;
+    const uint64_t period_ns = (uint64_t)INPUT_PERIOD_US * NSEC_PER_USEC;
+    uint64_t next_ns;
+    uint64_t now_ns;
+    struct timespec next;
+    sigset_t signals;
+
+    // Signals go to the network thread, whose waits they are meant to interrupt.
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if(sampler->cpu >= 0 && input_pin_cpu(sampler->cpu) == -1)
+    {
+        perror("pin input thread");
+    }
+
+    next_ns = (uint64_t)input_now_ns();
+    while(__atomic_load_n(&sampler->running, __ATOMIC_RELAXED))
+    {
+        enum button_command sampled = sample_buttons(candidate);
+
+        if(sampled != candidate)
+        {
+            candidate = sampled;
+            candidate_ns = input_now_ns();
+            stable = 1;
+        }
+        else if(stable < INPUT_DEBOUNCE_SAMPLES)
+        {
+            stable++;
+            if(stable == INPUT_DEBOUNCE_SAMPLES && candidate != sampler->snapshot.command)
+            {
+                publish(sampler, candidate, candidate_ns);
+            }
+        }
+
+        // Unsigned nanoseconds, so stepping over missed samples cannot overflow.
+        now_ns = (uint64_t)input_now_ns();
+        next_ns += period_ns;
+        if(next_ns <= now_ns)
+        {
+            next_ns += ((now_ns - next_ns) / period_ns + 1) * period_ns;
+        }
+        next.tv_sec = (time_t)(next_ns / NSEC_PER_SEC);
+        next.tv_nsec = (long)(next_ns % NSEC_PER_SEC);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * Read the buttons once.
+ * @param current State sampled last, kept while both buttons are pressed.
+ * @return Command the buttons ask for.
+ */
+static enum button_command sample_buttons(enum button_command current)
+{
+    int right = digitalRead(RightButtonPin);
+    int left = digitalRead(LeftButtonPin);
+
+    // Turn motors off if neither buttons are pressed
+    if(right == 1 && left == 1)
+    {
+        return COMMAND_STOP;
+    }
+    if(right == 0 && left == 1)
+    {
+        return COMMAND_CLOCKWISE;
+    }
+    if(left == 0 && right == 1)
+    {
+        return COMMAND_COUNTER_CLOCKWISE;
+    }
+    return current;
+}
+
+/**
+ * Publish a new state under the seqlock and wake the network thread.
+ * @param sampler Sampler publishing.
+ * @param command New state.
+ * @param changed_ns Time the state was first sampled.
+ */
+static void publish(struct input_sampler *sampler, enum button_command command, int64_t changed_ns)
+{
+    uint32_t sequence = sampler->sequence;
+    uint64_t one = 1;
+
+    __atomic_store_n(&sampler->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&sampler->snapshot.command, command, __ATOMIC_RELAXED);
+    __atomic_store_n(&sampler->snapshot.changes, sampler->snapshot.changes + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&sampler->snapshot.changed_ns, changed_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&sampler->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    if(write(sampler->event_fd, &one, sizeof(one)) == -1)
+    {
+        perror("write eventfd");
+    }
+}
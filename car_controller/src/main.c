@@ -1,20 +1,58 @@
+// SO_PRIORITY is not part of POSIX.
+#define _DEFAULT_SOURCE // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+#include "clock_sync.h"
+#include "deadline.h"
 #include "error.h"
+#include "fec.h"
+#include "fleet.h"
+#include "input.h"
+#include "packet_auth.h"
+#include "session.h"
+#include "shm_ring.h"
+#include "telemetry.h"
+#include "timer_wheel.h"
+#include "trace.h"
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <bits/types/struct_timeval.h>
 #include <bits/types/sig_atomic_t.h>
 #include <wiringPi.h>
 
-#define RightButtonPin 1
-#define LeftButtonPin 0
 #define BUF_SIZE 1024
 #define DEFAULT_PORT 5020
+#define COMMAND_PERIOD_MS 10
+#define RETRANSMIT_TIMEOUT_MS 5000
+#define KEEPALIVE_MS 200
+// Stops travel their own socket, marked DSCP EF and with a raised priority.
+#define DEFAULT_STOP_PORT 5021
+#define STOP_SOCKET_PRIORITY 6
+#define STOP_IP_TOS 0xB8
+#define STOP_RETRANSMIT_MS 20
+#define STOP_MAX_RETRANSMITS 25
+// Longest -d accepted, one hour, which still fits the packet's 32-bit microsecond budget.
+#define MAX_DEADLINE_MS (60UL * 60UL * 1000UL)
+// Header bytes before the epochs: six flags, the command id and the stop generation.
+#define SESSION_EPOCH_OFFSET (6 * sizeof(int) + 2 * sizeof(uint32_t))
+// Header bytes before the clock stamps: the above and both epochs.
+#define CLOCK_STAMPS_OFFSET (SESSION_EPOCH_OFFSET + 2 * SESSION_EPOCH_SIZE)
+// Largest serialized packet: header, stamps, the deadline, a full FEC history, the longest script and the MAC.
+#define PACKET_CAPACITY (CLOCK_STAMPS_OFFSET + CLOCK_STAMPS_SIZE + DEADLINE_SIZE + 1 + FEC_MAX_DEPTH * FEC_ENTRY_SIZE + BUF_SIZE + PACKET_AUTH_TRAILER_SIZE)
+// Fixed part every packet starts with: header, stamps and the deadline. Anything shorter is dropped unread.
+#define PACKET_HEADER_SIZE (CLOCK_STAMPS_OFFSET + CLOCK_STAMPS_SIZE + DEADLINE_SIZE)
+
+// With shared memory every packet is serialized straight into a ring slot.
+_Static_assert(PACKET_CAPACITY <= SHM_RING_SLOT_SIZE, "the largest packet does not fit a shared memory slot");
 
 // Custom struct for confirmation and sequence between car_controller/car_motors.
 struct data_packet {
@@ -23,6 +61,15 @@ struct data_packet {
     int sequence_flag;
     int clockwise;
     int counter_clockwise;
+    int script_flag;
+    uint32_t command_id;
+    uint32_t stop_generation; // stops sent so far, car_motors drops commands from before the latest.
+    uint64_t session_epoch; // epoch of the sender, filled in by dp_serialize.
+    uint64_t peer_epoch; // epoch the sender last saw from the other side.
+    struct clock_stamps stamps; // filled in by write_bytes at the moment of sending.
+    struct telemetry telemetry; // vehicle state carried by ACKs.
+    int has_telemetry;
+    struct sockaddr_in from; // sender, filled in by receive_packet.
     const char *data;
 };
 
@@ -31,25 +78,125 @@ struct options
 {
     char *ip_client;
     char *ip_receiver;
+    char *script;
+    char *shm_name; // shared memory transport instead of UDP.
+    char *state_path; // session state kept across restarts.
+    char *group; // multicast group commands are sent to, NULL for unicast.
+    char *receivers[FLEET_MAX_CARS]; // every car_motors given, the fleet in group mode.
+    size_t receiver_count;
+    size_t fec_depth; // past commands repeated in each packet, 0 disables FEC.
+    int input_cpu; // core for the input thread, -1 for any.
+    int network_cpu; // core for the network thread, -1 for any.
     in_port_t port_receiver; // special type for output port.
     struct sockaddr_in server_addr; // special type for
+    struct sockaddr_in stop_addr; // car_motors express lane for stops.
     int fd_in;
+    int fd_stop; // express lane socket, -1 with shared memory.
 };
+
+// Timers driving the controller, all on one timer wheel. Callbacks only raise
+// a flag so sending never happens from inside timer_wheel_advance.
+struct controller_timers
+{
+    struct timer_wheel wheel;
+    struct timer_entry command;     // input snapshot check, armed with shared memory only.
+    struct timer_entry retransmit;  // retransmission of the packet awaiting ACK.
+    struct timer_entry keepalive;   // link keepalive while no commands are sent.
+    struct timer_entry stop_retransmit; // retransmission of a stop on the express lane.
+    int command_due;
+    int retransmit_due;
+    int keepalive_due;
+    int stop_retransmit_due;
+};
+
+// Serialized packets are built in place here, so sending never allocates.
+struct packet_buffers
+{
+    uint8_t command[PACKET_CAPACITY]; // motion or script command, kept until ACKed.
+    uint8_t control[PACKET_CAPACITY]; // stop or keepalive, sent straight away.
+};
+
+// Command in flight when FEC is on. Commands are not waited on: the newest is
+// retransmitted until ACKed and earlier ones are covered by the FEC history.
+struct pending_command
+{
+    uint8_t *bytes; // the command buffer, reused by the next command.
+    size_t size;
+    int sequence;
+    int active;
+};
+
+// Counters reported on shutdown.
+struct link_stats
+{
+    uint32_t last_command_id;
+    uint64_t commands_sent;
+    uint64_t retransmissions;
+    uint32_t stop_generation;
+    uint64_t stops_acked;
+    uint64_t stop_retransmissions;
+    int64_t stop_rtt_total_us;
+    int64_t stop_rtt_max_us;
+    uint64_t input_changes_seen;
+    uint64_t commands_expired; // reported by car_motors, each answered with a resync.
+    struct latency_stat input_latency; // debounced button change to command sent.
+};
+
 static volatile sig_atomic_t running;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct controller_timers timers; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct shm_transport shm;        // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct packet_auth auth;         // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct packet_auth stop_auth;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct fec_history history;      // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct pending_command pending;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct packet_buffers buffers;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct link_stats stats;         // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct clock_sync peer_clock;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct session session;          // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct input_sampler input;      // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct telemetry_series vehicle; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct fleet fleet;              // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int resync_due;                  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static uint32_t deadline_us;            // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static uint32_t retransmit_timeout_ms = RETRANSMIT_TIMEOUT_MS; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
 
 // Prototypes of functions.
 static void options_init(struct options *opts);
 static void parse_arguments(int argc, char *argv[], struct options *opts);
 static void options_process(struct options *opts);
 static void cleanup(const struct options *opts);
-static uint8_t *dp_serialize(const struct data_packet *x, size_t *size);
-static struct data_packet *dp_deserialize(char *data_buffer);
-static void write_bytes(int fd, const uint8_t *bytes, size_t size, struct sockaddr_in server_addr);
-static struct data_packet * read_bytes(int fd, const uint8_t *bytes, size_t size, struct sockaddr_in server_addr, int seq);
-static void detect_button_change(struct data_packet dataPacket, long * sendCounter, int * sequence, struct options opts);
+static size_t dp_serialize(const struct data_packet *x, uint8_t *bytes);
+static int dp_deserialize(const char *data_buffer, size_t size, struct data_packet *pDataPacket);
+static void write_bytes(int fd, uint8_t *bytes, size_t size, struct sockaddr_in server_addr);
+static int read_bytes(int fd, uint8_t *bytes, size_t size, struct sockaddr_in server_addr, int seq, int preemptible);
+static void detect_button_change(struct data_packet dataPacket, enum button_command * lastCommand, int * sequence, struct options opts);
 static void send_stop_packet(struct data_packet dataPacket, int * sequence, struct options opts);
 static void send_clockwise_packet(struct data_packet dataPacket, int * sequence, struct options opts);
 static void send_counterclockwise_packet(struct data_packet dataPacket, int * sequence, struct options opts);
+static void send_script_packet(struct data_packet dataPacket, int * sequence, struct options opts);
+static void send_keepalive_packet(struct data_packet dataPacket, const int * sequence, struct options opts);
+static void timers_init(void);
+static void arm_command_tick(void);
+static void wait_for_timers(int fd);
+static void timer_flag(struct timer_entry *timer, void *arg);
+static void signal_handler(int sig);
+static int wait_readable(int fd, int timeout_ms);
+static int receive_packet(int fd, enum fleet_lane lane, struct data_packet *dataPacket);
+static int open_ack(struct packet_auth *lane_auth, const uint8_t *bytes, size_t size, const struct session_peer *peer, size_t *payload_size);
+static void await_ack(struct options opts, uint8_t *bytes, size_t size, int seq, int preemptible);
+static void record_command(struct data_packet *dataPacket);
+static void send_express_stop(struct options opts, uint8_t *bytes, size_t size, uint32_t generation);
+static int buttons_released(void);
+static int64_t monotonic_us(void);
+static int open_stop_socket(struct options *opts);
+static void save_session(void);
+static int accept_session(const struct data_packet *dataPacket, struct session_peer *peer);
+static int accept_ack(const struct data_packet *dataPacket, int64_t received_ns);
+static int join_group(struct options *opts);
+static void retransmit(int fd, uint8_t *bytes, size_t size, struct sockaddr_in addr, enum fleet_lane lane);
+static int ack_complete(const struct data_packet *dataPacket, enum fleet_lane lane);
+static uint8_t *serialize_target(uint8_t *buffer);
+static void retain_command(const uint8_t *bytes, size_t size);
 
 int main(int argc, char *argv[])
 {
@@ -57,8 +204,11 @@ int main(int argc, char *argv[])
     struct options opts;
     struct data_packet dataPacket;
 
-    int sequence = 1;
-    long offCounter = 0;
+    // Lives in the session state, so a warm restart carries on with it.
+    int *sequence;
+    // Motors start off, so only a button press produces the first command.
+    enum button_command lastCommand = COMMAND_STOP;
+    struct sigaction sa;
 
     memset(&dataPacket, 0, sizeof(struct data_packet)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
 
@@ -67,9 +217,10 @@ int main(int argc, char *argv[])
     parse_arguments(argc, argv, &opts);
     // option processing is also when socket connection is made.
     options_process(&opts);
+    sequence = &session.state->sequence;
 
-    // If valid information for car_controller and sever, send data to car_motors.
-    if(opts.ip_client && opts.ip_receiver)
+    // If valid information for car_controller and sever, or a shared memory channel, send data to car_motors.
+    if((opts.ip_client && opts.ip_receiver) || opts.shm_name)
     {
         if (wiringPiSetup() == -1) {
             printf("WiringPi failed \n");
@@ -79,12 +230,76 @@ int main(int argc, char *argv[])
         pinMode(LeftButtonPin, INPUT);
         pinMode(RightButtonPin, INPUT);
 
+        // Buttons are sampled on their own thread, this one only does the networking.
+        if(input_sampler_start(&input, opts.input_cpu) == -1)
+        {
+            printf("Input thread failed \n");
+            return EXIT_FAILURE;
+        }
+        if(opts.network_cpu >= 0 && input_pin_cpu(opts.network_cpu) == -1)
+        {
+            perror("pin network thread");
+        }
+
+        timers_init();
+        clock_sync_init(&peer_clock);
+
+        memset(&sa, 0, sizeof(sa)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        sa.sa_handler = signal_handler;
+        sigaction(SIGINT, &sa, NULL);
+
         running = 1;
 
+        // Hand the maneuver to car_motors once, it runs it on its own timer.
+        if(opts.script)
+        {
+            printf("Sending script: %s\n", opts.script);
+            send_script_packet(dataPacket, sequence, opts);
+        }
+
         // Continues loop to keep listening to self.
         while(running)
         {
-            detect_button_change(dataPacket, &offCounter, &sequence, opts);
+            // A preempted wait leaves its command tick pending, serve it without sleeping.
+            if(!timers.command_due)
+            {
+                wait_for_timers(opts.fd_in);
+            }
+
+            // Only the newest unacknowledged command is retransmitted.
+            if(timers.retransmit_due)
+            {
+                timers.retransmit_due = 0;
+                if(pending.active)
+                {
+                    TRACE_INSTANT("retransmit");
+                    printf("Retransmitting\n");
+                    stats.retransmissions++;
+                    retransmit(opts.fd_in, pending.bytes, pending.size, opts.server_addr, FLEET_COMMAND);
+                    timer_wheel_add(&timers.wheel, &timers.retransmit, timer_wheel_clock_ms() + retransmit_timeout_ms);
+                }
+            }
+
+            // A restarted car_motors has lost the held command, or one expired, send it again now.
+            if(resync_due)
+            {
+                resync_due = 0;
+                lastCommand = COMMAND_STOP;
+                timers.command_due = 1;
+            }
+
+            if(timers.command_due)
+            {
+                timers.command_due = 0;
+                arm_command_tick();
+                detect_button_change(dataPacket, &lastCommand, sequence, opts);
+            }
+
+            if(timers.keepalive_due)
+            {
+                timers.keepalive_due = 0;
+                send_keepalive_packet(dataPacket, sequence, opts);
+            }
         }
     }
 
@@ -93,27 +308,46 @@ int main(int argc, char *argv[])
     return EXIT_SUCCESS;
 }
 
-static void detect_button_change(struct data_packet dataPacket, long * sendCounter, int * sequence, struct options opts) {
-    // Turn motors off if neither buttons are pressed
-    if (digitalRead(RightButtonPin) == 1 && digitalRead(LeftButtonPin) == 1) {
-        (*sendCounter)++;
-        if ((*sendCounter) >= 100000) {
-            printf("Sending Off command\n");
-            send_stop_packet(dataPacket, sequence, opts);
-        }
-    } else if (digitalRead(RightButtonPin) == 0 && digitalRead(LeftButtonPin) == 1) {
-        (*sendCounter)++;
-        if ((*sendCounter) >= 100000) {
+static void detect_button_change(struct data_packet dataPacket, enum button_command * lastCommand, int * sequence, struct options opts) {
+    struct input_snapshot snapshot;
+    TRACE_BEGIN(span);
+
+    // The input thread publishes the debounced state, a command is only sent when it changes.
+    input_sampler_read(&input, &snapshot);
+    if (snapshot.command == *lastCommand) {
+        TRACE_END(span, "detect_button_change");
+        return;
+    }
+    *lastCommand = snapshot.command;
+
+    // A resync resends the held command, only count real button changes.
+    if (snapshot.changes != stats.input_changes_seen) {
+        stats.input_changes_seen = snapshot.changes;
+        latency_stat_add(&stats.input_latency, input_now_ns() - snapshot.changed_ns);
+    }
+
+    switch (snapshot.command) {
+        case COMMAND_CLOCKWISE:
+        {
             printf("Sending Clockwise command\n");
             send_clockwise_packet(dataPacket, sequence, opts);
+            break;
         }
-    } else if (digitalRead(LeftButtonPin) == 0 && digitalRead(RightButtonPin) == 1) {
-        (*sendCounter)++;
-        if ((*sendCounter) >= 100000) {
+        case COMMAND_COUNTER_CLOCKWISE:
+        {
             printf("Sending CounterClockwise command\n");
             send_counterclockwise_packet(dataPacket, sequence, opts);
+            break;
+        }
+        case COMMAND_STOP:
+        default:
+        {
+            printf("Sending Off command\n");
+            send_stop_packet(dataPacket, sequence, opts);
+            break;
         }
     }
+    TRACE_END(span, "detect_button_change");
 }
 
 static void send_stop_packet(struct data_packet dataPacket, int * sequence, struct options opts) {
@@ -126,22 +360,37 @@ static void send_stop_packet(struct data_packet dataPacket, int * sequence, stru
     dataPacket.data_flag = 1;
     // Ack flag set to 0
     dataPacket.ack_flag = 0;
-    // Alternate sequence number
-    *sequence = !*sequence;
+    // Stops are numbered by generation, not the alternating sequence. The
+    // current sequence goes along so car_motors can resync after preemption.
     dataPacket.sequence_flag = *sequence;
 
     dataPacket.clockwise = 0;
     dataPacket.counter_clockwise = 0;
 
-    // Dynamic memory for data to send and fill with what was read into the buffer.
-    dataPacket.data = malloc(BUF_SIZE);
     dataPacket.data = "";
+    stats.stop_generation++;
+    record_command(&dataPacket);
+
+    // A stop supersedes whatever motion is still waiting for its ACK.
+    if(pending.active)
+    {
+        pending.active = 0;
+        timer_wheel_cancel(&timers.wheel, &timers.retransmit);
+    }
 
     // Serialize struct
-    bytes = dp_serialize(&dataPacket, &size);
-    // Send to car_motors by using Socket FD.
-    write_bytes(opts.fd_in, bytes, size, opts.server_addr);
-    read_bytes(opts.fd_in, bytes, size, opts.server_addr, *sequence);
+    bytes = serialize_target(buffers.control);
+    size = dp_serialize(&dataPacket, bytes);
+
+    // The shared ring is lossless and in order, only UDP needs the express lane.
+    if(opts.fd_stop == -1)
+    {
+        write_bytes(opts.fd_in, bytes, size, opts.server_addr);
+    }
+    else
+    {
+        send_express_stop(opts, buffers.control, size, dataPacket.stop_generation);
+    }
 }
 
 static void send_clockwise_packet(struct data_packet dataPacket, int * sequence, struct options opts) {
@@ -160,16 +409,17 @@ static void send_clockwise_packet(struct data_packet dataPacket, int * sequence,
     dataPacket.clockwise = 1;
     dataPacket.counter_clockwise = 0;
 
-    // Get data
-    // Dynamic memory for data to send and fill with what was read into the buffer.
-    dataPacket.data = malloc(BUF_SIZE);
     dataPacket.data = "";
+    record_command(&dataPacket);
 
     // Serialize struct
-    bytes = dp_serialize(&dataPacket, &size);
-    // Send to car_motors by using Socket FD.
+    bytes = serialize_target(buffers.command);
+    size = dp_serialize(&dataPacket, bytes);
+    // Send to car_motors by using Socket FD, every car of a group owes an ACK.
+    fleet_arm(&fleet, FLEET_COMMAND, input_now_ns());
     write_bytes(opts.fd_in, bytes, size, opts.server_addr);
-    read_bytes(opts.fd_in, bytes, size, opts.server_addr, *sequence);
+    retain_command(bytes, size);
+    await_ack(opts, buffers.command, size, *sequence, 1);
 }
 
 static void send_counterclockwise_packet(struct data_packet dataPacket, int * sequence, struct options opts) {
@@ -188,33 +438,137 @@ static void send_counterclockwise_packet(struct data_packet dataPacket, int * se
     dataPacket.clockwise = 0;
     dataPacket.counter_clockwise = 1;
 
-    // Get data
-    // Dynamic memory for data to send and fill with what was read into the buffer.
-    dataPacket.data = malloc(BUF_SIZE);
     dataPacket.data = "";
+    record_command(&dataPacket);
+
+    // Serialize struct
+    bytes = serialize_target(buffers.command);
+    size = dp_serialize(&dataPacket, bytes);
+    // Send to car_motors by using Socket FD, every car of a group owes an ACK.
+    fleet_arm(&fleet, FLEET_COMMAND, input_now_ns());
+    write_bytes(opts.fd_in, bytes, size, opts.server_addr);
+    retain_command(bytes, size);
+    await_ack(opts, buffers.command, size, *sequence, 1);
+}
+
+static void send_script_packet(struct data_packet dataPacket, int * sequence, struct options opts) {
+    uint8_t *bytes;
+    size_t size;
+    // Send timed script, e.g. "C800,A300,S"
+    // Construct data packet before using sento
+    // Data flag set to 1
+    dataPacket.data_flag = 1;
+    // Ack flag set to 0
+    dataPacket.ack_flag = 0;
+    // Alternate sequence number
+    *sequence = !*sequence;
+    dataPacket.sequence_flag = *sequence;
+
+    dataPacket.clockwise = 0;
+    dataPacket.counter_clockwise = 0;
+    dataPacket.script_flag = 1;
+
+    // The script text travels as the packet data.
+    dataPacket.data = opts.script;
+    // Scripts get an id but no history entry, FEC can only rebuild motion commands.
+    dataPacket.command_id = ++stats.last_command_id;
+    dataPacket.stop_generation = stats.stop_generation;
+    stats.commands_sent++;
+    save_session();
+
+    // Serialize struct
+    bytes = serialize_target(buffers.command);
+    size = dp_serialize(&dataPacket, bytes);
+    // Send to car_motors by using Socket FD, every car of a group owes an ACK.
+    fleet_arm(&fleet, FLEET_COMMAND, input_now_ns());
+    write_bytes(opts.fd_in, bytes, size, opts.server_addr);
+    retain_command(bytes, size);
+    await_ack(opts, buffers.command, size, *sequence, 0);
+}
+
+static void send_keepalive_packet(struct data_packet dataPacket, const int * sequence, struct options opts) {
+    uint8_t *bytes;
+    size_t size;
+    // Keepalive: no data flag, so car_motors only ACKs it and refreshes its motor pulse.
+    dataPacket.data_flag = 0;
+    dataPacket.ack_flag = 0;
+    // Sequence is not alternated, this is not a new command.
+    dataPacket.sequence_flag = *sequence;
+
+    dataPacket.clockwise = 0;
+    dataPacket.counter_clockwise = 0;
+    dataPacket.data = "";
+    // Carries the latest id and, with FEC, the history to rebuild anything lost since.
+    dataPacket.command_id = stats.last_command_id;
+    dataPacket.stop_generation = stats.stop_generation;
 
     // Serialize struct
-    bytes = dp_serialize(&dataPacket, &size);
-    // Send to car_motors by using Socket FD.
+    bytes = serialize_target(buffers.control);
+    size = dp_serialize(&dataPacket, bytes);
+    // Fire and forget, the ACK is discarded by the next read_bytes as a stale sequence.
     write_bytes(opts.fd_in, bytes, size, opts.server_addr);
-    read_bytes(opts.fd_in, bytes, size, opts.server_addr, *sequence);
 }
 
 /**
- * For sending by writing to socket FD.
+ * For sending by writing to socket FD. The clock stamps and MAC are written
+ * here rather than at serialization, so every retransmission carries the time
+ * it really left.
  * @param fd Socket FD.
- * @param bytes the bytes to read.
- * @param size the size of bytes to read.
+ * @param bytes the bytes to read, with room for the MAC trailer. With shared
+ * memory, the reserved ring slot when it was serialized there.
+ * @param size the size of bytes to read, without the trailer.
  * @param server_addr Network address of the car_motors to send to.
  */
-static void write_bytes(int fd, const uint8_t *bytes, size_t size, struct sockaddr_in server_addr)
+static void write_bytes(int fd, uint8_t *bytes, size_t size, struct sockaddr_in server_addr)
 {
+    struct clock_stamps stamps;
+    TRACE_BEGIN(span);
+
+    clock_sync_stamp(&peer_clock, &stamps);
+    clock_stamps_encode(&stamps, &bytes[CLOCK_STAMPS_OFFSET]);
+
+    // Append counter and MAC so car_motors can reject forged commands.
+    if(auth.enabled)
+    {
+        size = packet_auth_seal(&auth, bytes, size);
+    }
+
+    // Co-located car_motors: the packet goes straight into the shared ring.
+    if(shm.channel)
+    {
+        uint8_t *slot = shm_ring_reserve(shm.tx);
+
+        if(size > SHM_RING_SLOT_SIZE)
+        {
+            printf("Packet of %zu bytes is larger than a ring slot, packet dropped\n", size);
+            TRACE_END(span, "write_bytes");
+            return;
+        }
+        if(slot == NULL)
+        {
+            printf("Command ring full, packet dropped\n");
+            TRACE_END(span, "write_bytes");
+            return;
+        }
+        // Serialized in the slot already unless this is a retransmission.
+        if(slot != bytes)
+        {
+            memcpy(slot, bytes, size);
+        }
+        shm_ring_commit(shm.tx, size);
+    }
+    else
+    {
+        // Sending the data to car_motors machine.
+        sendto(fd, bytes, size, 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    }
 
-    // Sending the data to car_motors machine.
-    sendto(fd, bytes, size, 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    // Any packet keeps the link alive, push the keepalive back.
+    timer_wheel_add(&timers.wheel, &timers.keepalive, timer_wheel_clock_ms() + KEEPALIVE_MS);
 
     // Display bytes and ACK/SEQ of packet sent.
     printf("Sent Packet\n");
+    TRACE_END(span, "write_bytes");
 
 }
 
@@ -224,44 +578,77 @@ static void write_bytes(int fd, const uint8_t *bytes, size_t size, struct sockad
  * @param bytes The bytes to read.
  * @param size the size of bytes to read.
  * @param server_addr the network address of the car_motors.
- * @return Data packet pointer of deserialized packet.
+ * @param seq Sequence flag the ACK must carry.
+ * @param preemptible Non-zero to give up the wait once the buttons ask for a stop.
+ * @return 0 once the ACK arrived, -1 if the wait was given up.
  */
-static struct data_packet * read_bytes(int fd, const uint8_t *bytes, size_t size, struct sockaddr_in server_addr, int seq)
+static int read_bytes(int fd, uint8_t *bytes, size_t size, struct sockaddr_in server_addr, int seq, int preemptible)
 {
-    struct sockaddr from_addr;
-    char data[BUF_SIZE];
-    ssize_t nRead;
-    socklen_t from_addr_len;
-    from_addr_len = sizeof (struct sockaddr);
+    struct data_packet dataPacket;
+    int ready;
 
     printf("\n Waiting \n");
 
-    // Read from the socket FD and get bytes read.
-    nRead = recvfrom(fd, data, BUF_SIZE, 0, &from_addr, &from_addr_len);
+    // Re-send on the retransmit timer until the matching ACK arrives.
+    timer_wheel_add(&timers.wheel, &timers.retransmit, timer_wheel_clock_ms() + retransmit_timeout_ms);
 
-    // Re-send if -1
-    if(nRead == -1)
+    while(running)
     {
-        write_bytes(fd, bytes, size, server_addr);
-    }
+        // Wait for an ACK or the next timer, whichever is first.
+        ready = wait_readable(fd, timer_wheel_timeout_ms(&timers.wheel, timer_wheel_clock_ms()));
+        timer_wheel_advance(&timers.wheel, timer_wheel_clock_ms());
 
-    // Return the data packet from the serialized information sent over.
-    struct data_packet * dataPacket = dp_deserialize(data);
-    if (dataPacket->sequence_flag != seq) {
-        read_bytes(fd, bytes, size, server_addr, seq);
+        if(timers.retransmit_due)
+        {
+            timers.retransmit_due = 0;
+            TRACE_INSTANT("retransmit");
+            printf("Retransmitting\n");
+            stats.retransmissions++;
+            retransmit(fd, bytes, size, server_addr, FLEET_COMMAND);
+            timer_wheel_add(&timers.wheel, &timers.retransmit, timer_wheel_clock_ms() + retransmit_timeout_ms);
+        }
+
+        // Released buttons mean stop: leave the tick pending for the main loop to send it.
+        if(preemptible && timers.command_due && buttons_released())
+        {
+            printf("Motion command preempted by stop\n");
+            break;
+        }
+
+        if(!ready)
+        {
+            continue;
+        }
+
+        if(receive_packet(fd, FLEET_COMMAND, &dataPacket) == -1)
+        {
+            // car_motors restarted without the command, the main loop sends it again.
+            if(resync_due)
+            {
+                break;
+            }
+            continue;
+        }
+
+        if (dataPacket.sequence_flag == seq && ack_complete(&dataPacket, FLEET_COMMAND)) {
+            timer_wheel_cancel(&timers.wheel, &timers.retransmit);
+            return 0;
+        }
     }
+
+    timer_wheel_cancel(&timers.wheel, &timers.retransmit);
+    return -1;
 }
 
 /**
  * Serialize the data packet.
  * @param x Pointer to the data packet to send to car_motors.
- * @param size Size of the data packet.
- * @return Serialized data packet to send to car_motors.
+ * @param bytes Buffer of PACKET_CAPACITY bytes to serialize into, leaving room for the MAC trailer.
+ * @return Size of the serialized data packet, without the trailer.
  */
-static uint8_t *dp_serialize(const struct data_packet *x, size_t *size)
+static size_t dp_serialize(const struct data_packet *x, uint8_t *bytes)
 {
 
-    uint8_t *bytes;
     size_t count;
     size_t len;
     int data_flag_number;
@@ -269,13 +656,15 @@ static uint8_t *dp_serialize(const struct data_packet *x, size_t *size)
     int sequence_flag_number;
     int clockwise;
     int counter_clockwise;
+    int script_flag;
+    uint32_t command_id;
+    uint32_t stop_generation;
+    struct deadline deadline;
+    TRACE_BEGIN(span);
 
+    // Scripts are capped below BUF_SIZE when parsed, so the packet always fits.
     len = strlen(x->data);
 
-    // Dynamic memory for serialize data packet.
-    *size = sizeof(x->data_flag) + sizeof(x->ack_flag) + sizeof(x->sequence_flag) + sizeof(x->clockwise) + sizeof(x->counter_clockwise) + len;
-    bytes = malloc(*size);
-
     // Make network byte order
     data_flag_number = htons(x->data_flag);
     // ACK/SEQ for reliable UDP converted to network bytes.
@@ -283,6 +672,12 @@ static uint8_t *dp_serialize(const struct data_packet *x, size_t *size)
     sequence_flag_number = htons(x->sequence_flag);
     clockwise = htons(x->clockwise);
     counter_clockwise = htons(x->counter_clockwise);
+    script_flag = htons(x->script_flag);
+    command_id = htonl(x->command_id);
+    stop_generation = htonl(x->stop_generation);
+    // Issued now, retransmissions of these bytes keep the time and so expire with the command.
+    deadline.issued_ns = clock_sync_now_ns();
+    deadline.budget_us = deadline_us;
 
     count = 0;
 
@@ -303,22 +698,56 @@ static uint8_t *dp_serialize(const struct data_packet *x, size_t *size)
     memcpy(&bytes[count], &counter_clockwise, sizeof(counter_clockwise));
     count += sizeof(counter_clockwise);
 
+    memcpy(&bytes[count], &script_flag, sizeof(script_flag));
+    count += sizeof(script_flag);
+
+    memcpy(&bytes[count], &command_id, sizeof(command_id));
+    count += sizeof(command_id);
+
+    memcpy(&bytes[count], &stop_generation, sizeof(stop_generation));
+    count += sizeof(stop_generation);
+
+    session_epoch_encode(session.state->epoch, &bytes[count]);
+    count += SESSION_EPOCH_SIZE;
+
+    session_epoch_encode(session.state->peer.epoch, &bytes[count]);
+    count += SESSION_EPOCH_SIZE;
+
+    // Clock stamps are left for write_bytes to fill in.
+    count += CLOCK_STAMPS_SIZE;
+
+    deadline_encode(&deadline, &bytes[count]);
+    count += DEADLINE_SIZE;
+
+    // The last commands sent, so car_motors can rebuild one that was lost.
+    count += fec_encode(&history, &bytes[count]);
+
     memcpy(&bytes[count], x->data, len);
+    count += len;
 
-    return bytes;
+    TRACE_END(span, "dp_serialize");
+    return count;
 }
 
 /**
  * Deserialize the data packet received.
  * @param data_buffer Data  buffer to read from.
- * @return
+ * @param size Bytes in the buffer, without the MAC trailer.
+ * @param pDataPacket Data packet to fill in.
+ * @return 0, or -1 if the packet is shorter than its fixed header.
  */
-static struct data_packet *dp_deserialize(char *data_buffer)
+static int dp_deserialize(const char *data_buffer, size_t size, struct data_packet *pDataPacket)
 {
-    struct data_packet * pDataPacket = malloc(sizeof(struct data_packet));
     size_t count;
+    TRACE_BEGIN(span);
 
     memset(pDataPacket, 0, sizeof(struct data_packet));
+    if(size < PACKET_HEADER_SIZE)
+    {
+        printf("Dropped packet of %zu bytes, shorter than a header\n", size);
+        TRACE_END(span, "dp_deserialize");
+        return -1;
+    }
     count = 0;
 
     memcpy(&pDataPacket->data_flag, &data_buffer[count], sizeof(pDataPacket->data_flag));
@@ -328,18 +757,53 @@ static struct data_packet *dp_deserialize(char *data_buffer)
     count += sizeof(pDataPacket->ack_flag);
 
     memcpy(&pDataPacket->sequence_flag, &data_buffer[count], sizeof(pDataPacket->sequence_flag));
+    count += sizeof(pDataPacket->sequence_flag);
 
     memcpy(&pDataPacket->clockwise, &data_buffer[count], sizeof(pDataPacket->clockwise));
+    count += sizeof(pDataPacket->clockwise);
 
     memcpy(&pDataPacket->counter_clockwise, &data_buffer[count], sizeof(pDataPacket->counter_clockwise));
+    count += sizeof(pDataPacket->counter_clockwise);
+
+    memcpy(&pDataPacket->script_flag, &data_buffer[count], sizeof(pDataPacket->script_flag));
+    count += sizeof(pDataPacket->script_flag);
+
+    memcpy(&pDataPacket->command_id, &data_buffer[count], sizeof(pDataPacket->command_id));
+    count += sizeof(pDataPacket->command_id);
+
+    memcpy(&pDataPacket->stop_generation, &data_buffer[count], sizeof(pDataPacket->stop_generation));
+    count += sizeof(pDataPacket->stop_generation);
+
+    pDataPacket->session_epoch = session_epoch_decode((const uint8_t *)&data_buffer[count]);
+    count += SESSION_EPOCH_SIZE;
+
+    pDataPacket->peer_epoch = session_epoch_decode((const uint8_t *)&data_buffer[count]);
+    count += SESSION_EPOCH_SIZE;
+
+    clock_stamps_decode((const uint8_t *)&data_buffer[count], &pDataPacket->stamps);
+    count += CLOCK_STAMPS_SIZE;
+
+    // ACKs carry no deadline.
+    count += DEADLINE_SIZE;
+
+    // The telemetry report follows the FEC history, which is empty on ACKs.
+    if(count < size)
+    {
+        count += 1 + (size_t)(uint8_t)data_buffer[count] * FEC_ENTRY_SIZE;
+        pDataPacket->has_telemetry = count <= size && telemetry_decode((const uint8_t *)&data_buffer[count], size - count, &pDataPacket->telemetry) == 0;
+    }
 
     pDataPacket->data_flag = ntohs(pDataPacket->data_flag);
     pDataPacket->ack_flag = ntohs(pDataPacket->ack_flag);
     pDataPacket->sequence_flag = ntohs(pDataPacket->sequence_flag);
     pDataPacket->clockwise = ntohs(pDataPacket->clockwise);
     pDataPacket->counter_clockwise = ntohs(pDataPacket->counter_clockwise);
+    pDataPacket->script_flag = ntohs(pDataPacket->script_flag);
+    pDataPacket->command_id = ntohl(pDataPacket->command_id);
+    pDataPacket->stop_generation = ntohl(pDataPacket->stop_generation);
 
-    return pDataPacket;
+    TRACE_END(span, "dp_deserialize");
+    return 0;
 }
 
 
@@ -354,6 +818,9 @@ static void options_init(struct options *opts)
 
     // Default values for file descriptor standard input.
     opts->fd_in = STDIN_FILENO;
+    opts->fd_stop = -1;
+    opts->input_cpu = -1;
+    opts->network_cpu = -1;
 
     // Default value for Default output port.
     opts->port_receiver = DEFAULT_PORT;
@@ -370,7 +837,7 @@ static void parse_arguments(int argc, char *argv[], struct options *opts)
     int c;
 
     // While valid option is passed.
-    while((c = getopt(argc, argv, ":c:o:")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    while((c = getopt(argc, argv, ":c:o:g:s:m:k:f:d:a:t:r:i:n:")) != -1)   // NOLINT(concurrency-mt-unsafe)
     {
         switch(c)
         {
@@ -394,6 +861,120 @@ static void parse_arguments(int argc, char *argv[], struct options *opts)
                 }
                 printf("Sending to ip address: %s \n", optarg);
                 opts->ip_receiver = optarg;
+                // Repeated with -g, every car of the group is listed.
+                if (opts->receiver_count == FLEET_MAX_CARS) {
+                    fatal_message(__FILE__, __func__ , __LINE__, "Too many cars", 9); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                }
+                opts->receivers[opts->receiver_count++] = optarg;
+                break;
+            }
+
+            // For sending every command once to a multicast group of cars.
+            case 'g':
+            {
+                if (!IN_MULTICAST(ntohl(inet_addr(optarg)))) {
+                    options_process_close(-1);
+                }
+                printf("Sending to multicast group: %s \n", optarg);
+                opts->group = optarg;
+                break;
+            }
+
+            // For sending a timed script to car_motors.
+            case 's':
+            {
+                if (strlen(optarg) >= BUF_SIZE) {
+                    options_process_close(-1);
+                }
+                opts->script = optarg;
+                break;
+            }
+
+            // For using a shared memory ring with a co-located car_motors.
+            case 'm':
+            {
+                printf("Using shared memory transport: %s \n", optarg);
+                opts->shm_name = optarg;
+                break;
+            }
+
+            // For loading the pre-shared key commands are authenticated with.
+            case 'k':
+            {
+                if (packet_auth_load_key(&auth, optarg) == -1) {
+                    fatal_message(__FILE__, __func__ , __LINE__, "Key file must hold 32 hex characters", 7); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                }
+                break;
+            }
+
+            // For repeating the last K commands in every packet.
+            case 'f':
+            {
+                opts->fec_depth = strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                if (opts->fec_depth > FEC_MAX_DEPTH) {
+                    fatal_message(__FILE__, __func__ , __LINE__, "FEC depth must be 0 to 8", 8); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                }
+                fec_history_init(&history, opts->fec_depth);
+                break;
+            }
+
+            // For setting how long a command stays current.
+            case 'd':
+            {
+                char *end;
+                unsigned long deadline_ms;
+
+                errno = 0;
+                deadline_ms = strtoul(optarg, &end, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                if (errno != 0 || end == optarg || *end != '\0' || optarg[0] == '-' || deadline_ms > MAX_DEADLINE_MS) {
+                    fatal_message(__FILE__, __func__ , __LINE__, "Deadline must be 0 to 3600000 ms", 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                }
+                deadline_us = (uint32_t)(deadline_ms * 1000); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                printf("Commands expire %u ms after they are issued\n", deadline_us / 1000); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+
+            // For setting how long an ACK is waited for before a command is sent again.
+            case 'a':
+            {
+                char *end;
+                unsigned long timeout_ms;
+
+                errno = 0;
+                timeout_ms = strtoul(optarg, &end, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                if (errno != 0 || end == optarg || *end != '\0' || optarg[0] == '-' || timeout_ms == 0 || timeout_ms > RETRANSMIT_TIMEOUT_MS) {
+                    fatal_message(__FILE__, __func__ , __LINE__, "Retransmit timeout must be 1 to 5000 ms", 11); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                }
+                retransmit_timeout_ms = (uint32_t)timeout_ms;
+                break;
+            }
+
+            // For recording a packet lifecycle trace.
+            case 't':
+            {
+                if (trace_open(optarg) == -1) {
+                    options_process_close(-1);
+                }
+                trace_thread_name("car_controller");
+                break;
+            }
+
+            // For keeping the session state in a file, so a restart resumes it.
+            case 'r':
+            {
+                opts->state_path = optarg;
+                break;
+            }
+
+            // For pinning the input and network threads to separate cores.
+            case 'i':
+            {
+                opts->input_cpu = (int)strtol(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'n':
+            {
+                opts->network_cpu = (int)strtol(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
                 break;
             }
 
@@ -404,7 +985,18 @@ static void parse_arguments(int argc, char *argv[], struct options *opts)
             case '?':
             {
                 fatal_message(__FILE__, __func__ , __LINE__, "\n\nUnknown Argument Passed: Please use from the following...\n'c' for setting car_controller IP.\n"
-                                                             "'o' for setting output IP.\n"
+                                                             "'o' for setting output IP, repeated for every car of a group.\n"
+                                                             "'g' for a multicast group the cars listed with 'o' joined.\n"
+                                                             "'s' for sending a timed script, e.g. C800,A300,S.\n"
+                                                             "'m' for a shared memory transport name, e.g. /car.\n"
+                                                             "'k' for a pre-shared key file.\n"
+                                                             "'f' for FEC depth, commands repeated per packet (0-8).\n"
+                                                             "'d' for the deadline in ms after which car_motors drops a command, stops never expire.\n"
+                                                             "'a' for the ms an ACK is waited for before a command is sent again (1-5000, default 5000).\n"
+                                                             "'t' for a Chrome trace-event JSON file.\n"
+                                                             "'r' for a session state file kept across restarts.\n"
+                                                             "'i' for the core the input thread is pinned to.\n"
+                                                             "'n' for the core the network thread is pinned to.\n"
                                                              "'p' for port (optional).", 6); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
             }
             default:
@@ -422,6 +1014,33 @@ static void parse_arguments(int argc, char *argv[], struct options *opts)
  */
 static void options_process(struct options *opts)
 {
+    if(session_open(&session, opts->state_path) == -1)
+    {
+        options_process_close(-1);
+    }
+
+    // The express lane keeps its own replay counter, stops may overtake commands.
+    stop_auth = auth;
+    if(session.warm)
+    {
+        stats.last_command_id = session.state->command_id;
+        stats.stop_generation = session.state->stop_generation;
+    }
+    else
+    {
+        session.state->sequence = 1;
+    }
+    printf("Session epoch %" PRIu64 ", %s start\n", session.state->epoch, session.warm ? "warm" : "cold");
+
+    // Shared memory replaces the socket entirely.
+    if(opts->shm_name)
+    {
+        if(shm_transport_open(&shm, opts->shm_name, 1) == -1)
+        {
+            options_process_close(-1);
+        }
+        return;
+    }
 
     // Only process if valid IP for car_controller is given.
     if(opts->ip_client)
@@ -446,26 +1065,30 @@ static void options_process(struct options *opts)
         addr.sin_addr.s_addr = inet_addr(opts->ip_client);
 
         // check for error when getting network byte from Client IP.
-        if(to_addr.sin_addr.s_addr ==  (in_addr_t)-1)
+        if(addr.sin_addr.s_addr ==  (in_addr_t)-1)
         {
             perror("inet_addr: Client Ip could not convert from dot notation to network bytes");
             options_process_close(-1);
         }
 
-        // Setting wait time for data packet exchange.
+        // Setting wait time for sending, receive waits are driven by the timer wheel.
         struct timeval timeout;
         timeout.tv_sec = 5;
         timeout.tv_usec = 0;
 
-        // Setting socket options for initiated socket FD and its reception/send time.
-        setsockopt(opts->fd_in, SOL_SOCKET, SO_RCVTIMEO, &timeout,
-                   sizeof timeout);
+        // Setting socket options for initiated socket FD and its send time.
         setsockopt(opts->fd_in, SOL_SOCKET, SO_SNDTIMEO, &timeout,
                    sizeof timeout);
 
         // Assigning address name to the socket FD.
         bindResult = bind(opts->fd_in, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
 
+        // Kernel receive timestamps keep scheduling delay out of the latency measured.
+        if(clock_sync_enable_timestamps(opts->fd_in) == -1)
+        {
+            printf("Kernel receive timestamps unavailable\n");
+        }
+
         // If socket FD to port binding fails, display error message and leave program.
         options_process_close(bindResult);
 
@@ -482,6 +1105,15 @@ static void options_process(struct options *opts)
             options_process_close(-1);
         }
         opts->server_addr = to_addr;
+
+        to_addr.sin_port = htons(DEFAULT_STOP_PORT);
+        opts->stop_addr = to_addr;
+        options_process_close(open_stop_socket(opts));
+
+        if(opts->group)
+        {
+            options_process_close(join_group(opts));
+        }
     }
 
 }
@@ -492,8 +1124,681 @@ static void options_process(struct options *opts)
  */
 static void cleanup(const struct options *opts)
 {
+    struct rusage usage;
+
+    input_sampler_stop(&input);
+    printf("Commands sent: %llu, retransmissions: %llu\n",
+           (unsigned long long)stats.commands_sent, (unsigned long long)stats.retransmissions);
+    latency_stat_report(&stats.input_latency, "Input to send");
+    if(stats.commands_expired)
+    {
+        printf("Commands expired at car_motors: %llu\n", (unsigned long long)stats.commands_expired);
+    }
+    if(stats.stops_acked)
+    {
+        printf("Stops acknowledged: %llu, round trip mean %lld us, max %lld us, retransmissions: %llu\n",
+               (unsigned long long)stats.stops_acked, (long long)(stats.stop_rtt_total_us / (int64_t)stats.stops_acked),
+               (long long)stats.stop_rtt_max_us, (unsigned long long)stats.stop_retransmissions);
+    }
+    // Packet buffers are fixed, so this stays flat however long the session ran.
+    if(getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        printf("Peak resident set: %ld KiB\n", usage.ru_maxrss);
+    }
+    trace_close();
+    if(opts->ip_client || opts->shm_name)
+    {
+        if(fleet.count)
+        {
+            fleet_report(&fleet);
+        }
+        else
+        {
+            clock_sync_report(&peer_clock, "Uplink to car_motors", "Downlink from car_motors", "car_motors processing");
+            telemetry_series_report(&vehicle);
+        }
+    }
+    shm_transport_close(&shm);
     if(opts->ip_client)
     {
         close(opts->fd_in);
     }
+    if(opts->fd_stop != -1)
+    {
+        close(opts->fd_stop);
+    }
+    session_close(&session);
+}
+
+/**
+ * Set up the timer wheel, with the command tick armed where it is needed.
+ */
+static void timers_init(void)
+{
+    memset(&timers, 0, sizeof(timers)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    timer_wheel_init(&timers.wheel, timer_wheel_clock_ms());
+
+    timer_init(&timers.command, timer_flag, &timers.command_due);
+    timer_init(&timers.retransmit, timer_flag, &timers.retransmit_due);
+    timer_init(&timers.keepalive, timer_flag, &timers.keepalive_due);
+    timer_init(&timers.stop_retransmit, timer_flag, &timers.stop_retransmit_due);
+
+    arm_command_tick();
+}
+
+/**
+ * Check the input snapshot again in COMMAND_PERIOD_MS, with shared memory
+ * only. Over UDP the input thread's eventfd wakes the loop on every change,
+ * so an idle link sleeps until the keepalive; the ring wait cannot watch the
+ * eventfd, so there the snapshot is polled.
+ */
+static void arm_command_tick(void)
+{
+    if(shm.channel)
+    {
+        timer_wheel_add(&timers.wheel, &timers.command, timers.wheel.now + COMMAND_PERIOD_MS);
+    }
+}
+
+/**
+ * Sleep until the next timer deadline or incoming ACK, fire everything due
+ * and settle the pending command if its ACK arrived.
+ * @param fd Socket FD.
+ */
+static void wait_for_timers(int fd)
+{
+    int ready = wait_readable(fd, timer_wheel_timeout_ms(&timers.wheel, timer_wheel_clock_ms()));
+
+    timer_wheel_advance(&timers.wheel, timer_wheel_clock_ms());
+
+    if(ready)
+    {
+        struct data_packet dataPacket;
+
+        if(receive_packet(fd, FLEET_COMMAND, &dataPacket) == 0 && pending.active && dataPacket.ack_flag && dataPacket.sequence_flag == pending.sequence &&
+           ack_complete(&dataPacket, FLEET_COMMAND))
+        {
+            pending.active = 0;
+            timer_wheel_cancel(&timers.wheel, &timers.retransmit);
+        }
+    }
+}
+
+/**
+ * Timer callback raising the flag it was armed with.
+ * @param timer Expired timer.
+ * @param arg Pointer to the flag.
+ */
+static void timer_flag(struct timer_entry *timer, void *arg)
+{
+    (void)timer;
+    *(int *)arg = 1;
+}
+
+/**
+ * Stop the main loop on SIGINT.
+ * @param sig Signal number.
+ */
+static void signal_handler(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+/**
+ * Wait for an incoming packet on the active transport. A button change
+ * published by the input thread ends the wait too and raises the command
+ * flag, so it is served without waiting for the next command tick.
+ * @param fd Socket FD, unused with shared memory.
+ * @param timeout_ms Milliseconds to wait, -1 for no limit.
+ * @return 1 if a packet is ready, 0 otherwise.
+ */
+static int wait_readable(int fd, int timeout_ms)
+{
+    struct pollfd pfd[2];
+
+    // The ring wait cannot watch the eventfd, the command tick picks changes up instead.
+    if(shm.channel)
+    {
+        return shm_ring_wait(shm.rx, timeout_ms);
+    }
+
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    pfd[1].fd = input.event_fd;
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    if(poll(pfd, 2, timeout_ms) == -1 && errno != EINTR)
+    {
+        fatal_errno(__FILE__, __func__ , __LINE__, errno, EXIT_FAILURE);
+    }
+    if((pfd[1].revents & POLLIN) && input_sampler_drain(&input))
+    {
+        timers.command_due = 1;
+    }
+    return (pfd[0].revents & POLLIN) != 0;
+}
+
+/**
+ * Read one packet from the active transport, verifying it if keyed.
+ * @param fd Socket FD.
+ * @param lane Lane read from, each lane keeps its own replay counter.
+ * @param dataPacket Filled in with the deserialized packet.
+ * @return 0 if a valid packet was read, -1 otherwise.
+ */
+static int receive_packet(int fd, enum fleet_lane lane, struct data_packet *dataPacket)
+{
+    struct packet_auth *lane_auth = lane == FLEET_STOP ? &stop_auth : &auth;
+    const struct session_peer *peer = &session.state->peer;
+    struct sockaddr from_addr;
+    struct sockaddr_in from;
+    char data[BUF_SIZE];
+    ssize_t nRead;
+    size_t payload_size;
+    socklen_t from_addr_len;
+    int64_t received_ns;
+
+    if(shm.channel)
+    {
+        // Deserialize straight out of the shared slot.
+        size_t slot_size;
+        const uint8_t *slot = shm_ring_peek(shm.rx, &slot_size);
+
+        if(slot == NULL)
+        {
+            return -1;
+        }
+        received_ns = clock_sync_now_ns();
+        if(auth.enabled && open_ack(&auth, slot, slot_size, peer, &slot_size) != 0)
+        {
+            printf("Rejected unauthenticated ACK\n");
+            shm_ring_release(shm.rx);
+            return -1;
+        }
+        if(dp_deserialize((const char *)slot, slot_size, dataPacket) == -1)
+        {
+            shm_ring_release(shm.rx);
+            return -1;
+        }
+        shm_ring_release(shm.rx);
+        return accept_ack(dataPacket, received_ns);
+    }
+
+    // Read from the socket FD and get bytes read.
+    from_addr_len = sizeof (struct sockaddr);
+    nRead = clock_sync_recvfrom(fd, data, BUF_SIZE, &from_addr, &from_addr_len, &received_ns);
+    if(nRead == -1)
+    {
+        return -1;
+    }
+
+    memcpy(&from, &from_addr, sizeof(from)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+
+    // Every car of a group counts its own ACKs, so each has its own replay counter.
+    if(fleet.count)
+    {
+        struct fleet_car *car = fleet_find(&fleet, &from);
+
+        if(car == NULL)
+        {
+            printf("Dropped ACK from outside the fleet\n");
+            return -1;
+        }
+        lane_auth = &car->auth[lane];
+        peer = &car->peer;
+    }
+
+    // Only trust ACKs signed with the pre-shared key.
+    payload_size = (size_t)nRead;
+    if(auth.enabled && open_ack(lane_auth, (const uint8_t *)data, (size_t)nRead, peer, &payload_size) != 0)
+    {
+        printf("Rejected unauthenticated ACK\n");
+        return -1;
+    }
+
+    // Return the data packet from the serialized information sent over.
+    if(dp_deserialize(data, payload_size, dataPacket) == -1)
+    {
+        return -1;
+    }
+    dataPacket->from = from;
+    return accept_ack(dataPacket, received_ns);
+}
+
+/**
+ * Check the MAC of an ACK from a car on one lane. An ACK of a car_motors
+ * session not seen on the lane yet opens a new counter window only if it
+ * answers this process's epoch, which car_motors only learns from a packet
+ * of this process, so nothing it sealed before this process started is let
+ * through.
+ * @param lane_auth Auth state of the lane, or of the car's lane in group mode.
+ * @param bytes ACK read, with the trailer.
+ * @param size Bytes read.
+ * @param peer Epochs of the car it came from.
+ * @param payload_size Set to the size without the trailer.
+ * @return As packet_auth_open.
+ */
+static int open_ack(struct packet_auth *lane_auth, const uint8_t *bytes, size_t size, const struct session_peer *peer, size_t *payload_size)
+{
+    uint64_t epoch = 0;
+    int bound = 0;
+
+    if(size >= CLOCK_STAMPS_OFFSET + PACKET_AUTH_TRAILER_SIZE)
+    {
+        epoch = session_epoch_decode(&bytes[SESSION_EPOCH_OFFSET]);
+        bound = session_epoch_decode(&bytes[SESSION_EPOCH_OFFSET + SESSION_EPOCH_SIZE]) == session.state->epoch &&
+                !session_peer_retired(peer, epoch);
+    }
+    return packet_auth_open(lane_auth, bytes, size, epoch, bound, payload_size);
+}
+
+/**
+ * Take in an ACK of this session: feed its clock stamps to the estimator and
+ * its telemetry to the vehicle time series. In group mode every car has its
+ * own clock, session and latest report instead.
+ * @param dataPacket ACK just received.
+ * @param received_ns When it was received.
+ * @return 0 if the ACK may be used, -1 if it was meant for an earlier car_controller.
+ */
+static int accept_ack(const struct data_packet *dataPacket, int64_t received_ns)
+{
+    struct clock_sync *clock = &peer_clock;
+    struct session_peer *peer = &session.state->peer;
+    struct fleet_car *car = NULL;
+    int joined;
+
+    // receive_packet only lets ACKs from the fleet through.
+    if(fleet.count)
+    {
+        car = fleet_find(&fleet, &dataPacket->from);
+        clock = &car->clock;
+        peer = &car->peer;
+    }
+
+    clock_sync_receive(clock, &dataPacket->stamps, received_ns);
+    joined = accept_session(dataPacket, peer);
+    if(joined == -1)
+    {
+        return -1;
+    }
+    // A car_motors announcing a session new to this process answers nothing
+    // held here, the held command goes again bound to it. Repeats of one
+    // already followed are only dropped.
+    if(dataPacket->has_telemetry && (dataPacket->telemetry.flags & TELEMETRY_SESSION_START))
+    {
+        if(joined)
+        {
+            resync_due = 1;
+        }
+        return -1;
+    }
+    if(dataPacket->has_telemetry && car)
+    {
+        car->telemetry = dataPacket->telemetry;
+        car->has_telemetry = 1;
+    }
+    else if(dataPacket->has_telemetry)
+    {
+        telemetry_series_add(&vehicle, received_ns, dataPacket->stamps.transmit, &dataPacket->telemetry);
+    }
+    // The car stopped instead of applying a late command, send the held command again as a fresh one.
+    if(dataPacket->has_telemetry && (dataPacket->telemetry.flags & TELEMETRY_COMMAND_EXPIRED))
+    {
+        stats.commands_expired++;
+        resync_due = 1;
+    }
+    return 0;
+}
+
+/**
+ * Wait for the ACK of a command just sent. With FEC the command is only
+ * tracked as pending, so the next command or keepalive follows without delay.
+ * @param opts Option struct with transport information.
+ * @param bytes Serialized command, the command buffer retransmitted from with FEC.
+ * @param size Size of the serialized command.
+ * @param seq Sequence flag of the command.
+ * @param preemptible Non-zero for motion commands, which a stop may cut short.
+ */
+static void await_ack(struct options opts, uint8_t *bytes, size_t size, int seq, int preemptible)
+{
+    if(!opts.fec_depth)
+    {
+        TRACE_BEGIN(span);
+        read_bytes(opts.fd_in, bytes, size, opts.server_addr, seq, preemptible);
+        TRACE_END(span, "read_bytes");
+        return;
+    }
+
+    pending.bytes = bytes;
+    pending.size = size;
+    pending.sequence = seq;
+    pending.active = 1;
+    timer_wheel_add(&timers.wheel, &timers.retransmit, timer_wheel_clock_ms() + retransmit_timeout_ms);
+}
+
+/**
+ * Give a motion command the next id and add it to the FEC history.
+ * @param dataPacket Command about to be serialized.
+ */
+static void record_command(struct data_packet *dataPacket)
+{
+    struct fec_entry entry;
+
+    dataPacket->command_id = ++stats.last_command_id;
+    dataPacket->stop_generation = stats.stop_generation;
+    stats.commands_sent++;
+
+    // The entry goes out with this packet too, so a keepalive right after it can rebuild it.
+    entry.command_id = dataPacket->command_id;
+    entry.sequence_flag = (uint8_t)dataPacket->sequence_flag;
+    entry.clockwise = (uint8_t)dataPacket->clockwise;
+    entry.counter_clockwise = (uint8_t)dataPacket->counter_clockwise;
+    fec_history_push(&history, &entry);
+    save_session();
+}
+
+/**
+ * Send a stop on the express lane and retransmit it quickly until car_motors
+ * ACKs its generation. car_motors only ACKs once the motors are off, so the
+ * round trip is the stop latency seen from the controller.
+ * @param opts Option struct with the express lane socket.
+ * @param bytes Serialized stop.
+ * @param size Size of the serialized stop.
+ * @param generation Stop generation the ACK must echo.
+ */
+static void send_express_stop(struct options opts, uint8_t *bytes, size_t size, uint32_t generation)
+{
+    int64_t sent = monotonic_us();
+    int retransmits = 0;
+    TRACE_BEGIN(span);
+
+    fleet_arm(&fleet, FLEET_STOP, input_now_ns());
+    write_bytes(opts.fd_stop, bytes, size, opts.stop_addr);
+    timer_wheel_add(&timers.wheel, &timers.stop_retransmit, timer_wheel_clock_ms() + STOP_RETRANSMIT_MS);
+
+    while(running)
+    {
+        struct data_packet dataPacket;
+        int ready = wait_readable(opts.fd_stop, timer_wheel_timeout_ms(&timers.wheel, timer_wheel_clock_ms()));
+
+        timer_wheel_advance(&timers.wheel, timer_wheel_clock_ms());
+
+        if(timers.stop_retransmit_due)
+        {
+            timers.stop_retransmit_due = 0;
+            // Past this the motor pulse on car_motors stops the car by itself.
+            if(retransmits == STOP_MAX_RETRANSMITS)
+            {
+                printf("Stop %u not acknowledged\n", generation);
+                break;
+            }
+            retransmits++;
+            stats.stop_retransmissions++;
+            TRACE_INSTANT("stop_retransmit");
+            retransmit(opts.fd_stop, bytes, size, opts.stop_addr, FLEET_STOP);
+            timer_wheel_add(&timers.wheel, &timers.stop_retransmit, timer_wheel_clock_ms() + STOP_RETRANSMIT_MS);
+        }
+
+        // A new press supersedes the stop: the command carries this generation,
+        // so car_motors still drops anything older if the stop itself was lost.
+        if(timers.command_due && !buttons_released())
+        {
+            printf("Stop %u preempted by a new command\n", generation);
+            break;
+        }
+
+        if(!ready)
+        {
+            continue;
+        }
+
+        if(receive_packet(opts.fd_stop, FLEET_STOP, &dataPacket) == 0 && dataPacket.ack_flag && dataPacket.stop_generation == generation &&
+           ack_complete(&dataPacket, FLEET_STOP))
+        {
+            int64_t rtt = monotonic_us() - sent;
+
+            stats.stops_acked++;
+            stats.stop_rtt_total_us += rtt;
+            if(rtt > stats.stop_rtt_max_us)
+            {
+                stats.stop_rtt_max_us = rtt;
+            }
+            printf("Stop %u acknowledged in %lld us\n", generation, (long long)rtt);
+            break;
+        }
+    }
+
+    timer_wheel_cancel(&timers.wheel, &timers.stop_retransmit);
+    TRACE_END(span, "send_express_stop");
+}
+
+/**
+ * Check whether the buttons currently ask for the motors to be off.
+ * @return 1 if the debounced state is released.
+ */
+static int buttons_released(void)
+{
+    struct input_snapshot snapshot;
+
+    input_sampler_read(&input, &snapshot);
+    return snapshot.command == COMMAND_STOP;
+}
+
+/**
+ * Monotonic clock in microseconds, for latency measurements.
+ * @return Current time.
+ */
+static int64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+/**
+ * Open the express lane socket used for stops only. It is bound next to the
+ * command socket, given a higher queueing priority on this host and marked
+ * DSCP EF so routers along the way forward it ahead of bulk traffic.
+ * @param opts Option struct, fd_stop is set on success.
+ * @return 0 on success, -1 on failure.
+ */
+static int open_stop_socket(struct options *opts)
+{
+    struct sockaddr_in addr;
+    int priority = STOP_SOCKET_PRIORITY;
+    int tos = STOP_IP_TOS;
+
+    opts->fd_stop = socket(AF_INET, SOCK_DGRAM, 0);
+    if(opts->fd_stop == -1)
+    {
+        return -1;
+    }
+
+    // Marking is best effort, a stop still goes out unmarked.
+    if(setsockopt(opts->fd_stop, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority)) == -1)
+    {
+        perror("setsockopt SO_PRIORITY");
+    }
+    if(setsockopt(opts->fd_stop, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) == -1)
+    {
+        perror("setsockopt IP_TOS");
+    }
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(DEFAULT_STOP_PORT);
+    addr.sin_addr.s_addr = inet_addr(opts->ip_client);
+
+    clock_sync_enable_timestamps(opts->fd_stop);
+
+    return bind(opts->fd_stop, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
+}
+
+/**
+ * Copy the counters a restart must carry on from into the session state,
+ * before the packet using them is sent.
+ */
+static void save_session(void)
+{
+    session.state->command_id = stats.last_command_id;
+    session.state->stop_generation = stats.stop_generation;
+}
+
+/**
+ * Check an ACK belongs to this session and follow car_motors restarts. A new
+ * car_motors epoch means its process started again and no longer drives the
+ * command held here, so that command is sent again on the next tick.
+ * @param dataPacket ACK just received.
+ * @param peer Epochs of the car that sent it, updated.
+ * @return 0 if the ACK may be used, 1 if it may and started following a new
+ * car_motors session, -1 if it was meant for an earlier car_controller or
+ * came from a car_motors since replaced.
+ */
+static int accept_session(const struct data_packet *dataPacket, struct session_peer *peer)
+{
+    if(dataPacket->peer_epoch != session.state->epoch)
+    {
+        printf("Dropped ACK from an earlier session\n");
+        return -1;
+    }
+
+    if(dataPacket->session_epoch != peer->epoch)
+    {
+        if(session_peer_retired(peer, dataPacket->session_epoch))
+        {
+            return -1;
+        }
+        if(peer->epoch)
+        {
+            printf("car_motors restarted, resyncing\n");
+            resync_due = 1;
+        }
+        session_peer_follow(peer, dataPacket->session_epoch);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Send to a multicast group instead of one car. Both lanes are addressed to
+ * the group and go out on the interface of the car_controller IP; the cars
+ * listed with -o make up the fleet, whose ACKs are tracked one by one.
+ * @param opts Option struct, its send addresses are replaced by the group.
+ * @return 0 on success, -1 on failure.
+ */
+static int join_group(struct options *opts)
+{
+    struct in_addr interface;
+
+    interface.s_addr = inet_addr(opts->ip_client);
+    if(setsockopt(opts->fd_in, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) == -1 ||
+       setsockopt(opts->fd_stop, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) == -1)
+    {
+        perror("setsockopt IP_MULTICAST_IF");
+        return -1;
+    }
+
+    for(size_t i = 0; i < opts->receiver_count; i++)
+    {
+        if(fleet_add(&fleet, opts->receivers[i], opts->port_receiver, DEFAULT_STOP_PORT, &auth) == -1)
+        {
+            return -1;
+        }
+    }
+
+    opts->server_addr.sin_addr.s_addr = inet_addr(opts->group);
+    opts->stop_addr.sin_addr.s_addr = opts->server_addr.sin_addr.s_addr;
+    return 0;
+}
+
+/**
+ * Send a packet that is still missing ACKs again. In group mode only the cars
+ * that have not ACKed it get it, unicast, so one lost copy does not make the
+ * whole group process it twice. Each copy names the car_motors epoch known
+ * now, which may have been learned since it was first sent.
+ * @param fd Socket FD.
+ * @param bytes Serialized packet, with room for the MAC trailer.
+ * @param size Size of the serialized packet, without the trailer.
+ * @param addr Address it was first sent to.
+ * @param lane Lane it was sent on.
+ */
+static void retransmit(int fd, uint8_t *bytes, size_t size, struct sockaddr_in addr, enum fleet_lane lane)
+{
+    if(!fleet.count)
+    {
+        session_epoch_encode(session.state->peer.epoch, &bytes[SESSION_EPOCH_OFFSET + SESSION_EPOCH_SIZE]);
+        write_bytes(fd, bytes, size, addr);
+        return;
+    }
+
+    for(size_t i = 0; i < fleet.count; i++)
+    {
+        struct fleet_car *car = &fleet.cars[i];
+
+        if(!car->acked[lane])
+        {
+            car->retransmissions++;
+            session_epoch_encode(car->peer.epoch, &bytes[SESSION_EPOCH_OFFSET + SESSION_EPOCH_SIZE]);
+            write_bytes(fd, bytes, size, car->addr[lane]);
+        }
+    }
+}
+
+/**
+ * Check whether an ACK settles the packet in flight on its lane. Without a
+ * group one ACK does; in group mode it takes one from every car.
+ * @param dataPacket ACK accepted by receive_packet.
+ * @param lane Lane the ACK answers.
+ * @return 1 once nothing is outstanding.
+ */
+static int ack_complete(const struct data_packet *dataPacket, enum fleet_lane lane)
+{
+    struct fleet_car *car;
+
+    if(!fleet.count)
+    {
+        return 1;
+    }
+
+    car = fleet_find(&fleet, &dataPacket->from);
+    if(car)
+    {
+        fleet_ack(&fleet, lane, car, input_now_ns());
+    }
+    return fleet_complete(&fleet, lane);
+}
+
+/**
+ * Buffer the next packet is serialized into. With shared memory that is the
+ * free ring slot itself, so the packet is never copied on its way out.
+ * @param buffer Loop-owned buffer used with UDP, or when the ring is full.
+ * @return Where to serialize.
+ */
+static uint8_t *serialize_target(uint8_t *buffer)
+{
+    uint8_t *slot;
+
+    if(!shm.channel)
+    {
+        return buffer;
+    }
+    slot = shm_ring_reserve(shm.tx);
+    return slot ? slot : buffer;
+}
+
+/**
+ * Keep a command that was serialized into a ring slot in the command buffer,
+ * which retransmissions and the FEC pending slot send from. The copy is taken
+ * once the slot is published, off the path to car_motors; the slot is not
+ * written again until the ring wraps.
+ * @param bytes Serialized command.
+ * @param size Its size, without the MAC trailer.
+ */
+static void retain_command(const uint8_t *bytes, size_t size)
+{
+    if(bytes != buffers.command)
+    {
+        memcpy(buffers.command, bytes, size);
+    }
 }
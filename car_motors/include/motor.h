@@ -1,6 +1,8 @@
 #ifndef UDP_SERVER_MOTOR_H
 #define UDP_SERVER_MOTOR_H
 
+#include <stdint.h>
+
 #define RightMotorPin1       0
 #define RightMotorPin2       2
 #define RightMotorEnable     3
@@ -9,8 +11,15 @@
 #define LeftMotorPin2        4
 #define LeftMotorEnable      5
 
+// Direction the motors were last driven in.
+#define MOTOR_OFF                0
+#define MOTOR_CLOCKWISE          1
+#define MOTOR_COUNTER_CLOCKWISE  2
+
 void *moveMotorRight(void *vargp);
 void *moveMotorLeft(void *vargp);
 void *stopMotor(void *vargp);
+int motorState(void);
+int64_t motorChangedNs(void);
 
 #endif //UDP_SERVER_MOTOR_H
@@ -0,0 +1,75 @@
+#ifndef UDP_SERVER_SCRIPT_H
+#define UDP_SERVER_SCRIPT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCRIPT_MAX_STEPS 32
+// Longest hold a step may ask for, one hour. Longer scripts are rejected.
+#define SCRIPT_MAX_STEP_MS (60L * 60L * 1000L)
+
+// Motor actions a script step can request.
+enum script_command {
+    SCRIPT_STOP,
+    SCRIPT_CLOCKWISE,
+    SCRIPT_COUNTER_CLOCKWISE
+};
+
+// A single timed step: actuate, then hold for duration_ms.
+struct script_step {
+    enum script_command command;
+    long duration_ms;
+};
+
+// A parsed command script, e.g. "C800,A300,S".
+struct script {
+    struct script_step steps[SCRIPT_MAX_STEPS];
+    size_t count;
+};
+
+// Timing accuracy of executed steps, measured against the executor clock.
+struct script_stats {
+    uint64_t steps_run;
+    uint64_t scripts_completed;
+    uint64_t scripts_cancelled;
+    int64_t lateness_max_ns;
+    int64_t lateness_total_ns;
+};
+
+// Time source used by the executor. Returns nanoseconds on a monotonic scale.
+typedef int64_t (*script_clock_fn)(void *ctx);
+// Called for every step the executor fires.
+typedef void (*script_actuate_fn)(enum script_command command, void *ctx);
+
+/**
+ * Executes a script locally on a precise timer. The executor itself is
+ * clock-agnostic: script_executor_step() is driven with the current time and
+ * reports the next deadline, so the same logic runs against a real or a
+ * simulated clock.
+ */
+struct script_executor {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct script current;
+    size_t next_step;
+    int active;
+    int64_t next_deadline_ns;
+    script_clock_fn clock;
+    script_actuate_fn actuate;
+    void *ctx;
+    struct script_stats stats;
+};
+
+int script_parse(const char *text, struct script *script);
+void script_executor_init(struct script_executor *executor, script_clock_fn clock, script_actuate_fn actuate, void *ctx);
+void script_executor_destroy(struct script_executor *executor);
+void script_executor_start(struct script_executor *executor, const struct script *script);
+int script_executor_cancel(struct script_executor *executor);
+size_t script_executor_pending(struct script_executor *executor);
+int64_t script_executor_step(struct script_executor *executor, int64_t now_ns);
+void *script_executor_run(void *vargp);
+void script_executor_report(struct script_executor *executor);
+int64_t script_monotonic_ns(void *ctx);
+
+#endif //UDP_SERVER_SCRIPT_H
@@ -0,0 +1,73 @@
+#ifndef CAR_MOTORS_XDP_TRANSPORT_H
+#define CAR_MOTORS_XDP_TRANSPORT_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define XDP_FRAME_SIZE 2048
+#define XDP_RX_FRAMES 1024
+#define XDP_TX_FRAMES 256
+#define XDP_ETH_ALEN 6
+
+// One of the four rings shared with the kernel, mapped from the AF_XDP socket.
+struct xdp_ring {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *desc;
+    uint32_t mask;
+    void *map;
+    size_t map_size;
+};
+
+/**
+ * AF_XDP receive and transmit path for the command port, built on the kernel
+ * UAPI alone. A small XDP program steers IPv4 UDP to the command port into
+ * the socket; everything else, and commands arriving on another queue, goes
+ * up the kernel stack to the regular sockets as before.
+ *
+ * The UMEM is split between receive frames, which live on the fill ring
+ * whenever they are not being processed, and transmit frames for the ACKs.
+ * A received payload is processed in place in its frame, like a shared memory
+ * slot, and the frame is only given back once it was deserialized. An ACK
+ * always answers the frame just received, so it is sent back to its source
+ * MAC without any neighbour lookup.
+ */
+struct xdp_transport {
+    int active;
+    int fd;
+    int map_fd;
+    int prog_fd;
+    int link_fd;
+    int native;                         // XDP program runs in the driver, not the generic hook.
+    int zero_copy;
+    uint8_t *umem;
+    struct xdp_ring fill;
+    struct xdp_ring completion;
+    struct xdp_ring rx;
+    struct xdp_ring tx;
+    uint64_t tx_free[XDP_TX_FRAMES];
+    size_t tx_free_count;
+    uint64_t held;                      // frame being processed, back on the fill ring once released.
+    int holding;
+    uint8_t local_mac[XDP_ETH_ALEN];
+    uint8_t peer_mac[XDP_ETH_ALEN];     // source of the frame last received.
+    in_addr_t local_ip;
+    in_port_t port;                     // host order.
+    uint16_t ip_id;
+    uint64_t rx_packets;
+    uint64_t rx_malformed;
+    uint64_t tx_packets;
+    uint64_t tx_dropped;
+};
+
+int xdp_transport_open(struct xdp_transport *xdp, const char *ifname, uint32_t queue, in_addr_t local_ip, in_port_t port);
+void xdp_transport_close(struct xdp_transport *xdp);
+uint8_t *xdp_transport_peek(struct xdp_transport *xdp, size_t *size, struct sockaddr_in *from);
+void xdp_transport_release(struct xdp_transport *xdp);
+int xdp_transport_send(struct xdp_transport *xdp, const uint8_t *bytes, size_t size, const struct sockaddr_in *to);
+size_t xdp_transport_depth(const struct xdp_transport *xdp);
+void xdp_transport_report(const struct xdp_transport *xdp);
+
+#endif //CAR_MOTORS_XDP_TRANSPORT_H
@@ -1,18 +1,59 @@
+// SO_PRIORITY is not part of POSIX.
+#define _DEFAULT_SOURCE // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+#include "clock_sync.h"
+#include "deadline.h"
+#include "fec.h"
 #include "motor.h"
+#include "packet_auth.h"
+#include "script.h"
+#include "session.h"
+#include "shm_ring.h"
+#include "telemetry.h"
+#include "timer_wheel.h"
+#include "trace.h"
+#include "xdp_transport.h"
 #include <arpa/inet.h>
 #include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/sock_diag.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <wiringPi.h>
 #include <pthread.h>
 
 #define BUF_LEN 1024
 #define DEFAULT_PORT 5020
+// Stops arrive on their own socket, polled ahead of the command socket.
+#define DEFAULT_STOP_PORT 5021
+#define STOP_SOCKET_PRIORITY 6
+#define STOP_IP_TOS 0xB8
+#define READY_COMMAND 1
+#define READY_STOP 2
+#define READY_GROUP 4
+#define READY_STOP_GROUP 8
+#define READY_XDP 16
+// Header bytes before the epochs: six flags, the command id and the stop generation.
+#define SESSION_EPOCH_OFFSET (6 * sizeof(int) + 2 * sizeof(uint32_t))
+// Header bytes before the clock stamps: the above and both epochs.
+#define CLOCK_STAMPS_OFFSET (SESSION_EPOCH_OFFSET + 2 * SESSION_EPOCH_SIZE)
+// Fixed part every packet starts with: header, stamps and the deadline. Anything shorter is dropped unread.
+#define PACKET_HEADER_SIZE (CLOCK_STAMPS_OFFSET + CLOCK_STAMPS_SIZE + DEADLINE_SIZE)
+// Largest command: the fixed part, a full FEC history, the longest script and the MAC.
+#define PACKET_CAPACITY (PACKET_HEADER_SIZE + 1 + FEC_MAX_DEPTH * FEC_ENTRY_SIZE + BUF_LEN + PACKET_AUTH_TRAILER_SIZE)
+// An ACK: header, stamps, an empty deadline and FEC history, the telemetry report and the MAC.
+#define ACK_CAPACITY (CLOCK_STAMPS_OFFSET + CLOCK_STAMPS_SIZE + DEADLINE_SIZE + 1 + TELEMETRY_SIZE + PACKET_AUTH_TRAILER_SIZE)
+// Motors stop if a live command is not refreshed by a command or keepalive within this time.
+#define MOTOR_PULSE_MS 500
+#define NSEC_PER_USEC 1000
 
 // cmake -DCMAKE_C_COMPILER="clang" -S . -B build
 // cmake --build build
@@ -20,8 +61,15 @@
 struct options
 {
     char *ip_server;
+    char *shm_name; // shared memory transport instead of UDP.
+    char *state_path; // session state kept across restarts.
+    char *group; // multicast group joined besides the unicast address.
+    char *xdp_ifname; // interface commands are received on over AF_XDP, NULL for sockets only.
     in_port_t server_port;
     int fd_in;
+    int fd_stop; // express lane for stops, -1 with shared memory.
+    int fd_group; // commands sent to the group, -1 without one.
+    int fd_stop_group; // stops sent to the group, -1 without one.
 };
 
 struct server_information
@@ -29,8 +77,24 @@ struct server_information
     char * struct_message_data;
     ssize_t bytes_read_from_socket;
     struct sockaddr from_addr;
-    char * previous_message;
+    char previous_message[BUF_LEN];
     int previous_sequence_number;
+    uint32_t last_command_id;
+    uint64_t fec_recovered;
+    uint32_t stop_generation; // latest stop applied, older commands are stale.
+    uint64_t stops_applied;
+    uint64_t stale_dropped;
+    int64_t stop_latency_total_ns;
+    int64_t stop_latency_max_ns;
+    int64_t received_ns; // receive stamp of the packet read, kernel time where available.
+    uint32_t packets_acknowledged;
+    int64_t loop_total_ns; // busy loop iterations since the last ACK, for its telemetry.
+    int64_t loop_max_ns;
+    uint32_t loop_count;
+    int command_expired; // a command was dropped past its deadline since the last ACK.
+    uint64_t expired_stops; // motors stopped instead of applying an expired command.
+    char message_buffer[PACKET_CAPACITY]; // owns the bytes struct_message_data points at for UDP.
+    uint8_t ack_buffer[ACK_CAPACITY]; // every ACK is serialized here, so replying never allocates.
 };
 
 struct data_packet {
@@ -39,34 +103,89 @@ struct data_packet {
     int sequence_flag;
     int clockwise;
     int counter_clockwise;
-    char *data;
+    int script_flag;
+    uint32_t command_id;
+    uint32_t stop_generation;
+    uint64_t session_epoch; // epoch of the sender.
+    uint64_t peer_epoch; // epoch the sender last saw from the other side.
+    struct clock_stamps stamps;
+    struct deadline deadline; // when the command was issued and how long it stays current.
+    size_t fec_count;
+    struct fec_entry fec[FEC_MAX_DEPTH];
+    struct telemetry telemetry; // sent in place of data on ACKs.
+    char data[BUF_LEN];
 };
 
 static volatile sig_atomic_t running;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
-static struct data_packet *dp_deserialize(ssize_t nRead, char * data_buffer);
+static struct script_executor executor;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct timer_wheel wheel;         // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct timer_entry pulse_timer;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct shm_transport shm;         // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct xdp_transport xdp;         // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct packet_auth auth;          // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct packet_auth stop_auth;     // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct clock_sync peer_clock;     // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct deadline_tracker deadlines; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct latency_stat processing;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct session session;           // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int64_t started_ns;               // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int dp_deserialize(ssize_t nRead, const char * data_buffer, struct data_packet *x);
 static void read_bytes(int fd, struct server_information *serverInformation);
-static void send_ack_packet(const struct data_packet * dataPacket, struct sockaddr * from_addr, int fd);
+static void send_ack_packet(const struct data_packet * dataPacket, struct sockaddr * from_addr, int fd, struct server_information * serverInformation);
 static void options_init(struct options *opts, struct server_information *serverInformation);
 static void parse_arguments(int argc, char *argv[], struct options *opts);
 static void options_process(struct options *opts);
 static void cleanup(const struct options *opts, struct server_information *serverInformation);
 static void process_packet(const struct data_packet * dataPacket, struct server_information * serverInformation);
-static uint8_t *dp_serialize(const struct data_packet *ackPacket, size_t *size);
-static void write_bytes(int fd, const uint8_t *bytes, size_t size, struct sockaddr_in server_addr);
+static size_t dp_serialize(const struct data_packet *ackPacket, uint8_t *bytes);
+static void write_bytes(int fd, uint8_t *bytes, size_t size, struct sockaddr_in server_addr, int answers);
 static void options_process_close(int result_number);
+static void script_actuate(enum script_command command, void *ctx);
+static void signal_handler(int sig);
+static int wait_for_packet(const struct options *opts);
+static void pulse_expired(struct timer_entry *timer, void *arg);
+static int authenticate_packet(struct server_information *serverInformation, int fd_reply, int group);
+static int open_packet(struct packet_auth *lane_auth, const uint8_t *bytes, size_t size, int group, uint64_t *epoch, size_t *payload_size);
+static void actuate(int clockwise, int counter_clockwise);
+static void recover_lost_commands(const struct data_packet * dataPacket, struct server_information * serverInformation, int *expired);
+static int command_expired(const struct data_packet * dataPacket, int *expired);
+static void expire_command(uint32_t command_id, struct server_information * serverInformation);
+static void serve_stop_lane(int fd, int fd_reply, struct server_information * serverInformation);
+static int is_stop(const struct data_packet * dataPacket);
+static void apply_stop(const struct data_packet * dataPacket, struct server_information * serverInformation, int64_t received_ns);
+static int open_stop_socket(struct options *opts);
+static int open_group_socket(const struct options *opts, in_port_t port);
+static void restore_session(struct server_information * serverInformation);
+static void save_session(const struct server_information * serverInformation);
+static void announce_session(const struct options * opts, struct server_information * serverInformation);
+static void send_announcement(int fd, uint64_t controller_epoch, struct sockaddr_in to_addr, struct server_information * serverInformation);
+static int sync_session(const struct data_packet * dataPacket, struct server_information * serverInformation);
+static void collect_telemetry(int fd, struct server_information * serverInformation, struct telemetry * telemetry);
+static uint32_t rx_queue_bytes(int fd);
+static void record_loop_time(struct server_information * serverInformation, int64_t busy_since_ns);
+static void release_message(struct server_information * serverInformation);
+static uint8_t *serialize_target(uint8_t *buffer);
 
 int main(int argc, char *argv[])
 {
     struct options opts;
     struct server_information serverInformation;
-    struct data_packet *dataPacket;
-
+    struct data_packet dataPacket; // reused for every packet the loop reads.
+    pthread_t script_thread;
+    int ready;
+    int fd_read;
+    int64_t busy_since_ns = 0;
+    struct sigaction sa;
+
+    // Restart to first actuation is reported from here.
+    started_ns = script_monotonic_ns(NULL);
     options_init(&opts, &serverInformation);
     parse_arguments(argc, argv, &opts);
     options_process(&opts);
+    restore_session(&serverInformation);
 
-    // If car_motors IP is given, run loop to listen to self.
-    if(opts.ip_server)
+    // If car_motors IP or a shared memory channel is given, run loop to listen to self.
+    if(opts.ip_server || opts.shm_name)
     {
         if (wiringPiSetup() == -1) {
             printf("WiringPi failed \n");
@@ -83,15 +202,76 @@ int main(int argc, char *argv[])
         pinMode(LeftMotorEnable, OUTPUT);
 
 
+        // Timed scripts run on their own thread so the socket keeps being serviced.
+        script_executor_init(&executor, script_monotonic_ns, script_actuate, NULL);
+        pthread_create(&script_thread, NULL, script_executor_run, &executor);
+        pthread_detach(script_thread);
+
+        memset(&sa, 0, sizeof(sa)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        sa.sa_handler = signal_handler;
+        sigaction(SIGINT, &sa, NULL);
+
+        timer_wheel_init(&wheel, timer_wheel_clock_ms());
+        timer_init(&pulse_timer, pulse_expired, NULL);
+        clock_sync_init(&peer_clock);
+        deadline_tracker_init(&deadlines);
+
         running = 1;
+        announce_session(&opts, &serverInformation);
 
         // Continues loop to keep listening to self.
         while(running)
         {
-            read_bytes(opts.fd_in, &serverInformation);
-            dataPacket = dp_deserialize(serverInformation.bytes_read_from_socket, serverInformation.struct_message_data);
-            process_packet(dataPacket, &serverInformation);
-            send_ack_packet(dataPacket, &serverInformation.from_addr, opts.fd_in);
+            record_loop_time(&serverInformation, busy_since_ns);
+            ready = wait_for_packet(&opts);
+            busy_since_ns = ready ? script_monotonic_ns(NULL) : 0;
+
+            // Stops are served before anything queued on the command socket.
+            if(ready & (READY_STOP | READY_STOP_GROUP))
+            {
+                TRACE_BEGIN(stop_span);
+                // ACKs always leave from the unicast sockets, their source tells car_controller which car this is.
+                serve_stop_lane((ready & READY_STOP) ? opts.fd_stop : opts.fd_stop_group, opts.fd_stop, &serverInformation);
+                TRACE_END(stop_span, "serve_stop_lane");
+            }
+            if(!(ready & (READY_COMMAND | READY_GROUP | READY_XDP)))
+            {
+                continue;
+            }
+            // The AF_XDP ring goes first, the sockets only see what its program passed on.
+            fd_read = (ready & READY_COMMAND) ? opts.fd_in : opts.fd_group;
+            if(ready & READY_XDP)
+            {
+                fd_read = xdp.fd;
+            }
+            TRACE_BEGIN(read_span);
+            read_bytes(fd_read, &serverInformation);
+            TRACE_END(read_span, "read_bytes");
+            if(serverInformation.bytes_read_from_socket <= 0)
+            {
+                continue;
+            }
+
+            // Nothing is actuated or acknowledged unless it carries a valid MAC.
+            if(!authenticate_packet(&serverInformation, (ready & READY_XDP) ? xdp.fd : opts.fd_in, fd_read == opts.fd_group))
+            {
+                continue;
+            }
+
+            if(dp_deserialize(serverInformation.bytes_read_from_socket, serverInformation.struct_message_data, &dataPacket) == -1)
+            {
+                release_message(&serverInformation);
+                continue;
+            }
+            // Deserialized in place, a shared slot or UMEM frame can go back.
+            release_message(&serverInformation);
+            clock_sync_receive(&peer_clock, &dataPacket.stamps, serverInformation.received_ns);
+            deadline_tracker_observe(&deadlines, dataPacket.stamps.transmit, serverInformation.received_ns);
+            TRACE_BEGIN(process_span);
+            process_packet(&dataPacket, &serverInformation);
+            TRACE_END(process_span, "process_packet");
+            save_session(&serverInformation);
+            send_ack_packet(&dataPacket, &serverInformation.from_addr, (ready & READY_XDP) ? xdp.fd : opts.fd_in, &serverInformation);
         }
     }
     cleanup(&opts, &serverInformation);
@@ -104,52 +284,197 @@ int main(int argc, char *argv[])
  * @param serverInformation Pointer to struct for car_motors side information.
  */
 static void process_packet(const struct data_packet * dataPacket, struct server_information * serverInformation) {
-    pthread_t thread_id;
+    int expired = -1; // not checked until something would be actuated.
+
     printf("Processing packet \n");
 
+    if (!dataPacket->ack_flag) {
+        if (!sync_session(dataPacket, serverInformation)) {
+            return;
+        }
+
+        // Anything sent before the latest stop was overtaken by it.
+        if (dataPacket->stop_generation < serverInformation->stop_generation) {
+            serverInformation->stale_dropped++;
+            printf("Dropped command %u sent before stop %u\n", dataPacket->command_id, serverInformation->stop_generation);
+            return;
+        }
+
+        if (is_stop(dataPacket)) {
+            apply_stop(dataPacket, serverInformation, script_monotonic_ns(NULL));
+            return;
+        }
+
+        // Any current packet from the controller, keepalives included, extends a running pulse.
+        // Late packets of an earlier epoch or stop were dropped above and must not keep the motors on.
+        if (pulse_timer.pending) {
+            timer_wheel_add(&wheel, &pulse_timer, timer_wheel_clock_ms() + MOTOR_PULSE_MS);
+        }
+
+        // The first command after a stop whose packet never came is new whatever its sequence.
+        if (dataPacket->stop_generation > serverInformation->stop_generation) {
+            serverInformation->stop_generation = dataPacket->stop_generation;
+            serverInformation->previous_sequence_number = !dataPacket->sequence_flag;
+        }
+    }
+
+    // Rebuild commands lost before this one from the history it carries.
+    if (!dataPacket->ack_flag) {
+        recover_lost_commands(dataPacket, serverInformation, &expired);
+    }
+
     // Confirm it is a new packet to be processed before processing.
     if (dataPacket->data_flag && !dataPacket->ack_flag) {
         if (serverInformation->previous_sequence_number != dataPacket->sequence_flag) {
             // Update car_motors side information.
             serverInformation->previous_sequence_number = dataPacket->sequence_flag;
-            serverInformation->previous_message = malloc(strlen(dataPacket->data));
-
+            if (dataPacket->command_id > serverInformation->last_command_id) {
+                serverInformation->last_command_id = dataPacket->command_id;
+            }
             // Update previous message sent by the other machine.
-            memmove(serverInformation->previous_message, dataPacket->data, strlen(dataPacket->data));
+            memcpy(serverInformation->previous_message, dataPacket->data, strlen(dataPacket->data) + 1);
 
-
-            // Create
-            if (dataPacket->clockwise == 1 && dataPacket->counter_clockwise == 0) {
-                pthread_create(&thread_id, NULL, moveMotorRight, NULL);
-                pthread_join(thread_id, NULL);
+            if (command_expired(dataPacket, &expired)) {
+                expire_command(dataPacket->command_id, serverInformation);
+                return;
             }
 
-            if (dataPacket->counter_clockwise && dataPacket->clockwise == 0) {
-                pthread_create(&thread_id, NULL, moveMotorLeft, NULL);
-                pthread_join(thread_id, NULL);
-            }
-            if (dataPacket->clockwise == 0 && dataPacket->counter_clockwise == 0) {
-                pthread_create(&thread_id, NULL, stopMotor, NULL);
-                pthread_join(thread_id, NULL);
+            // A script is executed locally on the executor's timer.
+            if (dataPacket->script_flag) {
+                struct script script;
+
+                if (script_parse(dataPacket->data, &script) == -1) {
+                    printf("Invalid script: %s\n", dataPacket->data);
+                    return;
+                }
+                printf("Running script: %s\n", dataPacket->data);
+                timer_wheel_cancel(&wheel, &pulse_timer);
+                script_executor_start(&executor, &script);
+                return;
             }
 
+            actuate(dataPacket->clockwise, dataPacket->counter_clockwise);
+        }
+    }
+
+}
+
+/**
+ * Drive the motors for a live command.
+ * @param clockwise Clockwise flag of the command.
+ * @param counter_clockwise Counter clockwise flag of the command.
+ */
+static void actuate(int clockwise, int counter_clockwise) {
+    TRACE_BEGIN(span);
+
+    // A live command always preempts a running script.
+    if (script_executor_cancel(&executor)) {
+        printf("Script preempted by live command\n");
+    }
+
+    // Driven inline, a thread created and joined per command only added a clone and a stack.
+    if (clockwise == 1 && counter_clockwise == 0) {
+        moveMotorRight(NULL);
+        timer_wheel_add(&wheel, &pulse_timer, timer_wheel_clock_ms() + MOTOR_PULSE_MS);
+    }
+
+    if (counter_clockwise && clockwise == 0) {
+        moveMotorLeft(NULL);
+        timer_wheel_add(&wheel, &pulse_timer, timer_wheel_clock_ms() + MOTOR_PULSE_MS);
+    }
+    if (clockwise == 0 && counter_clockwise == 0) {
+        stopMotor(NULL);
+        timer_wheel_cancel(&wheel, &pulse_timer);
+    }
+    if (started_ns) {
+        printf("First actuation %lld us after start\n", (long long)((script_monotonic_ns(NULL) - started_ns) / 1000)); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+        started_ns = 0;
+    }
+    TRACE_END(span, "actuate");
+}
+
+/**
+ * Apply commands from the FEC history that never arrived on their own. A
+ * command packet covers the ids before it, a keepalive covers its own id too.
+ * @param dataPacket Packet carrying the history.
+ * @param serverInformation Pointer to struct for car_motors side information.
+ * @param expired Deadline check of the packet, shared with its own command. The history is as stale as the packet.
+ */
+static void recover_lost_commands(const struct data_packet * dataPacket, struct server_information * serverInformation, int *expired) {
+    const struct fec_entry *latest = NULL;
+    uint32_t limit = dataPacket->data_flag ? dataPacket->command_id : dataPacket->command_id + 1;
+
+    for (size_t i = 0; i < dataPacket->fec_count; i++) {
+        const struct fec_entry *entry = &dataPacket->fec[i];
+
+        if (entry->command_id > serverInformation->last_command_id && entry->command_id < limit) {
+            serverInformation->last_command_id = entry->command_id;
+            serverInformation->previous_sequence_number = entry->sequence_flag;
+            serverInformation->fec_recovered++;
+            latest = entry;
         }
     }
 
+    // Only the newest rebuilt command matters for the motors.
+    if (latest && command_expired(dataPacket, expired)) {
+        expire_command(latest->command_id, serverInformation);
+    }
+    else if (latest) {
+        printf("Recovered command %u from FEC\n", latest->command_id);
+        actuate(latest->clockwise, latest->counter_clockwise);
+    }
+}
+
+/**
+ * Check a packet against its deadline just before the first command it
+ * carries would be actuated, so time spent queued here counts too. The
+ * result is kept for the rest of the packet.
+ * @param dataPacket Packet carrying the deadline.
+ * @param expired -1 until checked, then the result.
+ * @return 1 if the packet is past its deadline.
+ */
+static int command_expired(const struct data_packet * dataPacket, int *expired) {
+    if (*expired == -1) {
+        *expired = deadline_tracker_expired(&deadlines, &peer_clock, &dataPacket->deadline, clock_sync_now_ns());
+    }
+    return *expired;
 }
 
 /**
- * Send ACK to other machine to confirm their data packet was delivered.
+ * Drop a command that missed its deadline. Whatever the motors were doing was
+ * superseded by it, so they are stopped rather than left on an older command,
+ * and a burst of late commands collapses into that one stop. The next ACK
+ * tells car_controller to send the held command again.
+ * @param command_id Id of the expired command.
+ * @param serverInformation Pointer to struct for car_motors side information.
+ */
+static void expire_command(uint32_t command_id, struct server_information * serverInformation) {
+    printf("Expired command %u\n", command_id);
+    serverInformation->command_expired = 1;
+
+    if (script_executor_cancel(&executor) || motorState() != MOTOR_OFF) {
+        stopMotor(NULL);
+        timer_wheel_cancel(&wheel, &pulse_timer);
+        serverInformation->expired_stops++;
+    }
+}
+
+/**
+ * Send ACK to other machine to confirm their data packet was delivered. The
+ * ACK carries a telemetry report instead of echoing the data back.
  * @param dataPacket Data packet that was received.
  * @param from_addr The car_controller's IP address.
  * @param fd Socket FD.
+ * @param serverInformation car_motors state, its ack_buffer is serialized into unless a ring slot is free.
  */
-static void send_ack_packet(const struct data_packet * dataPacket, struct sockaddr * from_addr, int fd) {
-    uint8_t * bytes;
+static void send_ack_packet(const struct data_packet * dataPacket, struct sockaddr * from_addr, int fd, struct server_information * serverInformation) {
+    uint8_t *bytes = serialize_target(serverInformation->ack_buffer);
     size_t size;
+    TRACE_BEGIN(span);
     // Send Ack back to the car_motors
     struct data_packet acknowledgement_packet;
-    memset(&acknowledgement_packet, 0, sizeof(struct data_packet)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    // The header only, ACKs carry no data.
+    memset(&acknowledgement_packet, 0, offsetof(struct data_packet, data)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
     // Construct acknowledgement packet before sending
     // Data flag set to 0
     acknowledgement_packet.data_flag = 0;
@@ -160,12 +485,14 @@ static void send_ack_packet(const struct data_packet * dataPacket, struct sockad
 
     acknowledgement_packet.clockwise = 0;
     acknowledgement_packet.counter_clockwise = 0;
+    acknowledgement_packet.command_id = dataPacket->command_id;
+    acknowledgement_packet.stop_generation = dataPacket->stop_generation;
+    acknowledgement_packet.peer_epoch = session.state->peer.epoch;
 
-    acknowledgement_packet.data = malloc(strlen(dataPacket->data));
-    acknowledgement_packet.data = dataPacket->data;
+    collect_telemetry(fd, serverInformation, &acknowledgement_packet.telemetry);
 
     // Serialize
-    bytes = dp_serialize(&acknowledgement_packet, &size);
+    size = dp_serialize(&acknowledgement_packet, bytes);
 
     // Send Ack
     struct sockaddr_in *addr_in = (struct sockaddr_in *)from_addr;
@@ -175,7 +502,8 @@ static void send_ack_packet(const struct data_packet * dataPacket, struct sockad
     to_addr.sin_addr.s_addr = inet_addr(inet_ntoa(addr_in->sin_addr));
 
     // Write to Socket FD to send packet.
-    write_bytes(fd, bytes, size, to_addr);
+    write_bytes(fd, bytes, size, to_addr, 1);
+    TRACE_END(span, "send_ack_packet");
 }
 
 /**
@@ -186,35 +514,114 @@ static void send_ack_packet(const struct data_packet * dataPacket, struct sockad
 static void read_bytes(int fd, struct server_information * serverInformation)
 {
     struct sockaddr from_addr;
-    char data[BUF_LEN];
+    char *data = serverInformation->message_buffer;
     ssize_t nRead;
     socklen_t from_addr_len;
 
+    if(shm.channel)
+    {
+        size_t size = 0;
+
+        // Zero copy: point at the shared slot, released once deserialized.
+        serverInformation->struct_message_data = (char *)shm_ring_peek(shm.rx, &size);
+        serverInformation->received_ns = clock_sync_now_ns();
+        serverInformation->bytes_read_from_socket = (ssize_t)size;
+        return;
+    }
+
+    if(xdp.active && fd == xdp.fd)
+    {
+        struct sockaddr_in from;
+        size_t size = 0;
+
+        // Zero copy as well: point at the payload in its UMEM frame.
+        serverInformation->struct_message_data = (char *)xdp_transport_peek(&xdp, &size, &from);
+        serverInformation->received_ns = clock_sync_now_ns();
+        serverInformation->bytes_read_from_socket = (ssize_t)size;
+        memcpy(&serverInformation->from_addr, &from, sizeof(from)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        return;
+    }
+
     from_addr_len = sizeof (struct sockaddr);
-    nRead = recvfrom(fd, data, BUF_LEN, 0, &from_addr, &from_addr_len);
+    nRead = clock_sync_recvfrom(fd, data, sizeof(serverInformation->message_buffer), &from_addr, &from_addr_len, &serverInformation->received_ns);
 
     if(nRead == -1)
     {
         printf("Could not read from socket");
+        serverInformation->bytes_read_from_socket = 0;
         return;
     }
     serverInformation->bytes_read_from_socket = nRead;
     serverInformation->from_addr = from_addr;
-    serverInformation->struct_message_data = malloc(strlen(data));
     serverInformation->struct_message_data = data;
 }
 
 /**
- * Write to Socket FD to send data to a different machine.
+ * Write to Socket FD to send data to a different machine. The clock stamps
+ * and MAC are written here, at the moment of sending.
  * @param fd Socket FD.
- * @param bytes buffer to send.
- * @param size Number of bytes.
+ * @param bytes buffer to send, with room for the MAC trailer.
+ * @param size Number of bytes, without the trailer.
  * @param server_addr Server address.
+ * @param answers Non-zero for an ACK of the packet just processed, whose
+ * stamps it echoes. A session announcement answers nothing and echoes none.
  */
-static void write_bytes(int fd, const uint8_t *bytes, size_t size, struct sockaddr_in server_addr)
+static void write_bytes(int fd, uint8_t *bytes, size_t size, struct sockaddr_in server_addr, int answers)
 {
 
     ssize_t nWrote;
+    struct clock_stamps stamps;
+
+    // Every ACK answers the packet just received, so this is the time spent on it here.
+    clock_sync_stamp(&peer_clock, &stamps);
+    if(answers)
+    {
+        latency_stat_add(&processing, stamps.transmit - stamps.receive);
+    }
+    else
+    {
+        stamps.origin = 0;
+        stamps.receive = 0;
+    }
+    clock_stamps_encode(&stamps, &bytes[CLOCK_STAMPS_OFFSET]);
+
+    // Sign the ACK so car_controller can tell it came from this car.
+    if(auth.enabled)
+    {
+        size = packet_auth_seal(&auth, bytes, size);
+    }
+
+    // Co-located car_controller: the ACK goes straight into the shared ring.
+    if(shm.channel)
+    {
+        uint8_t *slot = shm_ring_reserve(shm.tx);
+
+        if(slot == NULL)
+        {
+            printf("ACK ring full, ack dropped\n");
+            return;
+        }
+        // Serialized in the slot already unless the ring was full then.
+        if(slot != bytes)
+        {
+            memcpy(slot, bytes, size);
+        }
+        shm_ring_commit(shm.tx, size);
+        printf("Sent ack\n\n");
+        return;
+    }
+
+    // A command that came over AF_XDP is answered on its transmit ring.
+    if(xdp.active && fd == xdp.fd)
+    {
+        if(xdp_transport_send(&xdp, bytes, size, &server_addr) == -1)
+        {
+            printf("AF_XDP transmit ring full, ack dropped\n");
+            return;
+        }
+        printf("Sent ack\n\n");
+        return;
+    }
 
     nWrote = sendto(fd, bytes, size, 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
     if(nWrote == -1)
@@ -230,15 +637,22 @@ static void write_bytes(int fd, const uint8_t *bytes, size_t size, struct sockad
  * Deserialize data sent from another machine.
  * @param nRead Number of bytes.
  * @param data_buffer Buffer for the data.
- * @return Data packet that has been deserialized.
+ * @param x Data packet to fill in, its data is copied into the packet itself.
+ * @return 0, or -1 if the packet is shorter than its fixed header.
  */
-static struct data_packet *dp_deserialize(ssize_t nRead, char * data_buffer)
+static int dp_deserialize(ssize_t nRead, const char * data_buffer, struct data_packet *x)
 {
-    struct data_packet * x = malloc(sizeof(struct data_packet));
     size_t count;
     size_t len;
+    TRACE_BEGIN(span);
 
-    memset(x, 0, sizeof(struct data_packet));
+    // Every transport can hand over a runt: check before the first byte is read.
+    if(nRead < (ssize_t)PACKET_HEADER_SIZE)
+    {
+        printf("Dropped packet of %zd bytes, shorter than a header\n", nRead);
+        TRACE_END(span, "dp_deserialize");
+        return -1;
+    }
     count = 0;
 
     memcpy(&x->data_flag, &data_buffer[count], sizeof(x->data_flag));
@@ -256,48 +670,79 @@ static struct data_packet *dp_deserialize(ssize_t nRead, char * data_buffer)
     memcpy(&x->counter_clockwise, &data_buffer[count], sizeof(x->counter_clockwise));
     count += sizeof(x->counter_clockwise);
 
+    memcpy(&x->script_flag, &data_buffer[count], sizeof(x->script_flag));
+    count += sizeof(x->script_flag);
+
+    memcpy(&x->command_id, &data_buffer[count], sizeof(x->command_id));
+    count += sizeof(x->command_id);
+
+    memcpy(&x->stop_generation, &data_buffer[count], sizeof(x->stop_generation));
+    count += sizeof(x->stop_generation);
+
+    x->session_epoch = session_epoch_decode((const uint8_t *)&data_buffer[count]);
+    count += SESSION_EPOCH_SIZE;
+
+    x->peer_epoch = session_epoch_decode((const uint8_t *)&data_buffer[count]);
+    count += SESSION_EPOCH_SIZE;
+
+    clock_stamps_decode((const uint8_t *)&data_buffer[count], &x->stamps);
+    count += CLOCK_STAMPS_SIZE;
+
+    deadline_decode((const uint8_t *)&data_buffer[count], &x->deadline);
+    count += DEADLINE_SIZE;
+
+    count += fec_decode((const uint8_t *)&data_buffer[count], (size_t)nRead - count, x->fec, &x->fec_count);
+
     x->data_flag = ntohs(x->data_flag);
     x->ack_flag = ntohs(x->ack_flag);
     x->sequence_flag = ntohs(x->sequence_flag);
     x->clockwise = ntohs(x->clockwise);
     x->counter_clockwise = ntohs(x->counter_clockwise);
+    x->script_flag = ntohs(x->script_flag);
+    x->command_id = ntohl(x->command_id);
+    x->stop_generation = ntohl(x->stop_generation);
 
+    // A shared memory slot may hold more than the data field, keep what fits.
     len = nRead - count;
-
-    x->data = malloc((len+1));
+    if(len >= sizeof(x->data))
+    {
+        len = sizeof(x->data) - 1;
+    }
     memcpy(x->data, &data_buffer[count], len);
     x->data[len] = '\0';
 
-    return x;
+    TRACE_END(span, "dp_deserialize");
+    return 0;
 }
 
 /**
  * Serialize data packet to be sent to another machine.
  * @param ackPacket ACK packet to send pack to car_controller.
- * @param size size of serialized information.
- * @return Serialized data packet.
+ * @param bytes Buffer of ACK_CAPACITY bytes to serialize into, leaving room for the MAC trailer.
+ * @return Size of serialized information, without the trailer.
  */
-static uint8_t *dp_serialize(const struct data_packet *ackPacket, size_t *size)
+static size_t dp_serialize(const struct data_packet *ackPacket, uint8_t *bytes)
 {
-    uint8_t *bytes;
     size_t count;
-    size_t len;
     int data_flag_number;
     int ack_flag_number;
     int sequence_flag_number;
     int clockwise;
     int counter_clockwise;
+    int script_flag;
+    uint32_t command_id;
+    uint32_t stop_generation;
+    TRACE_BEGIN(span);
 
-    len = strlen(ackPacket->data);
-
-    *size = sizeof(ackPacket->data_flag) + sizeof(ackPacket->ack_flag) + sizeof(ackPacket->sequence_flag) + sizeof(ackPacket->clockwise) + sizeof(ackPacket->counter_clockwise) + len;
-    bytes = malloc(*size);
     // Make network byte order
     data_flag_number = htons(ackPacket->data_flag);
     ack_flag_number = htons(ackPacket->ack_flag);
     sequence_flag_number = htons(ackPacket->sequence_flag);
     clockwise = htons(ackPacket->clockwise);
     counter_clockwise = htons(ackPacket->counter_clockwise);
+    script_flag = htons(ackPacket->script_flag);
+    command_id = htonl(ackPacket->command_id);
+    stop_generation = htonl(ackPacket->stop_generation);
 
     count = 0;
 
@@ -317,9 +762,38 @@ static uint8_t *dp_serialize(const struct data_packet *ackPacket, size_t *size)
     memcpy(&bytes[count], &counter_clockwise, sizeof(counter_clockwise));
     count += sizeof(counter_clockwise);
 
-    memcpy(&bytes[count], ackPacket->data, len);
+    memcpy(&bytes[count], &script_flag, sizeof(script_flag));
+    count += sizeof(script_flag);
+
+    memcpy(&bytes[count], &command_id, sizeof(command_id));
+    count += sizeof(command_id);
 
-    return bytes;
+    memcpy(&bytes[count], &stop_generation, sizeof(stop_generation));
+    count += sizeof(stop_generation);
+
+    // ACKs carry this process's epoch and the car_controller epoch they answer.
+    session_epoch_encode(session.state->epoch, &bytes[count]);
+    count += SESSION_EPOCH_SIZE;
+
+    session_epoch_encode(ackPacket->peer_epoch, &bytes[count]);
+    count += SESSION_EPOCH_SIZE;
+
+    // Clock stamps are left for write_bytes to fill in.
+    count += CLOCK_STAMPS_SIZE;
+
+    // ACKs never expire.
+    memset(&bytes[count], 0, DEADLINE_SIZE); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    count += DEADLINE_SIZE;
+
+    // ACKs carry no FEC history.
+    bytes[count] = 0;
+    count++;
+
+    telemetry_encode(&ackPacket->telemetry, &bytes[count]);
+    count += TELEMETRY_SIZE;
+
+    TRACE_END(span, "dp_serialize");
+    return count;
 }
 
 /**
@@ -334,10 +808,12 @@ static void options_init(struct options *opts, struct server_information *server
     memset(serverInformation, 0, sizeof(struct server_information)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
     serverInformation->previous_sequence_number = 1;
 
-    char d_text[4] = "null";
-    serverInformation->previous_message = d_text;
+    memcpy(serverInformation->previous_message, "null", sizeof("null"));
 
     opts->fd_in       = STDIN_FILENO;
+    opts->fd_stop     = -1;
+    opts->fd_group    = -1;
+    opts->fd_stop_group = -1;
     opts->server_port     = DEFAULT_PORT;
 }
 
@@ -351,7 +827,7 @@ static void parse_arguments(int argc, char *argv[], struct options *opts)
 {
     int c;
 
-    while((c = getopt(argc, argv, ":i:")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    while((c = getopt(argc, argv, ":i:g:x:m:k:t:r:")) != -1)   // NOLINT(concurrency-mt-unsafe)
     {
         switch(c)
         {
@@ -364,13 +840,51 @@ static void parse_arguments(int argc, char *argv[], struct options *opts)
                 opts->ip_server = optarg;
                 break;
             }
+            case 'g':
+            {
+                if (!IN_MULTICAST(ntohl(inet_addr(optarg)))) {
+                    options_process_close(-1);
+                }
+                printf("Joining multicast group: %s \n", optarg);
+                opts->group = optarg;
+                break;
+            }
+            case 'x':
+            {
+                printf("Receiving commands over AF_XDP on: %s \n", optarg);
+                opts->xdp_ifname = optarg;
+                break;
+            }
+            case 'm':
+            {
+                printf("Using shared memory transport: %s \n", optarg);
+                opts->shm_name = optarg;
+                break;
+            }
+            case 'k':
+            {
+                options_process_close(packet_auth_load_key(&auth, optarg));
+                break;
+            }
+            case 'r':
+            {
+                opts->state_path = optarg;
+                break;
+            }
+            case 't':
+            {
+                options_process_close(trace_open(optarg));
+                trace_thread_name("car_motors");
+                break;
+            }
             case ':':
             {
                 printf("Option requires an operand\n");
             }
+            // Fall through
             case '?':
             {
-                printf("Unknown Argument Passed: Please use from the following...\n '-c' for setting the car_controller IP.\n '-o' for setting the car_motors IP\n");
+                printf("Unknown Argument Passed: Please use from the following...\n '-i' for setting the car_motors IP to listen on\n '-g' for a multicast group to join on the '-i' address\n '-x' for an interface to receive commands on over AF_XDP\n '-m' for a shared memory transport name\n '-k' for a pre-shared key file\n '-t' for a Chrome trace-event JSON file\n '-r' for a session state file kept across restarts\n");
             }
             default:
             {
@@ -386,6 +900,22 @@ static void parse_arguments(int argc, char *argv[], struct options *opts)
  */
 static void options_process(struct options *opts)
 {
+    options_process_close(session_open(&session, opts->state_path));
+    printf("Session epoch %" PRIu64 ", %s start\n", session.state->epoch, session.warm ? "warm" : "cold");
+
+    // Nothing accepted by the last run may be accepted again. Only needed for
+    // the group, anything sent to this car alone is bound to the new epoch.
+    if(auth.enabled && session.warm && session.state->auth_epoch)
+    {
+        packet_auth_set_window(&auth, session.state->auth_epoch, session.state->auth_counter);
+    }
+
+    // Shared memory replaces the socket entirely.
+    if(opts->shm_name)
+    {
+        options_process_close(shm_transport_open(&shm, opts->shm_name, 0));
+        return;
+    }
 
     if(opts->ip_server)
     {
@@ -411,6 +941,30 @@ static void options_process(struct options *opts)
         result = bind(opts->fd_in, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
 
         options_process_close(result);
+
+        // Kernel receive timestamps keep scheduling delay out of the latency measured.
+        if(clock_sync_enable_timestamps(opts->fd_in) == -1)
+        {
+            printf("Kernel receive timestamps unavailable\n");
+        }
+
+        // The express lane keeps its own replay counter, stops may overtake commands.
+        stop_auth = auth;
+        options_process_close(open_stop_socket(opts));
+
+        if(opts->group)
+        {
+            opts->fd_group = open_group_socket(opts, opts->server_port);
+            options_process_close(opts->fd_group);
+            opts->fd_stop_group = open_group_socket(opts, DEFAULT_STOP_PORT);
+            options_process_close(opts->fd_stop_group);
+        }
+
+        // Commands steered to AF_XDP skip the UDP stack, the socket stays for whatever is passed on.
+        if(opts->xdp_ifname && xdp_transport_open(&xdp, opts->xdp_ifname, 0, addr.sin_addr.s_addr, opts->server_port) == -1)
+        {
+            printf("Falling back to the UDP socket\n");
+        }
     }
 }
 
@@ -429,13 +983,691 @@ static void options_process_close(int result_number) {
 /**
  * Clear memory for end of program.
  * @param opts Option struct for holding network information, close socket.
- * @param serverInformation Free memory for data still being held.
+ * @param serverInformation Car_motors side information, for the statistics reported.
  */
 static void cleanup(const struct options *opts, struct server_information *serverInformation)
 {
+    struct rusage usage;
+
+    trace_close();
+    shm_transport_close(&shm);
     if(opts->ip_server)
     {
         close(opts->fd_in);
     }
-    free(serverInformation->struct_message_data);
+    if(opts->fd_stop != -1)
+    {
+        close(opts->fd_stop);
+    }
+    if(opts->fd_group != -1)
+    {
+        close(opts->fd_group);
+        close(opts->fd_stop_group);
+    }
+    if(xdp.active)
+    {
+        xdp_transport_report(&xdp);
+        xdp_transport_close(&xdp);
+    }
+    if(opts->ip_server || opts->shm_name)
+    {
+        script_executor_report(&executor);
+        printf("Commands recovered by FEC: %llu\n", (unsigned long long)serverInformation->fec_recovered);
+        if(serverInformation->stops_applied)
+        {
+            printf("Stops applied: %llu, receive to motors off mean %lld us, max %lld us\n",
+                   (unsigned long long)serverInformation->stops_applied,
+                   (long long)(serverInformation->stop_latency_total_ns / (int64_t)serverInformation->stops_applied / 1000), // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                   (long long)(serverInformation->stop_latency_max_ns / 1000)); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+        }
+        printf("Commands dropped as older than a stop or session: %llu\n", (unsigned long long)serverInformation->stale_dropped);
+        deadline_tracker_report(&deadlines);
+        printf("Motors stopped for expired commands: %llu\n", (unsigned long long)serverInformation->expired_stops);
+        // Packet buffers are fixed, so this stays flat however long the session ran.
+        if(getrusage(RUSAGE_SELF, &usage) == 0)
+        {
+            printf("Peak resident set: %ld KiB\n", usage.ru_maxrss);
+        }
+        clock_sync_report(&peer_clock, "Downlink to car_controller", "Uplink from car_controller", NULL);
+        latency_stat_report(&processing, "Processing");
+        if(auth.enabled)
+        {
+            printf("Rejected packets: %llu bad MAC, %llu replayed, %llu of an unbound session\n",
+                   (unsigned long long)(auth.rejected_tag + stop_auth.rejected_tag),
+                   (unsigned long long)(auth.rejected_replay + stop_auth.rejected_replay),
+                   (unsigned long long)(auth.rejected_unbound + stop_auth.rejected_unbound));
+        }
+    }
+    session_close(&session);
+}
+
+/**
+ * Actuate the motors for a script step.
+ * @param command Step command.
+ * @param ctx Unused.
+ */
+static void script_actuate(enum script_command command, void *ctx)
+{
+    TRACE_BEGIN(span);
+
+    (void)ctx;
+    switch(command)
+    {
+        case SCRIPT_CLOCKWISE:
+        {
+            moveMotorRight(NULL);
+            break;
+        }
+        case SCRIPT_COUNTER_CLOCKWISE:
+        {
+            moveMotorLeft(NULL);
+            break;
+        }
+        case SCRIPT_STOP:
+        default:
+        {
+            stopMotor(NULL);
+            break;
+        }
+    }
+    TRACE_END(span, "script_actuate");
+}
+
+/**
+ * Stop the receive loop on SIGINT.
+ * @param sig Signal number.
+ */
+static void signal_handler(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+/**
+ * Wait until any socket is readable, firing timers that expire meanwhile.
+ * @param opts Option struct with the socket FDs, those not open are -1.
+ * @return READY_COMMAND, READY_STOP, READY_GROUP, READY_STOP_GROUP and READY_XDP bits for the sockets ready to read.
+ */
+static int wait_for_packet(const struct options *opts)
+{
+    struct pollfd pfd[5];
+    const int bits[5] = {READY_COMMAND, READY_STOP, READY_GROUP, READY_STOP_GROUP, READY_XDP};
+    int result;
+    int ready;
+
+    if(shm.channel)
+    {
+        result = shm_ring_wait(shm.rx, timer_wheel_timeout_ms(&wheel, timer_wheel_clock_ms()));
+        timer_wheel_advance(&wheel, timer_wheel_clock_ms());
+        return result ? READY_COMMAND : 0;
+    }
+
+    // poll ignores a negative FD.
+    pfd[0].fd = opts->fd_in;
+    pfd[1].fd = opts->fd_stop;
+    pfd[2].fd = opts->fd_group;
+    pfd[3].fd = opts->fd_stop_group;
+    pfd[4].fd = xdp.active ? xdp.fd : -1;
+    for(int i = 0; i < 5; i++)   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    {
+        pfd[i].events = POLLIN;
+        pfd[i].revents = 0;
+    }
+
+    result = poll(pfd, 5, timer_wheel_timeout_ms(&wheel, timer_wheel_clock_ms()));   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    if(result == -1 && errno != EINTR)
+    {
+        printf("Could not poll socket\n");
+    }
+    timer_wheel_advance(&wheel, timer_wheel_clock_ms());
+
+    ready = 0;
+    for(int i = 0; result > 0 && i < 5; i++)   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    {
+        if(pfd[i].revents & POLLIN)
+        {
+            ready |= bits[i];
+        }
+    }
+    return ready;
+}
+
+/**
+ * No command refreshed the motors in time, stop them.
+ * @param timer Expired pulse timer.
+ * @param arg Unused.
+ */
+static void pulse_expired(struct timer_entry *timer, void *arg)
+{
+    (void)timer;
+    (void)arg;
+    TRACE_INSTANT("pulse_expired");
+    printf("Motor pulse expired\n");
+    stopMotor(NULL);
+}
+
+/**
+ * Check the MAC and counter of the packet just read and strip the trailer.
+ * An authentic packet of a car_controller session that does not know this
+ * process's epoch yet is answered with an announcement instead.
+ * @param serverInformation Struct holding the packet read.
+ * @param fd_reply Socket FD an announcement is sent from.
+ * @param group Non-zero if the packet was sent to the multicast group.
+ * @return 1 if the packet may be processed, 0 if it was dropped.
+ */
+static int authenticate_packet(struct server_information *serverInformation, int fd_reply, int group)
+{
+    size_t payload_size;
+    uint64_t epoch;
+    int result;
+
+    if(!auth.enabled)
+    {
+        return 1;
+    }
+
+    result = open_packet(&auth, (const uint8_t *)serverInformation->struct_message_data,
+                         (size_t)serverInformation->bytes_read_from_socket, group, &epoch, &payload_size);
+    if(result == PACKET_AUTH_UNBOUND)
+    {
+        struct sockaddr_in from;
+
+        memcpy(&from, &serverInformation->from_addr, sizeof(from)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        send_announcement(fd_reply, epoch, from, serverInformation);
+    }
+    if(result != 0)
+    {
+        printf("Dropped unauthenticated packet\n");
+        release_message(serverInformation);
+        return 0;
+    }
+
+    serverInformation->bytes_read_from_socket = (ssize_t)payload_size;
+    return 1;
+}
+
+/**
+ * Check the MAC of a packet from car_controller on one lane. A packet of a
+ * car_controller session not seen on the lane yet opens a new counter window
+ * only if it names this process's epoch, which car_controller only learns
+ * from an ACK of this process. A packet sent to the group cannot name every
+ * car's epoch, so there only a retired session is refused, and replays
+ * across a restart are refused by the window kept in the state file.
+ * @param lane_auth Auth state of the lane read from.
+ * @param bytes Packet read, with the trailer.
+ * @param size Bytes read.
+ * @param group Non-zero if the packet was sent to the multicast group.
+ * @param epoch Set to the car_controller epoch the packet carries.
+ * @param payload_size Set to the size without the trailer.
+ * @return As packet_auth_open.
+ */
+static int open_packet(struct packet_auth *lane_auth, const uint8_t *bytes, size_t size, int group, uint64_t *epoch, size_t *payload_size)
+{
+    int bound = 0;
+
+    *epoch = 0;
+    if(size >= CLOCK_STAMPS_OFFSET + PACKET_AUTH_TRAILER_SIZE)
+    {
+        *epoch = session_epoch_decode(&bytes[SESSION_EPOCH_OFFSET]);
+        bound = (group || session_epoch_decode(&bytes[SESSION_EPOCH_OFFSET + SESSION_EPOCH_SIZE]) == session.state->epoch) &&
+                !session_peer_retired(&session.state->peer, *epoch);
+    }
+    return packet_auth_open(lane_auth, bytes, size, *epoch, bound, payload_size);
+}
+
+/**
+ * Read one packet from the express lane, stop the motors straight away if it
+ * is a new stop and ACK it on the unicast express lane.
+ * @param fd Express lane socket FD read from, unicast or group.
+ * @param fd_reply Unicast express lane socket FD the ACK is sent from.
+ * @param serverInformation Pointer to struct for car_motors side information.
+ */
+static void serve_stop_lane(int fd, int fd_reply, struct server_information * serverInformation)
+{
+    char data[PACKET_CAPACITY];
+    struct sockaddr from_addr;
+    socklen_t from_addr_len;
+    ssize_t nRead;
+    size_t payload_size;
+    int64_t received_ns;
+    int64_t stamped_ns;
+    uint64_t epoch;
+    int result;
+    struct data_packet dataPacket;
+
+    from_addr_len = sizeof (struct sockaddr);
+    nRead = clock_sync_recvfrom(fd, data, sizeof(data), &from_addr, &from_addr_len, &stamped_ns);
+    received_ns = script_monotonic_ns(NULL);
+    if(nRead <= 0)
+    {
+        return;
+    }
+
+    payload_size = (size_t)nRead;
+    result = auth.enabled ? open_packet(&stop_auth, (const uint8_t *)data, (size_t)nRead, fd != fd_reply, &epoch, &payload_size) : 0;
+    // The stop is retransmitted bound to this process once car_controller has the announcement.
+    if(result == PACKET_AUTH_UNBOUND)
+    {
+        struct sockaddr_in from;
+
+        memcpy(&from, &from_addr, sizeof(from)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        send_announcement(fd_reply, epoch, from, serverInformation);
+    }
+    if(result != 0)
+    {
+        printf("Dropped unauthenticated stop\n");
+        return;
+    }
+
+    if(dp_deserialize((ssize_t)payload_size, data, &dataPacket) == -1)
+    {
+        return;
+    }
+    clock_sync_receive(&peer_clock, &dataPacket.stamps, stamped_ns);
+
+    // Only stops travel this lane, anything else is ignored and not ACKed.
+    if(!dataPacket.ack_flag && is_stop(&dataPacket) && sync_session(&dataPacket, serverInformation))
+    {
+        apply_stop(&dataPacket, serverInformation, received_ns);
+        save_session(serverInformation);
+        send_ack_packet(&dataPacket, &from_addr, fd_reply, serverInformation);
+    }
+}
+
+/**
+ * Check whether a packet is a stop command.
+ * @param dataPacket Deserialized packet.
+ * @return 1 for a stop.
+ */
+static int is_stop(const struct data_packet * dataPacket)
+{
+    return dataPacket->data_flag && !dataPacket->script_flag && !dataPacket->clockwise && !dataPacket->counter_clockwise;
+}
+
+/**
+ * Turn the motors off for a stop of a newer generation, ahead of anything
+ * queued on the command socket. Retransmissions of the stop already applied are only ACKed again.
+ * @param dataPacket Stop packet.
+ * @param serverInformation Pointer to struct for car_motors side information.
+ * @param received_ns Monotonic time the packet was read, for the latency statistics.
+ */
+static void apply_stop(const struct data_packet * dataPacket, struct server_information * serverInformation, int64_t received_ns)
+{
+    int64_t latency;
+    int preempted;
+
+    if (dataPacket->stop_generation <= serverInformation->stop_generation) {
+        return;
+    }
+
+    // The script goes first, or a step due in between could drive the motors again.
+    preempted = script_executor_cancel(&executor);
+    stopMotor(NULL);
+    timer_wheel_cancel(&wheel, &pulse_timer);
+    latency = script_monotonic_ns(NULL) - received_ns;
+    if (preempted) {
+        printf("Script preempted by stop\n");
+    }
+
+    serverInformation->stop_generation = dataPacket->stop_generation;
+    // The stop carries the controller's sequence, so the next motion command is
+    // recognised as new even if the one the stop preempted never arrived.
+    serverInformation->previous_sequence_number = dataPacket->sequence_flag;
+    if (dataPacket->command_id > serverInformation->last_command_id) {
+        serverInformation->last_command_id = dataPacket->command_id;
+    }
+
+    serverInformation->stops_applied++;
+    serverInformation->stop_latency_total_ns += latency;
+    if (latency > serverInformation->stop_latency_max_ns) {
+        serverInformation->stop_latency_max_ns = latency;
+    }
+    printf("Stop %u applied\n", dataPacket->stop_generation);
+}
+
+/**
+ * Open the express lane socket stops arrive on, next to the command socket.
+ * ACKs sent from it get the same queueing priority and DSCP EF marking the
+ * controller uses for stops.
+ * @param opts Option struct, fd_stop is set on success.
+ * @return 0 on success, -1 on failure.
+ */
+static int open_stop_socket(struct options *opts)
+{
+    struct sockaddr_in addr;
+    int option = 1;
+    int priority = STOP_SOCKET_PRIORITY;
+    int tos = STOP_IP_TOS;
+
+    opts->fd_stop = socket(AF_INET, SOCK_DGRAM, 0);
+    if(opts->fd_stop == -1)
+    {
+        return -1;
+    }
+
+    setsockopt(opts->fd_stop, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+    // Marking is best effort, the lane still works unmarked.
+    if(setsockopt(opts->fd_stop, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority)) == -1)
+    {
+        perror("setsockopt SO_PRIORITY");
+    }
+    if(setsockopt(opts->fd_stop, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) == -1)
+    {
+        perror("setsockopt IP_TOS");
+    }
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(DEFAULT_STOP_PORT);
+    addr.sin_addr.s_addr = inet_addr(opts->ip_server);
+
+    clock_sync_enable_timestamps(opts->fd_stop);
+
+    return bind(opts->fd_stop, (struct sockaddr *)&addr, sizeof(struct sockaddr_in));
+}
+
+/**
+ * Carry on from the state of the last run on a warm start.
+ * @param serverInformation Pointer to struct for car_motors side information.
+ */
+static void restore_session(struct server_information * serverInformation)
+{
+    if(!session.warm)
+    {
+        return;
+    }
+    serverInformation->previous_sequence_number = session.state->sequence;
+    serverInformation->last_command_id = session.state->command_id;
+    serverInformation->stop_generation = session.state->stop_generation;
+}
+
+/**
+ * Copy the link state into the session state once a packet has been handled.
+ * @param serverInformation Pointer to struct for car_motors side information.
+ */
+static void save_session(const struct server_information * serverInformation)
+{
+    struct sockaddr_in from;
+
+    session.state->sequence = serverInformation->previous_sequence_number;
+    session.state->command_id = serverInformation->last_command_id;
+    session.state->stop_generation = serverInformation->stop_generation;
+    // Both lanes count from the one car_controller counter, so the higher of
+    // their windows in the session followed covers both.
+    if(auth.enabled)
+    {
+        session.state->auth_epoch = session.state->peer.epoch;
+        session.state->auth_counter = 0;
+        if(auth.rx_epoch == session.state->peer.epoch)
+        {
+            session.state->auth_counter = auth.rx_counter;
+        }
+        if(stop_auth.rx_epoch == session.state->peer.epoch && stop_auth.rx_counter > session.state->auth_counter)
+        {
+            session.state->auth_counter = stop_auth.rx_counter;
+        }
+    }
+    // The command lane address, where a restart is announced. Stops alone leave it unset.
+    memcpy(&from, &serverInformation->from_addr, sizeof(from)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    if(!shm.channel && from.sin_addr.s_addr != 0)
+    {
+        session.state->peer_address = from.sin_addr.s_addr;
+        session.state->peer_port = from.sin_port;
+    }
+}
+
+/**
+ * On a warm start, tell the car_controller of the restored session that this
+ * process replaced the one it was driving, so it sends the held command
+ * again at once instead of noticing the restart at its next keepalive.
+ * @param opts Option struct with the sockets.
+ * @param serverInformation car_motors state restored from the session.
+ */
+static void announce_session(const struct options * opts, struct server_information * serverInformation)
+{
+    struct sockaddr_in to_addr;
+
+    if(!session.warm || session.state->peer.epoch == 0 || (!shm.channel && session.state->peer_address == 0))
+    {
+        return;
+    }
+
+    memset(&to_addr, 0, sizeof(to_addr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    to_addr.sin_family = AF_INET;
+    to_addr.sin_port = session.state->peer_port;
+    to_addr.sin_addr.s_addr = session.state->peer_address;
+    send_announcement(opts->fd_in, session.state->peer.epoch, to_addr, serverInformation);
+}
+
+/**
+ * Send an ACK that answers no command and carries this process's epoch, for
+ * a car_controller session that does not know it yet.
+ * @param fd Socket FD to send from.
+ * @param controller_epoch car_controller epoch it is addressed to.
+ * @param to_addr car_controller address.
+ * @param serverInformation car_motors state, its ack_buffer is serialized into unless a ring slot is free.
+ */
+static void send_announcement(int fd, uint64_t controller_epoch, struct sockaddr_in to_addr, struct server_information * serverInformation)
+{
+    uint8_t *bytes = serialize_target(serverInformation->ack_buffer);
+    struct data_packet announcement;
+    size_t size;
+
+    memset(&announcement, 0, offsetof(struct data_packet, data)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    announcement.ack_flag = 1;
+    announcement.sequence_flag = serverInformation->previous_sequence_number;
+    announcement.command_id = serverInformation->last_command_id;
+    announcement.stop_generation = serverInformation->stop_generation;
+    announcement.peer_epoch = controller_epoch;
+    collect_telemetry(fd, serverInformation, &announcement.telemetry);
+    announcement.telemetry.flags |= TELEMETRY_SESSION_START;
+    size = dp_serialize(&announcement, bytes);
+
+    printf("Announcing session %" PRIu64 " to car_controller session %" PRIu64 "\n", session.state->epoch, controller_epoch);
+    write_bytes(fd, bytes, size, to_addr, 0);
+}
+
+/**
+ * Follow the car_controller session a packet belongs to. A new epoch is a
+ * restarted car_controller, which starts with the motors off: they are
+ * stopped and the link state taken from the packet, so it is applied as new
+ * whatever sequence it carries. Any epoch not followed before is new, whatever
+ * the clocks say; a late packet from a retired one is dropped.
+ * @param dataPacket Packet from car_controller.
+ * @param serverInformation Pointer to struct for car_motors side information.
+ * @return 1 if the packet may be processed, 0 if it was dropped.
+ */
+static int sync_session(const struct data_packet * dataPacket, struct server_information * serverInformation)
+{
+    struct session_state *state = session.state;
+
+    if (dataPacket->session_epoch == state->peer.epoch) {
+        return 1;
+    }
+    if (session_peer_retired(&state->peer, dataPacket->session_epoch)) {
+        serverInformation->stale_dropped++;
+        printf("Dropped packet from car_controller session %" PRIu64 "\n", dataPacket->session_epoch);
+        return 0;
+    }
+
+    printf("Joined car_controller session %" PRIu64 "\n", dataPacket->session_epoch);
+    session_peer_follow(&state->peer, dataPacket->session_epoch);
+    // The script goes first, or a step due in between could drive the motors again.
+    script_executor_cancel(&executor);
+    stopMotor(NULL);
+    timer_wheel_cancel(&wheel, &pulse_timer);
+
+    // Nothing the history carries from before this packet is replayed.
+    serverInformation->last_command_id = dataPacket->data_flag ? dataPacket->command_id - 1 : dataPacket->command_id;
+    serverInformation->previous_sequence_number = dataPacket->data_flag ? !dataPacket->sequence_flag : dataPacket->sequence_flag;
+    // A stop must still be newer than the generation followed, so apply_stop takes it.
+    serverInformation->stop_generation = is_stop(dataPacket) ? dataPacket->stop_generation - 1 : dataPacket->stop_generation;
+    return 1;
+}
+
+/**
+ * Fill in the telemetry report for an ACK and start a new loop window.
+ * @param fd Socket FD the packet was read from.
+ * @param serverInformation car_motors state.
+ * @param telemetry Report to fill in.
+ */
+static void collect_telemetry(int fd, struct server_information * serverInformation, struct telemetry * telemetry)
+{
+    size_t steps = script_executor_pending(&executor);
+
+    serverInformation->packets_acknowledged++;
+
+    telemetry->motor_state = (uint8_t)motorState();
+    telemetry->flags = 0;
+    if(steps > 0)
+    {
+        telemetry->flags |= TELEMETRY_SCRIPT_ACTIVE;
+    }
+    if(pulse_timer.pending)
+    {
+        telemetry->flags |= TELEMETRY_PULSE_PENDING;
+    }
+    if(serverInformation->command_expired)
+    {
+        telemetry->flags |= TELEMETRY_COMMAND_EXPIRED;
+        serverInformation->command_expired = 0;
+    }
+    telemetry->script_steps = (uint16_t)steps;
+    telemetry->command_id = serverInformation->last_command_id;
+    telemetry->actuated_ns = motorChangedNs();
+    telemetry->packets = serverInformation->packets_acknowledged;
+    telemetry->rx_queue_bytes = rx_queue_bytes(fd);
+    telemetry->loop_mean_us = 0;
+    telemetry->loop_max_us = (uint32_t)(serverInformation->loop_max_ns / NSEC_PER_USEC);
+    if(serverInformation->loop_count > 0)
+    {
+        telemetry->loop_mean_us = (uint32_t)(serverInformation->loop_total_ns / serverInformation->loop_count / NSEC_PER_USEC);
+    }
+
+    serverInformation->loop_total_ns = 0;
+    serverInformation->loop_max_ns = 0;
+    serverInformation->loop_count = 0;
+}
+
+/**
+ * Bytes waiting to be read, including kernel overhead per datagram for UDP.
+ * @param fd Socket FD, unused with shared memory.
+ * @return Receive queue in use, 0 if it cannot be read.
+ */
+static uint32_t rx_queue_bytes(int fd)
+{
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(meminfo);
+
+    if(shm.channel)
+    {
+        return (uint32_t)(shm_ring_depth(shm.rx) * SHM_RING_SLOT_SIZE);
+    }
+    if(xdp.active && fd == xdp.fd)
+    {
+        return (uint32_t)(xdp_transport_depth(&xdp) * XDP_FRAME_SIZE);
+    }
+    if(getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == -1)
+    {
+        return 0;
+    }
+    return meminfo[SK_MEMINFO_RMEM_ALLOC];
+}
+
+/**
+ * Close the timing of a loop iteration that had work to do.
+ * @param serverInformation car_motors state.
+ * @param busy_since_ns When the iteration woke up with work, 0 if it had none.
+ */
+static void record_loop_time(struct server_information * serverInformation, int64_t busy_since_ns)
+{
+    int64_t busy_ns;
+
+    if(!busy_since_ns)
+    {
+        return;
+    }
+    busy_ns = script_monotonic_ns(NULL) - busy_since_ns;
+    serverInformation->loop_total_ns += busy_ns;
+    serverInformation->loop_count++;
+    if(busy_ns > serverInformation->loop_max_ns)
+    {
+        serverInformation->loop_max_ns = busy_ns;
+    }
+}
+
+/**
+ * Open a socket receiving what car_controller sends to the multicast group.
+ * Every car on a host binds the group address with SO_REUSEADDR, so each gets
+ * its own copy; the membership is taken on the interface of the car IP.
+ * @param opts Option struct with the car IP and group.
+ * @param port Port to receive on.
+ * @return Socket FD, -1 on failure.
+ */
+static int open_group_socket(const struct options *opts, in_port_t port)
+{
+    struct sockaddr_in addr;
+    struct ip_mreq membership;
+    int option = 1;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if(fd == -1)
+    {
+        return -1;
+    }
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(opts->group);
+    membership.imr_multiaddr.s_addr = addr.sin_addr.s_addr;
+    membership.imr_interface.s_addr = inet_addr(opts->ip_server);
+
+    if(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option)) == -1 ||
+       bind(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) == -1 ||
+       setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) == -1)
+    {
+        perror("open group socket");
+        close(fd);
+        return -1;
+    }
+
+    clock_sync_enable_timestamps(fd);
+    return fd;
+}
+
+/**
+ * Hand a packet processed in place back to its transport, the shared memory
+ * slot or the AF_XDP frame it was read from. A socket read needs nothing.
+ * @param serverInformation Struct holding the packet read.
+ */
+static void release_message(struct server_information * serverInformation)
+{
+    if(shm.channel)
+    {
+        shm_ring_release(shm.rx);
+        serverInformation->struct_message_data = NULL;
+    }
+    if(xdp.holding)
+    {
+        xdp_transport_release(&xdp);
+        serverInformation->struct_message_data = NULL;
+    }
+}
+
+/**
+ * Buffer the next ACK is serialized into. With shared memory that is the free
+ * ring slot itself, so the ACK is never copied on its way out.
+ * @param buffer Buffer used with UDP, AF_XDP, or when the ring is full.
+ * @return Where to serialize.
+ */
+static uint8_t *serialize_target(uint8_t *buffer)
+{
+    uint8_t *slot;
+
+    if(!shm.channel)
+    {
+        return buffer;
+    }
+    slot = shm_ring_reserve(shm.tx);
+    return slot ? slot : buffer;
 }
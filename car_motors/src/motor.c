@@ -1,34 +1,13 @@
 #include "../include/motor.h"
+#include "clock_sync.h"
 #include <stdio.h>
 #include <wiringPi.h>
-#include <unistd.h>
-#include <time.h>
-#include <errno.h>
 
-int mSleep(long msec);
-
-//https://stackoverflow.com/questions/1157209/is-there-an-alternative-sleep-function-in-c-to-milliseconds
-int mSleep(long msec)
-{
-    struct timespec ts;
-    int res;
-
-    if (msec < 0)
-    {
-        errno = EINVAL;
-        return -1;
-    }
-
-    ts.tv_sec = msec / 1000;
-    ts.tv_nsec = (msec % 1000) * 1000000;
-
-    do {
-        res = nanosleep(&ts, &ts);
-    } while (res && errno == EINTR);
-
-    return res;
-}
+static void setMotorState(int state);
 
+// Read by the ACK path while a script step may be writing them.
+static int motor_state = MOTOR_OFF;      // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int64_t motor_changed_ns = 0;     // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
 
 void * moveMotorRight(void *vargp)
 {
@@ -40,7 +19,7 @@ void * moveMotorRight(void *vargp)
     digitalWrite(LeftMotorEnable, HIGH);
     digitalWrite(LeftMotorPin1, HIGH);
     digitalWrite(LeftMotorPin2, LOW);
-    mSleep(10);
+    setMotorState(MOTOR_CLOCKWISE);
     return NULL;
 }
 
@@ -54,7 +33,7 @@ void * moveMotorLeft(void *vargp)
     digitalWrite(LeftMotorEnable, HIGH);
     digitalWrite(LeftMotorPin1, LOW);
     digitalWrite(LeftMotorPin2, HIGH);
-    mSleep(10);
+    setMotorState(MOTOR_COUNTER_CLOCKWISE);
     return NULL;
 }
 
@@ -63,5 +42,34 @@ void * stopMotor(void *vargp)
     printf("Turning Off\n");
     digitalWrite(RightMotorEnable, LOW);
     digitalWrite(LeftMotorEnable, LOW);
+    setMotorState(MOTOR_OFF);
     return NULL;
 }
+
+/**
+ * Direction the motors were last driven in.
+ * @return MOTOR_OFF, MOTOR_CLOCKWISE or MOTOR_COUNTER_CLOCKWISE.
+ */
+int motorState(void)
+{
+    return __atomic_load_n(&motor_state, __ATOMIC_RELAXED);
+}
+
+/**
+ * When the motors were last driven.
+ * @return CLOCK_REALTIME in nanoseconds, 0 if they never were.
+ */
+int64_t motorChangedNs(void)
+{
+    return __atomic_load_n(&motor_changed_ns, __ATOMIC_RELAXED);
+}
+
+/**
+ * Record a change of direction.
+ * @param state New direction.
+ */
+static void setMotorState(int state)
+{
+    __atomic_store_n(&motor_changed_ns, clock_sync_now_ns(), __ATOMIC_RELAXED);
+    __atomic_store_n(&motor_state, state, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,318 @@
+#include "../include/script.h"
+#include "trace.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NSEC_PER_MSEC 1000000LL
+#define NSEC_PER_SEC 1000000000LL
+
+static void script_fire(struct script_executor *executor, enum script_command command, int64_t now_ns);
+
+/**
+ * Parse a script in the form "C800,A300,S": C = clockwise, A = anti-clockwise,
+ * S = stop, each followed by an optional hold time in milliseconds of at most
+ * SCRIPT_MAX_STEP_MS.
+ * @param text Script text received in the data packet.
+ * @param script Script to fill.
+ * @return 0 on success, -1 if the script is malformed, too long or holds a
+ * step out of range.
+ */
+int script_parse(const char *text, struct script *script)
+{
+    const char *cursor;
+
+    memset(script, 0, sizeof(struct script)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    cursor = text;
+
+    while(*cursor != '\0')
+    {
+        struct script_step *step;
+        char *end;
+
+        if(script->count == SCRIPT_MAX_STEPS)
+        {
+            return -1;
+        }
+        step = &script->steps[script->count];
+
+        switch(toupper((unsigned char)*cursor))
+        {
+            case 'C':
+            {
+                step->command = SCRIPT_CLOCKWISE;
+                break;
+            }
+            case 'A':
+            {
+                step->command = SCRIPT_COUNTER_CLOCKWISE;
+                break;
+            }
+            case 'S':
+            {
+                step->command = SCRIPT_STOP;
+                break;
+            }
+            default:
+            {
+                return -1;
+            }
+        }
+        cursor++;
+
+        step->duration_ms = 0;
+        if(isdigit((unsigned char)*cursor))
+        {
+            errno = 0;
+            step->duration_ms = strtol(cursor, &end, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+            if(errno == ERANGE || step->duration_ms < 0 || step->duration_ms > SCRIPT_MAX_STEP_MS)
+            {
+                return -1;
+            }
+            cursor = end;
+        }
+        script->count++;
+
+        if(*cursor == ',')
+        {
+            cursor++;
+        }
+        else if(*cursor != '\0')
+        {
+            return -1;
+        }
+    }
+
+    return script->count > 0 ? 0 : -1;
+}
+
+/**
+ * Initiate the script executor.
+ * @param executor Executor to initiate.
+ * @param clock Time source for deadlines and accuracy reporting.
+ * @param actuate Function called for each step fired.
+ * @param ctx Context passed to clock and actuate.
+ */
+void script_executor_init(struct script_executor *executor, script_clock_fn clock, script_actuate_fn actuate, void *ctx)
+{
+    pthread_condattr_t attr;
+
+    memset(executor, 0, sizeof(struct script_executor)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    pthread_mutex_init(&executor->lock, NULL);
+
+    // Deadlines are on CLOCK_MONOTONIC so wall clock changes do not shift a maneuver.
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&executor->wakeup, &attr);
+    pthread_condattr_destroy(&attr);
+
+    executor->clock = clock;
+    executor->actuate = actuate;
+    executor->ctx = ctx;
+    executor->next_deadline_ns = -1;
+}
+
+/**
+ * Release executor resources.
+ * @param executor Executor to destroy.
+ */
+void script_executor_destroy(struct script_executor *executor)
+{
+    pthread_cond_destroy(&executor->wakeup);
+    pthread_mutex_destroy(&executor->lock);
+}
+
+/**
+ * Start a script, preempting any script already running.
+ * @param executor Executor to run the script on.
+ * @param script Parsed script.
+ */
+void script_executor_start(struct script_executor *executor, const struct script *script)
+{
+    pthread_mutex_lock(&executor->lock);
+    if(executor->active)
+    {
+        executor->stats.scripts_cancelled++;
+    }
+    executor->current = *script;
+    executor->next_step = 0;
+    executor->active = 1;
+    executor->next_deadline_ns = executor->clock(executor->ctx);
+    pthread_cond_signal(&executor->wakeup);
+    pthread_mutex_unlock(&executor->lock);
+}
+
+/**
+ * Cancel the running script. Used when a live command arrives.
+ * @param executor Executor to cancel.
+ * @return 1 if a script was running, 0 otherwise.
+ */
+int script_executor_cancel(struct script_executor *executor)
+{
+    int was_active;
+
+    pthread_mutex_lock(&executor->lock);
+    was_active = executor->active;
+    if(was_active)
+    {
+        executor->active = 0;
+        executor->next_deadline_ns = -1;
+        executor->stats.scripts_cancelled++;
+        pthread_cond_signal(&executor->wakeup);
+    }
+    pthread_mutex_unlock(&executor->lock);
+
+    return was_active;
+}
+
+/**
+ * Steps of the running script not fired yet.
+ * @param executor Executor to inspect.
+ * @return Steps left, 0 if no script is running.
+ */
+size_t script_executor_pending(struct script_executor *executor)
+{
+    size_t pending = 0;
+
+    pthread_mutex_lock(&executor->lock);
+    if(executor->active)
+    {
+        pending = executor->current.count - executor->next_step;
+    }
+    pthread_mutex_unlock(&executor->lock);
+
+    return pending;
+}
+
+/**
+ * Fire every step that is due at now_ns.
+ * @param executor Executor to advance.
+ * @param now_ns Current time on the executor clock.
+ * @return Next deadline in nanoseconds, or -1 if no script is running.
+ */
+int64_t script_executor_step(struct script_executor *executor, int64_t now_ns)
+{
+    int64_t next;
+
+    pthread_mutex_lock(&executor->lock);
+    while(executor->active && now_ns >= executor->next_deadline_ns)
+    {
+        // Deadlines accumulate from the start of the script, so lateness of one step never shifts the next.
+        if(executor->next_step < executor->current.count)
+        {
+            const struct script_step *step = &executor->current.steps[executor->next_step];
+
+            script_fire(executor, step->command, now_ns);
+            executor->next_deadline_ns += step->duration_ms * NSEC_PER_MSEC;
+            executor->next_step++;
+        }
+        else
+        {
+            // Script finished, always leave the motors off.
+            if(executor->current.steps[executor->current.count - 1].command != SCRIPT_STOP)
+            {
+                script_fire(executor, SCRIPT_STOP, now_ns);
+            }
+            executor->active = 0;
+            executor->next_deadline_ns = -1;
+            executor->stats.scripts_completed++;
+        }
+    }
+    next = executor->active ? executor->next_deadline_ns : -1;
+    pthread_mutex_unlock(&executor->lock);
+
+    return next;
+}
+
+/**
+ * Thread body running the executor against CLOCK_MONOTONIC until cancelled.
+ * @param vargp Pointer to the script executor.
+ * @return NULL.
+ */
+void *script_executor_run(void *vargp)
+{
+    struct script_executor *executor = vargp;
+
+    trace_thread_name("script");
+
+    for(;;)
+    {
+        script_executor_step(executor, executor->clock(executor->ctx));
+
+        pthread_mutex_lock(&executor->lock);
+        if(!executor->active)
+        {
+            pthread_cond_wait(&executor->wakeup, &executor->lock);
+        }
+        else
+        {
+            struct timespec deadline;
+
+            deadline.tv_sec = (time_t)(executor->next_deadline_ns / NSEC_PER_SEC);
+            deadline.tv_nsec = (long)(executor->next_deadline_ns % NSEC_PER_SEC);
+            pthread_cond_timedwait(&executor->wakeup, &executor->lock, &deadline);
+        }
+        pthread_mutex_unlock(&executor->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * Print timing accuracy of the steps executed so far.
+ * @param executor Executor to report on.
+ */
+void script_executor_report(struct script_executor *executor)
+{
+    struct script_stats stats;
+
+    pthread_mutex_lock(&executor->lock);
+    stats = executor->stats;
+    pthread_mutex_unlock(&executor->lock);
+
+    printf("Script steps: %llu, completed: %llu, cancelled: %llu\n",
+           (unsigned long long)stats.steps_run, (unsigned long long)stats.scripts_completed,
+           (unsigned long long)stats.scripts_cancelled);
+    if(stats.steps_run > 0)
+    {
+        printf("Step lateness: mean %lld us, max %lld us\n",
+               (long long)(stats.lateness_total_ns / (int64_t)stats.steps_run / 1000), // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+               (long long)(stats.lateness_max_ns / 1000)); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    }
+}
+
+/**
+ * Default executor clock.
+ * @param ctx Unused.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+int64_t script_monotonic_ns(void *ctx)
+{
+    struct timespec ts;
+
+    (void)ctx;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Actuate one step and record how late it fired. Caller holds the lock.
+ * @param executor Executor firing the step.
+ * @param command Motor command.
+ * @param now_ns Time the step fired.
+ */
+static void script_fire(struct script_executor *executor, enum script_command command, int64_t now_ns)
+{
+    int64_t lateness = now_ns - executor->next_deadline_ns;
+
+    executor->stats.steps_run++;
+    executor->stats.lateness_total_ns += lateness;
+    if(lateness > executor->stats.lateness_max_ns)
+    {
+        executor->stats.lateness_max_ns = lateness;
+    }
+    executor->actuate(command, executor->ctx);
+}
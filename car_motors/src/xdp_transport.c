@@ -0,0 +1,634 @@
+// MAP_POPULATE, syscall and SIOCGIFHWADDR are not part of POSIX.
+#define _DEFAULT_SOURCE // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+#include "xdp_transport.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+// Frame layout: Ethernet, an IPv4 header without options and UDP.
+#define ETH_HEADER 14
+#define IP_HEADER 20
+#define UDP_HEADER 8
+#define XDP_HEADERS (ETH_HEADER + IP_HEADER + UDP_HEADER)
+#define ETH_TYPE_IP 0x0800
+#define IP_VERSION_IHL 0x45
+#define IP_DONT_FRAGMENT 0x4000
+#define IP_FRAGMENT_MASK 0x3fff
+#define IP_DEFAULT_TTL 64
+#define IP_PROTOCOL_UDP 17
+#define XDP_UMEM_SIZE ((XDP_RX_FRAMES + XDP_TX_FRAMES) * XDP_FRAME_SIZE)
+
+// Instruction of the steering program, see the kernel's filter.h macros.
+#define XDP_INSN(c, d, s, o, i) {.code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i)}
+#define XDP_LOAD(size, dst, src, offset) XDP_INSN(BPF_LDX | BPF_MEM | (size), dst, src, offset, 0)
+#define XDP_JNE(dst, value, pc) XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, dst, 0, XDP_PROGRAM_PASS - (pc) - 1, value)
+#define XDP_TO_HOST16(dst) XDP_INSN(BPF_ALU | BPF_END | BPF_TO_BE, dst, 0, 0, 16)
+// Index of the instruction that hands the frame to the kernel stack.
+#define XDP_PROGRAM_PASS 26
+#define XDP_VERIFIER_LOG_SIZE 65536
+
+static int xdp_bpf(int cmd, union bpf_attr *attr);
+static int xdp_ring_map(struct xdp_ring *ring, int fd, const struct xdp_ring_offset *offset, off_t page_offset, uint32_t entries, size_t entry_size);
+static int xdp_local_mac(const char *ifname, uint8_t *mac);
+static int xdp_program_load(int map_fd, in_port_t port);
+static int xdp_attach(struct xdp_transport *xdp, unsigned int ifindex);
+static void xdp_reclaim(struct xdp_transport *xdp);
+static void xdp_write_headers(struct xdp_transport *xdp, uint8_t *frame, size_t size, const struct sockaddr_in *to);
+static uint16_t ip_checksum(const uint8_t *header);
+static int xdp_fail(struct xdp_transport *xdp, const char *what);
+
+/**
+ * Set up the UMEM and rings, bind to one queue of the interface and attach
+ * the steering program. Native XDP is tried first, then the generic hook.
+ * @param xdp Transport to open.
+ * @param ifname Interface the commands arrive on.
+ * @param queue Receive queue to bind, commands on other queues go to the sockets.
+ * @param local_ip Address ACKs are sent from, network order.
+ * @param port Command port to steer, host order.
+ * @return 0 on success, -1 with the reason printed, the sockets are then used alone.
+ */
+int xdp_transport_open(struct xdp_transport *xdp, const char *ifname, uint32_t queue, in_addr_t local_ip, in_port_t port)
+{
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets offsets;
+    struct xdp_options options;
+    struct sockaddr_xdp address;
+    union bpf_attr attr;
+    socklen_t len;
+    unsigned int ifindex = if_nametoindex(ifname);
+    int rx_entries = XDP_RX_FRAMES;
+    int tx_entries = XDP_TX_FRAMES;
+
+    memset(xdp, 0, sizeof(struct xdp_transport)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    xdp->fd = -1;
+    xdp->map_fd = -1;
+    xdp->prog_fd = -1;
+    xdp->link_fd = -1;
+    xdp->local_ip = local_ip;
+    xdp->port = port;
+
+    if(ifindex == 0)
+    {
+        return xdp_fail(xdp, "interface");
+    }
+    if(xdp_local_mac(ifname, xdp->local_mac) == -1)
+    {
+        return xdp_fail(xdp, "interface address");
+    }
+
+    xdp->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if(xdp->fd == -1)
+    {
+        return xdp_fail(xdp, "socket");
+    }
+
+    xdp->umem = mmap(NULL, XDP_UMEM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if(xdp->umem == MAP_FAILED)
+    {
+        xdp->umem = NULL;
+        return xdp_fail(xdp, "UMEM");
+    }
+    memset(&reg, 0, sizeof(reg)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    reg.addr = (uintptr_t)xdp->umem;
+    reg.len = XDP_UMEM_SIZE;
+    reg.chunk_size = XDP_FRAME_SIZE;
+    if(setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) == -1 ||
+       setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_FILL_RING, &rx_entries, sizeof(rx_entries)) == -1 ||
+       setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &tx_entries, sizeof(tx_entries)) == -1 ||
+       setsockopt(xdp->fd, SOL_XDP, XDP_RX_RING, &rx_entries, sizeof(rx_entries)) == -1 ||
+       setsockopt(xdp->fd, SOL_XDP, XDP_TX_RING, &tx_entries, sizeof(tx_entries)) == -1)
+    {
+        return xdp_fail(xdp, "UMEM registration");
+    }
+
+    len = sizeof(offsets);
+    if(getsockopt(xdp->fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &len) == -1 ||
+       xdp_ring_map(&xdp->fill, xdp->fd, &offsets.fr, XDP_UMEM_PGOFF_FILL_RING, XDP_RX_FRAMES, sizeof(uint64_t)) == -1 ||
+       xdp_ring_map(&xdp->completion, xdp->fd, &offsets.cr, XDP_UMEM_PGOFF_COMPLETION_RING, XDP_TX_FRAMES, sizeof(uint64_t)) == -1 ||
+       xdp_ring_map(&xdp->rx, xdp->fd, &offsets.rx, XDP_PGOFF_RX_RING, XDP_RX_FRAMES, sizeof(struct xdp_desc)) == -1 ||
+       xdp_ring_map(&xdp->tx, xdp->fd, &offsets.tx, XDP_PGOFF_TX_RING, XDP_TX_FRAMES, sizeof(struct xdp_desc)) == -1)
+    {
+        return xdp_fail(xdp, "ring mapping");
+    }
+
+    // The first frames are for receiving and all start on the fill ring, the rest carry ACKs.
+    for(uint32_t i = 0; i < XDP_RX_FRAMES; i++)
+    {
+        ((uint64_t *)xdp->fill.desc)[i] = (uint64_t)i * XDP_FRAME_SIZE;
+    }
+    __atomic_store_n(xdp->fill.producer, XDP_RX_FRAMES, __ATOMIC_RELEASE);
+    for(uint32_t i = 0; i < XDP_TX_FRAMES; i++)
+    {
+        xdp->tx_free[i] = (uint64_t)(XDP_RX_FRAMES + i) * XDP_FRAME_SIZE;
+    }
+    xdp->tx_free_count = XDP_TX_FRAMES;
+
+    // The kernel picks zero copy where the driver supports it.
+    memset(&address, 0, sizeof(address)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    address.sxdp_family = AF_XDP;
+    address.sxdp_ifindex = ifindex;
+    address.sxdp_queue_id = queue;
+    address.sxdp_flags = XDP_USE_NEED_WAKEUP;
+    if(bind(xdp->fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        return xdp_fail(xdp, "bind");
+    }
+    len = sizeof(options);
+    if(getsockopt(xdp->fd, SOL_XDP, XDP_OPTIONS, &options, &len) == 0)
+    {
+        xdp->zero_copy = (options.flags & XDP_OPTIONS_ZEROCOPY) != 0;
+    }
+
+    // The steering program finds the socket by the queue the frame came in on.
+    memset(&attr, 0, sizeof(attr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(int);
+    attr.max_entries = queue + 1;
+    xdp->map_fd = xdp_bpf(BPF_MAP_CREATE, &attr);
+    if(xdp->map_fd == -1)
+    {
+        return xdp_fail(xdp, "socket map");
+    }
+    memset(&attr, 0, sizeof(attr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    attr.map_fd = (uint32_t)xdp->map_fd;
+    attr.key = (uintptr_t)&queue;
+    attr.value = (uintptr_t)&xdp->fd;
+    if(xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) == -1)
+    {
+        return xdp_fail(xdp, "socket map update");
+    }
+
+    xdp->prog_fd = xdp_program_load(xdp->map_fd, port);
+    if(xdp->prog_fd == -1)
+    {
+        return xdp_fail(xdp, "program load");
+    }
+    if(xdp_attach(xdp, ifindex) == -1)
+    {
+        return xdp_fail(xdp, "program attach");
+    }
+
+    xdp->active = 1;
+    printf("AF_XDP on %s queue %u, %s XDP, %s\n", ifname, queue, xdp->native ? "native" : "generic",
+           xdp->zero_copy ? "zero copy" : "copy mode");
+    return 0;
+}
+
+/**
+ * Detach the program and unmap everything. Safe on a transport that failed to open.
+ * @param xdp Transport to close.
+ */
+void xdp_transport_close(struct xdp_transport *xdp)
+{
+    struct xdp_ring *rings[] = {&xdp->fill, &xdp->completion, &xdp->rx, &xdp->tx};
+
+    // Closing the link detaches the program, commands go back to the sockets.
+    if(xdp->link_fd != -1)
+    {
+        close(xdp->link_fd);
+    }
+    if(xdp->prog_fd != -1)
+    {
+        close(xdp->prog_fd);
+    }
+    if(xdp->map_fd != -1)
+    {
+        close(xdp->map_fd);
+    }
+    for(size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++)
+    {
+        if(rings[i]->map)
+        {
+            munmap(rings[i]->map, rings[i]->map_size);
+        }
+    }
+    if(xdp->fd != -1)
+    {
+        close(xdp->fd);
+    }
+    if(xdp->umem)
+    {
+        munmap(xdp->umem, XDP_UMEM_SIZE);
+    }
+    xdp->active = 0;
+    xdp->fd = -1;
+    xdp->map_fd = -1;
+    xdp->prog_fd = -1;
+    xdp->link_fd = -1;
+    xdp->umem = NULL;
+}
+
+/**
+ * Point at the UDP payload of the next frame received. The frame stays with
+ * the caller until xdp_transport_release; frames that are not a well formed
+ * datagram are given back and skipped.
+ * @param xdp Transport to read.
+ * @param size Set to the payload size.
+ * @param from Set to the sender's address.
+ * @return The payload in the UMEM, NULL if nothing is waiting.
+ */
+uint8_t *xdp_transport_peek(struct xdp_transport *xdp, size_t *size, struct sockaddr_in *from)
+{
+    while(!xdp->holding)
+    {
+        uint32_t consumer = __atomic_load_n(xdp->rx.consumer, __ATOMIC_RELAXED);
+        const struct xdp_desc *desc;
+        const uint8_t *frame;
+        uint16_t udp_length;
+
+        if(consumer == __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE))
+        {
+            return NULL;
+        }
+        desc = &((const struct xdp_desc *)xdp->rx.desc)[consumer & xdp->rx.mask];
+        xdp->held = desc->addr;
+        xdp->holding = 1;
+        frame = &xdp->umem[desc->addr];
+
+        // The program only steers option-less IPv4, the UDP length is still checked against the frame.
+        udp_length = 0;
+        if(desc->len >= XDP_HEADERS)
+        {
+            memcpy(&udp_length, &frame[ETH_HEADER + IP_HEADER + 4], sizeof(udp_length)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+            udp_length = ntohs(udp_length);
+        }
+        if(desc->len >= XDP_HEADERS && frame[ETH_HEADER] == IP_VERSION_IHL &&
+           udp_length >= UDP_HEADER && udp_length <= desc->len - ETH_HEADER - IP_HEADER)
+        {
+            memcpy(xdp->peer_mac, &frame[XDP_ETH_ALEN], XDP_ETH_ALEN); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+            from->sin_family = AF_INET;
+            memcpy(&from->sin_addr.s_addr, &frame[ETH_HEADER + 12], sizeof(from->sin_addr.s_addr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+            memcpy(&from->sin_port, &frame[ETH_HEADER + IP_HEADER], sizeof(from->sin_port)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+            *size = (size_t)udp_length - UDP_HEADER;
+            xdp->rx_packets++;
+            return &xdp->umem[desc->addr + XDP_HEADERS];
+        }
+        xdp->rx_malformed++;
+        xdp_transport_release(xdp);
+    }
+    return NULL;
+}
+
+/**
+ * Give the frame last peeked back to the fill ring.
+ * @param xdp Transport read from.
+ */
+void xdp_transport_release(struct xdp_transport *xdp)
+{
+    uint32_t producer;
+
+    if(!xdp->holding)
+    {
+        return;
+    }
+
+    // Every receive frame has a fill ring entry, so this never overflows.
+    producer = __atomic_load_n(xdp->fill.producer, __ATOMIC_RELAXED);
+    ((uint64_t *)xdp->fill.desc)[producer & xdp->fill.mask] = xdp->held & ~(uint64_t)(XDP_FRAME_SIZE - 1);
+    __atomic_store_n(xdp->fill.producer, producer + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(xdp->rx.consumer, __atomic_load_n(xdp->rx.consumer, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+    xdp->holding = 0;
+}
+
+/**
+ * Send a datagram back to the source of the frame last received.
+ * @param xdp Transport to send on.
+ * @param bytes UDP payload.
+ * @param size Payload size.
+ * @param to Destination address and port.
+ * @return 0 on success, -1 if no transmit frame or ring slot was free.
+ */
+int xdp_transport_send(struct xdp_transport *xdp, const uint8_t *bytes, size_t size, const struct sockaddr_in *to)
+{
+    uint32_t producer;
+    uint64_t addr;
+    struct xdp_desc *desc;
+
+    xdp_reclaim(xdp);
+    producer = __atomic_load_n(xdp->tx.producer, __ATOMIC_RELAXED);
+    if(xdp->tx_free_count == 0 || size > XDP_FRAME_SIZE - XDP_HEADERS ||
+       producer - __atomic_load_n(xdp->tx.consumer, __ATOMIC_ACQUIRE) > xdp->tx.mask)
+    {
+        xdp->tx_dropped++;
+        return -1;
+    }
+
+    addr = xdp->tx_free[--xdp->tx_free_count];
+    xdp_write_headers(xdp, &xdp->umem[addr], size, to);
+    memcpy(&xdp->umem[addr + XDP_HEADERS], bytes, size); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+
+    desc = &((struct xdp_desc *)xdp->tx.desc)[producer & xdp->tx.mask];
+    desc->addr = addr;
+    desc->len = (uint32_t)(XDP_HEADERS + size);
+    desc->options = 0;
+    __atomic_store_n(xdp->tx.producer, producer + 1, __ATOMIC_RELEASE);
+
+    // Copy mode and most drivers only transmit when kicked.
+    if(__atomic_load_n(xdp->tx.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)
+    {
+        sendto(xdp->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+    }
+    xdp->tx_packets++;
+    return 0;
+}
+
+/**
+ * Frames received and not yet processed.
+ * @param xdp Transport to inspect.
+ * @return Number of frames on the receive ring.
+ */
+size_t xdp_transport_depth(const struct xdp_transport *xdp)
+{
+    return __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE) - __atomic_load_n(xdp->rx.consumer, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Print what went through the AF_XDP path.
+ * @param xdp Transport to print.
+ */
+void xdp_transport_report(const struct xdp_transport *xdp)
+{
+    printf("AF_XDP: %llu received, %llu malformed, %llu sent, %llu ACKs dropped\n",
+           (unsigned long long)xdp->rx_packets, (unsigned long long)xdp->rx_malformed,
+           (unsigned long long)xdp->tx_packets, (unsigned long long)xdp->tx_dropped);
+}
+
+/**
+ * bpf(2), which has no libc wrapper.
+ * @param cmd Command.
+ * @param attr Attributes of the command.
+ * @return Result of the command, -1 with errno set on failure.
+ */
+static int xdp_bpf(int cmd, union bpf_attr *attr)
+{
+    return (int)syscall(SYS_bpf, cmd, attr, sizeof(union bpf_attr));
+}
+
+/**
+ * Map one ring of the socket.
+ * @param ring Ring to fill in.
+ * @param fd AF_XDP socket.
+ * @param offset Offsets of the ring fields in its mapping.
+ * @param page_offset Which ring to map.
+ * @param entries Ring size, a power of two.
+ * @param entry_size Size of one descriptor.
+ * @return 0 on success, -1 on failure.
+ */
+static int xdp_ring_map(struct xdp_ring *ring, int fd, const struct xdp_ring_offset *offset, off_t page_offset, uint32_t entries, size_t entry_size)
+{
+    uint8_t *map;
+
+    ring->map_size = offset->desc + entries * entry_size;
+    map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, page_offset);
+    if(map == MAP_FAILED)
+    {
+        return -1;
+    }
+    ring->map = map;
+    ring->producer = (uint32_t *)(void *)&map[offset->producer];
+    ring->consumer = (uint32_t *)(void *)&map[offset->consumer];
+    ring->flags = (uint32_t *)(void *)&map[offset->flags];
+    ring->desc = &map[offset->desc];
+    ring->mask = entries - 1;
+    return 0;
+}
+
+/**
+ * Read the MAC address ACKs are sent from.
+ * @param ifname Interface.
+ * @param mac Filled in with XDP_ETH_ALEN bytes.
+ * @return 0 on success, -1 on failure.
+ */
+static int xdp_local_mac(const char *ifname, uint8_t *mac)
+{
+    struct ifreq request;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int result;
+
+    if(fd == -1)
+    {
+        return -1;
+    }
+    memset(&request, 0, sizeof(request)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    strncpy(request.ifr_name, ifname, IFNAMSIZ - 1); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    result = ioctl(fd, SIOCGIFHWADDR, &request);
+    close(fd);
+    if(result == -1)
+    {
+        return -1;
+    }
+    memcpy(mac, request.ifr_hwaddr.sa_data, XDP_ETH_ALEN); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    return 0;
+}
+
+/**
+ * Load the program steering the command port into the socket map. It passes
+ * anything that is not option-less, unfragmented IPv4 UDP to the port, and
+ * bpf_redirect_map falls back to XDP_PASS on a queue with no socket.
+ * @param map_fd XSKMAP of the sockets by queue.
+ * @param port Command port, host order.
+ * @return Program FD, -1 on failure.
+ */
+static int xdp_program_load(int map_fd, in_port_t port)
+{
+    const struct bpf_insn program[] = {
+        XDP_LOAD(BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data)),                   // 0
+        XDP_LOAD(BPF_W, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end)),
+        XDP_LOAD(BPF_W, BPF_REG_4, BPF_REG_1, offsetof(struct xdp_md, rx_queue_index)),
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_5, BPF_REG_2, 0, 0),
+        XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_5, 0, 0, XDP_HEADERS),
+        XDP_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_5, BPF_REG_3, XDP_PROGRAM_PASS - 5 - 1, 0),   // 5: too short.
+        XDP_LOAD(BPF_H, BPF_REG_5, BPF_REG_2, 12),
+        XDP_TO_HOST16(BPF_REG_5),
+        XDP_JNE(BPF_REG_5, ETH_TYPE_IP, 8),
+        XDP_LOAD(BPF_B, BPF_REG_5, BPF_REG_2, ETH_HEADER),
+        XDP_JNE(BPF_REG_5, IP_VERSION_IHL, 10),                                                 // 10
+        XDP_LOAD(BPF_B, BPF_REG_5, BPF_REG_2, ETH_HEADER + 9),
+        XDP_JNE(BPF_REG_5, IP_PROTOCOL_UDP, 12),
+        XDP_LOAD(BPF_H, BPF_REG_5, BPF_REG_2, ETH_HEADER + 6),
+        XDP_TO_HOST16(BPF_REG_5),
+        XDP_INSN(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, IP_FRAGMENT_MASK),                // 15
+        XDP_JNE(BPF_REG_5, 0, 16),
+        XDP_LOAD(BPF_H, BPF_REG_5, BPF_REG_2, ETH_HEADER + IP_HEADER + 2),
+        XDP_TO_HOST16(BPF_REG_5),
+        XDP_JNE(BPF_REG_5, port, 19),
+        XDP_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd),           // 20: map, two slots.
+        XDP_INSN(0, 0, 0, 0, 0),
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_4, 0, 0),
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS),
+        XDP_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),                                               // 25
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),                       // XDP_PROGRAM_PASS
+        XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+    static char log[XDP_VERIFIER_LOG_SIZE]; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+    union bpf_attr attr;
+    int fd;
+
+    _Static_assert(sizeof(program) / sizeof(program[0]) == XDP_PROGRAM_PASS + 2, "XDP_PROGRAM_PASS does not point at the pass instruction");
+
+    memset(&attr, 0, sizeof(attr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns = (uintptr_t)program;
+    attr.insn_cnt = sizeof(program) / sizeof(program[0]);
+    attr.license = (uintptr_t)"Dual BSD/GPL";
+    fd = xdp_bpf(BPF_PROG_LOAD, &attr);
+    if(fd != -1)
+    {
+        return fd;
+    }
+
+    // Loaded again only to print why the verifier refused it.
+    log[0] = '\0';
+    attr.log_buf = (uintptr_t)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    fd = xdp_bpf(BPF_PROG_LOAD, &attr);
+    if(fd == -1)
+    {
+        printf("%s\n", log);
+    }
+    return fd;
+}
+
+/**
+ * Attach the program through a BPF link, so it is detached with the link
+ * however the process ends. Native mode first, then the generic hook.
+ * @param xdp Transport with the program loaded.
+ * @param ifindex Interface to attach to.
+ * @return 0 on success, -1 on failure.
+ */
+static int xdp_attach(struct xdp_transport *xdp, unsigned int ifindex)
+{
+    const uint32_t modes[] = {XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE};
+    union bpf_attr attr;
+
+    for(size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        memset(&attr, 0, sizeof(attr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        attr.link_create.prog_fd = (uint32_t)xdp->prog_fd;
+        attr.link_create.target_ifindex = ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = modes[i];
+        xdp->link_fd = xdp_bpf(BPF_LINK_CREATE, &attr);
+        if(xdp->link_fd != -1)
+        {
+            xdp->native = modes[i] == XDP_FLAGS_DRV_MODE;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Take back the transmit frames the kernel is done with.
+ * @param xdp Transport to reclaim on.
+ */
+static void xdp_reclaim(struct xdp_transport *xdp)
+{
+    uint32_t consumer = __atomic_load_n(xdp->completion.consumer, __ATOMIC_RELAXED);
+    uint32_t producer = __atomic_load_n(xdp->completion.producer, __ATOMIC_ACQUIRE);
+
+    while(consumer != producer)
+    {
+        xdp->tx_free[xdp->tx_free_count++] = ((const uint64_t *)xdp->completion.desc)[consumer & xdp->completion.mask];
+        consumer++;
+    }
+    __atomic_store_n(xdp->completion.consumer, consumer, __ATOMIC_RELEASE);
+}
+
+/**
+ * Write the Ethernet, IPv4 and UDP headers of a datagram to the peer of the
+ * frame last received. The UDP checksum is left out, which IPv4 allows.
+ * @param xdp Transport sending.
+ * @param frame Frame to write at.
+ * @param size UDP payload size.
+ * @param to Destination address and port.
+ */
+static void xdp_write_headers(struct xdp_transport *xdp, uint8_t *frame, size_t size, const struct sockaddr_in *to)
+{
+    uint8_t *ip = &frame[ETH_HEADER];
+    uint8_t *udp = &frame[ETH_HEADER + IP_HEADER];
+    uint16_t field;
+
+    memcpy(frame, xdp->peer_mac, XDP_ETH_ALEN); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    memcpy(&frame[XDP_ETH_ALEN], xdp->local_mac, XDP_ETH_ALEN); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    field = htons(ETH_TYPE_IP);
+    memcpy(&frame[2 * XDP_ETH_ALEN], &field, sizeof(field)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+
+    memset(ip, 0, IP_HEADER); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    ip[0] = IP_VERSION_IHL;
+    field = htons((uint16_t)(IP_HEADER + UDP_HEADER + size));
+    memcpy(&ip[2], &field, sizeof(field)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    field = htons(xdp->ip_id++);
+    memcpy(&ip[4], &field, sizeof(field)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    field = htons(IP_DONT_FRAGMENT);
+    memcpy(&ip[6], &field, sizeof(field)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    ip[8] = IP_DEFAULT_TTL; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    ip[9] = IP_PROTOCOL_UDP; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    memcpy(&ip[12], &xdp->local_ip, sizeof(xdp->local_ip)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    memcpy(&ip[16], &to->sin_addr.s_addr, sizeof(to->sin_addr.s_addr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    field = ip_checksum(ip);
+    memcpy(&ip[10], &field, sizeof(field)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+
+    field = htons(xdp->port);
+    memcpy(udp, &field, sizeof(field)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    memcpy(&udp[2], &to->sin_port, sizeof(to->sin_port)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    field = htons((uint16_t)(UDP_HEADER + size));
+    memcpy(&udp[4], &field, sizeof(field)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    memset(&udp[6], 0, sizeof(uint16_t)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+/**
+ * Internet checksum of an IPv4 header with its checksum field zeroed.
+ * @param header IP_HEADER bytes.
+ * @return Checksum, ready to store as is.
+ */
+static uint16_t ip_checksum(const uint8_t *header)
+{
+    uint32_t sum = 0;
+    uint16_t word;
+
+    for(size_t i = 0; i < IP_HEADER; i += 2)
+    {
+        memcpy(&word, &header[i], sizeof(word)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        sum += word;
+    }
+    while(sum >> 16)   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    }
+    return (uint16_t)~sum;
+}
+
+/**
+ * Print why the AF_XDP path could not be set up and release what was.
+ * @param xdp Transport being opened.
+ * @param what Step that failed.
+ * @return -1.
+ */
+static int xdp_fail(struct xdp_transport *xdp, const char *what)
+{
+    printf("AF_XDP %s failed: %s\n", what, strerror(errno));
+    xdp_transport_close(xdp);
+    return -1;
+}
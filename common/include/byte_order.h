@@ -0,0 +1,59 @@
+#ifndef COMMON_BYTE_ORDER_H
+#define COMMON_BYTE_ORDER_H
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Big endian (network order) fields of the wire formats, read and written
+ * through memcpy so they may sit at any offset in a packet.
+ */
+
+/**
+ * Write a big endian (network order) 32 bit value.
+ * @param bytes Destination bytes.
+ * @param value Value.
+ */
+static inline void store_be32(uint8_t *bytes, uint32_t value)
+{
+    uint32_t network = htonl(value);
+
+    memcpy(bytes, &network, sizeof(network)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+}
+
+/**
+ * Read a big endian (network order) 32 bit value.
+ * @param bytes Source bytes.
+ * @return Value.
+ */
+static inline uint32_t load_be32(const uint8_t *bytes)
+{
+    uint32_t network;
+
+    memcpy(&network, bytes, sizeof(network)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    return ntohl(network);
+}
+
+/**
+ * Write a big endian (network order) 64 bit value.
+ * @param bytes Destination bytes.
+ * @param value Value.
+ */
+static inline void store_be64(uint8_t *bytes, uint64_t value)
+{
+    store_be32(bytes, (uint32_t)(value >> 32));   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    store_be32(&bytes[sizeof(uint32_t)], (uint32_t)value);
+}
+
+/**
+ * Read a big endian (network order) 64 bit value.
+ * @param bytes Source bytes.
+ * @return Value.
+ */
+static inline uint64_t load_be64(const uint8_t *bytes)
+{
+    return ((uint64_t)load_be32(bytes) << 32) | load_be32(&bytes[sizeof(uint32_t)]);   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+#endif //COMMON_BYTE_ORDER_H
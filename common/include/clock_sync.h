@@ -0,0 +1,69 @@
+#ifndef COMMON_CLOCK_SYNC_H
+#define COMMON_CLOCK_SYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#define CLOCK_STAMPS_SIZE 24
+#define CLOCK_SYNC_WINDOW 8
+
+// Timestamps every packet carries, NTP symmetric mode style, in CLOCK_REALTIME ns.
+struct clock_stamps {
+    int64_t origin;   // transmit stamp of the last packet received from the peer.
+    int64_t receive;  // when that packet was received here.
+    int64_t transmit; // when this packet was sent.
+};
+
+// One offset measurement, kept for the clock filter.
+struct clock_sync_sample {
+    int64_t offset_ns;
+    int64_t delay_ns;
+    int64_t local_ns;
+};
+
+// Running min/mean/max of a latency.
+struct latency_stat {
+    uint64_t count;
+    int64_t total_ns;
+    int64_t min_ns;
+    int64_t max_ns;
+};
+
+/**
+ * Offset and drift of the peer clock relative to ours. Each packet received
+ * with an echoed origin completes a sample (t1 origin, t2 receive, t3
+ * transmit, t4 local receive). The sample with the lowest round trip delay in
+ * the window sets the offset, and the drift is the slope of the offset over at
+ * least a second. One-way latencies assume that best sample was symmetric.
+ */
+struct clock_sync {
+    int64_t peer_transmit;
+    int64_t local_receive;
+    struct clock_sync_sample window[CLOCK_SYNC_WINDOW];
+    size_t count;
+    size_t next;
+    struct clock_sync_sample best;
+    struct clock_sync_sample anchor;
+    double drift;
+    int valid;
+    struct latency_stat outbound;   // our transmit to peer receive.
+    struct latency_stat inbound;    // peer transmit to our receive.
+    struct latency_stat turnaround; // peer receive to peer transmit.
+};
+
+void clock_sync_init(struct clock_sync *sync);
+int64_t clock_sync_now_ns(void);
+void clock_sync_stamp(const struct clock_sync *sync, struct clock_stamps *stamps);
+int clock_sync_receive(struct clock_sync *sync, const struct clock_stamps *stamps, int64_t received_ns);
+int64_t clock_sync_offset(const struct clock_sync *sync, int64_t local_ns);
+void clock_sync_report(const struct clock_sync *sync, const char *outbound_name, const char *inbound_name, const char *turnaround_name);
+void clock_stamps_encode(const struct clock_stamps *stamps, uint8_t *bytes);
+void clock_stamps_decode(const uint8_t *bytes, struct clock_stamps *stamps);
+void latency_stat_add(struct latency_stat *stat, int64_t value_ns);
+void latency_stat_report(const struct latency_stat *stat, const char *name);
+int clock_sync_enable_timestamps(int fd);
+ssize_t clock_sync_recvfrom(int fd, void *buffer, size_t size, struct sockaddr *from_addr, socklen_t *from_addr_len, int64_t *received_ns);
+
+#endif //COMMON_CLOCK_SYNC_H
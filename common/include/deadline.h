@@ -0,0 +1,49 @@
+#ifndef COMMON_DEADLINE_H
+#define COMMON_DEADLINE_H
+
+#include "clock_sync.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEADLINE_SIZE 12
+// The lowest one-way delay is kept per bucket, the base is the lowest of the last few.
+#define DEADLINE_BASE_BUCKETS 6
+#define DEADLINE_BUCKET_NS 10000000000LL
+
+/**
+ * When a command was issued and how long it may take to reach the motors,
+ * both on the sender's CLOCK_REALTIME. The issue time is taken when the
+ * command is serialized, so retransmissions keep it while their transmit
+ * stamp moves on. A budget of 0 never expires.
+ */
+struct deadline {
+    int64_t issued_ns;
+    uint32_t budget_us;
+};
+
+/**
+ * Ages the commands of one sender against their deadlines. With a valid clock
+ * sync estimate the age is measured on the sender's clock. Without one it is
+ * session relative: the delay above the lowest transmit to receive difference
+ * seen over the last DEADLINE_BASE_BUCKETS buckets, which needs no offset and
+ * follows a clock step within a minute.
+ */
+struct deadline_tracker {
+    int64_t base_ns[DEADLINE_BASE_BUCKETS];
+    int64_t bucket_start_ns;
+    size_t bucket;
+    int has_base;
+    uint64_t checked;
+    uint64_t expired;
+    struct latency_stat applied_age; // issue to actuation of commands on time.
+    struct latency_stat overdue;     // past the deadline by, for expired commands.
+};
+
+void deadline_encode(const struct deadline *deadline, uint8_t *bytes);
+void deadline_decode(const uint8_t *bytes, struct deadline *deadline);
+void deadline_tracker_init(struct deadline_tracker *tracker);
+void deadline_tracker_observe(struct deadline_tracker *tracker, int64_t transmit_ns, int64_t received_ns);
+int deadline_tracker_expired(struct deadline_tracker *tracker, const struct clock_sync *sync, const struct deadline *deadline, int64_t now_ns);
+void deadline_tracker_report(const struct deadline_tracker *tracker);
+
+#endif //COMMON_DEADLINE_H
@@ -0,0 +1,31 @@
+#ifndef COMMON_FEC_H
+#define COMMON_FEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FEC_MAX_DEPTH 8
+#define FEC_ENTRY_SIZE 7
+
+// A past command repeated in later packets so a lost one can be rebuilt.
+struct fec_entry {
+    uint32_t command_id;
+    uint8_t sequence_flag;
+    uint8_t clockwise;
+    uint8_t counter_clockwise;
+};
+
+// The last depth commands sent, oldest first when encoded.
+struct fec_history {
+    struct fec_entry entries[FEC_MAX_DEPTH];
+    size_t depth;
+    size_t count;
+    size_t next;
+};
+
+void fec_history_init(struct fec_history *history, size_t depth);
+void fec_history_push(struct fec_history *history, const struct fec_entry *entry);
+size_t fec_encode(const struct fec_history *history, uint8_t *bytes);
+size_t fec_decode(const uint8_t *bytes, size_t available, struct fec_entry *entries, size_t *count);
+
+#endif //COMMON_FEC_H
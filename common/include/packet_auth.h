@@ -0,0 +1,46 @@
+#ifndef COMMON_PACKET_AUTH_H
+#define COMMON_PACKET_AUTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACKET_AUTH_KEY_SIZE 16
+#define PACKET_AUTH_COUNTER_SIZE 8
+#define PACKET_AUTH_TAG_SIZE 8
+#define PACKET_AUTH_TRAILER_SIZE (PACKET_AUTH_COUNTER_SIZE + PACKET_AUTH_TAG_SIZE)
+// packet_auth_open: authentic, but from a peer session not bound to this one yet.
+#define PACKET_AUTH_UNBOUND 1
+
+/**
+ * Pre-shared key state for one side of the link. Every packet carries a
+ * trailer of a big endian message counter and a SipHash-2-4 tag over the
+ * packet and counter. A counter is never sent twice and only a counter above
+ * the last one accepted is let through, so no captured packet can be
+ * replayed; retransmissions are sealed again with a new counter.
+ *
+ * Counters belong to a session: every process counts from 1, and the
+ * receiver keeps one window per lane, for the peer epoch it last accepted.
+ * A packet of another epoch may only open a new window if it is bound to
+ * this process, by carrying this process's own epoch as the one it was sent
+ * to. A peer only learns that epoch from this process, so nothing sealed
+ * before this process started can open a window, whatever the wall clocks
+ * on either side say.
+ */
+struct packet_auth {
+    int enabled;
+    uint8_t key[PACKET_AUTH_KEY_SIZE];
+    uint64_t tx_counter;       // last counter sealed by this process.
+    uint64_t rx_epoch;         // peer epoch rx_counter belongs to, 0 before the first packet.
+    uint64_t rx_counter;       // highest counter accepted from it.
+    uint64_t rejected_tag;
+    uint64_t rejected_replay;
+    uint64_t rejected_unbound; // authentic packets of a peer session not bound to this one.
+};
+
+int packet_auth_load_key(struct packet_auth *auth, const char *path);
+size_t packet_auth_seal(struct packet_auth *auth, uint8_t *bytes, size_t size);
+int packet_auth_open(struct packet_auth *auth, const uint8_t *bytes, size_t size, uint64_t epoch, int bound, size_t *payload_size);
+void packet_auth_set_window(struct packet_auth *auth, uint64_t epoch, uint64_t counter);
+uint64_t siphash24(const uint8_t key[PACKET_AUTH_KEY_SIZE], const uint8_t *data, size_t len);
+
+#endif //COMMON_PACKET_AUTH_H
@@ -0,0 +1,63 @@
+#ifndef COMMON_SESSION_H
+#define COMMON_SESSION_H
+
+#include <stdint.h>
+
+#define SESSION_MAGIC 0x43415253u // "CARS"
+#define SESSION_VERSION 6
+#define SESSION_EPOCH_SIZE 8
+#define SESSION_RETIRED_EPOCHS 8
+
+/**
+ * The epoch a peer is followed in and the ones it had before. Epochs are
+ * only compared for equality: a restarted peer whose wall clock was stepped
+ * back still gets followed, while a late packet from a process it replaced
+ * is dropped.
+ */
+struct session_peer {
+    uint64_t epoch;                            // current epoch, 0 before first contact.
+    uint64_t retired[SESSION_RETIRED_EPOCHS];  // earlier epochs, newest first.
+};
+
+/**
+ * Link state that survives a restart. With a state file it lives in a shared
+ * file mapping, so every store is in the page cache the moment it is made and
+ * a process that crashes or is killed loses nothing; without one it is plain
+ * process memory.
+ *
+ * Every start gets a new epoch, different from the one saved, so the peer
+ * can tell a restarted process from a late packet of the one it replaced.
+ * The epoch is the wall clock in nanoseconds at start, so even without a
+ * state file two starts within the same second get different epochs.
+ */
+struct session_state {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t epoch;           // this process, new on every start.
+    struct session_peer peer; // the other side.
+    uint32_t peer_address;    // IPv4 address the peer last sent from, network order, 0 if unknown.
+    uint16_t peer_port;       // and its port, network order.
+    int sequence;             // alternating sequence bit.
+    uint32_t command_id;      // last command id sent or applied.
+    uint32_t stop_generation; // last stop generation sent or applied.
+    uint32_t restarts;        // warm restarts from this file.
+    uint64_t auth_epoch;      // peer epoch of the MAC counter window, 0 without a key.
+    uint64_t auth_counter;    // highest MAC counter accepted in it.
+};
+
+// An open session, warm if its state was restored from a file.
+struct session {
+    struct session_state *state;
+    struct session_state local;
+    int warm;
+};
+
+int session_open(struct session *session, const char *path);
+void session_close(struct session *session);
+int session_epoch_newer(uint64_t epoch, uint64_t than);
+int session_peer_retired(const struct session_peer *peer, uint64_t epoch);
+void session_peer_follow(struct session_peer *peer, uint64_t epoch);
+void session_epoch_encode(uint64_t epoch, uint8_t *bytes);
+uint64_t session_epoch_decode(const uint8_t *bytes);
+
+#endif //COMMON_SESSION_H
@@ -0,0 +1,52 @@
+#ifndef COMMON_SHM_RING_H
+#define COMMON_SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHM_RING_SLOTS 64
+// Room for the largest packet, a full FEC history and the longest script included.
+#define SHM_RING_SLOT_SIZE 2048
+#define SHM_RING_CACHE_LINE 64
+
+// One packet in the ring.
+struct shm_ring_slot {
+    uint32_t size;
+    uint8_t bytes[SHM_RING_SLOT_SIZE];
+};
+
+/**
+ * Single-producer/single-consumer ring living in shared memory. head is only
+ * written by the producer and tail only by the consumer; each sits on its own
+ * cache line. The consumer sleeps on head with a futex when the ring is empty.
+ */
+struct shm_ring {
+    _Alignas(SHM_RING_CACHE_LINE) uint32_t head;
+    uint32_t consumer_waiting;
+    _Alignas(SHM_RING_CACHE_LINE) uint32_t tail;
+    _Alignas(SHM_RING_CACHE_LINE) struct shm_ring_slot slots[SHM_RING_SLOTS];
+};
+
+// Both directions between car_controller and car_motors in one mapping.
+struct shm_channel {
+    struct shm_ring command;
+    struct shm_ring ack;
+};
+
+// An open shared memory transport, seen from one side.
+struct shm_transport {
+    struct shm_channel *channel;
+    struct shm_ring *tx;
+    struct shm_ring *rx;
+};
+
+int shm_transport_open(struct shm_transport *transport, const char *name, int is_controller);
+void shm_transport_close(struct shm_transport *transport);
+uint8_t *shm_ring_reserve(struct shm_ring *ring);
+void shm_ring_commit(struct shm_ring *ring, size_t size);
+uint8_t *shm_ring_peek(struct shm_ring *ring, size_t *size);
+void shm_ring_release(struct shm_ring *ring);
+size_t shm_ring_depth(const struct shm_ring *ring);
+int shm_ring_wait(struct shm_ring *ring, int timeout_ms);
+
+#endif //COMMON_SHM_RING_H
@@ -0,0 +1,52 @@
+#ifndef COMMON_TELEMETRY_H
+#define COMMON_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_SIZE 32
+#define TELEMETRY_SERIES 1024
+#define TELEMETRY_SCRIPT_ACTIVE 0x01
+#define TELEMETRY_PULSE_PENDING 0x02
+#define TELEMETRY_COMMAND_EXPIRED 0x04
+#define TELEMETRY_SESSION_START 0x08
+
+/**
+ * Vehicle state car_motors sends in place of the ACK payload. It is a fixed
+ * TELEMETRY_SIZE bytes, encoded field by field in network order with no
+ * loops over variable data, so every ACK pays the same small cost.
+ */
+struct telemetry {
+    uint8_t motor_state;        // MOTOR_OFF, MOTOR_CLOCKWISE or MOTOR_COUNTER_CLOCKWISE.
+    uint8_t flags;              // TELEMETRY_SCRIPT_ACTIVE, TELEMETRY_PULSE_PENDING, TELEMETRY_COMMAND_EXPIRED, TELEMETRY_SESSION_START.
+    uint16_t script_steps;      // steps left in the running script.
+    uint32_t command_id;        // last command applied.
+    int64_t actuated_ns;        // last motor change, car_motors CLOCK_REALTIME.
+    uint32_t packets;           // packets handled since start.
+    uint32_t rx_queue_bytes;    // receive buffer in use when the ACK was sent.
+    uint32_t loop_mean_us;      // receive loop iteration time since the previous ACK.
+    uint32_t loop_max_us;
+};
+
+// A telemetry report and when it arrived here.
+struct telemetry_sample {
+    int64_t received_ns;
+    int64_t sent_ns; // car_motors transmit stamp, for the age of actuated_ns.
+    struct telemetry telemetry;
+};
+
+// Rolling time series of the last TELEMETRY_SERIES reports.
+struct telemetry_series {
+    struct telemetry_sample samples[TELEMETRY_SERIES];
+    size_t count;
+    size_t next;
+    uint64_t total;
+};
+
+void telemetry_encode(const struct telemetry *telemetry, uint8_t *bytes);
+int telemetry_decode(const uint8_t *bytes, size_t available, struct telemetry *telemetry);
+void telemetry_series_add(struct telemetry_series *series, int64_t received_ns, int64_t sent_ns, const struct telemetry *telemetry);
+const struct telemetry_sample *telemetry_series_latest(const struct telemetry_series *series);
+void telemetry_series_report(const struct telemetry_series *series);
+
+#endif //COMMON_TELEMETRY_H
@@ -0,0 +1,51 @@
+#ifndef COMMON_TIMER_WHEEL_H
+#define COMMON_TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1U << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+struct timer_entry;
+
+// Called when a timer expires. The entry is already detached and may be re-armed.
+typedef void (*timer_callback)(struct timer_entry *timer, void *arg);
+
+/**
+ * A timer owned by the caller and linked into the wheel while pending, so
+ * insert and cancel never allocate.
+ */
+struct timer_entry {
+    struct timer_entry *next;
+    struct timer_entry *prev;
+    uint64_t expires;
+    timer_callback callback;
+    void *arg;
+    unsigned int bucket;
+    int pending;
+};
+
+/**
+ * Hierarchical timer wheel with millisecond ticks. Level n holds timers due
+ * within 64^(n+1) ticks; they cascade down as time advances. Timers further
+ * out than the top level are parked there and re-cascaded until due.
+ */
+struct timer_wheel {
+    uint64_t now;
+    struct timer_entry slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    size_t count;
+};
+
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now);
+void timer_init(struct timer_entry *timer, timer_callback callback, void *arg);
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_entry *timer, uint64_t expires);
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer_entry *timer);
+size_t timer_wheel_advance(struct timer_wheel *wheel, uint64_t now);
+int timer_wheel_next_deadline(const struct timer_wheel *wheel, uint64_t *deadline);
+int timer_wheel_timeout_ms(const struct timer_wheel *wheel, uint64_t now);
+uint64_t timer_wheel_clock_ms(void);
+
+#endif //COMMON_TIMER_WHEEL_H
@@ -0,0 +1,56 @@
+#ifndef COMMON_TRACE_H
+#define COMMON_TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_BUFFER_EVENTS 65536
+
+/**
+ * Packet lifecycle tracing, exported as Chrome trace-event JSON for
+ * chrome://tracing or Perfetto. Spans are only compiled in with -DTRACE=ON
+ * (CAR_TRACE) and only recorded after trace_open, so a default build pays
+ * nothing and a tracing build pays one branch per span while disabled.
+ *
+ * Each thread records into its own fixed buffer, allocated on its first event
+ * and never shared, so recording takes no lock. Times are CLOCK_MONOTONIC, so
+ * traces from car_controller and car_motors on one host line up when loaded
+ * together.
+ */
+
+// One recorded event. Instants have a negative duration.
+struct trace_event {
+    const char *name;
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+// Events of one thread.
+struct trace_buffer {
+    struct trace_buffer *next;
+    const char *thread_name;
+    uint32_t tid;
+    uint32_t count;
+    uint64_t dropped;
+    struct trace_event events[TRACE_BUFFER_EVENTS];
+};
+
+extern int trace_enabled; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+int trace_open(const char *path);
+void trace_close(void);
+void trace_thread_name(const char *name);
+int64_t trace_now_ns(void);
+void trace_complete(const char *name, int64_t start_ns);
+void trace_instant(const char *name);
+
+#ifdef CAR_TRACE
+#define TRACE_BEGIN(span) int64_t span = trace_enabled ? trace_now_ns() : 0
+#define TRACE_END(span, name) do { if(span) { trace_complete(name, span); } } while(0)
+#define TRACE_INSTANT(name) do { if(trace_enabled) { trace_instant(name); } } while(0)
+#else
+#define TRACE_BEGIN(span) (void)0
+#define TRACE_END(span, name) (void)0
+#define TRACE_INSTANT(name) (void)0
+#endif
+
+#endif //COMMON_TRACE_H
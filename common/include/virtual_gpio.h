@@ -0,0 +1,48 @@
+#ifndef COMMON_VIRTUAL_GPIO_H
+#define COMMON_VIRTUAL_GPIO_H
+
+#include <stdint.h>
+
+#define VIRTUAL_GPIO_PINS 64
+#define VIRTUAL_GPIO_LOG_SIZE 65536
+#define VIRTUAL_GPIO_MAX_STEPS 64
+
+/**
+ * Virtual GPIO backend, a drop-in for wiringPi on a plain Linux host.
+ *
+ * Both binaries map the same edge log from shared memory (VIRTUAL_GPIO_NAME,
+ * default "/car_gpio") and record every input edge and output change with its
+ * CLOCK_MONOTONIC time, so edges from the two processes share one timeline.
+ *
+ * Inputs follow VIRTUAL_GPIO_SCRIPT, repeated for as long as the process
+ * runs, e.g. "1=0+150,1=1+300" holds pin 1 low for 150 ms then high for
+ * 300 ms. A value starting with '@' names a file holding the script. Pins the
+ * script does not set read HIGH, like the pulled-up buttons. The scripted side
+ * clears the log when it starts.
+ *
+ * The side that writes outputs prints, on exit, the distribution of the time
+ * from each input edge to the first output change after it.
+ */
+
+// One pin change.
+struct virtual_gpio_edge {
+    int64_t time_ns;
+    uint8_t pin;
+    uint8_t level;
+    uint8_t output;
+};
+
+// Edge log shared by both processes.
+struct virtual_gpio_log {
+    uint32_t count;
+    struct virtual_gpio_edge edges[VIRTUAL_GPIO_LOG_SIZE];
+};
+
+// A scripted input change, held for hold_ms before the next step.
+struct virtual_gpio_step {
+    int pin;
+    int level;
+    long hold_ms;
+};
+
+#endif //COMMON_VIRTUAL_GPIO_H
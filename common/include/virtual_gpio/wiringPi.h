@@ -0,0 +1,17 @@
+#ifndef COMMON_VIRTUAL_GPIO_WIRINGPI_H
+#define COMMON_VIRTUAL_GPIO_WIRINGPI_H
+
+// The subset of wiringPi used by car_controller and car_motors, served by the
+// virtual GPIO backend when built with -DVIRTUAL_GPIO=ON.
+
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+
+int wiringPiSetup(void);
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+void digitalWrite(int pin, int value);
+
+#endif //COMMON_VIRTUAL_GPIO_WIRINGPI_H
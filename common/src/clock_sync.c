@@ -0,0 +1,295 @@
+// SO_TIMESTAMPING and SO_TIMESTAMPNS are not part of POSIX.
+#define _DEFAULT_SOURCE // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+#include "clock_sync.h"
+#include "byte_order.h"
+#include <linux/net_tstamp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_USEC 1000
+// Drift is only measured across samples at least this far apart.
+#define CLOCK_SYNC_DRIFT_INTERVAL_NS NSEC_PER_SEC
+// Weight of a new drift measurement in the running estimate, as 1/N.
+#define CLOCK_SYNC_DRIFT_SMOOTHING 4
+#define PPM 1000000
+
+/**
+ * Reset the estimator, no peer clock is known until the first sample.
+ * @param sync Estimator to initiate.
+ */
+void clock_sync_init(struct clock_sync *sync)
+{
+    memset(sync, 0, sizeof(struct clock_sync)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+}
+
+/**
+ * Wall clock the stamps are taken on, the same clock kernel receive timestamps use.
+ * @return CLOCK_REALTIME in nanoseconds.
+ */
+int64_t clock_sync_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Fill the stamps of a packet about to be sent, echoing the peer's last one.
+ * @param sync Estimator.
+ * @param stamps Stamps to fill, transmit is taken now.
+ */
+void clock_sync_stamp(const struct clock_sync *sync, struct clock_stamps *stamps)
+{
+    stamps->origin = sync->peer_transmit;
+    stamps->receive = sync->local_receive;
+    stamps->transmit = clock_sync_now_ns();
+}
+
+/**
+ * Take the stamps of a received packet and, once it echoes one of ours,
+ * update the offset, drift and latency statistics.
+ * @param sync Estimator.
+ * @param stamps Stamps the packet carried.
+ * @param received_ns When the packet was received here.
+ * @return 1 if a sample was taken.
+ */
+int clock_sync_receive(struct clock_sync *sync, const struct clock_stamps *stamps, int64_t received_ns)
+{
+    struct clock_sync_sample sample;
+    int64_t offset;
+
+    sync->peer_transmit = stamps->transmit;
+    sync->local_receive = received_ns;
+
+    if(stamps->origin == 0 || stamps->receive == 0)
+    {
+        return 0;
+    }
+
+    sample.offset_ns = ((stamps->receive - stamps->origin) + (stamps->transmit - received_ns)) / 2;
+    sample.delay_ns = (received_ns - stamps->origin) - (stamps->transmit - stamps->receive);
+    sample.local_ns = received_ns;
+
+    sync->window[sync->next] = sample;
+    sync->next = (sync->next + 1) % CLOCK_SYNC_WINDOW;
+    if(sync->count < CLOCK_SYNC_WINDOW)
+    {
+        sync->count++;
+    }
+
+    // Clock filter: the least delayed sample is the least skewed by queueing.
+    sync->best = sync->window[0];
+    for(size_t i = 1; i < sync->count; i++)
+    {
+        if(sync->window[i].delay_ns < sync->best.delay_ns)
+        {
+            sync->best = sync->window[i];
+        }
+    }
+
+    if(!sync->valid)
+    {
+        sync->anchor = sync->best;
+        sync->valid = 1;
+    }
+    else if(sync->best.local_ns - sync->anchor.local_ns >= CLOCK_SYNC_DRIFT_INTERVAL_NS)
+    {
+        double measured = (double)(sync->best.offset_ns - sync->anchor.offset_ns) /
+                          (double)(sync->best.local_ns - sync->anchor.local_ns);
+
+        sync->drift += (measured - sync->drift) / CLOCK_SYNC_DRIFT_SMOOTHING;
+        sync->anchor = sync->best;
+    }
+
+    offset = clock_sync_offset(sync, received_ns);
+    latency_stat_add(&sync->outbound, stamps->receive - stamps->origin - offset);
+    latency_stat_add(&sync->inbound, received_ns - stamps->transmit + offset);
+    latency_stat_add(&sync->turnaround, stamps->transmit - stamps->receive);
+
+    return 1;
+}
+
+/**
+ * Estimated peer clock minus local clock.
+ * @param sync Estimator.
+ * @param local_ns Local time the offset is wanted for.
+ * @return Offset in nanoseconds, 0 before the first sample.
+ */
+int64_t clock_sync_offset(const struct clock_sync *sync, int64_t local_ns)
+{
+    if(!sync->valid)
+    {
+        return 0;
+    }
+    return sync->best.offset_ns + (int64_t)(sync->drift * (double)(local_ns - sync->best.local_ns));
+}
+
+/**
+ * Print the clock estimate and the latencies measured.
+ * @param sync Estimator.
+ * @param outbound_name Label for the direction away from this side.
+ * @param inbound_name Label for the direction towards this side.
+ * @param turnaround_name Label for the time the peer held each packet, NULL to leave it out.
+ */
+void clock_sync_report(const struct clock_sync *sync, const char *outbound_name, const char *inbound_name, const char *turnaround_name)
+{
+    if(!sync->valid)
+    {
+        printf("Clock sync: no samples\n");
+        return;
+    }
+    printf("Clock sync: peer offset %lld us, drift %.3f ppm, best round trip %lld us\n",
+           (long long)(clock_sync_offset(sync, clock_sync_now_ns()) / NSEC_PER_USEC), sync->drift * (double)PPM,
+           (long long)(sync->best.delay_ns / NSEC_PER_USEC));
+    latency_stat_report(&sync->outbound, outbound_name);
+    latency_stat_report(&sync->inbound, inbound_name);
+    if(turnaround_name)
+    {
+        latency_stat_report(&sync->turnaround, turnaround_name);
+    }
+}
+
+/**
+ * Write the stamps in network order.
+ * @param stamps Stamps to write.
+ * @param bytes Destination, CLOCK_STAMPS_SIZE bytes.
+ */
+void clock_stamps_encode(const struct clock_stamps *stamps, uint8_t *bytes)
+{
+    store_be64(bytes, (uint64_t)stamps->origin);
+    store_be64(&bytes[sizeof(int64_t)], (uint64_t)stamps->receive);
+    store_be64(&bytes[2 * sizeof(int64_t)], (uint64_t)stamps->transmit);
+}
+
+/**
+ * Read stamps written by clock_stamps_encode.
+ * @param bytes Source, CLOCK_STAMPS_SIZE bytes.
+ * @param stamps Destination.
+ */
+void clock_stamps_decode(const uint8_t *bytes, struct clock_stamps *stamps)
+{
+    stamps->origin = (int64_t)load_be64(bytes);
+    stamps->receive = (int64_t)load_be64(&bytes[sizeof(int64_t)]);
+    stamps->transmit = (int64_t)load_be64(&bytes[2 * sizeof(int64_t)]);
+}
+
+/**
+ * Add a measurement.
+ * @param stat Statistic to add to.
+ * @param value_ns Measured value.
+ */
+void latency_stat_add(struct latency_stat *stat, int64_t value_ns)
+{
+    if(stat->count == 0 || value_ns < stat->min_ns)
+    {
+        stat->min_ns = value_ns;
+    }
+    if(stat->count == 0 || value_ns > stat->max_ns)
+    {
+        stat->max_ns = value_ns;
+    }
+    stat->total_ns += value_ns;
+    stat->count++;
+}
+
+/**
+ * Print min/mean/max in microseconds.
+ * @param stat Statistic to print.
+ * @param name Label.
+ */
+void latency_stat_report(const struct latency_stat *stat, const char *name)
+{
+    if(stat->count == 0)
+    {
+        printf("%s: no samples\n", name);
+        return;
+    }
+    printf("%s: min %lld us, mean %lld us, max %lld us over %llu\n", name,
+           (long long)(stat->min_ns / NSEC_PER_USEC), (long long)(stat->total_ns / (int64_t)stat->count / NSEC_PER_USEC),
+           (long long)(stat->max_ns / NSEC_PER_USEC), (unsigned long long)stat->count);
+}
+
+/**
+ * Ask the kernel to timestamp packets as they arrive, so receive stamps do not
+ * include the time spent before the process got around to reading.
+ * SO_TIMESTAMPING software stamps are preferred, SO_TIMESTAMPNS is the fallback.
+ * @param fd UDP socket FD.
+ * @return 0 if kernel timestamps are on, -1 if receive stamps are taken in user space.
+ */
+int clock_sync_enable_timestamps(int fd)
+{
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    int on = 1;
+
+    if(setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0)
+    {
+        return 0;
+    }
+    if(setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0)
+    {
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * recvfrom that also returns when the packet was received.
+ * @param fd UDP socket FD.
+ * @param buffer Destination buffer.
+ * @param size Size of the buffer.
+ * @param from_addr Set to the sender address.
+ * @param from_addr_len Size of from_addr, updated to the address length.
+ * @param received_ns Set to the kernel receive timestamp, or the time of the read without one.
+ * @return Bytes read, or -1 on error.
+ */
+ssize_t clock_sync_recvfrom(int fd, void *buffer, size_t size, struct sockaddr *from_addr, socklen_t *from_addr_len, int64_t *received_ns)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        char buffer[CMSG_SPACE(3 * sizeof(struct timespec))];
+        struct cmsghdr align;
+    } control;
+    ssize_t nRead;
+
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+    memset(&msg, 0, sizeof(msg)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    msg.msg_name = from_addr;
+    msg.msg_namelen = *from_addr_len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    nRead = recvmsg(fd, &msg, 0);
+    *received_ns = clock_sync_now_ns();
+    if(nRead == -1)
+    {
+        return -1;
+    }
+    *from_addr_len = msg.msg_namelen;
+
+    for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        struct timespec ts;
+
+        if(cmsg->cmsg_level != SOL_SOCKET || (cmsg->cmsg_type != SO_TIMESTAMPING && cmsg->cmsg_type != SO_TIMESTAMPNS))
+        {
+            continue;
+        }
+        // SO_TIMESTAMPING carries three stamps, the software one is first like SO_TIMESTAMPNS.
+        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+        if(ts.tv_sec != 0 || ts.tv_nsec != 0)
+        {
+            *received_ns = (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+        }
+    }
+
+    return nRead;
+}
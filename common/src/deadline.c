@@ -0,0 +1,149 @@
+#include "deadline.h"
+#include "byte_order.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NSEC_PER_USEC 1000
+
+static int64_t deadline_tracker_base(const struct deadline_tracker *tracker);
+
+/**
+ * Write a deadline in network order.
+ * @param deadline Deadline to write.
+ * @param bytes Destination, DEADLINE_SIZE bytes.
+ */
+void deadline_encode(const struct deadline *deadline, uint8_t *bytes)
+{
+    store_be64(bytes, (uint64_t)deadline->issued_ns);
+    store_be32(&bytes[sizeof(int64_t)], deadline->budget_us);
+}
+
+/**
+ * Read a deadline written by deadline_encode.
+ * @param bytes Source, DEADLINE_SIZE bytes.
+ * @param deadline Destination.
+ */
+void deadline_decode(const uint8_t *bytes, struct deadline *deadline)
+{
+    deadline->issued_ns = (int64_t)load_be64(bytes);
+    deadline->budget_us = load_be32(&bytes[sizeof(int64_t)]);
+}
+
+/**
+ * Reset the tracker, nothing is known of the sender's delay yet.
+ * @param tracker Tracker to initiate.
+ */
+void deadline_tracker_init(struct deadline_tracker *tracker)
+{
+    memset(tracker, 0, sizeof(struct deadline_tracker)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+}
+
+/**
+ * Feed the transmit to receive difference of a packet from the sender into
+ * the base delay. Every packet of the lane counts, keepalives included.
+ * @param tracker Tracker to update.
+ * @param transmit_ns Transmit stamp of the packet, sender CLOCK_REALTIME.
+ * @param received_ns When it was received, local CLOCK_REALTIME.
+ */
+void deadline_tracker_observe(struct deadline_tracker *tracker, int64_t transmit_ns, int64_t received_ns)
+{
+    int64_t delay_ns = received_ns - transmit_ns;
+
+    if(!tracker->has_base)
+    {
+        for(size_t i = 0; i < DEADLINE_BASE_BUCKETS; i++)
+        {
+            tracker->base_ns[i] = delay_ns;
+        }
+        tracker->bucket_start_ns = received_ns;
+        tracker->has_base = 1;
+        return;
+    }
+
+    // The oldest bucket is dropped, so a base that no longer holds ages out.
+    if(received_ns - tracker->bucket_start_ns >= DEADLINE_BUCKET_NS)
+    {
+        tracker->bucket = (tracker->bucket + 1) % DEADLINE_BASE_BUCKETS;
+        tracker->base_ns[tracker->bucket] = delay_ns;
+        tracker->bucket_start_ns = received_ns;
+    }
+    else if(delay_ns < tracker->base_ns[tracker->bucket])
+    {
+        tracker->base_ns[tracker->bucket] = delay_ns;
+    }
+}
+
+/**
+ * Check a command against its deadline just before it would be actuated.
+ * @param tracker Tracker of the sender.
+ * @param sync Clock sync estimate of the sender, used when valid.
+ * @param deadline Deadline the command carries.
+ * @param now_ns Local CLOCK_REALTIME.
+ * @return 1 if the command is past its deadline, 0 if it may be applied.
+ */
+int deadline_tracker_expired(struct deadline_tracker *tracker, const struct clock_sync *sync, const struct deadline *deadline, int64_t now_ns)
+{
+    int64_t sender_now_ns = deadline->issued_ns;
+    int64_t late_ns;
+
+    if(deadline->budget_us == 0)
+    {
+        return 0;
+    }
+
+    if(sync->valid)
+    {
+        sender_now_ns = now_ns + clock_sync_offset(sync, now_ns);
+    }
+    else if(tracker->has_base)
+    {
+        sender_now_ns = now_ns - deadline_tracker_base(tracker);
+    }
+
+    tracker->checked++;
+    late_ns = sender_now_ns - deadline->issued_ns - (int64_t)deadline->budget_us * NSEC_PER_USEC;
+    if(late_ns > 0)
+    {
+        tracker->expired++;
+        latency_stat_add(&tracker->overdue, late_ns);
+        return 1;
+    }
+    latency_stat_add(&tracker->applied_age, sender_now_ns - deadline->issued_ns);
+    return 0;
+}
+
+/**
+ * Print how many commands expired and how stale the applied ones were.
+ * @param tracker Tracker to print.
+ */
+void deadline_tracker_report(const struct deadline_tracker *tracker)
+{
+    if(tracker->checked == 0)
+    {
+        printf("Deadlines: no commands carried one\n");
+        return;
+    }
+    printf("Deadlines: %llu commands checked, %llu expired\n",
+           (unsigned long long)tracker->checked, (unsigned long long)tracker->expired);
+    latency_stat_report(&tracker->applied_age, "Issue to actuation");
+    latency_stat_report(&tracker->overdue, "Expired past deadline by");
+}
+
+/**
+ * Lowest transmit to receive difference over the buckets kept.
+ * @param tracker Tracker to read.
+ * @return Base delay, including the clock offset.
+ */
+static int64_t deadline_tracker_base(const struct deadline_tracker *tracker)
+{
+    int64_t base_ns = tracker->base_ns[0];
+
+    for(size_t i = 1; i < DEADLINE_BASE_BUCKETS; i++)
+    {
+        if(tracker->base_ns[i] < base_ns)
+        {
+            base_ns = tracker->base_ns[i];
+        }
+    }
+    return base_ns;
+}
@@ -0,0 +1,98 @@
+#include "fec.h"
+#include <arpa/inet.h>
+#include <string.h>
+
+/**
+ * Initiate an empty history.
+ * @param history History to initiate.
+ * @param depth Number of past commands carried per packet, at most FEC_MAX_DEPTH.
+ */
+void fec_history_init(struct fec_history *history, size_t depth)
+{
+    memset(history, 0, sizeof(struct fec_history)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    history->depth = depth < FEC_MAX_DEPTH ? depth : FEC_MAX_DEPTH;
+}
+
+/**
+ * Record a command that was sent, dropping the oldest once full.
+ * @param history History to add to.
+ * @param entry Command sent.
+ */
+void fec_history_push(struct fec_history *history, const struct fec_entry *entry)
+{
+    if(history->depth == 0)
+    {
+        return;
+    }
+    history->entries[history->next] = *entry;
+    history->next = (history->next + 1) % history->depth;
+    if(history->count < history->depth)
+    {
+        history->count++;
+    }
+}
+
+/**
+ * Serialize the history: a count byte, then the entries oldest first.
+ * @param history History to encode.
+ * @param bytes Destination, at least 1 + FEC_MAX_DEPTH * FEC_ENTRY_SIZE bytes.
+ * @return Number of bytes written.
+ */
+size_t fec_encode(const struct fec_history *history, uint8_t *bytes)
+{
+    size_t count;
+    size_t first;
+
+    count = 0;
+    bytes[count++] = (uint8_t)history->count;
+
+    first = (history->next + history->depth - history->count) % (history->depth ? history->depth : 1);
+    for(size_t i = 0; i < history->count; i++)
+    {
+        const struct fec_entry *entry = &history->entries[(first + i) % history->depth];
+        uint32_t command_id = htonl(entry->command_id);
+
+        memcpy(&bytes[count], &command_id, sizeof(command_id));
+        count += sizeof(command_id);
+        bytes[count++] = entry->sequence_flag;
+        bytes[count++] = entry->clockwise;
+        bytes[count++] = entry->counter_clockwise;
+    }
+
+    return count;
+}
+
+/**
+ * Deserialize a history written by fec_encode.
+ * @param bytes Source bytes.
+ * @param available Bytes available to read.
+ * @param entries Destination, FEC_MAX_DEPTH entries.
+ * @param count Set to the number of entries decoded.
+ * @return Number of bytes consumed, 0 if the block is truncated.
+ */
+size_t fec_decode(const uint8_t *bytes, size_t available, struct fec_entry *entries, size_t *count)
+{
+    size_t consumed;
+
+    *count = 0;
+    if(available < 1 || bytes[0] > FEC_MAX_DEPTH || available < 1 + (size_t)bytes[0] * FEC_ENTRY_SIZE)
+    {
+        return 0;
+    }
+
+    consumed = 1;
+    for(size_t i = 0; i < bytes[0]; i++)
+    {
+        uint32_t command_id;
+
+        memcpy(&command_id, &bytes[consumed], sizeof(command_id));
+        consumed += sizeof(command_id);
+        entries[i].command_id = ntohl(command_id);
+        entries[i].sequence_flag = bytes[consumed++];
+        entries[i].clockwise = bytes[consumed++];
+        entries[i].counter_clockwise = bytes[consumed++];
+    }
+    *count = bytes[0];
+
+    return consumed;
+}
@@ -0,0 +1,159 @@
+#include "session.h"
+#include "byte_order.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/**
+ * Open the session, mapping the state file if one is given. A file holding
+ * state from an earlier run makes a warm start; a new or unreadable one is
+ * reset and the caller fills in its defaults.
+ * @param session Session to open.
+ * @param path State file, created if missing, or NULL to keep nothing.
+ * @return 0 on success, -1 if the file cannot be mapped.
+ */
+int session_open(struct session *session, const char *path)
+{
+    struct session_state *state;
+    struct timespec now;
+    uint64_t epoch;
+    int fd;
+
+    memset(session, 0, sizeof(struct session)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    session->state = &session->local;
+
+    if(path)
+    {
+        fd = open(path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+        if(fd == -1)
+        {
+            perror("open session state");
+            return -1;
+        }
+
+        // A freshly created file is zero filled, which fails the magic check below.
+        if(ftruncate(fd, sizeof(struct session_state)) == -1)
+        {
+            perror("ftruncate");
+            close(fd);
+            return -1;
+        }
+
+        state = mmap(NULL, sizeof(struct session_state), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(state == MAP_FAILED)
+        {
+            perror("mmap");
+            return -1;
+        }
+        session->state = state;
+    }
+
+    state = session->state;
+    session->warm = state->magic == SESSION_MAGIC && state->version == SESSION_VERSION;
+    if(!session->warm)
+    {
+        memset(state, 0, sizeof(struct session_state)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        state->magic = SESSION_MAGIC;
+        state->version = SESSION_VERSION;
+    }
+    else
+    {
+        state->restarts++;
+    }
+
+    // Never reuse an epoch, even when the wall clock was stepped back.
+    clock_gettime(CLOCK_REALTIME, &now);
+    epoch = (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+    if(state->epoch && !session_epoch_newer(epoch, state->epoch))
+    {
+        epoch = state->epoch + 1;
+    }
+    state->epoch = epoch ? epoch : 1;
+
+    return 0;
+}
+
+/**
+ * Unmap the state file. The state stays in the file for the next start.
+ * @param session Session to close.
+ */
+void session_close(struct session *session)
+{
+    if(session->state && session->state != &session->local)
+    {
+        munmap(session->state, sizeof(struct session_state));
+    }
+    session->state = NULL;
+}
+
+/**
+ * Compare epochs in serial number order, so wrapping round is harmless.
+ * @param epoch Epoch to test.
+ * @param than Epoch to compare with.
+ * @return 1 if epoch is later than than.
+ */
+int session_epoch_newer(uint64_t epoch, uint64_t than)
+{
+    return (int64_t)(epoch - than) > 0;
+}
+
+/**
+ * Whether an epoch is one the peer had before its current one.
+ * @param peer Peer followed.
+ * @param epoch Epoch of a packet from it.
+ * @return 1 if the epoch was retired, 0 otherwise.
+ */
+int session_peer_retired(const struct session_peer *peer, uint64_t epoch)
+{
+    for(int i = 0; i < SESSION_RETIRED_EPOCHS; i++)
+    {
+        if(peer->retired[i] == epoch && epoch != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Follow the peer into a new epoch, retiring the current one. The oldest
+ * retired epoch is forgotten.
+ * @param peer Peer followed.
+ * @param epoch Its new epoch.
+ */
+void session_peer_follow(struct session_peer *peer, uint64_t epoch)
+{
+    if(peer->epoch)
+    {
+        memmove(&peer->retired[1], &peer->retired[0], sizeof(peer->retired) - sizeof(peer->retired[0])); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        peer->retired[0] = peer->epoch;
+    }
+    peer->epoch = epoch;
+}
+
+/**
+ * Write an epoch into a packet in network order.
+ * @param epoch Epoch to write.
+ * @param bytes SESSION_EPOCH_SIZE bytes to write to.
+ */
+void session_epoch_encode(uint64_t epoch, uint8_t *bytes)
+{
+    store_be64(bytes, epoch);
+}
+
+/**
+ * Read an epoch written by session_epoch_encode.
+ * @param bytes SESSION_EPOCH_SIZE bytes to read.
+ * @return Epoch.
+ */
+uint64_t session_epoch_decode(const uint8_t *bytes)
+{
+    return load_be64(bytes);
+}
+
@@ -0,0 +1,213 @@
+// syscall() for futex is not part of POSIX.
+#define _DEFAULT_SOURCE // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+#include "shm_ring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Busy-poll this many times before sleeping, so a hot ring never pays for a syscall.
+#define SHM_RING_SPIN 2000
+#define MSEC_PER_SEC 1000
+#define NSEC_PER_MSEC 1000000L
+
+static long futex(uint32_t *addr, int op, uint32_t value, const struct timespec *timeout);
+
+/**
+ * Map the shared memory channel, creating it in /dev/shm if needed.
+ * @param transport Transport to open.
+ * @param name Shared memory object name, e.g. "/car".
+ * @param is_controller Non-zero for car_controller, which sends commands and receives ACKs.
+ * @return 0 on success, -1 on failure.
+ */
+int shm_transport_open(struct shm_transport *transport, const char *name, int is_controller)
+{
+    int fd;
+    void *mapping;
+
+    memset(transport, 0, sizeof(struct shm_transport)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+
+    fd = shm_open(name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    if(fd == -1)
+    {
+        perror("shm_open");
+        return -1;
+    }
+
+    // A freshly created object is zero filled, which is an empty ring.
+    if(ftruncate(fd, sizeof(struct shm_channel)) == -1)
+    {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    mapping = mmap(NULL, sizeof(struct shm_channel), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        perror("mmap");
+        return -1;
+    }
+
+    transport->channel = mapping;
+    transport->tx = is_controller ? &transport->channel->command : &transport->channel->ack;
+    transport->rx = is_controller ? &transport->channel->ack : &transport->channel->command;
+
+    // Drop anything left over from a previous run of the other side.
+    __atomic_store_n(&transport->rx->tail, __atomic_load_n(&transport->rx->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/**
+ * Unmap the shared memory channel. The object itself is kept for the peer.
+ * @param transport Transport to close.
+ */
+void shm_transport_close(struct shm_transport *transport)
+{
+    if(transport->channel)
+    {
+        munmap(transport->channel, sizeof(struct shm_channel));
+        transport->channel = NULL;
+    }
+}
+
+/**
+ * Get the next free slot so the producer can write a packet in place.
+ * @param ring Ring to produce into.
+ * @return Slot bytes, or NULL if the ring is full.
+ */
+uint8_t *shm_ring_reserve(struct shm_ring *ring)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if(head - tail == SHM_RING_SLOTS)
+    {
+        return NULL;
+    }
+    return ring->slots[head % SHM_RING_SLOTS].bytes;
+}
+
+/**
+ * Publish the reserved slot and wake the consumer if it sleeps.
+ * @param ring Ring to produce into.
+ * @param size Bytes written into the slot.
+ */
+void shm_ring_commit(struct shm_ring *ring, size_t size)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    ring->slots[head % SHM_RING_SLOTS].size = (uint32_t)size;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&ring->consumer_waiting, __ATOMIC_SEQ_CST))
+    {
+        futex(&ring->head, FUTEX_WAKE, 1, NULL);
+    }
+}
+
+/**
+ * Look at the oldest packet without copying it out.
+ * @param ring Ring to consume from.
+ * @param size Set to the packet size, 0 if the producer wrote a size past the slot.
+ * @return Packet bytes, owned by the consumer until shm_ring_release, or NULL if empty.
+ */
+uint8_t *shm_ring_peek(struct shm_ring *ring, size_t *size)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    struct shm_ring_slot *slot;
+
+    if(head == tail)
+    {
+        return NULL;
+    }
+    slot = &ring->slots[tail % SHM_RING_SLOTS];
+    // The size is written by the other process, never trust it past the slot.
+    *size = slot->size <= SHM_RING_SLOT_SIZE ? slot->size : 0;
+    return slot->bytes;
+}
+
+/**
+ * Hand the oldest slot back to the producer.
+ * @param ring Ring to consume from.
+ */
+void shm_ring_release(struct shm_ring *ring)
+{
+    __atomic_store_n(&ring->tail, __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Packets committed and not yet released.
+ * @param ring Ring to inspect.
+ * @return Slots in use.
+ */
+size_t shm_ring_depth(const struct shm_ring *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Wait for a packet, spinning briefly before sleeping on the futex.
+ * @param ring Ring to consume from.
+ * @param timeout_ms Milliseconds to wait, -1 for no limit.
+ * @return 1 if a packet is ready, 0 on timeout or signal.
+ */
+int shm_ring_wait(struct shm_ring *ring, int timeout_ms)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t head;
+    struct timespec timeout;
+
+    for(int spin = 0; spin < SHM_RING_SPIN; spin++)
+    {
+        if(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != tail)
+        {
+            return 1;
+        }
+    }
+    if(timeout_ms == 0)
+    {
+        return 0;
+    }
+
+    timeout.tv_sec = timeout_ms / MSEC_PER_SEC;
+    timeout.tv_nsec = (long)(timeout_ms % MSEC_PER_SEC) * NSEC_PER_MSEC;
+
+    // Announce the sleep before the final check, the producer wakes us after publishing.
+    __atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+    head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    if(head == tail)
+    {
+        futex(&ring->head, FUTEX_WAIT, head, timeout_ms < 0 ? NULL : &timeout);
+    }
+    __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_RELAXED);
+
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != tail;
+}
+
+/**
+ * Shared (not process private) futex, the word lives in memory mapped by both binaries.
+ * @param addr Futex word.
+ * @param op FUTEX_WAIT or FUTEX_WAKE.
+ * @param value Expected value for WAIT, count for WAKE.
+ * @param timeout Relative timeout for WAIT, or NULL.
+ * @return Result of the system call.
+ */
+static long futex(uint32_t *addr, int op, uint32_t value, const struct timespec *timeout)
+{
+    long result = syscall(SYS_futex, addr, op, value, timeout, NULL, 0);
+
+    if(result == -1 && errno != EAGAIN && errno != ETIMEDOUT && errno != EINTR)
+    {
+        perror("futex");
+    }
+    return result;
+}
@@ -0,0 +1,148 @@
+#include "telemetry.h"
+#include "byte_order.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NSEC_PER_MSEC 1000000
+
+// Byte offsets of the encoded fields.
+#define TELEMETRY_MOTOR_STATE 0
+#define TELEMETRY_FLAGS 1
+#define TELEMETRY_SCRIPT_STEPS 2
+#define TELEMETRY_COMMAND_ID 4
+#define TELEMETRY_ACTUATED 8
+#define TELEMETRY_PACKETS 16
+#define TELEMETRY_RX_QUEUE 20
+#define TELEMETRY_LOOP_MEAN 24
+#define TELEMETRY_LOOP_MAX 28
+
+_Static_assert(TELEMETRY_LOOP_MAX + sizeof(uint32_t) == TELEMETRY_SIZE, "telemetry layout does not fill TELEMETRY_SIZE");
+
+/**
+ * Encode a report into TELEMETRY_SIZE bytes.
+ * @param telemetry Report to encode.
+ * @param bytes Destination, at least TELEMETRY_SIZE bytes.
+ */
+void telemetry_encode(const struct telemetry *telemetry, uint8_t *bytes)
+{
+    uint16_t steps = htons(telemetry->script_steps);
+
+    bytes[TELEMETRY_MOTOR_STATE] = telemetry->motor_state;
+    bytes[TELEMETRY_FLAGS] = telemetry->flags;
+    memcpy(&bytes[TELEMETRY_SCRIPT_STEPS], &steps, sizeof(steps)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    store_be32(&bytes[TELEMETRY_COMMAND_ID], telemetry->command_id);
+    store_be64(&bytes[TELEMETRY_ACTUATED], (uint64_t)telemetry->actuated_ns);
+    store_be32(&bytes[TELEMETRY_PACKETS], telemetry->packets);
+    store_be32(&bytes[TELEMETRY_RX_QUEUE], telemetry->rx_queue_bytes);
+    store_be32(&bytes[TELEMETRY_LOOP_MEAN], telemetry->loop_mean_us);
+    store_be32(&bytes[TELEMETRY_LOOP_MAX], telemetry->loop_max_us);
+}
+
+/**
+ * Decode a report.
+ * @param bytes Encoded report.
+ * @param available Bytes left in the packet from bytes on.
+ * @param telemetry Filled in with the report.
+ * @return 0 on success, -1 if the packet is too short to hold one.
+ */
+int telemetry_decode(const uint8_t *bytes, size_t available, struct telemetry *telemetry)
+{
+    uint16_t steps;
+
+    if(available < TELEMETRY_SIZE)
+    {
+        return -1;
+    }
+
+    telemetry->motor_state = bytes[TELEMETRY_MOTOR_STATE];
+    telemetry->flags = bytes[TELEMETRY_FLAGS];
+    memcpy(&steps, &bytes[TELEMETRY_SCRIPT_STEPS], sizeof(steps)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    telemetry->script_steps = ntohs(steps);
+    telemetry->command_id = load_be32(&bytes[TELEMETRY_COMMAND_ID]);
+    telemetry->actuated_ns = (int64_t)load_be64(&bytes[TELEMETRY_ACTUATED]);
+    telemetry->packets = load_be32(&bytes[TELEMETRY_PACKETS]);
+    telemetry->rx_queue_bytes = load_be32(&bytes[TELEMETRY_RX_QUEUE]);
+    telemetry->loop_mean_us = load_be32(&bytes[TELEMETRY_LOOP_MEAN]);
+    telemetry->loop_max_us = load_be32(&bytes[TELEMETRY_LOOP_MAX]);
+    return 0;
+}
+
+/**
+ * Add a report to the series, overwriting the oldest once it is full.
+ * @param series Series to add to.
+ * @param received_ns When the report arrived, local CLOCK_REALTIME.
+ * @param sent_ns When car_motors sent it, car_motors CLOCK_REALTIME.
+ * @param telemetry The report.
+ */
+void telemetry_series_add(struct telemetry_series *series, int64_t received_ns, int64_t sent_ns, const struct telemetry *telemetry)
+{
+    struct telemetry_sample *sample = &series->samples[series->next];
+
+    sample->received_ns = received_ns;
+    sample->sent_ns = sent_ns;
+    sample->telemetry = *telemetry;
+    series->next = (series->next + 1) % TELEMETRY_SERIES;
+    if(series->count < TELEMETRY_SERIES)
+    {
+        series->count++;
+    }
+    series->total++;
+}
+
+/**
+ * Most recent report.
+ * @param series Series to read.
+ * @return The report, or NULL if none arrived yet.
+ */
+const struct telemetry_sample *telemetry_series_latest(const struct telemetry_series *series)
+{
+    if(series->count == 0)
+    {
+        return NULL;
+    }
+    return &series->samples[(series->next + TELEMETRY_SERIES - 1) % TELEMETRY_SERIES];
+}
+
+/**
+ * Print the latest report and the extremes over the series window.
+ * @param series Series to print.
+ */
+void telemetry_series_report(const struct telemetry_series *series)
+{
+    const struct telemetry_sample *latest = telemetry_series_latest(series);
+    uint32_t loop_max_us = 0;
+    uint32_t rx_queue_max = 0;
+    uint64_t loop_mean_total = 0;
+    int64_t span_ns;
+
+    if(!latest)
+    {
+        printf("Telemetry: no reports\n");
+        return;
+    }
+
+    for(size_t i = 0; i < series->count; i++)
+    {
+        const struct telemetry *telemetry = &series->samples[i].telemetry;
+
+        loop_mean_total += telemetry->loop_mean_us;
+        if(telemetry->loop_max_us > loop_max_us)
+        {
+            loop_max_us = telemetry->loop_max_us;
+        }
+        if(telemetry->rx_queue_bytes > rx_queue_max)
+        {
+            rx_queue_max = telemetry->rx_queue_bytes;
+        }
+    }
+
+    span_ns = latest->received_ns - series->samples[series->count < TELEMETRY_SERIES ? 0 : series->next].received_ns;
+    printf("Telemetry: %llu reports, last %zu over %lld ms\n", (unsigned long long)series->total, series->count,
+           (long long)(span_ns / NSEC_PER_MSEC));
+    printf("Telemetry latest: motor %u, command %u, script steps %u%s, %u packets, actuated %lld ms before sending\n",
+           latest->telemetry.motor_state, latest->telemetry.command_id, latest->telemetry.script_steps,
+           latest->telemetry.flags & TELEMETRY_PULSE_PENDING ? ", pulse pending" : "", latest->telemetry.packets,
+           latest->telemetry.actuated_ns ? (long long)((latest->sent_ns - latest->telemetry.actuated_ns) / NSEC_PER_MSEC) : -1LL);
+    printf("Telemetry window: loop mean %llu us, loop max %u us, rx queue max %u bytes\n",
+           (unsigned long long)(loop_mean_total / series->count), loop_max_us, rx_queue_max);
+}
@@ -0,0 +1,352 @@
+#include "timer_wheel.h"
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define MSEC_PER_SEC 1000ULL
+#define NSEC_PER_MSEC 1000000ULL
+
+static void list_unlink(struct timer_entry *timer);
+static void wheel_place(struct timer_wheel *wheel, struct timer_entry *timer, uint64_t earliest);
+static void wheel_cascade(struct timer_wheel *wheel, unsigned int level, unsigned int index);
+static size_t wheel_expire(struct timer_wheel *wheel, unsigned int index);
+static unsigned int first_slot_from(uint64_t bitmap, unsigned int start);
+
+/**
+ * Initiate an empty wheel.
+ * @param wheel Wheel to initiate.
+ * @param now Current time in milliseconds.
+ */
+void timer_wheel_init(struct timer_wheel *wheel, uint64_t now)
+{
+    memset(wheel, 0, sizeof(struct timer_wheel)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    wheel->now = now;
+
+    // Every slot is a circular list with a sentinel head.
+    for(unsigned int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        for(unsigned int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+        {
+            wheel->slots[level][slot].next = &wheel->slots[level][slot];
+            wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+        }
+    }
+}
+
+/**
+ * Initiate a timer before its first use.
+ * @param timer Timer to initiate.
+ * @param callback Function called on expiry.
+ * @param arg Argument passed to the callback.
+ */
+void timer_init(struct timer_entry *timer, timer_callback callback, void *arg)
+{
+    memset(timer, 0, sizeof(struct timer_entry)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+/**
+ * Arm a timer, re-arming it if it is already pending. O(1).
+ * @param wheel Wheel to add to.
+ * @param timer Timer to arm.
+ * @param expires Absolute expiry in milliseconds.
+ */
+void timer_wheel_add(struct timer_wheel *wheel, struct timer_entry *timer, uint64_t expires)
+{
+    if(timer->pending)
+    {
+        timer_wheel_cancel(wheel, timer);
+    }
+    timer->expires = expires;
+    timer->pending = 1;
+    wheel->count++;
+    wheel_place(wheel, timer, wheel->now + 1);
+}
+
+/**
+ * Disarm a timer. Cancelling a timer that is not pending is a no-op. O(1).
+ * @param wheel Wheel the timer is in.
+ * @param timer Timer to cancel.
+ */
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer_entry *timer)
+{
+    unsigned int level;
+    unsigned int index;
+
+    if(!timer->pending)
+    {
+        return;
+    }
+
+    // A slot whose list becomes empty is cleared from its level bitmap.
+    level = timer->bucket / TIMER_WHEEL_SLOTS;
+    index = timer->bucket % TIMER_WHEEL_SLOTS;
+    list_unlink(timer);
+    if(wheel->slots[level][index].next == &wheel->slots[level][index])
+    {
+        wheel->occupied[level] &= ~(1ULL << index);
+    }
+    timer->pending = 0;
+    wheel->count--;
+}
+
+/**
+ * Move the wheel forward to now, firing every timer that is due.
+ * @param wheel Wheel to advance.
+ * @param now Current time in milliseconds.
+ * @return Number of timers fired.
+ */
+size_t timer_wheel_advance(struct timer_wheel *wheel, uint64_t now)
+{
+    size_t fired;
+
+    fired = 0;
+    while(wheel->now < now)
+    {
+        unsigned int index;
+
+        // Nothing due on level 0, skip straight to the next cascade point.
+        if(wheel->occupied[0] == 0)
+        {
+            uint64_t boundary = (wheel->now | SLOT_MASK) + 1;
+
+            if(boundary > now)
+            {
+                wheel->now = now;
+                break;
+            }
+            wheel->now = boundary - 1;
+        }
+
+        wheel->now++;
+        index = (unsigned int)(wheel->now & SLOT_MASK);
+
+        // Crossing a level boundary pulls the next block of timers down.
+        if(index == 0)
+        {
+            for(unsigned int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+            {
+                unsigned int upper = (unsigned int)((wheel->now >> (level * TIMER_WHEEL_BITS)) & SLOT_MASK);
+
+                wheel_cascade(wheel, level, upper);
+                if(upper != 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        fired += wheel_expire(wheel, index);
+    }
+
+    return fired;
+}
+
+/**
+ * Earliest time the wheel needs attention. Exact for timers within 64 ticks,
+ * otherwise the next cascade point, which is never later than the timer.
+ * @param wheel Wheel to query.
+ * @param deadline Set to the deadline in milliseconds.
+ * @return 1 if a deadline exists, 0 if no timers are pending.
+ */
+int timer_wheel_next_deadline(const struct timer_wheel *wheel, uint64_t *deadline)
+{
+    int found;
+
+    found = 0;
+
+    for(unsigned int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        unsigned int shift = level * TIMER_WHEEL_BITS;
+        unsigned int current = (unsigned int)((wheel->now >> shift) & SLOT_MASK);
+        unsigned int slot;
+        uint64_t distance;
+        uint64_t candidate;
+
+        if(wheel->occupied[level] == 0)
+        {
+            continue;
+        }
+
+        // Level 0 slots are single ticks, higher levels are processed when their block starts.
+        slot = first_slot_from(wheel->occupied[level], (current + 1) & SLOT_MASK);
+        distance = ((slot - current - 1) & SLOT_MASK) + 1;
+        if(level == 0)
+        {
+            candidate = wheel->now + distance;
+        }
+        else
+        {
+            candidate = ((wheel->now >> shift) + distance) << shift;
+        }
+
+        if(!found || candidate < *deadline)
+        {
+            *deadline = candidate;
+            found = 1;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Timeout to pass to poll() so the caller wakes for the next deadline.
+ * @param wheel Wheel to query.
+ * @param now Current time in milliseconds.
+ * @return Milliseconds until the next deadline, 0 if due, -1 if no timers.
+ */
+int timer_wheel_timeout_ms(const struct timer_wheel *wheel, uint64_t now)
+{
+    uint64_t deadline = 0;
+
+    if(!timer_wheel_next_deadline(wheel, &deadline))
+    {
+        return -1;
+    }
+    if(deadline <= now)
+    {
+        return 0;
+    }
+    if(deadline - now > INT_MAX)
+    {
+        return INT_MAX;
+    }
+    return (int)(deadline - now);
+}
+
+/**
+ * Millisecond clock the binaries drive their wheels with.
+ * @return CLOCK_MONOTONIC in milliseconds.
+ */
+uint64_t timer_wheel_clock_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * MSEC_PER_SEC + (uint64_t)ts.tv_nsec / NSEC_PER_MSEC;
+}
+
+/**
+ * Remove an entry from its list.
+ * @param timer Entry to remove.
+ */
+static void list_unlink(struct timer_entry *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer;
+    timer->prev = timer;
+}
+
+/**
+ * Link a timer into the slot for its expiry.
+ * @param wheel Wheel to place into.
+ * @param timer Timer with expires set.
+ * @param earliest Tick an overdue timer is moved to.
+ */
+static void wheel_place(struct timer_wheel *wheel, struct timer_entry *timer, uint64_t earliest)
+{
+    uint64_t expires;
+    uint64_t delta;
+    unsigned int level;
+    unsigned int index;
+    struct timer_entry *head;
+
+    // Overdue timers fire on the earliest tick still to be processed.
+    expires = timer->expires > earliest ? timer->expires : earliest;
+    delta = expires - wheel->now;
+
+    level = 0;
+    while(level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << ((level + 1) * TIMER_WHEEL_BITS)))
+    {
+        level++;
+    }
+
+    // Beyond the top level, park in its furthest slot and re-cascade later.
+    if(delta >= (1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)))
+    {
+        expires = wheel->now + (1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1;
+    }
+
+    index = (unsigned int)((expires >> (level * TIMER_WHEEL_BITS)) & SLOT_MASK);
+    head = &wheel->slots[level][index];
+
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+    timer->bucket = level * TIMER_WHEEL_SLOTS + index;
+    wheel->occupied[level] |= 1ULL << index;
+}
+
+/**
+ * Re-place every timer from an upper level slot.
+ * @param wheel Wheel to cascade.
+ * @param level Level of the slot.
+ * @param index Slot index.
+ */
+static void wheel_cascade(struct timer_wheel *wheel, unsigned int level, unsigned int index)
+{
+    struct timer_entry *head = &wheel->slots[level][index];
+
+    wheel->occupied[level] &= ~(1ULL << index);
+    while(head->next != head)
+    {
+        struct timer_entry *timer = head->next;
+
+        // The current tick's slot is expired right after cascading.
+        list_unlink(timer);
+        wheel_place(wheel, timer, wheel->now);
+    }
+}
+
+/**
+ * Fire every timer in a level 0 slot.
+ * @param wheel Wheel being advanced.
+ * @param index Level 0 slot index.
+ * @return Number of timers fired.
+ */
+static size_t wheel_expire(struct timer_wheel *wheel, unsigned int index)
+{
+    struct timer_entry *head = &wheel->slots[0][index];
+    size_t fired;
+
+    fired = 0;
+    wheel->occupied[0] &= ~(1ULL << index);
+    while(head->next != head)
+    {
+        struct timer_entry *timer = head->next;
+
+        list_unlink(timer);
+
+        // Parked timers that are not yet due go back in.
+        if(timer->expires > wheel->now)
+        {
+            wheel_place(wheel, timer, wheel->now + 1);
+            continue;
+        }
+
+        timer->pending = 0;
+        wheel->count--;
+        fired++;
+        timer->callback(timer, timer->arg);
+    }
+
+    return fired;
+}
+
+/**
+ * Find the first set bit at or after start, wrapping around.
+ * @param bitmap Non-zero slot bitmap.
+ * @param start Slot to start from.
+ * @return Index of the first occupied slot.
+ */
+static unsigned int first_slot_from(uint64_t bitmap, unsigned int start)
+{
+    uint64_t rotated = (bitmap >> start) | (start ? bitmap << (TIMER_WHEEL_SLOTS - start) : 0);
+
+    return (start + (unsigned int)__builtin_ctzll(rotated)) & SLOT_MASK;
+}
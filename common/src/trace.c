@@ -0,0 +1,225 @@
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_USEC 1000
+
+int trace_enabled; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct trace_buffer *buffers;                                // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static uint32_t next_tid;                                           // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static const char *trace_path;                                      // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static _Thread_local struct trace_buffer *local;                    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static struct trace_buffer *local_buffer(void);
+static void record(const char *name, int64_t start_ns, int64_t duration_ns);
+static void write_timestamp(FILE *file, const char *key, int64_t ns);
+
+/**
+ * Start recording, the trace is written to path by trace_close.
+ * @param path JSON file to write.
+ * @return 0 on success, -1 if the file cannot be written.
+ */
+int trace_open(const char *path)
+{
+    FILE *file = fopen(path, "w");
+
+    if(file == NULL)
+    {
+        perror("fopen trace");
+        return -1;
+    }
+    fclose(file);  // NOLINT(cert-err33-c)
+
+#ifndef CAR_TRACE
+    printf("Built without -DTRACE=ON, the trace will be empty\n");
+#endif
+    trace_path = path;
+    trace_enabled = 1;
+    return 0;
+}
+
+/**
+ * Stop recording and write every thread's events as Chrome trace-event JSON.
+ * Buffers are not freed, a thread may still be finishing a span.
+ */
+void trace_close(void)
+{
+    FILE *file;
+    int pid = (int)getpid();
+    const char *separator = "";
+    uint64_t dropped = 0;
+
+    if(!trace_enabled)
+    {
+        return;
+    }
+    trace_enabled = 0;
+
+    file = fopen(trace_path, "w");
+    if(file == NULL)
+    {
+        perror("fopen trace");
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    pthread_mutex_lock(&registry_lock);
+    for(const struct trace_buffer *buffer = buffers; buffer != NULL; buffer = buffer->next)
+    {
+        uint32_t count = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+
+        if(buffer->thread_name)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    separator, pid, buffer->tid, buffer->thread_name);
+            separator = ",\n";
+        }
+
+        for(uint32_t i = 0; i < count; i++)
+        {
+            const struct trace_event *event = &buffer->events[i];
+
+            if(event->duration_ns < 0)
+            {
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u", separator, event->name, pid, buffer->tid);
+            }
+            else
+            {
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u", separator, event->name, pid, buffer->tid);
+                write_timestamp(file, "dur", event->duration_ns);
+            }
+            write_timestamp(file, "ts", event->start_ns);
+            fprintf(file, "}");
+            separator = ",\n";
+        }
+        dropped += buffer->dropped;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    fprintf(file, "\n]}\n");
+    fclose(file);  // NOLINT(cert-err33-c)
+
+    printf("Trace written to %s", trace_path);
+    if(dropped)
+    {
+        printf(", %llu events dropped on full buffers", (unsigned long long)dropped);
+    }
+    printf("\n");
+}
+
+/**
+ * Name the calling thread in the timeline.
+ * @param name Thread name, must outlive the trace.
+ */
+void trace_thread_name(const char *name)
+{
+    struct trace_buffer *buffer;
+
+    if(!trace_enabled)
+    {
+        return;
+    }
+    buffer = local_buffer();
+    if(buffer)
+    {
+        buffer->thread_name = name;
+    }
+}
+
+/**
+ * Clock spans are measured on.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+int64_t trace_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Record a span that started at start_ns and ends now.
+ * @param name Span name, a string literal.
+ * @param start_ns Start from trace_now_ns.
+ */
+void trace_complete(const char *name, int64_t start_ns)
+{
+    record(name, start_ns, trace_now_ns() - start_ns);
+}
+
+/**
+ * Record an instant event.
+ * @param name Event name, a string literal.
+ */
+void trace_instant(const char *name)
+{
+    record(name, trace_now_ns(), -1);
+}
+
+/**
+ * Buffer of the calling thread, registered on first use.
+ * @return Buffer, or NULL if it could not be allocated.
+ */
+static struct trace_buffer *local_buffer(void)
+{
+    if(local == NULL)
+    {
+        local = calloc(1, sizeof(struct trace_buffer));
+        if(local == NULL)
+        {
+            return NULL;
+        }
+        pthread_mutex_lock(&registry_lock);
+        local->tid = ++next_tid;
+        local->next = buffers;
+        buffers = local;
+        pthread_mutex_unlock(&registry_lock);
+    }
+    return local;
+}
+
+/**
+ * Append an event to the calling thread's buffer, dropping it once full.
+ * @param name Event name.
+ * @param start_ns Start time.
+ * @param duration_ns Duration, negative for an instant.
+ */
+static void record(const char *name, int64_t start_ns, int64_t duration_ns)
+{
+    struct trace_buffer *buffer = local_buffer();
+    struct trace_event *event;
+
+    if(buffer == NULL)
+    {
+        return;
+    }
+    if(buffer->count == TRACE_BUFFER_EVENTS)
+    {
+        buffer->dropped++;
+        return;
+    }
+
+    event = &buffer->events[buffer->count];
+    event->name = name;
+    event->start_ns = start_ns;
+    event->duration_ns = duration_ns;
+    __atomic_store_n(&buffer->count, buffer->count + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Write a JSON microsecond field with nanosecond precision.
+ * @param file Output file.
+ * @param key Field name.
+ * @param ns Value in nanoseconds.
+ */
+static void write_timestamp(FILE *file, const char *key, int64_t ns)
+{
+    fprintf(file, ",\"%s\":%lld.%03lld", key, (long long)(ns / NSEC_PER_USEC), (long long)(ns % NSEC_PER_USEC));
+}
@@ -0,0 +1,408 @@
+#include "virtual_gpio.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wiringPi.h>
+
+#define VIRTUAL_GPIO_DEFAULT_NAME "/car_gpio"
+#define VIRTUAL_GPIO_SCRIPT_LEN 4096
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_MSEC 1000000LL
+#define NSEC_PER_USEC 1000
+#define PERCENT 100
+
+static struct virtual_gpio_log *gpio_log;                         // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static struct virtual_gpio_step steps[VIRTUAL_GPIO_MAX_STEPS];    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static size_t step_count;                                         // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int64_t cycle_ns;                                          // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int64_t start_ns;                                          // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int input_level[VIRTUAL_GPIO_PINS];                        // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int output_level[VIRTUAL_GPIO_PINS];                       // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int wrote_outputs;                                         // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static int64_t monotonic_ns(void);
+static int load_script(const char *text);
+static int scripted_level(int pin, int64_t now, int64_t *edge_ns);
+static void log_edge(int64_t time_ns, int pin, int level, int output);
+static void report(void);
+static int compare_edges(const void *a, const void *b);
+static int compare_latencies(const void *a, const void *b);
+
+/**
+ * Map the shared edge log and load the button script, if any.
+ * @return 0 on success, -1 on failure.
+ */
+int wiringPiSetup(void)
+{
+    const char *name = getenv("VIRTUAL_GPIO_NAME");   // NOLINT(concurrency-mt-unsafe)
+    const char *script = getenv("VIRTUAL_GPIO_SCRIPT");   // NOLINT(concurrency-mt-unsafe)
+    void *mapping;
+    int fd;
+
+    fd = shm_open(name ? name : VIRTUAL_GPIO_DEFAULT_NAME, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    if(fd == -1)
+    {
+        perror("shm_open");
+        return -1;
+    }
+    if(ftruncate(fd, sizeof(struct virtual_gpio_log)) == -1)
+    {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+    mapping = mmap(NULL, sizeof(struct virtual_gpio_log), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        perror("mmap");
+        return -1;
+    }
+    gpio_log = mapping;
+
+    for(int pin = 0; pin < VIRTUAL_GPIO_PINS; pin++)
+    {
+        input_level[pin] = HIGH;
+        output_level[pin] = -1;
+    }
+
+    if(script && load_script(script) == -1)
+    {
+        printf("Invalid VIRTUAL_GPIO_SCRIPT, expected pin=level+hold_ms,...\n");
+        return -1;
+    }
+
+    // The scripted side starts a new run.
+    if(step_count)
+    {
+        memset(gpio_log, 0, sizeof(struct virtual_gpio_log)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    }
+
+    start_ns = monotonic_ns();
+    atexit(report);
+
+    return 0;
+}
+
+/**
+ * Pin modes are implied by use, reads are inputs and writes outputs.
+ * @param pin Pin number.
+ * @param mode INPUT or OUTPUT.
+ */
+void pinMode(int pin, int mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+/**
+ * Read a scripted input, logging the edge at the time the script changed it.
+ * @param pin Pin number.
+ * @return Current level.
+ */
+int digitalRead(int pin)
+{
+    int64_t edge_ns;
+    int level;
+
+    if(pin < 0 || pin >= VIRTUAL_GPIO_PINS || step_count == 0)
+    {
+        return HIGH;
+    }
+
+    level = scripted_level(pin, monotonic_ns(), &edge_ns);
+    if(level != input_level[pin])
+    {
+        input_level[pin] = level;
+        log_edge(edge_ns, pin, level, 0);
+    }
+    return level;
+}
+
+/**
+ * Set an output, logging it if the level changed.
+ * @param pin Pin number.
+ * @param value New level.
+ */
+void digitalWrite(int pin, int value)
+{
+    int64_t now = monotonic_ns();
+
+    if(pin < 0 || pin >= VIRTUAL_GPIO_PINS)
+    {
+        return;
+    }
+
+    // Motors are written from more than one thread.
+    if(__atomic_exchange_n(&output_level[pin], value, __ATOMIC_RELAXED) != value)
+    {
+        wrote_outputs = 1;
+        log_edge(now, pin, value, 1);
+    }
+}
+
+/**
+ * Monotonic clock shared by every process on the host.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+static int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Parse a button script, read from a file when it starts with '@'.
+ * @param text Script, e.g. "1=0+150,1=1+300".
+ * @return 0 on success, -1 if malformed.
+ */
+static int load_script(const char *text)
+{
+    char buffer[VIRTUAL_GPIO_SCRIPT_LEN];
+    const char *cursor;
+
+    if(text[0] == '@')
+    {
+        FILE *file = fopen(&text[1], "r");
+        size_t len;
+
+        if(file == NULL)
+        {
+            perror("fopen script");
+            return -1;
+        }
+        len = fread(buffer, 1, sizeof(buffer) - 1, file);
+        fclose(file);  // NOLINT(cert-err33-c)
+        buffer[len] = '\0';
+        text = buffer;
+    }
+
+    step_count = 0;
+    cycle_ns = 0;
+    cursor = text;
+    while(*cursor != '\0' && *cursor != '\n')
+    {
+        struct virtual_gpio_step *step;
+        char *end;
+
+        if(step_count == VIRTUAL_GPIO_MAX_STEPS)
+        {
+            return -1;
+        }
+        step = &steps[step_count];
+
+        step->pin = (int)strtol(cursor, &end, 10);   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+        if(end == cursor || *end != '=' || step->pin < 0 || step->pin >= VIRTUAL_GPIO_PINS)
+        {
+            return -1;
+        }
+        cursor = end + 1;
+        step->level = (int)strtol(cursor, &end, 10);   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+        if(end == cursor || *end != '+' || (step->level != LOW && step->level != HIGH))
+        {
+            return -1;
+        }
+        cursor = end + 1;
+        step->hold_ms = strtol(cursor, &end, 10);   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+        if(end == cursor || step->hold_ms <= 0)
+        {
+            return -1;
+        }
+        cursor = *end == ',' ? end + 1 : end;
+
+        cycle_ns += step->hold_ms * NSEC_PER_MSEC;
+        step_count++;
+    }
+
+    return step_count ? 0 : -1;
+}
+
+/**
+ * Level the script gives a pin at a point in time.
+ * @param pin Pin number.
+ * @param now Monotonic time.
+ * @param edge_ns Set to when the pin was given that level.
+ * @return Scripted level.
+ */
+static int scripted_level(int pin, int64_t now, int64_t *edge_ns)
+{
+    int64_t elapsed = now - start_ns;
+    int64_t cycle_start = start_ns + elapsed / cycle_ns * cycle_ns;
+    int64_t offset = elapsed % cycle_ns;
+    int64_t t = 0;
+    int level = HIGH;
+
+    // After the first cycle a pin starts each cycle where the last one left it.
+    if(cycle_start != start_ns)
+    {
+        for(size_t i = 0; i < step_count; i++)
+        {
+            if(steps[i].pin == pin)
+            {
+                level = steps[i].level;
+            }
+        }
+    }
+
+    *edge_ns = cycle_start;
+    for(size_t i = 0; i < step_count && t <= offset; i++)
+    {
+        if(steps[i].pin == pin)
+        {
+            level = steps[i].level;
+            *edge_ns = cycle_start + t;
+        }
+        t += steps[i].hold_ms * NSEC_PER_MSEC;
+    }
+    return level;
+}
+
+/**
+ * Append to the shared log, dropping edges once it is full.
+ * @param time_ns When the pin changed.
+ * @param pin Pin number.
+ * @param level New level.
+ * @param output Non-zero for an output.
+ */
+static void log_edge(int64_t time_ns, int pin, int level, int output)
+{
+    uint32_t index = __atomic_fetch_add(&gpio_log->count, 1, __ATOMIC_RELAXED);
+    struct virtual_gpio_edge *edge;
+
+    if(index >= VIRTUAL_GPIO_LOG_SIZE)
+    {
+        return;
+    }
+    edge = &gpio_log->edges[index];
+    edge->pin = (uint8_t)pin;
+    edge->level = (uint8_t)level;
+    edge->output = (uint8_t)output;
+    __atomic_store_n(&edge->time_ns, time_ns, __ATOMIC_RELEASE);
+}
+
+/**
+ * At exit of the output side, pair each input edge with the first output
+ * change after it and print the latency distribution.
+ */
+static void report(void)
+{
+    static const int64_t bucket_us[] = {100, 250, 500, 1000, 2500, 5000, 10000, 25000};   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    size_t buckets[sizeof(bucket_us) / sizeof(bucket_us[0]) + 1] = {0};
+    struct virtual_gpio_edge *edges;
+    int64_t *latencies;
+    size_t count;
+    size_t inputs = 0;
+    size_t matched = 0;
+
+    if(!wrote_outputs)
+    {
+        return;
+    }
+
+    count = __atomic_load_n(&gpio_log->count, __ATOMIC_ACQUIRE);
+    if(count > VIRTUAL_GPIO_LOG_SIZE)
+    {
+        count = VIRTUAL_GPIO_LOG_SIZE;
+    }
+    edges = malloc(count * sizeof(struct virtual_gpio_edge));
+    latencies = malloc(count * sizeof(int64_t));
+    if(edges == NULL || latencies == NULL)
+    {
+        free(edges);
+        free(latencies);
+        return;
+    }
+    memcpy(edges, gpio_log->edges, count * sizeof(struct virtual_gpio_edge));
+
+    // Inputs are logged when read, so the log is only roughly in time order.
+    qsort(edges, count, sizeof(struct virtual_gpio_edge), compare_edges);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if(edges[i].output || edges[i].time_ns == 0)
+        {
+            continue;
+        }
+        inputs++;
+        // Another input edge first means this one changed nothing.
+        if(i + 1 < count && edges[i + 1].output)
+        {
+            latencies[matched++] = edges[i + 1].time_ns - edges[i].time_ns;
+        }
+    }
+
+    printf("Button to motor latency: %zu input edges, %zu without an output change\n", inputs, inputs - matched);
+    if(matched == 0)
+    {
+        free(edges);
+        free(latencies);
+        return;
+    }
+
+    qsort(latencies, matched, sizeof(int64_t), compare_latencies);
+    printf("  min %lld us, p50 %lld us, p90 %lld us, p99 %lld us, max %lld us\n",
+           (long long)(latencies[0] / NSEC_PER_USEC),
+           (long long)(latencies[matched * 50 / PERCENT] / NSEC_PER_USEC),   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+           (long long)(latencies[matched * 90 / PERCENT] / NSEC_PER_USEC),   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+           (long long)(latencies[matched * 99 / PERCENT] / NSEC_PER_USEC),   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+           (long long)(latencies[matched - 1] / NSEC_PER_USEC));
+
+    for(size_t i = 0; i < matched; i++)
+    {
+        size_t b = 0;
+
+        while(b < sizeof(bucket_us) / sizeof(bucket_us[0]) && latencies[i] >= bucket_us[b] * NSEC_PER_USEC)
+        {
+            b++;
+        }
+        buckets[b]++;
+    }
+    for(size_t b = 0; b < sizeof(buckets) / sizeof(buckets[0]); b++)
+    {
+        if(b < sizeof(bucket_us) / sizeof(bucket_us[0]))
+        {
+            printf("  < %6lld us: %zu\n", (long long)bucket_us[b], buckets[b]);
+        }
+        else
+        {
+            printf("  >= %5lld us: %zu\n", (long long)bucket_us[b - 1], buckets[b]);
+        }
+    }
+
+    free(edges);
+    free(latencies);
+}
+
+/**
+ * qsort comparator ordering edges by time.
+ * @param a First edge.
+ * @param b Second edge.
+ * @return Negative, zero or positive.
+ */
+static int compare_edges(const void *a, const void *b)
+{
+    const struct virtual_gpio_edge *x = a;
+    const struct virtual_gpio_edge *y = b;
+
+    return (x->time_ns > y->time_ns) - (x->time_ns < y->time_ns);
+}
+
+/**
+ * qsort comparator for latencies.
+ * @param a First latency.
+ * @param b Second latency.
+ * @return Negative, zero or positive.
+ */
+static int compare_latencies(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,149 @@
+#ifndef SIMULATION_SIM_H
+#define SIMULATION_SIM_H
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <ucontext.h>
+
+#define SIM_MAX_NODES 2
+#define SIM_MAX_TASKS 8
+#define SIM_MAX_ARGS 32
+#define SIM_NAME_SIZE 32
+#define SIM_STACK_SIZE (256 * 1024)
+#define SIM_NSEC_PER_SEC 1000000000LL
+#define SIM_NSEC_PER_MSEC 1000000LL
+#define SIM_NSEC_PER_USEC 1000LL
+// Wall clock both nodes start near, 2024-01-01 00:00:00 UTC.
+#define SIM_EPOCH_NS 1704067200000000000LL
+
+// Entry point of a program run as a node, its main renamed.
+typedef int (*sim_entry_fn)(int argc, char *argv[]);
+// Called when a scheduled event comes due, with the generation it was scheduled with.
+typedef void (*sim_event_fn)(void *arg, uint64_t generation);
+
+enum sim_task_state {
+    SIM_TASK_RUNNABLE,
+    SIM_TASK_BLOCKED,
+    SIM_TASK_DONE
+};
+
+// Why a blocked task was resumed.
+enum sim_wake_reason {
+    SIM_WOKEN,
+    SIM_TIMED_OUT,
+    SIM_INTERRUPTED
+};
+
+struct sim_node;
+
+/**
+ * A thread of a node, run as a coroutine on the one real thread. A task only
+ * gives the CPU up inside a wrapped blocking call, so everything between two
+ * blocking calls happens at one instant of virtual time.
+ */
+struct sim_task {
+    ucontext_t context;          // first entry only.
+    jmp_buf resume;              // where it blocked last.
+    int started;
+    struct sim_node *node;
+    void *(*start)(void *);
+    void *arg;
+    void *result;
+    void *stack;
+    enum sim_task_state state;
+    enum sim_wake_reason reason;
+    uint64_t generation;         // bumped on every block, stale wake events are ignored.
+    uint64_t blocked_sequence;   // order the task blocked in, condition variables wake FIFO.
+    int64_t requested_wake_ns;   // deadline the blocking call asked for, -1 for none.
+    int reads_inputs;            // sampled a GPIO input, its sleeps may be stretched.
+    const void *waiting_on;      // condition variable or task waited for.
+    const struct pollfd *poll_fds;
+    nfds_t poll_count;
+    struct sim_task *next_runnable;
+};
+
+/**
+ * One of the programs, with its own clocks, sockets and GPIO. The node's
+ * monotonic clock is virtual time from its boot; its wall clock starts a
+ * little off SIM_EPOCH_NS and drifts, like an undisciplined oscillator.
+ */
+struct sim_node {
+    char name[SIM_NAME_SIZE];    // also argv[0].
+    in_addr_t ip;
+    sim_entry_fn entry;
+    int argc;
+    char *argv[SIM_MAX_ARGS + 1];
+    int64_t boot_ns;             // monotonic clock at virtual time 0.
+    int64_t realtime_offset_ns;
+    int64_t drift_ppb;
+    void (*interrupt_handler)(int);
+    struct sim_task *main_task;
+    int exit_status;
+    int64_t last_input_edge_ns;  // virtual time of the last GPIO input change.
+    int64_t next_input_edge_ns;  // of the next one, -1 if none is coming.
+};
+
+// Scheduler configuration.
+struct sim_config {
+    uint64_t seed;
+    int64_t wake_latency_ns;     // timed wakeups land up to this late.
+};
+
+// Scheduler counters.
+struct sim_stats {
+    uint64_t events;
+    uint64_t switches;
+    uint64_t stretched_sleeps;
+};
+
+void sim_init(const struct sim_config *config);
+struct sim_node *sim_node_add(const char *name, const char *ip, sim_entry_fn entry, int argc, char *const argv[]);
+int sim_run(int64_t duration_ns, sim_event_fn at_stop, void *arg);
+void sim_destroy(void);
+int64_t sim_now(void);
+struct sim_task *sim_current(void);
+void sim_schedule(int64_t time_ns, sim_event_fn fire, void *arg, uint64_t generation);
+enum sim_wake_reason sim_block(int64_t deadline_ns);
+void sim_wake(struct sim_task *task);
+void sim_wake_pollers(int fd);
+uint64_t sim_random(void);
+int64_t sim_random_range(int64_t low, int64_t high);
+int64_t sim_node_monotonic(const struct sim_node *node, int64_t virtual_ns);
+int64_t sim_node_realtime(const struct sim_node *node, int64_t virtual_ns);
+const struct sim_stats *sim_get_stats(void);
+
+// Time and thread calls of the nodes, redirected here at link time.
+int __wrap_clock_gettime(clockid_t clock, struct timespec *ts);                                          // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_clock_gettime(clockid_t clock, struct timespec *ts);                                          // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_clock_nanosleep(clockid_t clock, int flags, const struct timespec *request, struct timespec *remain); // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_clock_nanosleep(clockid_t clock, int flags, const struct timespec *request, struct timespec *remain); // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_nanosleep(const struct timespec *request, struct timespec *remain);                           // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_nanosleep(const struct timespec *request, struct timespec *remain);                           // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+time_t __wrap_time(time_t *result);                                                                       // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+time_t __real_time(time_t *result);                                                                       // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start)(void *), void *arg); // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start)(void *), void *arg); // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_pthread_join(pthread_t thread, void **result);                                                 // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_pthread_join(pthread_t thread, void **result);                                                 // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_pthread_detach(pthread_t thread);                                                              // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_pthread_detach(pthread_t thread);                                                              // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);                               // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);                               // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline); // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline); // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_pthread_cond_signal(pthread_cond_t *cond);                                                     // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_pthread_cond_signal(pthread_cond_t *cond);                                                     // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_pthread_cond_broadcast(pthread_cond_t *cond);                                                  // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_pthread_cond_broadcast(pthread_cond_t *cond);                                                  // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_pthread_sigmask(int how, const sigset_t *set, sigset_t *old);                                  // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_pthread_sigmask(int how, const sigset_t *set, sigset_t *old);                                  // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_sigaction(int sig, const struct sigaction *action, struct sigaction *old);                     // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_sigaction(int sig, const struct sigaction *action, struct sigaction *old);                     // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+
+#endif //SIMULATION_SIM_H
@@ -0,0 +1,39 @@
+#ifndef SIMULATION_SIM_ALLOC_H
+#define SIMULATION_SIM_ALLOC_H
+
+#include "sim.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Start-up is over by then, and the fixed rings the programs fill as they
+// go, such as the TELEMETRY_SERIES reports at one per ACK, are all touched.
+#define SIM_ALLOC_WARMUP_NS (600 * SIM_NSEC_PER_SEC)
+
+/**
+ * Heap use of the two programs. Only calls the programs make themselves are
+ * counted; the simulator allocates with the __real_ functions, and the C
+ * library's own allocations, such as stdio buffers, are not seen at all.
+ * Peak resident set is the whole process, simulator included.
+ */
+struct sim_alloc_stats {
+    uint64_t allocations;           // malloc, calloc and realloc calls.
+    uint64_t steady_allocations;    // of those, after SIM_ALLOC_WARMUP_NS.
+    int64_t first_steady_ns;        // virtual time of the first one, -1 if none.
+    size_t first_steady_size;
+    long warm_peak_rss_kib;         // peak resident set at SIM_ALLOC_WARMUP_NS.
+    long end_peak_rss_kib;          // and when the run stopped.
+};
+
+void sim_alloc_init(void);
+void sim_alloc_finish(void);
+const struct sim_alloc_stats *sim_alloc_get_stats(void);
+
+// Heap calls of the nodes, redirected here at link time.
+void *__wrap_malloc(size_t size);                   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+void *__real_malloc(size_t size);                   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+void *__wrap_calloc(size_t count, size_t size);     // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+void *__real_calloc(size_t count, size_t size);     // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+void *__wrap_realloc(void *pointer, size_t size);   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+void *__real_realloc(void *pointer, size_t size);   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+
+#endif //SIMULATION_SIM_ALLOC_H
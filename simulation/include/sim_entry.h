@@ -0,0 +1,10 @@
+#ifndef SIMULATION_SIM_ENTRY_H
+#define SIMULATION_SIM_ENTRY_H
+
+// The two programs' mains, renamed when built into the simulator. Included
+// ahead of each main.c so they keep a prototype.
+
+int car_controller_main(int argc, char *argv[]);
+int car_motors_main(int argc, char *argv[]);
+
+#endif //SIMULATION_SIM_ENTRY_H
@@ -0,0 +1,47 @@
+#ifndef SIMULATION_SIM_GPIO_H
+#define SIMULATION_SIM_GPIO_H
+
+#include "clock_sync.h"
+#include "sim.h"
+#include <stdint.h>
+
+#define SIM_GPIO_PINS 8
+// A transition bounces up to this many times within SIM_GPIO_BOUNCE_NS.
+#define SIM_GPIO_MAX_BOUNCES 3
+#define SIM_GPIO_BOUNCE_NS (3 * SIM_NSEC_PER_MSEC)
+#define SIM_GPIO_HOLD_MIN_NS (20 * SIM_NSEC_PER_MSEC)
+#define SIM_GPIO_HOLD_MAX_NS (5 * SIM_NSEC_PER_SEC)
+// The buttons are left alone while both programs start.
+#define SIM_GPIO_FIRST_PRESS_NS SIM_NSEC_PER_SEC
+
+// Motor direction, as the button target and as read back from the motor pins.
+enum sim_motion {
+    SIM_MOTION_OFF,
+    SIM_MOTION_CLOCKWISE,
+    SIM_MOTION_COUNTER_CLOCKWISE,
+    SIM_MOTION_COUNT
+};
+
+/**
+ * What the motors did against what the buttons asked for. Latencies run from
+ * the last bounce of a button change to the motor pins following it.
+ */
+struct sim_gpio_results {
+    uint64_t transitions;           // settled button changes.
+    uint64_t edges;                 // input pin changes, bounces included.
+    struct latency_stat stop_latency;
+    struct latency_stat drive_latency;
+    uint64_t stops_late;            // motors still driven past the bound after a release. Violation.
+    uint64_t stale_actuations;      // driven in a direction not asked for within the bound. Violation.
+    uint64_t drives_missed;         // a press ended before the motors followed it.
+    uint64_t deadman_stops;         // motors stopped while a button was held.
+    uint64_t motor_changes;
+    uint64_t motor_hash;            // FNV-1a of every motor change and its time.
+    int64_t first_violation_ns;     // -1 if none.
+};
+
+void sim_gpio_init(struct sim_node *buttons, struct sim_node *motors, int64_t bound_ns);
+void sim_gpio_finish(void);
+const struct sim_gpio_results *sim_gpio_get_results(void);
+
+#endif //SIMULATION_SIM_GPIO_H
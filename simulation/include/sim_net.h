@@ -0,0 +1,72 @@
+#ifndef SIMULATION_SIM_NET_H
+#define SIMULATION_SIM_NET_H
+
+#include "sim.h"
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+// Virtual descriptors start here, well above anything the process opens for real.
+#define SIM_NET_FD_BASE 1024
+#define SIM_NET_MAX_FDS 32
+#define SIM_NET_MAX_GROUPS 4
+#define SIM_NET_PACKET_SIZE 2048
+// Receive buffer of a socket, and what each datagram costs of it, like the kernel's truesize.
+#define SIM_NET_RCVBUF 212992
+#define SIM_NET_PACKET_OVERHEAD 768
+#define SIM_NET_PPM 1000000
+
+/**
+ * The link between the nodes. Every datagram is lost with probability
+ * loss_ppm and otherwise arrives delay_ns plus up to jitter_ns later, so
+ * jitter reorders. Outages take the link down for outage_ns at a time, with
+ * gaps drawn uniformly up to twice outage_mean_ns; 0 disables them.
+ */
+struct sim_link_config {
+    uint32_t loss_ppm;
+    int64_t delay_ns;
+    int64_t jitter_ns;
+    int64_t outage_mean_ns;
+    int64_t outage_ns;
+};
+
+// Datagram counters.
+struct sim_net_stats {
+    uint64_t sent;
+    uint64_t lost;          // dropped by the link, outages included.
+    uint64_t delivered;
+    uint64_t overflowed;    // dropped on a full receive buffer.
+    uint64_t unreachable;   // no socket bound to the destination.
+};
+
+void sim_net_init(const struct sim_link_config *config);
+void sim_net_destroy(void);
+const struct sim_net_stats *sim_net_get_stats(void);
+
+// Socket and eventfd calls of the nodes, redirected here at link time.
+int __wrap_socket(int domain, int type, int protocol);                                                    // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_socket(int domain, int type, int protocol);                                                    // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_bind(int fd, const struct sockaddr *addr, socklen_t len);                                      // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_bind(int fd, const struct sockaddr *addr, socklen_t len);                                      // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_setsockopt(int fd, int level, int name, const void *value, socklen_t len);                     // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_setsockopt(int fd, int level, int name, const void *value, socklen_t len);                     // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_getsockopt(int fd, int level, int name, void *value, socklen_t *len);                          // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_getsockopt(int fd, int level, int name, void *value, socklen_t *len);                          // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_close(int fd);                                                                                 // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_close(int fd);                                                                                 // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+ssize_t __wrap_sendto(int fd, const void *bytes, size_t size, int flags, const struct sockaddr *to, socklen_t len); // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+ssize_t __real_sendto(int fd, const void *bytes, size_t size, int flags, const struct sockaddr *to, socklen_t len); // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+ssize_t __wrap_recvmsg(int fd, struct msghdr *msg, int flags);                                            // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+ssize_t __real_recvmsg(int fd, struct msghdr *msg, int flags);                                            // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_poll(struct pollfd *fds, nfds_t count, int timeout_ms);                                        // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_poll(struct pollfd *fds, nfds_t count, int timeout_ms);                                        // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __wrap_eventfd(unsigned int initial, int flags);                                                      // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+int __real_eventfd(unsigned int initial, int flags);                                                      // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+ssize_t __wrap_read(int fd, void *bytes, size_t size);                                                    // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+ssize_t __real_read(int fd, void *bytes, size_t size);                                                    // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+ssize_t __wrap_write(int fd, const void *bytes, size_t size);                                             // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+ssize_t __real_write(int fd, const void *bytes, size_t size);                                             // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+
+#endif //SIMULATION_SIM_NET_H
@@ -0,0 +1,606 @@
+#include "sim.h"
+#include "sim_alloc.h"
+#include "sim_entry.h"
+#include "sim_gpio.h"
+#include "sim_net.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CONTROLLER_IP "10.0.0.1"
+#define MOTORS_IP "10.0.0.2"
+#define SECONDS_PER_HOUR 3600
+#define DEFAULT_HOURS 1
+#define DEFAULT_BOUND_MS 1000
+#define MAX_PARALLEL 64
+#define EXTRA_ARGS_SIZE 512
+
+struct sim_options
+{
+    uint64_t first_seed;
+    unsigned runs;
+    unsigned parallel;
+    int64_t duration_ns;
+    int64_t bound_ns;
+    int64_t wake_latency_ns;
+    struct sim_link_config link;
+    int verbose;
+    long rss_growth_kib;        // -1 unless -a asked for a steady-state heap check.
+    int controller_argc;
+    char *controller_argv[SIM_MAX_ARGS];
+    int motors_argc;
+    char *motors_argv[SIM_MAX_ARGS];
+    char controller_extra[EXTRA_ARGS_SIZE];
+    char motors_extra[EXTRA_ARGS_SIZE];
+};
+
+// What a run sends back to the parent.
+struct run_result
+{
+    uint64_t seed;
+    int hung;                   // a node never exited after being stopped.
+    int controller_status;
+    int motors_status;
+    int64_t wall_ns;
+    struct sim_gpio_results gpio;
+    struct sim_net_stats net;
+    struct sim_stats scheduler;
+    struct sim_alloc_stats alloc;
+};
+
+// A run still going in a child process.
+struct child
+{
+    pid_t pid;
+    int fd;
+    uint64_t seed;
+};
+
+// Totals over every run.
+struct totals
+{
+    unsigned failed;
+    unsigned violating;
+    uint64_t violations;
+    int64_t simulated_ns;
+    struct latency_stat stop_latency;
+    struct latency_stat drive_latency;
+    uint64_t sent;
+    uint64_t lost;
+};
+
+// Prototypes of functions.
+static void options_init(struct sim_options *opts);
+static void parse_arguments(int argc, char *argv[], struct sim_options *opts);
+static void add_arguments(char *extra, int *argc, char *argv[]);
+static void run_one(uint64_t seed, const struct sim_options *opts, struct run_result *result);
+static void stop_run(void *arg, uint64_t generation);
+static pid_t start_child(uint64_t seed, const struct sim_options *opts, int *fd);
+static void collect_child(const struct child *child, const struct sim_options *opts, struct totals *totals);
+static void report_run(const struct run_result *result, const struct sim_options *opts, struct totals *totals);
+static void report_totals(const struct totals *totals, const struct sim_options *opts, int64_t wall_ns);
+static void merge_latency(struct latency_stat *into, const struct latency_stat *from);
+static int64_t wall_clock_ns(void);
+static double to_ms(int64_t ns);
+static double mean_ms(const struct latency_stat *stat);
+
+int main(int argc, char *argv[])
+{
+    struct sim_options opts;
+    struct child children[MAX_PARALLEL];
+    struct totals totals;
+    unsigned started = 0;
+    unsigned running = 0;
+    int64_t wall_start;
+
+    options_init(&opts);
+    parse_arguments(argc, argv, &opts);
+    memset(&totals, 0, sizeof(totals)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+
+    printf("%u run(s) of %.1f h from seed %" PRIu64 ", loss %.2f%%, delay %.1f ms + %.1f ms jitter\n",
+           opts.runs, (double)opts.duration_ns / (double)(SECONDS_PER_HOUR * SIM_NSEC_PER_SEC), opts.first_seed,
+           (double)opts.link.loss_ppm / (double)(SIM_NET_PPM / 100), to_ms(opts.link.delay_ns), to_ms(opts.link.jitter_ns));
+    fflush(stdout);   // NOLINT(cert-err33-c)
+
+    // Every run is a child of its own, so the programs start from fresh statics.
+    wall_start = wall_clock_ns();
+    while(started < opts.runs || running > 0)
+    {
+        pid_t pid;
+        int status;
+
+        if(started < opts.runs && running < opts.parallel)
+        {
+            struct child *child = &children[running];
+
+            child->seed = opts.first_seed + started;
+            child->pid = start_child(child->seed, &opts, &child->fd);
+            started++;
+            running++;
+            continue;
+        }
+
+        pid = waitpid(-1, &status, 0);
+        if(pid == -1)
+        {
+            perror("waitpid");
+            return EXIT_FAILURE;
+        }
+        for(unsigned i = 0; i < running; i++)
+        {
+            if(children[i].pid != pid)
+            {
+                continue;
+            }
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                printf("seed %" PRIu64 ": run failed, status %d\n", children[i].seed, status);
+                totals.failed++;
+                close(children[i].fd);
+            }
+            else
+            {
+                collect_child(&children[i], &opts, &totals);
+            }
+            children[i] = children[--running];
+            break;
+        }
+    }
+
+    report_totals(&totals, &opts, wall_clock_ns() - wall_start);
+    return totals.failed || totals.violating ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Defaults: one hour, a clean link and the node addresses.
+ * @param opts Options to initialize.
+ */
+static void options_init(struct sim_options *opts)
+{
+    static char controller_ip[] = CONTROLLER_IP;
+    static char motors_ip[] = MOTORS_IP;
+    static char flag_controller[] = "-c";
+    static char flag_receiver[] = "-o";
+    static char flag_listen[] = "-i";
+
+    memset(opts, 0, sizeof(struct sim_options)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    opts->first_seed = 1;
+    opts->runs = 1;
+    opts->parallel = 1;
+    opts->duration_ns = (int64_t)DEFAULT_HOURS * SECONDS_PER_HOUR * SIM_NSEC_PER_SEC;
+    opts->bound_ns = DEFAULT_BOUND_MS * SIM_NSEC_PER_MSEC;
+    opts->rss_growth_kib = -1;
+
+    opts->controller_argv[opts->controller_argc++] = flag_controller;
+    opts->controller_argv[opts->controller_argc++] = controller_ip;
+    opts->controller_argv[opts->controller_argc++] = flag_receiver;
+    opts->controller_argv[opts->controller_argc++] = motors_ip;
+    opts->motors_argv[opts->motors_argc++] = flag_listen;
+    opts->motors_argv[opts->motors_argc++] = motors_ip;
+}
+
+/**
+ * Take in arguments from the command line.
+ * @param argc Number of arguments.
+ * @param argv Arguments.
+ * @param opts Options to fill in.
+ */
+static void parse_arguments(int argc, char *argv[], struct sim_options *opts)
+{
+    int c;
+
+    while((c = getopt(argc, argv, ":s:r:H:l:d:j:O:w:b:c:m:p:a:v")) != -1)   // NOLINT(concurrency-mt-unsafe)
+    {
+        switch(c)
+        {
+            case 's':
+            {
+                opts->first_seed = strtoull(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'r':
+            {
+                opts->runs = (unsigned)strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'H':
+            {
+                opts->duration_ns = (int64_t)(strtod(optarg, NULL) * SECONDS_PER_HOUR * (double)SIM_NSEC_PER_SEC);
+                break;
+            }
+            case 'l':
+            {
+                opts->link.loss_ppm = (uint32_t)(strtod(optarg, NULL) * (double)(SIM_NET_PPM / 100)); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'd':
+            {
+                opts->link.delay_ns = (int64_t)(strtod(optarg, NULL) * (double)SIM_NSEC_PER_MSEC);
+                break;
+            }
+            case 'j':
+            {
+                opts->link.jitter_ns = (int64_t)(strtod(optarg, NULL) * (double)SIM_NSEC_PER_MSEC);
+                break;
+            }
+            case 'O':
+            {
+                char *end;
+
+                opts->link.outage_mean_ns = (int64_t)(strtod(optarg, &end) * (double)SIM_NSEC_PER_SEC);
+                if(*end != ':')
+                {
+                    printf("Outages are given as mean_s:duration_ms\n");
+                    exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+                }
+                opts->link.outage_ns = (int64_t)(strtod(end + 1, NULL) * (double)SIM_NSEC_PER_MSEC);
+                break;
+            }
+            case 'w':
+            {
+                opts->wake_latency_ns = (int64_t)(strtod(optarg, NULL) * (double)SIM_NSEC_PER_USEC);
+                break;
+            }
+            case 'b':
+            {
+                opts->bound_ns = (int64_t)strtol(optarg, NULL, 10) * SIM_NSEC_PER_MSEC; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'c':
+            {
+                snprintf(opts->controller_extra, sizeof(opts->controller_extra), "%s", optarg);
+                add_arguments(opts->controller_extra, &opts->controller_argc, opts->controller_argv);
+                break;
+            }
+            case 'm':
+            {
+                snprintf(opts->motors_extra, sizeof(opts->motors_extra), "%s", optarg);
+                add_arguments(opts->motors_extra, &opts->motors_argc, opts->motors_argv);
+                break;
+            }
+            case 'p':
+            {
+                opts->parallel = (unsigned)strtoul(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                if(opts->parallel == 0 || opts->parallel > MAX_PARALLEL)
+                {
+                    opts->parallel = MAX_PARALLEL;
+                }
+                break;
+            }
+            case 'a':
+            {
+                opts->rss_growth_kib = strtol(optarg, NULL, 10); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+                break;
+            }
+            case 'v':
+            {
+                opts->verbose = 1;
+                break;
+            }
+            case ':':
+            {
+                printf("Option requires an operand\n");
+            }
+            // Fall through
+            case '?':
+            {
+                printf("Unknown Argument Passed: Please use from the following...\n"
+                       " '-s' for the seed of the first run, the next runs count up from it\n"
+                       " '-r' for the number of runs\n"
+                       " '-H' for the virtual hours each run lasts\n"
+                       " '-l' for the percentage of datagrams lost\n"
+                       " '-d' for the one-way delay in ms\n"
+                       " '-j' for the delay jitter in ms, added uniformly\n"
+                       " '-O' for link outages as mean_s:duration_ms, e.g. 60:2000\n"
+                       " '-w' for the most a timed wakeup lands late, in us\n"
+                       " '-b' for the ms the motors may keep following a released button\n"
+                       " '-c' for more car_controller arguments, e.g. \"-f 4 -d 300\"\n"
+                       " '-m' for more car_motors arguments\n"
+                       " '-p' for the number of runs at a time\n"
+                       " '-a' to fail runs that allocate after the first ten minutes or grow their peak RSS by more KiB\n"
+                       " '-v' for the programs' own output\n");
+                exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+            }
+            default:
+            {
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Split extra node arguments on spaces and append them. The transports that
+ * leave the sockets, shared memory, AF_XDP and tracing are not simulated.
+ * @param extra Arguments, split in place.
+ * @param argc Argument count, updated.
+ * @param argv Arguments, appended to.
+ */
+static void add_arguments(char *extra, int *argc, char *argv[])
+{
+    char *save = NULL;
+
+    for(char *arg = strtok_r(extra, " ", &save); arg; arg = strtok_r(NULL, " ", &save))
+    {
+        if(strcmp(arg, "-m") == 0 || strcmp(arg, "-x") == 0 || strcmp(arg, "-t") == 0 || strcmp(arg, "-o") == 0)
+        {
+            printf("%s is not supported in the simulation\n", arg);
+            exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+        }
+        if(*argc == SIM_MAX_ARGS - 1)
+        {
+            printf("Too many arguments\n");
+            exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+        }
+        argv[(*argc)++] = arg;
+    }
+}
+
+/**
+ * Run both programs for one seed in this process.
+ * @param seed Seed of the run.
+ * @param opts Options.
+ * @param result Filled in.
+ */
+static void run_one(uint64_t seed, const struct sim_options *opts, struct run_result *result)
+{
+    struct sim_config config;
+    struct sim_node *motors;
+    struct sim_node *controller;
+    int64_t wall_start = wall_clock_ns();
+
+    memset(result, 0, sizeof(struct run_result)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    result->seed = seed;
+    config.seed = seed;
+    config.wake_latency_ns = opts->wake_latency_ns;
+    sim_init(&config);
+    sim_net_init(&opts->link);
+    sim_alloc_init();
+
+    // car_motors first, so it listens before the first command; it is stopped last.
+    motors = sim_node_add("car_motors", MOTORS_IP, car_motors_main, opts->motors_argc, opts->motors_argv);
+    controller = sim_node_add("car_controller", CONTROLLER_IP, car_controller_main, opts->controller_argc, opts->controller_argv);
+    sim_gpio_init(controller, motors, opts->bound_ns);
+
+    result->hung = sim_run(opts->duration_ns, stop_run, NULL) == -1;
+    result->controller_status = controller->exit_status;
+    result->motors_status = motors->exit_status;
+    result->wall_ns = wall_clock_ns() - wall_start;
+    result->gpio = *sim_gpio_get_results();
+    result->net = *sim_net_get_stats();
+    result->scheduler = *sim_get_stats();
+    result->alloc = *sim_alloc_get_stats();
+
+    sim_net_destroy();
+    sim_destroy();
+}
+
+/**
+ * Called when the time is up, before the programs are stopped.
+ * @param arg Unused.
+ * @param generation Unused.
+ */
+static void stop_run(void *arg, uint64_t generation)
+{
+    (void)arg;
+    (void)generation;
+    sim_gpio_finish();
+    sim_alloc_finish();
+}
+
+/**
+ * Fork a child running one seed, its result coming back over a pipe.
+ * @param seed Seed of the run.
+ * @param opts Options.
+ * @param fd Set to the read end of the pipe.
+ * @return Child PID.
+ */
+static pid_t start_child(uint64_t seed, const struct sim_options *opts, int *fd)
+{
+    int fds[2];
+    pid_t pid;
+
+    fflush(stdout);   // NOLINT(cert-err33-c)
+    if(pipe(fds) == -1 || (pid = fork()) == -1)
+    {
+        perror("start run");
+        exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+    }
+
+    if(pid == 0)
+    {
+        struct run_result result;
+        int null_fd;
+
+        close(fds[0]);
+        // The programs print every packet, only their crash output is kept.
+        if(!opts->verbose && (null_fd = open("/dev/null", O_WRONLY)) != -1)
+        {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+        run_one(seed, opts, &result);
+        fflush(stdout);   // NOLINT(cert-err33-c)
+        // Well under PIPE_BUF, the write is atomic and never blocks.
+        _exit(write(fds[1], &result, sizeof(result)) == (ssize_t)sizeof(result) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    *fd = fds[0];
+    return pid;
+}
+
+/**
+ * Read the result of a finished child and report it.
+ * @param child Child that exited cleanly.
+ * @param opts Options.
+ * @param totals Totals to add to.
+ */
+static void collect_child(const struct child *child, const struct sim_options *opts, struct totals *totals)
+{
+    struct run_result result;
+
+    if(read(child->fd, &result, sizeof(result)) != (ssize_t)sizeof(result))
+    {
+        printf("seed %" PRIu64 ": no result\n", child->seed);
+        totals->failed++;
+    }
+    else
+    {
+        report_run(&result, opts, totals);
+    }
+    close(child->fd);
+}
+
+/**
+ * Print one run and add it to the totals.
+ * @param result Run result.
+ * @param opts Options.
+ * @param totals Totals to add to.
+ */
+static void report_run(const struct run_result *result, const struct sim_options *opts, struct totals *totals)
+{
+    const struct sim_gpio_results *gpio = &result->gpio;
+    uint64_t violations = gpio->stops_late + gpio->stale_actuations;
+
+    printf("seed %" PRIu64 ": %.1f h in %.2f s, %" PRIu64 " button changes, stop mean %.1f ms max %.1f ms, "
+           "drive mean %.1f ms max %.1f ms, %" PRIu64 " missed, %" PRIu64 " dead-man stops, "
+           "%" PRIu64 "/%" PRIu64 " datagrams lost, %" PRIu64 " stretched sleeps, motors %016" PRIx64 "\n",
+           result->seed, (double)opts->duration_ns / (double)(SECONDS_PER_HOUR * SIM_NSEC_PER_SEC), (double)result->wall_ns / (double)SIM_NSEC_PER_SEC,
+           gpio->transitions,
+           mean_ms(&gpio->stop_latency), to_ms(gpio->stop_latency.max_ns),
+           mean_ms(&gpio->drive_latency), to_ms(gpio->drive_latency.max_ns),
+           gpio->drives_missed, gpio->deadman_stops, result->net.lost, result->net.sent,
+           result->scheduler.stretched_sleeps, gpio->motor_hash);
+
+    if(violations)
+    {
+        printf("seed %" PRIu64 ": VIOLATION %" PRIu64 " late stops, %" PRIu64 " stale actuations, first at %.3f s\n",
+               result->seed, gpio->stops_late, gpio->stale_actuations, (double)gpio->first_violation_ns / (double)SIM_NSEC_PER_SEC);
+        totals->violating++;
+        totals->violations += violations;
+    }
+    if(opts->verbose || opts->rss_growth_kib >= 0)
+    {
+        printf("seed %" PRIu64 ": %" PRIu64 " allocations, %" PRIu64 " after warm-up, peak RSS %ld KiB, %+ld KiB after warm-up\n",
+               result->seed, result->alloc.allocations, result->alloc.steady_allocations, result->alloc.end_peak_rss_kib,
+               result->alloc.end_peak_rss_kib - result->alloc.warm_peak_rss_kib);
+    }
+    if(opts->rss_growth_kib >= 0 && result->alloc.steady_allocations)
+    {
+        printf("seed %" PRIu64 ": HEAP %" PRIu64 " allocations after warm-up, the first at %.3f s of %zu bytes\n",
+               result->seed, result->alloc.steady_allocations,
+               (double)result->alloc.first_steady_ns / (double)SIM_NSEC_PER_SEC, result->alloc.first_steady_size);
+        totals->failed++;
+    }
+    else if(opts->rss_growth_kib >= 0 && result->alloc.end_peak_rss_kib - result->alloc.warm_peak_rss_kib > opts->rss_growth_kib)
+    {
+        printf("seed %" PRIu64 ": HEAP peak RSS grew %ld KiB after warm-up\n",
+               result->seed, result->alloc.end_peak_rss_kib - result->alloc.warm_peak_rss_kib);
+        totals->failed++;
+    }
+    if(result->hung || result->controller_status != EXIT_SUCCESS || result->motors_status != EXIT_SUCCESS)
+    {
+        printf("seed %" PRIu64 ": %s, car_controller exited %d, car_motors exited %d\n", result->seed,
+               result->hung ? "shutdown hung" : "unclean exit", result->controller_status, result->motors_status);
+        totals->failed++;
+    }
+
+    totals->simulated_ns += opts->duration_ns;
+    merge_latency(&totals->stop_latency, &gpio->stop_latency);
+    merge_latency(&totals->drive_latency, &gpio->drive_latency);
+    totals->sent += result->net.sent;
+    totals->lost += result->net.lost;
+}
+
+/**
+ * Print the totals over every run.
+ * @param totals Totals.
+ * @param opts Options.
+ * @param wall_ns Wall time of the whole batch.
+ */
+static void report_totals(const struct totals *totals, const struct sim_options *opts, int64_t wall_ns)
+{
+    double hours = (double)totals->simulated_ns / (double)(SECONDS_PER_HOUR * SIM_NSEC_PER_SEC);
+    double seconds = (double)wall_ns / (double)SIM_NSEC_PER_SEC;
+
+    printf("%u run(s), %.1f simulated hours in %.2f s, %.1f simulated hours per second\n",
+           opts->runs, hours, seconds, hours / seconds);
+    if(totals->stop_latency.count)
+    {
+        printf("Release to motors off: mean %.1f ms, max %.1f ms over %" PRIu64 "\n",
+               mean_ms(&totals->stop_latency), to_ms(totals->stop_latency.max_ns), totals->stop_latency.count);
+    }
+    if(totals->drive_latency.count)
+    {
+        printf("Press to motors driven: mean %.1f ms, max %.1f ms over %" PRIu64 "\n",
+               mean_ms(&totals->drive_latency), to_ms(totals->drive_latency.max_ns), totals->drive_latency.count);
+    }
+    printf("Datagrams lost: %" PRIu64 " of %" PRIu64 "\n", totals->lost, totals->sent);
+    printf("Violations: %" PRIu64 " in %u run(s), failed runs: %u\n", totals->violations, totals->violating, totals->failed);
+}
+
+/**
+ * Add one latency statistic into another.
+ * @param into Statistic added to.
+ * @param from Statistic added.
+ */
+static void merge_latency(struct latency_stat *into, const struct latency_stat *from)
+{
+    if(from->count == 0)
+    {
+        return;
+    }
+    if(into->count == 0 || from->min_ns < into->min_ns)
+    {
+        into->min_ns = from->min_ns;
+    }
+    if(into->count == 0 || from->max_ns > into->max_ns)
+    {
+        into->max_ns = from->max_ns;
+    }
+    into->total_ns += from->total_ns;
+    into->count += from->count;
+}
+
+/**
+ * Real time spent, outside the simulation.
+ * @return CLOCK_MONOTONIC in nanoseconds.
+ */
+static int64_t wall_clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * SIM_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Nanoseconds to milliseconds, for printing.
+ * @param ns Nanoseconds.
+ * @return Milliseconds.
+ */
+static double to_ms(int64_t ns)
+{
+    return (double)ns / (double)SIM_NSEC_PER_MSEC;
+}
+
+/**
+ * Mean of a latency statistic in milliseconds, for printing.
+ * @param stat Statistic.
+ * @return Mean, 0 without samples.
+ */
+static double mean_ms(const struct latency_stat *stat)
+{
+    if(stat->count == 0)
+    {
+        return 0;
+    }
+    return to_ms(stat->total_ns / (int64_t)stat->count);
+}
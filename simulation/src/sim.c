@@ -0,0 +1,1054 @@
+#include "sim.h"
+#include "sim_alloc.h"
+#include "input.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIM_EVENTS_INITIAL 256
+// Wall clocks start up to this far apart and drift up to this many ppb.
+#define SIM_CLOCK_OFFSET_NS (50 * SIM_NSEC_PER_MSEC)
+#define SIM_CLOCK_DRIFT_PPB 50000
+#define SIM_BOOT_MIN_NS (10 * SIM_NSEC_PER_SEC)
+#define SIM_BOOT_MAX_NS (3600 * SIM_NSEC_PER_SEC)
+// Nodes that have not exited this long after being interrupted are given up on.
+#define SIM_SHUTDOWN_NS (30 * SIM_NSEC_PER_SEC)
+// The input sampler has published the last edge once it held for this long.
+#define SIM_INPUT_PERIOD_NS (INPUT_PERIOD_US * SIM_NSEC_PER_USEC)
+#define SIM_INPUT_QUIET_NS ((INPUT_DEBOUNCE_SAMPLES + 1) * SIM_INPUT_PERIOD_NS)
+#define PPB 1000000000LL
+
+// Something to do at a point of virtual time. Ties run in the order scheduled.
+struct sim_event {
+    int64_t time_ns;
+    uint64_t sequence;
+    sim_event_fn fire;
+    void *arg;
+    uint64_t generation;
+};
+
+// Everything the scheduler owns. One simulation per process.
+struct simulation {
+    struct sim_config config;
+    uint64_t random_state;
+    int64_t now_ns;
+    uint64_t next_sequence;
+    uint64_t next_blocked;
+    struct sim_event *events;    // binary min-heap on time, then sequence.
+    size_t event_count;
+    size_t event_capacity;
+    struct sim_node nodes[SIM_MAX_NODES];
+    size_t node_count;
+    struct sim_task tasks[SIM_MAX_TASKS];
+    size_t task_count;
+    struct sim_task *current;    // NULL while the scheduler itself runs.
+    struct sim_task *runnable_head;
+    struct sim_task *runnable_tail;
+    jmp_buf scheduler;
+    struct sim_stats stats;
+    int gave_up;
+};
+
+static struct simulation sim;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static int event_before(const struct sim_event *a, const struct sim_event *b);
+static void event_push(const struct sim_event *event);
+static void event_pop(struct sim_event *event);
+static struct sim_task *task_create(struct sim_node *node, void *(*start)(void *), void *arg);
+static void task_main(void);
+static void *node_main(void *vargp);
+static void make_runnable(struct sim_task *task, enum sim_wake_reason reason);
+static enum sim_wake_reason block_until(int64_t requested_ns, int64_t scheduled_ns);
+static void wake_expired(void *arg, uint64_t generation);
+static int64_t wake_latency(void);
+static int64_t stretch_sleep(const struct sim_task *task, int64_t wake_ns);
+static void stop_nodes(void *arg, uint64_t generation);
+static void give_up(void *arg, uint64_t generation);
+static int nodes_done(void);
+static int64_t node_clock(const struct sim_node *node, clockid_t clock);
+static int64_t node_deadline(const struct sim_node *node, clockid_t clock, const struct timespec *deadline);
+static struct sim_task *task_from_thread(pthread_t thread);
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t deadline_ns);
+static void cond_wake(const pthread_cond_t *cond, int all);
+static void to_timespec(int64_t ns, struct timespec *ts);
+
+// Handed to the scheduler by sim_run, called when virtual time runs out.
+static sim_event_fn stop_hook;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static void *stop_hook_arg;      // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * Start a new simulation at virtual time 0.
+ * @param config Seed and scheduling parameters.
+ */
+void sim_init(const struct sim_config *config)
+{
+    memset(&sim, 0, sizeof(sim)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    sim.config = *config;
+    sim.random_state = config->seed;
+}
+
+/**
+ * Add a program to run, with clocks of its own drawn from the seed.
+ * @param name Program name, also argv[0].
+ * @param ip Address its sockets live on.
+ * @param entry Its main.
+ * @param argc Number of arguments after the name.
+ * @param argv Arguments after the name, kept by reference.
+ * @return The node, or NULL if there are too many nodes or arguments.
+ */
+struct sim_node *sim_node_add(const char *name, const char *ip, sim_entry_fn entry, int argc, char *const argv[])
+{
+    struct sim_node *node;
+
+    if(sim.node_count == SIM_MAX_NODES || argc >= SIM_MAX_ARGS)
+    {
+        return NULL;
+    }
+
+    node = &sim.nodes[sim.node_count++];
+    snprintf(node->name, sizeof(node->name), "%s", name);
+    node->ip = inet_addr(ip);
+    node->entry = entry;
+    node->argv[0] = node->name;
+    for(int i = 0; i < argc; i++)
+    {
+        node->argv[i + 1] = argv[i];
+    }
+    node->argc = argc + 1;
+    node->boot_ns = sim_random_range(SIM_BOOT_MIN_NS, SIM_BOOT_MAX_NS);
+    node->realtime_offset_ns = sim_random_range(-SIM_CLOCK_OFFSET_NS, SIM_CLOCK_OFFSET_NS);
+    node->drift_ppb = sim_random_range(-SIM_CLOCK_DRIFT_PPB, SIM_CLOCK_DRIFT_PPB);
+    node->last_input_edge_ns = 0;
+    node->next_input_edge_ns = -1;
+    return node;
+}
+
+/**
+ * Run the nodes, in the order added, until duration_ns of virtual time has
+ * passed. Then at_stop is called and the nodes are interrupted like with
+ * SIGINT, last added first, and run until they exit.
+ * @param duration_ns Virtual time to run for.
+ * @param at_stop Called when the time is up, before the nodes are stopped, may be NULL.
+ * @param arg Passed to at_stop.
+ * @return 0 if every node exited, -1 if one never did.
+ */
+int sim_run(int64_t duration_ns, sim_event_fn at_stop, void *arg)
+{
+    struct sim_event event;
+
+    stop_hook = at_stop;
+    stop_hook_arg = arg;
+    for(size_t i = 0; i < sim.node_count; i++)
+    {
+        sim.nodes[i].main_task = task_create(&sim.nodes[i], node_main, &sim.nodes[i]);
+        if(sim.nodes[i].main_task == NULL)
+        {
+            return -1;
+        }
+    }
+    sim_schedule(duration_ns, stop_nodes, NULL, 0);
+    sim_schedule(duration_ns + SIM_SHUTDOWN_NS, give_up, NULL, 0);
+
+    while(!nodes_done() && !sim.gave_up)
+    {
+        struct sim_task *task = sim.runnable_head;
+
+        if(task)
+        {
+            sim.runnable_head = task->next_runnable;
+            if(sim.runnable_head == NULL)
+            {
+                sim.runnable_tail = NULL;
+            }
+            sim.current = task;
+            sim.stats.switches++;
+            // Only the first switch into a task needs its ucontext. After that
+            // _longjmp switches, which unlike swapcontext leaves the signal
+            // mask alone and so makes no system call.
+            if(_setjmp(sim.scheduler) == 0)
+            {
+                if(task->started)
+                {
+                    _longjmp(task->resume, 1);
+                }
+                task->started = 1;
+                setcontext(&task->context);
+            }
+            sim.current = NULL;
+            continue;
+        }
+
+        // Every task is blocked, jump to the next thing that happens.
+        if(sim.event_count == 0)
+        {
+            break;
+        }
+        event_pop(&event);
+        sim.now_ns = event.time_ns;
+        sim.stats.events++;
+        event.fire(event.arg, event.generation);
+    }
+
+    return nodes_done() ? 0 : -1;
+}
+
+/**
+ * Free the task stacks and the event queue.
+ */
+void sim_destroy(void)
+{
+    for(size_t i = 0; i < sim.task_count; i++)
+    {
+        free(sim.tasks[i].stack);
+    }
+    free(sim.events);
+    sim.events = NULL;
+    sim.task_count = 0;
+}
+
+/**
+ * Current virtual time.
+ * @return Nanoseconds since the simulation started.
+ */
+int64_t sim_now(void)
+{
+    return sim.now_ns;
+}
+
+/**
+ * Task running now.
+ * @return The task, or NULL when called from the scheduler or outside a run.
+ */
+struct sim_task *sim_current(void)
+{
+    return sim.current;
+}
+
+/**
+ * Schedule a callback at a point of virtual time.
+ * @param time_ns When, not before the current time.
+ * @param fire Callback.
+ * @param arg Passed to the callback.
+ * @param generation Passed to the callback, to tell stale events apart.
+ */
+void sim_schedule(int64_t time_ns, sim_event_fn fire, void *arg, uint64_t generation)
+{
+    struct sim_event event;
+
+    event.time_ns = time_ns < sim.now_ns ? sim.now_ns : time_ns;
+    event.sequence = sim.next_sequence++;
+    event.fire = fire;
+    event.arg = arg;
+    event.generation = generation;
+    event_push(&event);
+}
+
+/**
+ * Block the current task until it is woken or the deadline passes.
+ * @param deadline_ns Virtual time to wake at, -1 for none.
+ * @return Why the task was resumed.
+ */
+enum sim_wake_reason sim_block(int64_t deadline_ns)
+{
+    return block_until(deadline_ns, deadline_ns);
+}
+
+/**
+ * Make a blocked task runnable at the current time.
+ * @param task Task to wake, nothing happens unless it is blocked.
+ */
+void sim_wake(struct sim_task *task)
+{
+    if(task->state == SIM_TASK_BLOCKED)
+    {
+        make_runnable(task, SIM_WOKEN);
+    }
+}
+
+/**
+ * Wake every task polling or reading a descriptor that just became readable.
+ * @param fd Descriptor.
+ */
+void sim_wake_pollers(int fd)
+{
+    for(size_t i = 0; i < sim.task_count; i++)
+    {
+        struct sim_task *task = &sim.tasks[i];
+
+        if(task->state != SIM_TASK_BLOCKED || task->poll_fds == NULL)
+        {
+            continue;
+        }
+        for(nfds_t j = 0; j < task->poll_count; j++)
+        {
+            if(task->poll_fds[j].fd == fd)
+            {
+                make_runnable(task, SIM_WOKEN);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Next number of the seeded generator, splitmix64.
+ * @return 64 random bits.
+ */
+uint64_t sim_random(void)
+{
+    uint64_t z;
+
+    sim.random_state += 0x9E3779B97F4A7C15ULL;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    z = sim.random_state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    return z ^ (z >> 31);                        // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+}
+
+/**
+ * Uniform random number in a range.
+ * @param low Lowest value.
+ * @param high Highest value, included.
+ * @return Value drawn.
+ */
+int64_t sim_random_range(int64_t low, int64_t high)
+{
+    if(high <= low)
+    {
+        return low;
+    }
+    return low + (int64_t)(sim_random() % (uint64_t)(high - low + 1));
+}
+
+/**
+ * A node's CLOCK_MONOTONIC.
+ * @param node Node.
+ * @param virtual_ns Virtual time.
+ * @return Nanoseconds since the node booted.
+ */
+int64_t sim_node_monotonic(const struct sim_node *node, int64_t virtual_ns)
+{
+    return node->boot_ns + virtual_ns;
+}
+
+/**
+ * A node's CLOCK_REALTIME, offset and drifting from true time.
+ * @param node Node.
+ * @param virtual_ns Virtual time.
+ * @return Nanoseconds since the Unix epoch on the node's clock.
+ */
+int64_t sim_node_realtime(const struct sim_node *node, int64_t virtual_ns)
+{
+    // Scaled down first so thousands of hours of drift do not overflow.
+    return SIM_EPOCH_NS + node->realtime_offset_ns + virtual_ns + virtual_ns / SIM_NSEC_PER_USEC * node->drift_ppb / (PPB / SIM_NSEC_PER_USEC);
+}
+
+/**
+ * Scheduler counters so far.
+ * @return Counters.
+ */
+const struct sim_stats *sim_get_stats(void)
+{
+    return &sim.stats;
+}
+
+/**
+ * Clock read by the nodes: virtual time on the calling node's clocks.
+ * @param clock Clock to read.
+ * @param ts Set to the time.
+ * @return 0.
+ */
+int __wrap_clock_gettime(clockid_t clock, struct timespec *ts)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    if(sim.current == NULL)
+    {
+        return __real_clock_gettime(clock, ts);
+    }
+    to_timespec(node_clock(sim.current->node, clock), ts);
+    return 0;
+}
+
+/**
+ * Sleep in virtual time. The input sampler's sleeps are stretched to the next
+ * input edge once its debounce settled: every sample skipped would have read
+ * the same levels and changed nothing.
+ * @param clock Clock the request is on.
+ * @param flags TIMER_ABSTIME for an absolute deadline.
+ * @param request Deadline or duration.
+ * @param remain Unused, the remaining time is not reported.
+ * @return 0, or EINTR if the node was interrupted.
+ */
+int __wrap_clock_nanosleep(clockid_t clock, int flags, const struct timespec *request, struct timespec *remain)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    int64_t wake_ns;
+
+    if(sim.current == NULL)
+    {
+        return __real_clock_nanosleep(clock, flags, request, remain);
+    }
+
+    if(flags & TIMER_ABSTIME)
+    {
+        wake_ns = node_deadline(sim.current->node, clock, request);
+    }
+    else
+    {
+        wake_ns = sim.now_ns + (int64_t)request->tv_sec * SIM_NSEC_PER_SEC + request->tv_nsec;
+    }
+    return block_until(wake_ns, stretch_sleep(sim.current, wake_ns)) == SIM_INTERRUPTED ? EINTR : 0;
+}
+
+/**
+ * Relative sleep in virtual time.
+ * @param request Duration.
+ * @param remain Unused.
+ * @return 0, or -1 with errno EINTR if the node was interrupted.
+ */
+int __wrap_nanosleep(const struct timespec *request, struct timespec *remain)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    int result;
+
+    if(sim.current == NULL)
+    {
+        return __real_nanosleep(request, remain);
+    }
+    result = __wrap_clock_nanosleep(CLOCK_MONOTONIC, 0, request, remain);
+    if(result)
+    {
+        errno = result;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Seconds on the calling node's wall clock.
+ * @param result Also set to the seconds if not NULL.
+ * @return Seconds since the Unix epoch.
+ */
+time_t __wrap_time(time_t *result)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    time_t seconds;
+
+    if(sim.current == NULL)
+    {
+        return __real_time(result);
+    }
+    seconds = (time_t)(sim_node_realtime(sim.current->node, sim.now_ns) / SIM_NSEC_PER_SEC);
+    if(result)
+    {
+        *result = seconds;
+    }
+    return seconds;
+}
+
+/**
+ * Start a thread of the calling node as a new task. It first runs once the
+ * creator blocks. Attributes are ignored.
+ * @param thread Set to the task handle.
+ * @param attr Unused.
+ * @param start Thread body.
+ * @param arg Passed to the body.
+ * @return 0, or EAGAIN if there are too many tasks.
+ */
+int __wrap_pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start)(void *), void *arg)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_task *task;
+
+    if(sim.current == NULL)
+    {
+        return __real_pthread_create(thread, attr, start, arg);
+    }
+    task = task_create(sim.current->node, start, arg);
+    if(task == NULL)
+    {
+        return EAGAIN;
+    }
+    *thread = (pthread_t)(task - sim.tasks) + 1;
+    return 0;
+}
+
+/**
+ * Wait for a task to finish. A stretched sleep of the task is cut back to
+ * what it asked for, so it notices it was told to stop.
+ * @param thread Task handle.
+ * @param result Set to the value the task returned, if not NULL.
+ * @return 0, or ESRCH for an unknown handle.
+ */
+int __wrap_pthread_join(pthread_t thread, void **result)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_task *task;
+
+    if(sim.current == NULL)
+    {
+        return __real_pthread_join(thread, result);
+    }
+    task = task_from_thread(thread);
+    if(task == NULL)
+    {
+        return ESRCH;
+    }
+
+    if(task->state == SIM_TASK_BLOCKED && task->requested_wake_ns >= 0)
+    {
+        sim_schedule(task->requested_wake_ns, wake_expired, task, task->generation);
+    }
+    sim.current->waiting_on = task;
+    while(task->state != SIM_TASK_DONE)
+    {
+        sim_block(-1);
+    }
+    sim.current->waiting_on = NULL;
+
+    if(result)
+    {
+        *result = task->result;
+    }
+    return 0;
+}
+
+/**
+ * Tasks need no detaching, their stacks are freed with the simulation.
+ * @param thread Task handle.
+ * @return 0.
+ */
+int __wrap_pthread_detach(pthread_t thread)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    if(sim.current == NULL)
+    {
+        return __real_pthread_detach(thread);
+    }
+    return 0;
+}
+
+/**
+ * Wait on a condition variable in virtual time. The mutex is a real one; it
+ * is never contended, as no task blocks while holding it.
+ * @param cond Condition variable.
+ * @param mutex Mutex held by the caller.
+ * @return 0.
+ */
+int __wrap_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    if(sim.current == NULL)
+    {
+        return __real_pthread_cond_wait(cond, mutex);
+    }
+    return cond_wait(cond, mutex, -1);
+}
+
+/**
+ * Timed wait on a condition variable. The only one in the nodes, the script
+ * executor's, is on CLOCK_MONOTONIC.
+ * @param cond Condition variable.
+ * @param mutex Mutex held by the caller.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline.
+ * @return 0 if signalled, ETIMEDOUT if the deadline passed.
+ */
+int __wrap_pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    if(sim.current == NULL)
+    {
+        return __real_pthread_cond_timedwait(cond, mutex, deadline);
+    }
+    return cond_wait(cond, mutex, node_deadline(sim.current->node, CLOCK_MONOTONIC, deadline));
+}
+
+/**
+ * Wake the task that waited longest on a condition variable.
+ * @param cond Condition variable.
+ * @return 0.
+ */
+int __wrap_pthread_cond_signal(pthread_cond_t *cond)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    if(sim.current == NULL)
+    {
+        return __real_pthread_cond_signal(cond);
+    }
+    cond_wake(cond, 0);
+    return 0;
+}
+
+/**
+ * Wake every task waiting on a condition variable.
+ * @param cond Condition variable.
+ * @return 0.
+ */
+int __wrap_pthread_cond_broadcast(pthread_cond_t *cond)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    if(sim.current == NULL)
+    {
+        return __real_pthread_cond_broadcast(cond);
+    }
+    cond_wake(cond, 1);
+    return 0;
+}
+
+/**
+ * Signal masks have no meaning for tasks, interrupts go to the main task.
+ * @param how Unused.
+ * @param set Unused.
+ * @param old Unused.
+ * @return 0.
+ */
+int __wrap_pthread_sigmask(int how, const sigset_t *set, sigset_t *old)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    if(sim.current == NULL)
+    {
+        return __real_pthread_sigmask(how, set, old);
+    }
+    return 0;
+}
+
+/**
+ * Keep a node's SIGINT handler, called when the simulation stops it.
+ * Handlers for other signals are not installed.
+ * @param sig Signal.
+ * @param action New action.
+ * @param old Cleared if not NULL.
+ * @return 0.
+ */
+int __wrap_sigaction(int sig, const struct sigaction *action, struct sigaction *old)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    if(sim.current == NULL)
+    {
+        return __real_sigaction(sig, action, old);
+    }
+    if(old)
+    {
+        memset(old, 0, sizeof(*old)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    }
+    if(sig == SIGINT && action)
+    {
+        sim.current->node->interrupt_handler = action->sa_handler;
+    }
+    return 0;
+}
+
+/**
+ * Heap order: earlier first, ties in the order scheduled.
+ * @param a Event.
+ * @param b Event.
+ * @return 1 if a comes before b.
+ */
+static int event_before(const struct sim_event *a, const struct sim_event *b)
+{
+    return a->time_ns < b->time_ns || (a->time_ns == b->time_ns && a->sequence < b->sequence);
+}
+
+/**
+ * Add an event to the heap, growing it if needed.
+ * @param event Event to add.
+ */
+static void event_push(const struct sim_event *event)
+{
+    size_t i;
+
+    if(sim.event_count == sim.event_capacity)
+    {
+        size_t capacity = sim.event_capacity ? sim.event_capacity * 2 : SIM_EVENTS_INITIAL;
+        // The simulator's own heap is left out of the programs' allocation counts.
+        struct sim_event *events = __real_realloc(sim.events, capacity * sizeof(struct sim_event));
+
+        if(events == NULL)
+        {
+            perror("simulation events");
+            exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+        }
+        sim.events = events;
+        sim.event_capacity = capacity;
+    }
+
+    i = sim.event_count++;
+    while(i > 0 && event_before(event, &sim.events[(i - 1) / 2]))
+    {
+        sim.events[i] = sim.events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sim.events[i] = *event;
+}
+
+/**
+ * Take the earliest event off the heap.
+ * @param event Set to the event, the heap must not be empty.
+ */
+static void event_pop(struct sim_event *event)
+{
+    struct sim_event last;
+    size_t i = 0;
+
+    *event = sim.events[0];
+    last = sim.events[--sim.event_count];
+    for(;;)
+    {
+        size_t child = 2 * i + 1;
+
+        if(child >= sim.event_count)
+        {
+            break;
+        }
+        if(child + 1 < sim.event_count && event_before(&sim.events[child + 1], &sim.events[child]))
+        {
+            child++;
+        }
+        if(!event_before(&sim.events[child], &last))
+        {
+            break;
+        }
+        sim.events[i] = sim.events[child];
+        i = child;
+    }
+    sim.events[i] = last;
+}
+
+/**
+ * Create a runnable task on its own stack.
+ * @param node Node the task belongs to.
+ * @param start Body.
+ * @param arg Passed to the body.
+ * @return The task, or NULL if there are too many or no stack could be allocated.
+ */
+static struct sim_task *task_create(struct sim_node *node, void *(*start)(void *), void *arg)
+{
+    struct sim_task *task;
+
+    if(sim.task_count == SIM_MAX_TASKS)
+    {
+        return NULL;
+    }
+    task = &sim.tasks[sim.task_count];
+    memset(task, 0, sizeof(struct sim_task)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    task->stack = __real_malloc(SIM_STACK_SIZE);
+    if(task->stack == NULL)
+    {
+        return NULL;
+    }
+    sim.task_count++;
+
+    task->node = node;
+    task->start = start;
+    task->arg = arg;
+    task->requested_wake_ns = -1;
+    getcontext(&sim.tasks[sim.task_count - 1].context);
+    // As far as the compiler knows getcontext returns twice, like setjmp.
+    task = &sim.tasks[sim.task_count - 1];
+    task->context.uc_stack.ss_sp = task->stack;
+    task->context.uc_stack.ss_size = SIM_STACK_SIZE;
+    // task_main jumps back to the scheduler loop instead of returning.
+    task->context.uc_link = NULL;
+    makecontext(&task->context, task_main, 0);
+    make_runnable(task, SIM_WOKEN);
+    return task;
+}
+
+/**
+ * First frame of every task: run the body, wake whoever joins it and go back
+ * to the scheduler for good.
+ */
+static void task_main(void)
+{
+    struct sim_task *task = sim.current;
+
+    task->result = task->start(task->arg);
+    task->state = SIM_TASK_DONE;
+    for(size_t i = 0; i < sim.task_count; i++)
+    {
+        if(sim.tasks[i].waiting_on == task)
+        {
+            sim_wake(&sim.tasks[i]);
+        }
+    }
+    _longjmp(sim.scheduler, 1);
+}
+
+/**
+ * Body of a node's main task.
+ * @param vargp The node.
+ * @return NULL, the exit status is kept in the node.
+ */
+static void *node_main(void *vargp)
+{
+    struct sim_node *node = vargp;
+
+    // Both programs parse their arguments with getopt, one after the other.
+    optind = 1;
+    node->exit_status = node->entry(node->argc, node->argv);
+    return NULL;
+}
+
+/**
+ * Queue a task to run at the current time.
+ * @param task Task.
+ * @param reason What the blocking call it is in returns.
+ */
+static void make_runnable(struct sim_task *task, enum sim_wake_reason reason)
+{
+    task->state = SIM_TASK_RUNNABLE;
+    task->reason = reason;
+    // Whatever wake event is still pending for the block it leaves is now stale.
+    task->generation++;
+    task->next_runnable = NULL;
+    if(sim.runnable_tail)
+    {
+        sim.runnable_tail->next_runnable = task;
+    }
+    else
+    {
+        sim.runnable_head = task;
+    }
+    sim.runnable_tail = task;
+}
+
+/**
+ * Block the current task and switch back to the scheduler.
+ * @param requested_ns Deadline the caller asked for, -1 for none.
+ * @param scheduled_ns Deadline actually scheduled, later when stretched.
+ * @return Why the task was resumed.
+ */
+static enum sim_wake_reason block_until(int64_t requested_ns, int64_t scheduled_ns)
+{
+    struct sim_task *task = sim.current;
+
+    task->state = SIM_TASK_BLOCKED;
+    task->generation++;
+    task->blocked_sequence = sim.next_blocked++;
+    task->requested_wake_ns = requested_ns;
+    if(scheduled_ns >= 0)
+    {
+        sim_schedule(scheduled_ns + wake_latency(), wake_expired, task, task->generation);
+    }
+    if(_setjmp(task->resume) == 0)
+    {
+        _longjmp(sim.scheduler, 1);
+    }
+    task->requested_wake_ns = -1;
+    return task->reason;
+}
+
+/**
+ * Event ending a timed block.
+ * @param arg The task.
+ * @param generation Generation of the block the event was scheduled for.
+ */
+static void wake_expired(void *arg, uint64_t generation)
+{
+    struct sim_task *task = arg;
+
+    if(task->state == SIM_TASK_BLOCKED && task->generation == generation)
+    {
+        make_runnable(task, SIM_TIMED_OUT);
+    }
+}
+
+/**
+ * How late a timed wakeup lands, drawn from the seed.
+ * @return Nanoseconds, 0 unless a latency was configured.
+ */
+static int64_t wake_latency(void)
+{
+    if(sim.config.wake_latency_ns <= 0)
+    {
+        return 0;
+    }
+    return sim_random_range(0, sim.config.wake_latency_ns);
+}
+
+/**
+ * Move a sleep of the input sampler to the first sample on or after the next
+ * input edge, if its debounce settled on the last one before it would wake.
+ * @param task Task going to sleep.
+ * @param wake_ns Virtual time it asked to wake at.
+ * @return Virtual time to wake it at.
+ */
+static int64_t stretch_sleep(const struct sim_task *task, int64_t wake_ns)
+{
+    const struct sim_node *node = task->node;
+    int64_t skipped;
+
+    if(!task->reads_inputs || node->next_input_edge_ns <= wake_ns || wake_ns < node->last_input_edge_ns + SIM_INPUT_QUIET_NS)
+    {
+        return wake_ns;
+    }
+    skipped = (node->next_input_edge_ns - wake_ns + SIM_INPUT_PERIOD_NS - 1) / SIM_INPUT_PERIOD_NS;
+    sim.stats.stretched_sleeps++;
+    return wake_ns + skipped * SIM_INPUT_PERIOD_NS;
+}
+
+/**
+ * Event ending the run: deliver SIGINT to the nodes, last started first, and
+ * interrupt the blocking call their main task is in.
+ * @param arg Unused.
+ * @param generation Unused.
+ */
+static void stop_nodes(void *arg, uint64_t generation)
+{
+    (void)arg;
+    (void)generation;
+
+    if(stop_hook)
+    {
+        stop_hook(stop_hook_arg, 0);
+    }
+    for(size_t i = sim.node_count; i-- > 0;)
+    {
+        struct sim_node *node = &sim.nodes[i];
+        struct sim_task *task = node->main_task;
+
+        if(node->interrupt_handler)
+        {
+            node->interrupt_handler(SIGINT);
+        }
+        // Only calls that fail with EINTR are cut short, not joins and condition waits.
+        if(task->state == SIM_TASK_BLOCKED && task->waiting_on == NULL)
+        {
+            make_runnable(task, SIM_INTERRUPTED);
+        }
+    }
+}
+
+/**
+ * Event ending the run when a node does not exit.
+ * @param arg Unused.
+ * @param generation Unused.
+ */
+static void give_up(void *arg, uint64_t generation)
+{
+    (void)arg;
+    (void)generation;
+    sim.gave_up = 1;
+}
+
+/**
+ * Check whether every node's main returned.
+ * @return 1 if they all did.
+ */
+static int nodes_done(void)
+{
+    for(size_t i = 0; i < sim.node_count; i++)
+    {
+        if(sim.nodes[i].main_task == NULL || sim.nodes[i].main_task->state != SIM_TASK_DONE)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Read a node clock now.
+ * @param node Node.
+ * @param clock Clock, wall clocks read CLOCK_REALTIME and the rest CLOCK_MONOTONIC.
+ * @return Nanoseconds.
+ */
+static int64_t node_clock(const struct sim_node *node, clockid_t clock)
+{
+    switch(clock)
+    {
+        case CLOCK_REALTIME:
+        case CLOCK_REALTIME_COARSE:
+        case CLOCK_TAI:
+        {
+            return sim_node_realtime(node, sim.now_ns);
+        }
+        default:
+        {
+            return sim_node_monotonic(node, sim.now_ns);
+        }
+    }
+}
+
+/**
+ * Virtual time an absolute deadline on a node clock falls at. Wall clock
+ * deadlines take the current drift as constant.
+ * @param node Node.
+ * @param clock Clock the deadline is on.
+ * @param deadline Deadline.
+ * @return Virtual time.
+ */
+static int64_t node_deadline(const struct sim_node *node, clockid_t clock, const struct timespec *deadline)
+{
+    int64_t deadline_ns = (int64_t)deadline->tv_sec * SIM_NSEC_PER_SEC + deadline->tv_nsec;
+
+    return sim.now_ns + (deadline_ns - node_clock(node, clock));
+}
+
+/**
+ * Task behind a handle given out by __wrap_pthread_create.
+ * @param thread Handle.
+ * @return The task, or NULL.
+ */
+static struct sim_task *task_from_thread(pthread_t thread)
+{
+    if(thread == 0 || thread > sim.task_count)
+    {
+        return NULL;
+    }
+    return &sim.tasks[thread - 1];
+}
+
+/**
+ * Block on a condition variable with the mutex released.
+ * @param cond Condition variable.
+ * @param mutex Mutex held by the caller, held again on return.
+ * @param deadline_ns Virtual time to give up at, -1 for none.
+ * @return 0 if signalled, ETIMEDOUT if the deadline passed.
+ */
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, int64_t deadline_ns)
+{
+    struct sim_task *task = sim.current;
+    enum sim_wake_reason reason;
+
+    task->waiting_on = cond;
+    pthread_mutex_unlock(mutex);
+    reason = sim_block(deadline_ns);
+    task->waiting_on = NULL;
+    pthread_mutex_lock(mutex);
+    return reason == SIM_TIMED_OUT ? ETIMEDOUT : 0;
+}
+
+/**
+ * Wake tasks waiting on a condition variable, longest waiting first.
+ * @param cond Condition variable.
+ * @param all Wake all of them instead of one.
+ */
+static void cond_wake(const pthread_cond_t *cond, int all)
+{
+    for(;;)
+    {
+        struct sim_task *first = NULL;
+
+        for(size_t i = 0; i < sim.task_count; i++)
+        {
+            struct sim_task *task = &sim.tasks[i];
+
+            if(task->state == SIM_TASK_BLOCKED && task->waiting_on == cond &&
+               (first == NULL || task->blocked_sequence < first->blocked_sequence))
+            {
+                first = task;
+            }
+        }
+        if(first == NULL)
+        {
+            return;
+        }
+        make_runnable(first, SIM_WOKEN);
+        if(!all)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Split nanoseconds into a timespec.
+ * @param ns Nanoseconds, not negative.
+ * @param ts Destination.
+ */
+static void to_timespec(int64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = (time_t)(ns / SIM_NSEC_PER_SEC);
+    ts->tv_nsec = (long)(ns % SIM_NSEC_PER_SEC);
+}
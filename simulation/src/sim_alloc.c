@@ -0,0 +1,125 @@
+#include "sim_alloc.h"
+#include <string.h>
+#include <sys/resource.h>
+
+static struct sim_alloc_stats alloc_stats;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static void count_allocation(size_t size);
+static void warmed_up(void *arg, uint64_t generation);
+static long peak_rss_kib(void);
+
+/**
+ * Reset the counters and take the peak resident set once warm-up is over.
+ * Call after sim_init.
+ */
+void sim_alloc_init(void)
+{
+    memset(&alloc_stats, 0, sizeof(alloc_stats)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    alloc_stats.first_steady_ns = -1;
+    sim_schedule(SIM_ALLOC_WARMUP_NS, warmed_up, NULL, 0);
+}
+
+/**
+ * Take the peak resident set at the end of the run.
+ */
+void sim_alloc_finish(void)
+{
+    alloc_stats.end_peak_rss_kib = peak_rss_kib();
+    // A run shorter than the warm-up has no steady state to compare with.
+    if(alloc_stats.warm_peak_rss_kib == 0)
+    {
+        alloc_stats.warm_peak_rss_kib = alloc_stats.end_peak_rss_kib;
+    }
+}
+
+/**
+ * Heap use so far.
+ * @return Counters.
+ */
+const struct sim_alloc_stats *sim_alloc_get_stats(void)
+{
+    return &alloc_stats;
+}
+
+/**
+ * Count a malloc made by car_controller or car_motors. The simulator
+ * itself calls __real_malloc.
+ * @param size Bytes asked for.
+ * @return As malloc.
+ */
+void *__wrap_malloc(size_t size)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    count_allocation(size);
+    return __real_malloc(size);
+}
+
+/**
+ * Count a calloc made by car_controller or car_motors.
+ * @param count Elements.
+ * @param size Bytes per element.
+ * @return As calloc.
+ */
+void *__wrap_calloc(size_t count, size_t size)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    count_allocation(count * size);
+    return __real_calloc(count, size);
+}
+
+/**
+ * Count a realloc made by car_controller or car_motors. The simulator
+ * itself calls __real_realloc.
+ * @param pointer Block to resize.
+ * @param size New size.
+ * @return As realloc.
+ */
+void *__wrap_realloc(void *pointer, size_t size)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    count_allocation(size);
+    return __real_realloc(pointer, size);
+}
+
+/**
+ * Count one allocation, noting the first after warm-up.
+ * @param size Bytes asked for.
+ */
+static void count_allocation(size_t size)
+{
+    alloc_stats.allocations++;
+    if(sim_now() < SIM_ALLOC_WARMUP_NS)
+    {
+        return;
+    }
+    if(alloc_stats.steady_allocations == 0)
+    {
+        alloc_stats.first_steady_ns = sim_now();
+        alloc_stats.first_steady_size = size;
+    }
+    alloc_stats.steady_allocations++;
+}
+
+/**
+ * Event at the end of warm-up.
+ * @param arg Unused.
+ * @param generation Unused.
+ */
+static void warmed_up(void *arg, uint64_t generation)
+{
+    (void)arg;
+    (void)generation;
+    alloc_stats.warm_peak_rss_kib = peak_rss_kib();
+}
+
+/**
+ * Peak resident set of this process.
+ * @return KiB, 0 if unknown.
+ */
+static long peak_rss_kib(void)
+{
+    struct rusage usage;
+
+    if(getrusage(RUSAGE_SELF, &usage) == -1)
+    {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
@@ -0,0 +1,392 @@
+#include "sim_gpio.h"
+#include "input.h"
+#include "motor.h"
+#include <string.h>
+#include <wiringPi.h>
+
+#define SIM_GPIO_MAX_EDGES (2 * SIM_GPIO_MAX_BOUNCES + 1)
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+// Before anything: a direction never asked for was last asked for long ago.
+#define NEVER_NS (INT64_MIN / 4)
+
+// GPIO of both nodes, the button driver and the motor checker.
+struct sim_gpio {
+    struct sim_node *buttons;
+    struct sim_node *motors;
+    int64_t bound_ns;
+    int input_level[SIM_GPIO_PINS];
+    int output_level[SIM_GPIO_PINS];
+    int finished;
+
+    // Button change being played, bounces first.
+    enum sim_motion next_target;
+    int edge_pin;
+    int64_t edge_ns[SIM_GPIO_MAX_EDGES];
+    int edge_count;
+    int edge_index;
+
+    // Settled buttons against the motors.
+    enum sim_motion target;
+    int64_t target_since_ns;
+    int64_t left_ns[SIM_MOTION_COUNT];    // last time the target stopped being each direction.
+    enum sim_motion motion;
+    int evaluation_pending;
+    int stop_pending;
+    int drive_pending;
+    struct sim_gpio_results results;
+};
+
+static struct sim_gpio gpio;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static void plan_change(int64_t start_ns);
+static void edge_fire(void *arg, uint64_t generation);
+static void settle(int64_t now_ns);
+static void check_released(void *arg, uint64_t generation);
+static void evaluate_motors(void *arg, uint64_t generation);
+static void motors_changed(enum sim_motion motion, int64_t now_ns);
+static void violation(int64_t now_ns);
+static int button_pin(enum sim_motion motion);
+
+/**
+ * Start driving the buttons of one node and watching the motors of another.
+ * The buttons start released and the motor outputs low.
+ * @param buttons Node reading the buttons.
+ * @param motors Node driving the motors.
+ * @param bound_ns Longest the motors may keep following a released button.
+ */
+void sim_gpio_init(struct sim_node *buttons, struct sim_node *motors, int64_t bound_ns)
+{
+    memset(&gpio, 0, sizeof(gpio)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    gpio.buttons = buttons;
+    gpio.motors = motors;
+    gpio.bound_ns = bound_ns;
+    gpio.target = SIM_MOTION_OFF;
+    gpio.motion = SIM_MOTION_OFF;
+    gpio.results.motor_hash = FNV_OFFSET;
+    gpio.results.first_violation_ns = -1;
+    for(int i = 0; i < SIM_GPIO_PINS; i++)
+    {
+        gpio.input_level[i] = HIGH;
+        gpio.output_level[i] = LOW;
+    }
+    for(int i = 0; i < SIM_MOTION_COUNT; i++)
+    {
+        gpio.left_ns[i] = NEVER_NS;
+    }
+    plan_change(SIM_GPIO_FIRST_PRESS_NS);
+}
+
+/**
+ * Stop driving and checking, the nodes are about to be stopped.
+ */
+void sim_gpio_finish(void)
+{
+    gpio.finished = 1;
+    gpio.buttons->next_input_edge_ns = -1;
+}
+
+/**
+ * What was checked so far.
+ * @return Results.
+ */
+const struct sim_gpio_results *sim_gpio_get_results(void)
+{
+    return &gpio.results;
+}
+
+/**
+ * Nothing to set up, every node starts with its own pins.
+ * @return 0.
+ */
+int wiringPiSetup(void)
+{
+    return 0;
+}
+
+/**
+ * Pins are inputs or outputs by node, the mode is not needed.
+ * @param pin Unused.
+ * @param mode Unused.
+ */
+void pinMode(int pin, int mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+/**
+ * Read a button. The reading task's sleeps may be stretched from now on.
+ * @param pin Pin number.
+ * @return The level driven, HIGH for any pin not driven.
+ */
+int digitalRead(int pin)
+{
+    struct sim_task *task = sim_current();
+
+    if(task == NULL || task->node != gpio.buttons || pin < 0 || pin >= SIM_GPIO_PINS)
+    {
+        return HIGH;
+    }
+    task->reads_inputs = 1;
+    return gpio.input_level[pin];
+}
+
+/**
+ * Set a motor pin. The motors are read back once the writing task blocks, so
+ * a direction change written pin by pin counts as one change.
+ * @param pin Pin number.
+ * @param value Level.
+ */
+void digitalWrite(int pin, int value)
+{
+    struct sim_task *task = sim_current();
+
+    if(task == NULL || task->node != gpio.motors || pin < 0 || pin >= SIM_GPIO_PINS)
+    {
+        return;
+    }
+    gpio.output_level[pin] = value;
+    if(!gpio.evaluation_pending)
+    {
+        gpio.evaluation_pending = 1;
+        sim_schedule(sim_now(), evaluate_motors, NULL, 0);
+    }
+}
+
+/**
+ * Draw the next button change: a press of either button after a release, a
+ * release after a press. It bounces up to SIM_GPIO_MAX_BOUNCES times.
+ * @param start_ns Virtual time of its first edge.
+ */
+static void plan_change(int64_t start_ns)
+{
+    int bounces = (int)sim_random_range(0, SIM_GPIO_MAX_BOUNCES);
+
+    if(gpio.target == SIM_MOTION_OFF)
+    {
+        gpio.next_target = sim_random_range(0, 1) ? SIM_MOTION_CLOCKWISE : SIM_MOTION_COUNTER_CLOCKWISE;
+        gpio.edge_pin = button_pin(gpio.next_target);
+    }
+    else
+    {
+        gpio.next_target = SIM_MOTION_OFF;
+        gpio.edge_pin = button_pin(gpio.target);
+    }
+
+    // The bounces fall anywhere in the window, kept in order.
+    gpio.edge_ns[0] = start_ns;
+    gpio.edge_count = 2 * bounces + 1;
+    for(int i = 1; i < gpio.edge_count; i++)
+    {
+        int64_t edge = start_ns + sim_random_range(1, SIM_GPIO_BOUNCE_NS);
+        int j = i;
+
+        while(j > 1 && gpio.edge_ns[j - 1] > edge)
+        {
+            gpio.edge_ns[j] = gpio.edge_ns[j - 1];
+            j--;
+        }
+        gpio.edge_ns[j] = edge;
+    }
+    gpio.edge_index = 0;
+
+    gpio.buttons->next_input_edge_ns = start_ns;
+    sim_schedule(start_ns, edge_fire, NULL, 0);
+}
+
+/**
+ * Event of a button pin toggling. The last toggle settles the change and
+ * draws the next one after a random hold.
+ * @param arg Unused.
+ * @param generation Unused.
+ */
+static void edge_fire(void *arg, uint64_t generation)
+{
+    int64_t now = sim_now();
+
+    (void)arg;
+    (void)generation;
+    if(gpio.finished)
+    {
+        return;
+    }
+
+    gpio.input_level[gpio.edge_pin] = !gpio.input_level[gpio.edge_pin];
+    gpio.results.edges++;
+    gpio.buttons->last_input_edge_ns = now;
+
+    if(++gpio.edge_index < gpio.edge_count)
+    {
+        gpio.buttons->next_input_edge_ns = gpio.edge_ns[gpio.edge_index];
+        sim_schedule(gpio.edge_ns[gpio.edge_index], edge_fire, NULL, 0);
+        return;
+    }
+
+    settle(now);
+    plan_change(now + sim_random_range(SIM_GPIO_HOLD_MIN_NS, SIM_GPIO_HOLD_MAX_NS));
+}
+
+/**
+ * The buttons settled on a new target. A direction the buttons leave must be
+ * let go of within the bound.
+ * @param now_ns Virtual time of the last bounce.
+ */
+static void settle(int64_t now_ns)
+{
+    enum sim_motion left = gpio.target;
+
+    if(gpio.drive_pending)
+    {
+        gpio.results.drives_missed++;
+    }
+    gpio.stop_pending = 0;
+    gpio.drive_pending = 0;
+
+    gpio.target = gpio.next_target;
+    gpio.target_since_ns = now_ns;
+    gpio.left_ns[left] = now_ns;
+    gpio.results.transitions++;
+
+    if(left != SIM_MOTION_OFF)
+    {
+        sim_schedule(now_ns + gpio.bound_ns, check_released, NULL, (uint64_t)left);
+    }
+    if(gpio.target == SIM_MOTION_OFF)
+    {
+        gpio.stop_pending = gpio.motion != SIM_MOTION_OFF;
+    }
+    else
+    {
+        gpio.drive_pending = gpio.motion != gpio.target;
+    }
+}
+
+/**
+ * Event a bound after the buttons left a direction: the motors must no longer
+ * be driven in it, unless the buttons came back to it.
+ * @param arg Unused.
+ * @param generation The direction left.
+ */
+static void check_released(void *arg, uint64_t generation)
+{
+    enum sim_motion left = (enum sim_motion)generation;
+    int64_t now = sim_now();
+
+    (void)arg;
+    // Only the latest release of the direction counts.
+    if(gpio.finished || gpio.target == left || gpio.motion != left || now < gpio.left_ns[left] + gpio.bound_ns)
+    {
+        return;
+    }
+    gpio.results.stops_late++;
+    violation(now);
+}
+
+/**
+ * Event reading the motor pins back once the writer blocked. Pins that are
+ * neither off nor a direction, like one motor enabled, keep the last reading.
+ * @param arg Unused.
+ * @param generation Unused.
+ */
+static void evaluate_motors(void *arg, uint64_t generation)
+{
+    const int *out = gpio.output_level;
+    enum sim_motion motion = gpio.motion;
+
+    (void)arg;
+    (void)generation;
+    gpio.evaluation_pending = 0;
+
+    if(!out[RightMotorEnable] && !out[LeftMotorEnable])
+    {
+        motion = SIM_MOTION_OFF;
+    }
+    else if(out[RightMotorEnable] && out[LeftMotorEnable] && out[RightMotorPin1] == out[LeftMotorPin1] &&
+            out[RightMotorPin2] == out[LeftMotorPin2] && out[RightMotorPin1] != out[RightMotorPin2])
+    {
+        motion = out[RightMotorPin1] ? SIM_MOTION_CLOCKWISE : SIM_MOTION_COUNTER_CLOCKWISE;
+    }
+
+    if(motion != gpio.motion)
+    {
+        motors_changed(motion, sim_now());
+    }
+}
+
+/**
+ * Check a change of the motors against the buttons and fold it into the hash.
+ * @param motion New direction.
+ * @param now_ns Virtual time of the change.
+ */
+static void motors_changed(enum sim_motion motion, int64_t now_ns)
+{
+    uint64_t stamp = (uint64_t)now_ns;
+
+    gpio.motion = motion;
+    gpio.results.motor_changes++;
+    for(int i = 0; i < 8; i++)   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    {
+        gpio.results.motor_hash = (gpio.results.motor_hash ^ (stamp & 0xff)) * FNV_PRIME;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+        stamp >>= 8;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    }
+    gpio.results.motor_hash = (gpio.results.motor_hash ^ (uint64_t)motion) * FNV_PRIME;
+
+    if(gpio.finished)
+    {
+        return;
+    }
+
+    if(motion == SIM_MOTION_OFF)
+    {
+        if(gpio.stop_pending)
+        {
+            latency_stat_add(&gpio.results.stop_latency, now_ns - gpio.target_since_ns);
+            gpio.stop_pending = 0;
+        }
+        else if(gpio.target != SIM_MOTION_OFF)
+        {
+            gpio.results.deadman_stops++;
+        }
+        return;
+    }
+
+    if(motion == gpio.target)
+    {
+        if(gpio.drive_pending)
+        {
+            latency_stat_add(&gpio.results.drive_latency, now_ns - gpio.target_since_ns);
+            gpio.drive_pending = 0;
+        }
+        return;
+    }
+
+    // Following a press that ended within the bound is late, not wrong.
+    if(gpio.left_ns[motion] + gpio.bound_ns < now_ns)
+    {
+        gpio.results.stale_actuations++;
+        violation(now_ns);
+    }
+}
+
+/**
+ * Record the time of the first violation.
+ * @param now_ns Virtual time of the violation.
+ */
+static void violation(int64_t now_ns)
+{
+    if(gpio.results.first_violation_ns == -1)
+    {
+        gpio.results.first_violation_ns = now_ns;
+    }
+}
+
+/**
+ * Button driving a direction, pressed when low.
+ * @param motion Direction.
+ * @return Pin number.
+ */
+static int button_pin(enum sim_motion motion)
+{
+    return motion == SIM_MOTION_CLOCKWISE ? RightButtonPin : LeftButtonPin;
+}
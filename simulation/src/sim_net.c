@@ -0,0 +1,819 @@
+// ip_mreq and the socket timestamp options are not part of POSIX.
+#define _DEFAULT_SOURCE // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+#include "sim_net.h"
+#include "sim_alloc.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+
+enum sim_fd_kind {
+    SIM_FD_FREE,
+    SIM_FD_SOCKET,
+    SIM_FD_EVENT
+};
+
+// A datagram in flight or queued on a socket.
+struct sim_packet {
+    struct sim_packet *next;
+    struct sockaddr_in from;
+    struct sockaddr_in to;
+    int64_t arrival_ns;
+    size_t size;
+    uint8_t bytes[SIM_NET_PACKET_SIZE];
+};
+
+// A UDP socket or an eventfd of one node.
+struct sim_fd {
+    enum sim_fd_kind kind;
+    struct sim_node *node;
+    struct sockaddr_in local;
+    int bound;
+    int reuse_address;
+    int timestamps;
+    in_addr_t groups[SIM_NET_MAX_GROUPS];
+    size_t group_count;
+    struct sim_packet *head;
+    struct sim_packet *tail;
+    size_t queued_bytes;
+    uint64_t counter;      // eventfd value.
+    int nonblocking;
+};
+
+// Network state, one per simulation.
+struct sim_net {
+    struct sim_link_config config;
+    struct sim_fd fds[SIM_NET_MAX_FDS];
+    struct sim_packet *free_packets;
+    int64_t outage_start_ns;
+    int64_t outage_end_ns;
+    in_port_t next_ephemeral;
+    struct sim_net_stats stats;
+};
+
+static struct sim_net net;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static struct sim_fd *lookup(int fd);
+static int allocate_fd(enum sim_fd_kind kind);
+static struct sim_packet *packet_get(void);
+static void packet_put(struct sim_packet *packet);
+static int link_down(int64_t now_ns);
+static void deliver(void *arg, uint64_t generation);
+static void enqueue(int fd, const struct sim_packet *packet);
+static int accepts(const struct sim_fd *socket, const struct sockaddr_in *to);
+static int readable(const struct sim_fd *entry);
+static int wait_readable(int fd);
+static int fail(int error);
+
+/**
+ * Bring the link up with no descriptors open.
+ * @param config Link model.
+ */
+void sim_net_init(const struct sim_link_config *config)
+{
+    memset(&net, 0, sizeof(net)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    net.config = *config;
+    net.next_ephemeral = 32768;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers)
+    net.outage_start_ns = -1;
+    net.outage_end_ns = 0;
+}
+
+/**
+ * Free every packet, queued or pooled. Packets still in flight belong to
+ * events of the simulation, which must be over.
+ */
+void sim_net_destroy(void)
+{
+    for(size_t i = 0; i < SIM_NET_MAX_FDS; i++)
+    {
+        while(net.fds[i].head)
+        {
+            struct sim_packet *packet = net.fds[i].head;
+
+            net.fds[i].head = packet->next;
+            packet_put(packet);
+        }
+    }
+    while(net.free_packets)
+    {
+        struct sim_packet *packet = net.free_packets;
+
+        net.free_packets = packet->next;
+        free(packet);
+    }
+}
+
+/**
+ * Datagram counters so far.
+ * @return Counters.
+ */
+const struct sim_net_stats *sim_net_get_stats(void)
+{
+    return &net.stats;
+}
+
+/**
+ * Open a virtual UDP socket on the calling node. Other sockets are real.
+ * @param domain Address family.
+ * @param type Socket type.
+ * @param protocol Protocol.
+ * @return Descriptor, or -1 with errno EMFILE.
+ */
+int __wrap_socket(int domain, int type, int protocol)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    int fd;
+
+    if(sim_current() == NULL || domain != AF_INET || (type & ~(SOCK_NONBLOCK | SOCK_CLOEXEC)) != SOCK_DGRAM)
+    {
+        return __real_socket(domain, type, protocol);
+    }
+    fd = allocate_fd(SIM_FD_SOCKET);
+    if(fd != -1)
+    {
+        net.fds[fd - SIM_NET_FD_BASE].nonblocking = (type & SOCK_NONBLOCK) != 0;
+    }
+    return fd;
+}
+
+/**
+ * Bind a virtual socket to an address of its node, the wildcard or a group.
+ * @param fd Descriptor.
+ * @param addr Address.
+ * @param len Size of the address.
+ * @return 0, or -1 with errno EADDRNOTAVAIL or EADDRINUSE.
+ */
+int __wrap_bind(int fd, const struct sockaddr *addr, socklen_t len)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_fd *entry = lookup(fd);
+    struct sockaddr_in local;
+
+    if(entry == NULL)
+    {
+        return __real_bind(fd, addr, len);
+    }
+    if(entry->kind != SIM_FD_SOCKET || len < sizeof(struct sockaddr_in))
+    {
+        return fail(EINVAL);
+    }
+    memcpy(&local, addr, sizeof(local)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+
+    if(local.sin_addr.s_addr != htonl(INADDR_ANY) && local.sin_addr.s_addr != entry->node->ip &&
+       !IN_MULTICAST(ntohl(local.sin_addr.s_addr)))
+    {
+        return fail(EADDRNOTAVAIL);
+    }
+
+    for(size_t i = 0; i < SIM_NET_MAX_FDS; i++)
+    {
+        const struct sim_fd *other = &net.fds[i];
+
+        if(other->kind == SIM_FD_SOCKET && other->bound && other->node == entry->node && other->local.sin_port == local.sin_port &&
+           (other->local.sin_addr.s_addr == local.sin_addr.s_addr || other->local.sin_addr.s_addr == htonl(INADDR_ANY) ||
+            local.sin_addr.s_addr == htonl(INADDR_ANY)) &&
+           !(other->reuse_address && entry->reuse_address))
+        {
+            return fail(EADDRINUSE);
+        }
+    }
+
+    entry->local = local;
+    entry->local.sin_family = AF_INET;
+    entry->bound = 1;
+    return 0;
+}
+
+/**
+ * Socket options of a virtual socket. Only SO_TIMESTAMPNS receive stamps are
+ * offered, SO_TIMESTAMPING is refused; the rest are accepted and ignored
+ * unless they join a group or allow sharing the address.
+ * @param fd Descriptor.
+ * @param level Option level.
+ * @param name Option.
+ * @param value Option value.
+ * @param len Size of the value.
+ * @return 0, or -1 with errno ENOPROTOOPT.
+ */
+int __wrap_setsockopt(int fd, int level, int name, const void *value, socklen_t len)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_fd *entry = lookup(fd);
+    int on = 0;
+
+    if(entry == NULL)
+    {
+        return __real_setsockopt(fd, level, name, value, len);
+    }
+    if(len >= sizeof(int))
+    {
+        memcpy(&on, value, sizeof(on)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    }
+
+    if(level == SOL_SOCKET && name == SO_TIMESTAMPING)
+    {
+        return fail(ENOPROTOOPT);
+    }
+    if(level == SOL_SOCKET && name == SO_TIMESTAMPNS)
+    {
+        entry->timestamps = on != 0;
+    }
+    if(level == SOL_SOCKET && name == SO_REUSEADDR)
+    {
+        entry->reuse_address = on != 0;
+    }
+    if(level == IPPROTO_IP && name == IP_ADD_MEMBERSHIP && len >= sizeof(struct ip_mreq))
+    {
+        struct ip_mreq membership;
+
+        memcpy(&membership, value, sizeof(membership)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        if(entry->group_count == SIM_NET_MAX_GROUPS)
+        {
+            return fail(ENOBUFS);
+        }
+        entry->groups[entry->group_count++] = membership.imr_multiaddr.s_addr;
+    }
+    return 0;
+}
+
+/**
+ * SO_MEMINFO of a virtual socket, the receive queue with its overhead.
+ * @param fd Descriptor.
+ * @param level Option level.
+ * @param name Option.
+ * @param value Filled in.
+ * @param len Size of the value, updated.
+ * @return 0, or -1 with errno ENOPROTOOPT for anything else.
+ */
+int __wrap_getsockopt(int fd, int level, int name, void *value, socklen_t *len)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    const struct sim_fd *entry = lookup(fd);
+    uint32_t meminfo[SK_MEMINFO_VARS];
+
+    if(entry == NULL)
+    {
+        return __real_getsockopt(fd, level, name, value, len);
+    }
+    if(level != SOL_SOCKET || name != SO_MEMINFO)
+    {
+        return fail(ENOPROTOOPT);
+    }
+
+    memset(meminfo, 0, sizeof(meminfo)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    meminfo[SK_MEMINFO_RMEM_ALLOC] = (uint32_t)entry->queued_bytes;
+    meminfo[SK_MEMINFO_RCVBUF] = SIM_NET_RCVBUF;
+    if(*len > sizeof(meminfo))
+    {
+        *len = sizeof(meminfo);
+    }
+    memcpy(value, meminfo, *len); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    return 0;
+}
+
+/**
+ * Close a virtual descriptor, dropping whatever is queued on it.
+ * @param fd Descriptor.
+ * @return 0.
+ */
+int __wrap_close(int fd)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_fd *entry = lookup(fd);
+
+    if(entry == NULL)
+    {
+        return __real_close(fd);
+    }
+    while(entry->head)
+    {
+        struct sim_packet *packet = entry->head;
+
+        entry->head = packet->next;
+        packet_put(packet);
+    }
+    memset(entry, 0, sizeof(struct sim_fd)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    return 0;
+}
+
+/**
+ * Send a datagram over the link. It is never blocked or refused: loss, the
+ * delay and whether anything is listening are settled by the link model.
+ * @param fd Descriptor.
+ * @param bytes Payload.
+ * @param size Payload size.
+ * @param flags Unused.
+ * @param to Destination.
+ * @param len Size of the destination.
+ * @return size, or -1 with errno EMSGSIZE or EINVAL.
+ */
+ssize_t __wrap_sendto(int fd, const void *bytes, size_t size, int flags, const struct sockaddr *to, socklen_t len)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_fd *entry = lookup(fd);
+    struct sim_packet *packet;
+    int64_t now = sim_now();
+
+    if(entry == NULL)
+    {
+        return __real_sendto(fd, bytes, size, flags, to, len);
+    }
+    if(entry->kind != SIM_FD_SOCKET || to == NULL || len < sizeof(struct sockaddr_in))
+    {
+        return fail(EINVAL);
+    }
+    if(size > SIM_NET_PACKET_SIZE)
+    {
+        return fail(EMSGSIZE);
+    }
+
+    // An unbound socket gets the node address and an ephemeral port, like on first send.
+    if(!entry->bound)
+    {
+        entry->local.sin_family = AF_INET;
+        entry->local.sin_addr.s_addr = htonl(INADDR_ANY);
+        entry->local.sin_port = htons(net.next_ephemeral++);
+        entry->bound = 1;
+    }
+
+    net.stats.sent++;
+    if(link_down(now) || (uint32_t)sim_random_range(0, SIM_NET_PPM - 1) < net.config.loss_ppm)
+    {
+        net.stats.lost++;
+        return (ssize_t)size;
+    }
+
+    packet = packet_get();
+    packet->from = entry->local;
+    if(packet->from.sin_addr.s_addr == htonl(INADDR_ANY) || IN_MULTICAST(ntohl(packet->from.sin_addr.s_addr)))
+    {
+        packet->from.sin_addr.s_addr = entry->node->ip;
+    }
+    memcpy(&packet->to, to, sizeof(packet->to)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    memcpy(packet->bytes, bytes, size); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    packet->size = size;
+    packet->arrival_ns = now + net.config.delay_ns + sim_random_range(0, net.config.jitter_ns);
+    sim_schedule(packet->arrival_ns, deliver, packet, 0);
+    return (ssize_t)size;
+}
+
+/**
+ * Take the oldest datagram queued on a virtual socket, with its source and,
+ * if SO_TIMESTAMPNS is on, an SCM_TIMESTAMPNS stamp of its arrival on the
+ * receiving node's wall clock. Blocks while the queue is empty.
+ * @param fd Descriptor.
+ * @param msg Message to fill in.
+ * @param flags Unused.
+ * @return Bytes copied, or -1 with errno EAGAIN or EINTR.
+ */
+ssize_t __wrap_recvmsg(int fd, struct msghdr *msg, int flags)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_fd *entry = lookup(fd);
+    struct sim_packet *packet;
+    size_t copied = 0;
+
+    if(entry == NULL)
+    {
+        return __real_recvmsg(fd, msg, flags);
+    }
+    if(entry->kind != SIM_FD_SOCKET)
+    {
+        return fail(EINVAL);
+    }
+    while(entry->head == NULL)
+    {
+        if(entry->nonblocking || (flags & MSG_DONTWAIT))
+        {
+            return fail(EAGAIN);
+        }
+        if(wait_readable(fd) == -1)
+        {
+            return fail(EINTR);
+        }
+    }
+
+    packet = entry->head;
+    entry->head = packet->next;
+    if(entry->head == NULL)
+    {
+        entry->tail = NULL;
+    }
+    entry->queued_bytes -= packet->size + SIM_NET_PACKET_OVERHEAD;
+
+    msg->msg_flags = 0;
+    for(size_t i = 0; i < msg->msg_iovlen && copied < packet->size; i++)
+    {
+        size_t chunk = packet->size - copied;
+
+        if(chunk > msg->msg_iov[i].iov_len)
+        {
+            chunk = msg->msg_iov[i].iov_len;
+        }
+        memcpy(msg->msg_iov[i].iov_base, &packet->bytes[copied], chunk); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        copied += chunk;
+    }
+    if(copied < packet->size)
+    {
+        msg->msg_flags |= MSG_TRUNC;
+    }
+
+    if(msg->msg_name)
+    {
+        memcpy(msg->msg_name, &packet->from, msg->msg_namelen < sizeof(packet->from) ? msg->msg_namelen : sizeof(packet->from)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        msg->msg_namelen = sizeof(packet->from);
+    }
+
+    if(entry->timestamps && msg->msg_control && msg->msg_controllen >= CMSG_SPACE(sizeof(struct timespec)))
+    {
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+        int64_t stamp_ns = sim_node_realtime(entry->node, packet->arrival_ns);
+        struct timespec stamp;
+
+        stamp.tv_sec = (time_t)(stamp_ns / SIM_NSEC_PER_SEC);
+        stamp.tv_nsec = (long)(stamp_ns % SIM_NSEC_PER_SEC);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_TIMESTAMPNS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(stamp));
+        memcpy(CMSG_DATA(cmsg), &stamp, sizeof(stamp)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+        msg->msg_controllen = CMSG_SPACE(sizeof(stamp));
+    }
+    else
+    {
+        msg->msg_controllen = 0;
+    }
+
+    packet_put(packet);
+    return (ssize_t)copied;
+}
+
+/**
+ * Wait in virtual time for a virtual descriptor to become readable. Real
+ * descriptors in the set never report ready. A zero timeout with nothing
+ * ready still moves time on by a microsecond, so a task polling in a loop
+ * cannot stall the simulation.
+ * @param fds Descriptors, negative ones are ignored.
+ * @param count Number of descriptors.
+ * @param timeout_ms Milliseconds to wait, -1 for no limit.
+ * @return Number of descriptors ready, 0 on timeout, -1 with errno EINTR if the node was interrupted.
+ */
+int __wrap_poll(struct pollfd *fds, nfds_t count, int timeout_ms)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_task *task = sim_current();
+    int64_t deadline = -1;
+    enum sim_wake_reason reason = SIM_WOKEN;
+
+    if(task == NULL)
+    {
+        return __real_poll(fds, count, timeout_ms);
+    }
+    if(timeout_ms == 0)
+    {
+        deadline = sim_now() + SIM_NSEC_PER_USEC;
+    }
+    else if(timeout_ms > 0)
+    {
+        deadline = sim_now() + (int64_t)timeout_ms * SIM_NSEC_PER_MSEC;
+    }
+
+    for(;;)
+    {
+        int ready = 0;
+
+        for(nfds_t i = 0; i < count; i++)
+        {
+            const struct sim_fd *entry = lookup(fds[i].fd);
+
+            fds[i].revents = 0;
+            if(entry && readable(entry))
+            {
+                fds[i].revents = (short)(fds[i].events & POLLIN);
+            }
+            if(entry && entry->kind == SIM_FD_EVENT)
+            {
+                fds[i].revents |= (short)(fds[i].events & POLLOUT);
+            }
+            ready += fds[i].revents != 0;
+        }
+        if(ready || reason == SIM_TIMED_OUT)
+        {
+            return ready;
+        }
+        if(reason == SIM_INTERRUPTED)
+        {
+            return fail(EINTR);
+        }
+
+        task->poll_fds = fds;
+        task->poll_count = count;
+        reason = sim_block(deadline);
+        task->poll_fds = NULL;
+        task->poll_count = 0;
+    }
+}
+
+/**
+ * Create a virtual eventfd on the calling node.
+ * @param initial Initial counter value.
+ * @param flags EFD_NONBLOCK is honoured, EFD_SEMAPHORE is not supported.
+ * @return Descriptor, or -1 with errno EMFILE.
+ */
+int __wrap_eventfd(unsigned int initial, int flags)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    int fd;
+
+    if(sim_current() == NULL)
+    {
+        return __real_eventfd(initial, flags);
+    }
+    fd = allocate_fd(SIM_FD_EVENT);
+    if(fd != -1)
+    {
+        net.fds[fd - SIM_NET_FD_BASE].counter = initial;
+        net.fds[fd - SIM_NET_FD_BASE].nonblocking = (flags & EFD_NONBLOCK) != 0;
+    }
+    return fd;
+}
+
+/**
+ * Read and reset the counter of a virtual eventfd, blocking while it is 0.
+ * @param fd Descriptor.
+ * @param bytes Destination of the counter.
+ * @param size At least 8.
+ * @return 8, or -1 with errno EAGAIN, EINTR or EINVAL.
+ */
+ssize_t __wrap_read(int fd, void *bytes, size_t size)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_fd *entry = lookup(fd);
+
+    if(entry == NULL)
+    {
+        return __real_read(fd, bytes, size);
+    }
+    if(entry->kind != SIM_FD_EVENT || size < sizeof(uint64_t))
+    {
+        return fail(EINVAL);
+    }
+    while(entry->counter == 0)
+    {
+        if(entry->nonblocking)
+        {
+            return fail(EAGAIN);
+        }
+        if(wait_readable(fd) == -1)
+        {
+            return fail(EINTR);
+        }
+    }
+    memcpy(bytes, &entry->counter, sizeof(uint64_t)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    entry->counter = 0;
+    return sizeof(uint64_t);
+}
+
+/**
+ * Add to the counter of a virtual eventfd and wake its pollers.
+ * @param fd Descriptor.
+ * @param bytes Value to add.
+ * @param size At least 8.
+ * @return 8, or -1 with errno EINVAL.
+ */
+ssize_t __wrap_write(int fd, const void *bytes, size_t size)   // NOLINT(bugprone-reserved-identifier,cert-dcl37-c,cert-dcl51-cpp)
+{
+    struct sim_fd *entry = lookup(fd);
+    uint64_t value;
+
+    if(entry == NULL)
+    {
+        return __real_write(fd, bytes, size);
+    }
+    if(entry->kind != SIM_FD_EVENT || size < sizeof(uint64_t))
+    {
+        return fail(EINVAL);
+    }
+    memcpy(&value, bytes, sizeof(value)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    entry->counter += value;
+    if(entry->counter)
+    {
+        sim_wake_pollers(fd);
+    }
+    return sizeof(uint64_t);
+}
+
+/**
+ * Virtual descriptor behind a number, only while a task runs.
+ * @param fd Descriptor.
+ * @return The entry, or NULL for a real descriptor or outside a task.
+ */
+static struct sim_fd *lookup(int fd)
+{
+    if(sim_current() == NULL || fd < SIM_NET_FD_BASE || fd >= SIM_NET_FD_BASE + SIM_NET_MAX_FDS ||
+       net.fds[fd - SIM_NET_FD_BASE].kind == SIM_FD_FREE)
+    {
+        return NULL;
+    }
+    return &net.fds[fd - SIM_NET_FD_BASE];
+}
+
+/**
+ * Take the lowest free virtual descriptor for the calling node.
+ * @param kind What it is.
+ * @return Descriptor, or -1 with errno EMFILE.
+ */
+static int allocate_fd(enum sim_fd_kind kind)
+{
+    for(int i = 0; i < SIM_NET_MAX_FDS; i++)
+    {
+        if(net.fds[i].kind == SIM_FD_FREE)
+        {
+            memset(&net.fds[i], 0, sizeof(struct sim_fd)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+            net.fds[i].kind = kind;
+            net.fds[i].node = sim_current()->node;
+            return SIM_NET_FD_BASE + i;
+        }
+    }
+    return fail(EMFILE);
+}
+
+/**
+ * Take a packet from the pool, growing it if empty.
+ * @return Packet.
+ */
+static struct sim_packet *packet_get(void)
+{
+    struct sim_packet *packet = net.free_packets;
+
+    if(packet)
+    {
+        net.free_packets = packet->next;
+    }
+    else
+    {
+        packet = __real_malloc(sizeof(struct sim_packet));
+        if(packet == NULL)
+        {
+            perror("simulation packet");
+            exit(EXIT_FAILURE);   // NOLINT(concurrency-mt-unsafe)
+        }
+    }
+    packet->next = NULL;
+    return packet;
+}
+
+/**
+ * Return a packet to the pool.
+ * @param packet Packet.
+ */
+static void packet_put(struct sim_packet *packet)
+{
+    packet->next = net.free_packets;
+    net.free_packets = packet;
+}
+
+/**
+ * Check whether the link is in an outage, drawing outages as time goes by.
+ * Sends come in time order, so the outages are as reproducible as they are.
+ * @param now_ns Virtual time of the send.
+ * @return 1 if the link is down.
+ */
+static int link_down(int64_t now_ns)
+{
+    if(net.config.outage_mean_ns <= 0 || net.config.outage_ns <= 0)
+    {
+        return 0;
+    }
+    while(now_ns >= net.outage_end_ns)
+    {
+        net.outage_start_ns = net.outage_end_ns + sim_random_range(0, 2 * net.config.outage_mean_ns);
+        net.outage_end_ns = net.outage_start_ns + net.config.outage_ns;
+    }
+    return now_ns >= net.outage_start_ns;
+}
+
+/**
+ * Event of a datagram reaching the far end: queue it on the socket bound to
+ * its destination, or on every member socket of its group.
+ * @param arg The packet.
+ * @param generation Unused.
+ */
+static void deliver(void *arg, uint64_t generation)
+{
+    struct sim_packet *packet = arg;
+    int multicast = IN_MULTICAST(ntohl(packet->to.sin_addr.s_addr));
+    int delivered = 0;
+
+    (void)generation;
+    for(int i = 0; i < SIM_NET_MAX_FDS && (multicast || !delivered); i++)
+    {
+        if(accepts(&net.fds[i], &packet->to))
+        {
+            enqueue(SIM_NET_FD_BASE + i, packet);
+            delivered = 1;
+        }
+    }
+    if(!delivered)
+    {
+        net.stats.unreachable++;
+    }
+    packet_put(packet);
+}
+
+/**
+ * Queue a copy of a datagram on a socket, unless its buffer is full.
+ * @param fd Descriptor of the socket.
+ * @param packet Datagram.
+ */
+static void enqueue(int fd, const struct sim_packet *packet)
+{
+    struct sim_fd *entry = &net.fds[fd - SIM_NET_FD_BASE];
+    struct sim_packet *copy;
+
+    if(entry->queued_bytes + packet->size + SIM_NET_PACKET_OVERHEAD > SIM_NET_RCVBUF)
+    {
+        net.stats.overflowed++;
+        return;
+    }
+
+    copy = packet_get();
+    memcpy(copy, packet, sizeof(struct sim_packet)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling)
+    copy->next = NULL;
+    if(entry->tail)
+    {
+        entry->tail->next = copy;
+    }
+    else
+    {
+        entry->head = copy;
+    }
+    entry->tail = copy;
+    entry->queued_bytes += packet->size + SIM_NET_PACKET_OVERHEAD;
+    net.stats.delivered++;
+    sim_wake_pollers(fd);
+}
+
+/**
+ * Check whether a socket receives datagrams sent to an address.
+ * @param socket Descriptor entry.
+ * @param to Destination.
+ * @return 1 if it does.
+ */
+static int accepts(const struct sim_fd *socket, const struct sockaddr_in *to)
+{
+    in_addr_t bound = socket->local.sin_addr.s_addr;
+
+    if(socket->kind != SIM_FD_SOCKET || !socket->bound || socket->local.sin_port != to->sin_port)
+    {
+        return 0;
+    }
+    if(IN_MULTICAST(ntohl(to->sin_addr.s_addr)))
+    {
+        for(size_t i = 0; i < socket->group_count; i++)
+        {
+            if(socket->groups[i] == to->sin_addr.s_addr && (bound == to->sin_addr.s_addr || bound == htonl(INADDR_ANY)))
+            {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    return bound == to->sin_addr.s_addr || (bound == htonl(INADDR_ANY) && socket->node->ip == to->sin_addr.s_addr);
+}
+
+/**
+ * Check whether a read would return something now.
+ * @param entry Descriptor entry.
+ * @return 1 if readable.
+ */
+static int readable(const struct sim_fd *entry)
+{
+    return entry->kind == SIM_FD_SOCKET ? entry->head != NULL : entry->counter != 0;
+}
+
+/**
+ * Block the calling task until a virtual descriptor may have become readable.
+ * @param fd Descriptor.
+ * @return 0 when woken, -1 if the node was interrupted.
+ */
+static int wait_readable(int fd)
+{
+    struct sim_task *task = sim_current();
+    struct pollfd pfd;
+    enum sim_wake_reason reason;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    task->poll_fds = &pfd;
+    task->poll_count = 1;
+    reason = sim_block(-1);
+    task->poll_fds = NULL;
+    task->poll_count = 0;
+    return reason == SIM_INTERRUPTED ? -1 : 0;
+}
+
+/**
+ * Fail a call the way the C library does.
+ * @param error errno value.
+ * @return -1.
+ */
+static int fail(int error)
+{
+    errno = error;
+    return -1;
+}